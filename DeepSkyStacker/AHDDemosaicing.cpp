@@ -6,24 +6,12 @@
 #include "DSSProgress.h"
 
 
-/* ------------------------------------------------------------------- */
-
-static	std::vector<float>		g_vLUT;
-
 /* ------------------------------------------------------------------- */
 
 CRGBToLab::CRGBToLab()
 {
-	if (!g_vLUT.size())
-	{
-		g_vLUT.reserve(0x10000);
-		for (LONG i = 0;i<0x10000;i++)
-		{
-			float		r = float(i) / 65535.0f;
-			float		f = r > 0.008856f ? pow((float)r, (float)1.0/3.0f) : 7.787f*r + 16.0/116.0f;
-			g_vLUT.push_back(f);
-		};
-	};
+	// The cube root table is shared with the Lab kernels of the AHD tiles
+	pLUT = SimdKernels::labCubeRootTable();
 };
 
 /* ------------------------------------------------------------------- */
@@ -36,9 +24,9 @@ void CRGBToLab::RGBToLab(double fRed, double fGreen, double fBlue, double & L, d
 	Y = 0.212671*fRed + 0.715160*fGreen + 0.072169*fBlue;
 	Z = 0.017758*fRed + 0.109477*fGreen + 0.872766*fBlue;
 
-	X = g_vLUT[(int)floor(X*65535.0)];
-	Y = g_vLUT[(int)floor(Y*65535.0)];
-	Z = g_vLUT[(int)floor(Z*65535.0)];
+	X = pLUT[(int)floor(X*65535.0)];
+	Y = pLUT[(int)floor(Y*65535.0)];
+	Z = pLUT[(int)floor(Z*65535.0)];
 
 	L = 116.0*Y - 16.0;
 	a = 500.0*(X - Y);
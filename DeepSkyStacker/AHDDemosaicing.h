@@ -1,10 +1,17 @@
 #ifndef __AHDDEMOSAICING_H__
 #define __AHDDEMOSAICING_H__
 
+#include <vector>
+#include <algorithm>
+#include "avx_simd.h"
+
 /* ------------------------------------------------------------------- */
 
 class CRGBToLab
 {
+private :
+	const float *		pLUT;
+
 public :
 	CRGBToLab();
 
@@ -13,64 +20,133 @@ public :
 
 /* ------------------------------------------------------------------- */
 
-static const LONG							AHDWS = 256;
-
-template <typename TType>
-class CAHDTaskVariables
+// The image is demosaiced by tiles of AHDTILESIZE x AHDTILESIZE pixels.
+// Each tile is read with a margin so that the tiles are independent and
+// can be processed in parallel without any seam:
+//  - the green is interpolated on the tile + AHDBORDER pixels
+//  - the red and blue on the tile + 2 pixels (they use the green around)
+//  - the CIELab images on the tile + 2 pixels
+//  - the homogeneity maps on the tile + 1 pixel (they use the Lab around)
+//  - the output on the tile (the homogeneity is summed on 3x3 pixels)
+// The pixels on the borders of the image are interpolated at the end of the
+// tile containing them.
+static const LONG							AHDTILESIZE = 256;
+static const LONG							AHDBORDER = 3;
+static const LONG							AHDMARGIN = AHDBORDER + 2;	// The green uses the gray values at +-2
+
+class CAHDTileBuffers
 {
 public :
-	CSmartPtr<CColorBitmapT<TType> >		pWindowV;
-	CSmartPtr<CColorBitmapT<TType> >		pWindowH;
-	CSmartPtr<C96BitFloatColorBitmap>		pLabWindowV;
-	CSmartPtr<C96BitFloatColorBitmap>		pLabWindowH;
-	CSmartPtr<C8BitGrayBitmap>				pHomoH;
-	CSmartPtr<C8BitGrayBitmap>				pHomoV;
+	LONG						lStride;
+	LONG						lOriginX,
+								lOriginY;
+	std::vector<float>			vPlanes;
+	std::vector<BYTE>			vHomo;
+
+	// All the values are normalised (0..1), 0 outside the image
+	float *						pGray;
+	float *						pRGBH[3];
+	float *						pRGBV[3];
+	float *						pLabH[3];
+	float *						pLabV[3];
+	BYTE *						pHomoH;
+	BYTE *						pHomoV;
 
 public :
-	CAHDTaskVariables() {};
-	virtual ~CAHDTaskVariables() {};
+	CAHDTileBuffers()
+	{
+		lStride		= 0;
+		lOriginX	= 0;
+		lOriginY	= 0;
+	};
+
+	void	Init(LONG lSize)
+	{
+		const size_t			lPlaneSize = static_cast<size_t>(lSize) * lSize;
+		float *					pPlane;
 
-	bool		Init()
+		lStride = lSize;
+		vPlanes.resize(13 * lPlaneSize);
+		vHomo.resize(2 * lPlaneSize);
+
+		pPlane = vPlanes.data();
+		pGray = pPlane;
+		for (LONG i = 0;i<3;i++)
+		{
+			pRGBH[i] = (pPlane += lPlaneSize);
+			pRGBV[i] = (pPlane += lPlaneSize);
+			pLabH[i] = (pPlane += lPlaneSize);
+			pLabV[i] = (pPlane += lPlaneSize);
+		};
+		pHomoH = vHomo.data();
+		pHomoV = vHomo.data() + lPlaneSize;
+	};
+
+	size_t	Offset(LONG x, LONG y) const
 	{
-		bool				bResult;
-
-		pWindowV.Attach(new C48BitColorBitmap);
-		pWindowH.Attach(new C48BitColorBitmap);
-		pLabWindowV.Attach(new C96BitFloatColorBitmap);
-		pLabWindowH.Attach(new C96BitFloatColorBitmap);
-		pHomoH.Attach(new C8BitGrayBitmap);
-		pHomoV.Attach(new C8BitGrayBitmap);
-
-		bResult = pWindowV->Init(AHDWS, AHDWS);
-		bResult = bResult && pWindowH->Init(AHDWS, AHDWS);
-		bResult = bResult && pLabWindowV->Init(AHDWS, AHDWS);
-		bResult = bResult && pLabWindowH->Init(AHDWS, AHDWS);
-		bResult = bResult && pHomoH->Init(AHDWS, AHDWS);
-		bResult = bResult && pHomoV->Init(AHDWS, AHDWS);
-
-		return bResult;
+		return static_cast<size_t>(y - lOriginY) * lStride + (x - lOriginX);
 	};
 };
 
+/* ------------------------------------------------------------------- */
+
+inline float AHDInterpolateGreen(float g1, float g3, float v0, float v1, float v3)
+{
+	// g1 and g3 are the green neighbours, v1 and v3 the gray values 2 pixels away
+	if (g1 == g3)
+		return g1;
+
+	const float				fLow = min(g1, g3),
+							fHigh = max(g1, g3);
+	float					fGreen = (g1+v0+g3)/2.0f - (v1+v3)/4.0f;
+
+	if (fGreen < fLow || fGreen > fHigh)
+		fGreen = (fabs(v0-v1) < fabs(v0-v3)) ? g1 + (v0-v1)/2.0f : g3 + (v0-v3)/2.0f;
+
+	return std::clamp(fGreen, fLow, fHigh);
+};
+
+/* ------------------------------------------------------------------- */
+
 template <typename TType>
 class CAHDTask : public CMultitask
 {
 public :
 	CDSSProgress *							pProgress;
-	CRGBToLab								RGBToLab;
 	CSmartPtr<CGrayBitmapT<TType> >			pGrayBitmap;
 	CSmartPtr<CColorBitmapT<TType> >		pColorBitmap;
 	CSmartPtr<CMemoryBitmap>				pOutputBitmap;
 	LONG									lWidth;
 	LONG									lHeight;
+	LONG									lNrTilesX;
+	LONG									lNrTilesY;
 
 	double									fMultiplier;
 
+private :
+	static LONG	NrTiles(LONG lSize)
+	{
+		LONG			lNrTiles = (lSize + AHDTILESIZE - 1)/AHDTILESIZE;
+
+		// A last tile narrower than 2 pixels is merged with the previous one
+		// so that the border pixels always have their inner neighbour in the tile
+		if (lNrTiles > 1 && lSize - (lNrTiles - 1) * AHDTILESIZE < 2)
+			lNrTiles--;
+
+		return lNrTiles;
+	};
+
+	void	ProcessTile(LONG x0, LONG y0, LONG x1, LONG y1, CAHDTileBuffers & buf);
+	void	InterpolateBorderPixel(LONG x, LONG y, LONG lInward, LONG lAlong, bool bColumn);
+	void	InterpolateCorner(LONG x, LONG y, LONG dx, LONG dy);
+
 public :
 	CAHDTask()
     {
         lWidth = 0;
         lHeight = 0;
+		lNrTilesX = 0;
+		lNrTilesY = 0;
         fMultiplier = 0;
     }
 
@@ -79,10 +155,7 @@ public :
 	bool	Init(CGrayBitmapT<TType> * pGrayBitmap, CDSSProgress * pProgress);
 
 	virtual bool	Process();
-	virtual void	DoSubWindow(LONG x, LONG y, CAHDTaskVariables<TType> & var);
-	virtual bool	DoTask(HANDLE hEvent);
-
-	virtual void	InterpolateBorders();
+	virtual bool	DoTask();
 };
 
 /* ------------------------------------------------------------------- */
@@ -96,6 +169,8 @@ inline bool	CAHDTask<TType>::Init(CGrayBitmapT<TType> * pGrayBmp, CDSSProgress *
 	pGrayBitmap		= pGrayBmp;
 	lWidth = pGrayBitmap->Width();
 	lHeight = pGrayBitmap->Height();
+	lNrTilesX = NrTiles(lWidth);
+	lNrTilesY = NrTiles(lHeight);
 
 	fMultiplier = pGrayBitmap->GetMultiplier()*256.0;
 
@@ -111,50 +186,15 @@ template <typename TType>
 inline bool	CAHDTask<TType>::Process()
 {
 	bool			bResult = true;
-	LONG			lNrWindows;
-	LONG			lNrWindowsWidth,
-					lNrWindowsHeight;
-	LONG			x, y;
-
-	lNrWindowsWidth = lWidth/(AHDWS-4);
-	if (lWidth % (AHDWS-4))
-		lNrWindowsWidth++;
-
-	lNrWindowsHeight = lHeight/(AHDWS-4);
-	if (lHeight % (AHDWS-4))
-		lNrWindowsHeight++;
-
-	lNrWindows = lNrWindowsWidth * lNrWindowsHeight;
+	LONG			lNrTiles = lNrTilesX * lNrTilesY;
 
 	if (pProgress)
-	{
-		pProgress->Start2(nullptr, lNrWindows);
-		pProgress->SetNrUsedProcessors(GetNrThreads());
-	};
+		pProgress->Start2(nullptr, lNrTiles);
 
-	lNrWindows = 0;
+	bResult = ProcessChunks(0, lNrTiles, 1, pProgress);
 
-	for (y = 0;y<lHeight;y+=AHDWS-4)
-	{
-		for (x= 0;x<lWidth;x+=AHDWS-4)
-		{
-			DWORD			dwThreadId;
-
-			dwThreadId = GetAvailableThreadId();
-			PostThreadMessage(dwThreadId, WM_MT_PROCESS, x, y);
-
-			lNrWindows++;
-			if (pProgress)
-				pProgress->Progress2(nullptr, lNrWindows);
-		};
-	};
-
-	CloseAllThreads();
 	if (pProgress)
-	{
-		pProgress->SetNrUsedProcessors();
 		pProgress->End2();
-	};
 
 	return bResult;
 };
@@ -162,807 +202,346 @@ inline bool	CAHDTask<TType>::Process()
 /* ------------------------------------------------------------------- */
 
 template <typename TType>
-inline void	CAHDTask<TType>::DoSubWindow(LONG x, LONG y, CAHDTaskVariables<TType> & var)
+inline void	CAHDTask<TType>::ProcessTile(LONG x0, LONG y0, LONG x1, LONG y1, CAHDTileBuffers & buf)
 {
-	// Iterate through the window
-	LONG						wx, wy;
-	TType *						pBaseGrayPixel;
-	TType *						pVBaseGreenPixel;
-	TType *						pHBaseGreenPixel;
-	TType *						pVBaseRedPixel;
-	TType *						pHBaseRedPixel;
-	TType *						pVBaseBluePixel;
-	TType *						pHBaseBluePixel;
-	float *						pVBaseLPixel;
-	float *						pVBaseaPixel;
-	float *						pVBasebPixel;
-	float *						pHBaseLPixel;
-	float *						pHBaseaPixel;
-	float *						pHBasebPixel;
-	BYTE *						pHBaseHomoPixel;
-	BYTE *						pVBaseHomoPixel;
-
-	TType *						pBaseOutputRedPixel;
-	TType *						pBaseOutputGreenPixel;
-	TType *						pBaseOutputBluePixel;
-
-	pBaseGrayPixel			= pGrayBitmap->GetGrayPixel(x, y);
-	pBaseOutputRedPixel		= pColorBitmap->GetRedPixel(x, y);
-	pBaseOutputGreenPixel	= pColorBitmap->GetGreenPixel(x, y);
-	pBaseOutputBluePixel	= pColorBitmap->GetBluePixel(x, y);
-
-	pVBaseGreenPixel		= var.pWindowV->GetGreenPixel(0, 0);
-	pHBaseGreenPixel		= var.pWindowH->GetGreenPixel(0, 0);
-	pVBaseRedPixel			= var.pWindowV->GetRedPixel(0, 0);
-	pHBaseRedPixel			= var.pWindowH->GetRedPixel(0, 0);
-	pVBaseBluePixel			= var.pWindowV->GetBluePixel(0, 0);
-	pHBaseBluePixel			= var.pWindowH->GetBluePixel(0, 0);
-
-	pVBaseLPixel			= var.pLabWindowV->GetRedPixel(0, 0);
-	pVBaseaPixel			= var.pLabWindowV->GetGreenPixel(0, 0);
-	pVBasebPixel			= var.pLabWindowV->GetBluePixel(0, 0);
-	pHBaseLPixel			= var.pLabWindowH->GetRedPixel(0, 0);
-	pHBaseaPixel			= var.pLabWindowH->GetGreenPixel(0, 0);
-	pHBasebPixel			= var.pLabWindowH->GetBluePixel(0, 0);
-
-	pHBaseHomoPixel			= var.pHomoH->GetGrayPixel(0, 0);
-	pVBaseHomoPixel			= var.pHomoV->GetGrayPixel(0, 0);
+	const SimdKernels &			Kernels = SimdKernels::get();
+	const float					fScale = static_cast<float>(1.0/fMultiplier);
+	const LONG					lStride = buf.lStride;
+	const CFATYPE				CFAType = pGrayBitmap->GetCFAType();
+	const LONG					lYOffset = pGrayBitmap->yOffset();
+
+	// Same upper limit as ClampPixel for the 16 bit images
+	const auto					Clamp = [](float fValue) -> float
+	{
+		return std::clamp(fValue, 0.0f, 255.0f/256.0f);
+	};
 
-	// Interpolate green horizontally and vertically
-	for (wy = y;wy<lHeight && wy<y+AHDWS;wy++)
+	buf.lOriginX = x0 - AHDMARGIN;
+	buf.lOriginY = y0 - AHDMARGIN;
+
+	// Normalised gray values
+	for (LONG y = y0-AHDMARGIN;y<y1+AHDMARGIN;y++)
 	{
-		TType *					pGrayPixel;
-		TType *					pHGreenPixel;
-		TType *					pVGreenPixel;
+		float *					pGray = buf.pGray + buf.Offset(x0-AHDMARGIN, y);
+
+		if (y < 0 || y >= lHeight)
+			std::fill(pGray, pGray + (x1-x0+2*AHDMARGIN), 0.0f);
+		else
+		{
+			const TType *		pGrayPixel = pGrayBitmap->GetGrayPixel(0, y);
 
-		pGrayPixel = pBaseGrayPixel + (wy-y)*lWidth;
-		pHGreenPixel = pHBaseGreenPixel + (wy-y)*AHDWS;
-		pVGreenPixel = pVBaseGreenPixel + (wy-y)*AHDWS;
+			for (LONG x = x0-AHDMARGIN;x<x1+AHDMARGIN;x++, pGray++)
+				*pGray = (x >= 0 && x < lWidth) ? pGrayPixel[x] * fScale : 0.0f;
+		};
+	};
 
-		for (wx = x;wx<lWidth && wx <x+AHDWS;wx++)
+	// Interpolate green horizontally and vertically
+	for (LONG y = y0-AHDBORDER;y<y1+AHDBORDER;y++)
+	{
+		const size_t			lOffset = buf.Offset(x0-AHDBORDER, y);
+		const float *			pGray = buf.pGray + lOffset;
+		float *					pHGreen = buf.pRGBH[1] + lOffset;
+		float *					pVGreen = buf.pRGBV[1] + lOffset;
+		const bool				bInsideLine = (y >= 0 && y < lHeight);
+		const BAYERCOLOR		BayerColors[2] = { pGrayBitmap->GetBayerColor(0, y), pGrayBitmap->GetBayerColor(1, y) };
+
+		for (LONG x = x0-AHDBORDER;x<x1+AHDBORDER;x++, pGray++, pHGreen++, pVGreen++)
 		{
-			BAYERCOLOR			BayerColor;
-            double				fVGreen = 0;
-            double              fHGreen = 0;
+			float				fHGreen = 0,
+								fVGreen = 0;
 
-			BayerColor = pGrayBitmap->GetBayerColor(wx, wy);
-			switch (BayerColor)
+			if (bInsideLine && x >= 0 && x < lWidth)
 			{
-			case BAYER_BLUE :
-			case BAYER_RED :
+				switch (BayerColors[x & 1])
 				{
-					// Blue and Red line and column
-					// Horizontal green interpolation
-					double		g1, g3;
-
-					g1 = (wx > 0) ? (*(pGrayPixel-1))/fMultiplier : 0;
-					g3 = (wx < lWidth-1) ? (*(pGrayPixel+1))/fMultiplier : 0;
-
-					if (g1 == g3)
-						fHGreen = g1;
-					else
-					{
-						double	v0, v2, v4;
-
-						v0 = (*pGrayPixel)/fMultiplier;
-						v4 = (wx > 1) ? (*(pGrayPixel-2))/fMultiplier : 0;
-						v2 = (wx < lWidth-2) ? (*(pGrayPixel+2))/fMultiplier : 0;
-						fHGreen = (g1+v0+g3)/2.0 - (v4+v2)/4.0;
-						if (g1 > g3)
-						{
-							if (fHGreen > g1 || fHGreen < g3)
-								fHGreen = (fabs(v0-v4) < fabs(v0-v2)) ? g1 + (v0-v4)/2.0 : g3 + (v0-v2)/2.0;
-							if  (fHGreen > g1)
-								fHGreen = g1;
-							else if (fHGreen < g3)
-								fHGreen = g3;
-						}
-						else
-						{
-							if (fHGreen < g1 || fHGreen > g3)
-								fHGreen = (fabs(v0-v4) < fabs(v0-v2)) ? g1 + (v0-v4)/2.0 : g3 + (v0-v2)/2.0;
-//								fHGreen = (fabs(v2-v0) - fabs(v2-v4)) ? g1 + (v0-v4)/2.0 : g3 + (v0-v2)/2.0;
-							if (fHGreen < g1)
-								fHGreen = g1;
-							else if (fHGreen > g3)
-								fHGreen = g3;
-						}
-					};
-					// Vertical green interpolation
-					g1 = (wy>0) ? (*(pGrayPixel-lWidth))/fMultiplier : 0;
-					g3 = (wy<lHeight-1) ? (*(pGrayPixel+lWidth))/fMultiplier : 0;
-					if (g1 == g3)
-						fVGreen = g1;
-					else
-					{
-						double	v0, v1, v3;
-
-						v0 = (*pGrayPixel)/fMultiplier;
-						v1 = (wy>1) ? (*(pGrayPixel-2*lWidth))/fMultiplier : 0;
-						v3 = (wy<lHeight-2) ? (*(pGrayPixel+2*lWidth))/fMultiplier : 0;
-						fVGreen = (g1+v0+g3/*+1*/)/2 - (v1+v3)/4;
-						if (g1 > g3)
-						{
-							if (fVGreen > g1 || fVGreen < g3)
-								fVGreen = (fabs(v0-v1) < fabs(v0-v3)) ?	g1 + (v0-v1/*+1*/)/2.0 : g3 + (v0-v3/*+1*/)/2.0;
-							if (fVGreen > g1)
-								fVGreen = g1;
-							else if (fVGreen < g3)
-								fVGreen = g3;
-						}
-						else
-						{
-							if (fVGreen < g1 || fVGreen > g3)
-								fVGreen = (fabs(v0-v1) < fabs(v0-v3)) ?	g1 + (v0-v1/*+1*/)/2.0 : g3 + (v0-v3/*+1*/)/2.0;
-//								fVGreen = (fabs(v0-v1) - fabs(v0-v3)) ?	g1 + (v0-v1/*+1*/)/2.0 : g3 + (v0-v3/*+1*/)/2.0;
-							if (fVGreen < g1)
-								fVGreen = g1;
-							else if (fVGreen > g3)
-								fVGreen = g3;
-						}
-					};
+				case BAYER_BLUE :
+				case BAYER_RED :
+					fHGreen = AHDInterpolateGreen(pGray[-1], pGray[1], pGray[0], pGray[-2], pGray[2]);
+					fVGreen = AHDInterpolateGreen(pGray[-lStride], pGray[lStride], pGray[0], pGray[-2*lStride], pGray[2*lStride]);
+					break;
+				case BAYER_GREEN :
+					fHGreen = fVGreen = pGray[0];
+					break;
 				};
-				break;
-			case BAYER_GREEN :
-				// Pixel value
-				fVGreen = fHGreen = *(pGrayPixel)/fMultiplier;
-				break;
+				fHGreen = Clamp(fHGreen);
+				fVGreen = Clamp(fVGreen);
 			};
 
-			*pHGreenPixel = ClampPixel(fHGreen * fMultiplier);
-			*pVGreenPixel = ClampPixel(fVGreen * fMultiplier);
-
-			pHGreenPixel++;
-			pVGreenPixel++;
-			pGrayPixel++;
+			*pHGreen = fHGreen;
+			*pVGreen = fVGreen;
 		};
 	};
-	// End of green interpolation
-
-	bool						bBlueLine;
-
-	bBlueLine = IsBayerBlueLine(y, pGrayBitmap->GetCFAType(), pGrayBitmap->yOffset());
 
 	// Interpolate red and blue horizontally and vertically
-	for (wy = y;wy<lHeight && wy<y+AHDWS;wy++)
+	const LONG					lRBX0 = max(x0-2, 0L),
+								lRBX1 = min(x1+2, lWidth),
+								lRBY0 = max(y0-2, 0L),
+								lRBY1 = min(y1+2, lHeight);
+
+	for (LONG y = lRBY0;y<lRBY1;y++)
 	{
-		TType *					pGrayPixel;
-		TType *					pHGreenPixel;
-		TType *					pVGreenPixel;
-		TType *					pHRedPixel;
-		TType *					pVRedPixel;
-		TType *					pHBluePixel;
-		TType *					pVBluePixel;
-
-		pGrayPixel		= pBaseGrayPixel + (wy-y)*lWidth;
-		pHGreenPixel	= pHBaseGreenPixel + (wy-y)*AHDWS;
-		pVGreenPixel	= pVBaseGreenPixel + (wy-y)*AHDWS;
-		pHRedPixel		= pHBaseRedPixel + (wy-y)*AHDWS;
-		pVRedPixel		= pVBaseRedPixel + (wy-y)*AHDWS;
-		pHBluePixel		= pHBaseBluePixel + (wy-y)*AHDWS;
-		pVBluePixel		= pVBaseBluePixel + (wy-y)*AHDWS;
-
-		for (wx = x;wx<lWidth && wx <x+AHDWS;wx++)
+		const size_t			lOffset = buf.Offset(lRBX0, y);
+		const float *			pGray = buf.pGray + lOffset;
+		const float *			pHGreen = buf.pRGBH[1] + lOffset;
+		const float *			pVGreen = buf.pRGBV[1] + lOffset;
+		const bool				bBlueLine = IsBayerBlueLine(y, CFAType, lYOffset);
+		const BAYERCOLOR		BayerColors[2] = { pGrayBitmap->GetBayerColor(0, y), pGrayBitmap->GetBayerColor(1, y) };
+		// Colour of the horizontal neighbours of the green pixels (vertical ones for the red and blue pixels)
+		float *					pHHColour = (bBlueLine ? buf.pRGBH[2] : buf.pRGBH[0]) + lOffset;
+		float *					pVHColour = (bBlueLine ? buf.pRGBV[2] : buf.pRGBV[0]) + lOffset;
+		float *					pHVColour = (bBlueLine ? buf.pRGBH[0] : buf.pRGBH[2]) + lOffset;
+		float *					pVVColour = (bBlueLine ? buf.pRGBV[0] : buf.pRGBV[2]) + lOffset;
+
+		for (LONG x = lRBX0;x<lRBX1;x++, pGray++, pHGreen++, pVGreen++, pHHColour++, pVHColour++, pHVColour++, pVVColour++)
 		{
-			BAYERCOLOR			BayerColor;
-
-			BayerColor = pGrayBitmap->GetBayerColor(wx, wy);
-			switch (BayerColor)
+			switch (BayerColors[x & 1])
 			{
 			case BAYER_BLUE :
 			case BAYER_RED :
 				{
-					//  B G B G B   R G R G R
-					//  G R G R G   G B G B G
-					//  B G[B]G B   R G[R]G R
-					//  G R G R G   G B G B G
-					//  B G B G B   R G R G R
-
 					//  v0  G  v1
 					//  G  [v] G
 					//  v2  G  v3
-					if (bBlueLine)
-						*pVBluePixel = *pHBluePixel = *pGrayPixel;
-					else
-						*pVRedPixel = *pHRedPixel = *pGrayPixel;
-
-					double			v0, v1, v2, v3;
-
-					v0 = (wx>0) && (wy>0) ? (*(pGrayPixel-1-lWidth))/fMultiplier : 0;
-					v1 = (wx<lWidth-1) && (wy>0) ? (*(pGrayPixel+1-lWidth))/fMultiplier : 0;
-					v2 = (wx>0) && (wy<lHeight-1) ? (*(pGrayPixel-1+lWidth))/fMultiplier : 0;
-					v3 = (wx<lWidth-1) && (wy<lHeight-1) ? (*(pGrayPixel+1+lWidth))/fMultiplier : 0;
-
-					// Horizontal interpolation
-					double			valH;
-					double			g, g0, g1, g2, g3;
+					const float		fDiagonals = pGray[-1-lStride] + pGray[1-lStride] + pGray[-1+lStride] + pGray[1+lStride];
 
-					g  = (*pHGreenPixel)/fMultiplier;
-					g0 = (wx-x>0) && (wy-y>0) ? (*(pHGreenPixel-1-AHDWS))/fMultiplier : 0;
-					g1 = (wx-x<AHDWS-1) && (wy-y>0) ? (*(pHGreenPixel+1-AHDWS))/fMultiplier : 0;
-					g2 = (wx-x>0) && (wy-y<AHDWS-1) ? (*(pHGreenPixel-1+AHDWS))/fMultiplier : 0;
-					g3 = (wx-x<AHDWS-1) && (wy-y<AHDWS-1) ? (*(pHGreenPixel+1+AHDWS))/fMultiplier : 0;
-
-					valH = g + (v0+v1+v2+v3-g0-g1-g2-g3)/4.0;
-
-					if (bBlueLine)
-						*pHRedPixel = ClampPixel(valH*fMultiplier);
-					else
-						*pHBluePixel = ClampPixel(valH*fMultiplier);
-
-					// Vertical interpolation
-					double			valV;
-
-					g  = (*pVGreenPixel)/fMultiplier;
-					g0 = (wx-x>0) && (wy-y>0) ? (*(pVGreenPixel-1-AHDWS))/fMultiplier : 0;
-					g1 = (wx-x<AHDWS-1) && (wy-y>0) ? (*(pVGreenPixel+1-AHDWS))/fMultiplier : 0;
-					g2 = (wx-x>0) && (wy-y<AHDWS-1) ? (*(pVGreenPixel-1+AHDWS))/fMultiplier : 0;
-					g3 = (wx-x<AHDWS-1) && (wy-y<AHDWS-1) ? (*(pVGreenPixel+1+AHDWS))/fMultiplier : 0;
-
-					valV = g + (v0+v1+v2+v3-g0-g1-g2-g3)/4.0;
-
-					if (bBlueLine)
-						*pVRedPixel = ClampPixel(valV*fMultiplier);
-					else
-						*pVBluePixel = ClampPixel(valV*fMultiplier);
+					*pHHColour = *pVHColour = pGray[0];
+					*pHVColour = Clamp(pHGreen[0] + (fDiagonals - pHGreen[-1-lStride] - pHGreen[1-lStride] - pHGreen[-1+lStride] - pHGreen[1+lStride])/4.0f);
+					*pVVColour = Clamp(pVGreen[0] + (fDiagonals - pVGreen[-1-lStride] - pVGreen[1-lStride] - pVGreen[-1+lStride] - pVGreen[1+lStride])/4.0f);
 				};
 				break;
 			case BAYER_GREEN :
 				{
-					//  G B G B G    G R G R G
-					//  R G R G R    B G B G B
-					//  G B[G]B G    G R[G]R G
-					//  R G R G R    B G B G B
-					//  G B G B G    G R G R G
-					double		g, v1, v2, valV, valH;
-
-					// interpolating horizontally and vertically
-					//  v1 [v] v2
-
-					g = (*pGrayPixel)/fMultiplier;
-					v1 = (wx>0) ? (*(pGrayPixel-1))/fMultiplier : 0;
-					v2 = (wx<lWidth-1) ? (*(pGrayPixel+1))/fMultiplier : 0;
+					const float		g = pGray[0];
+					float			v1, v2, valV, valH;
 
+					// interpolating horizontally
+					//  v1 [v] v2
+					v1 = pGray[-1];
+					v2 = pGray[1];
 					if (v1 == v2)
 						valH = valV = v1;
 					else
 					{
-						double			g1, g2;
-
-						g1 = (wx-x>0) ? (*(pVGreenPixel-1))/fMultiplier : 0;
-						g2 = (wx-x<AHDWS-1) ? (*(pVGreenPixel+1))/fMultiplier : 0;
-
-						valV = g + (v1+v2-g1-g2)/2.0;
-						//valV = Median(v1, v2, valV);
-
-						g1 = (wx-x>0) ? (*(pHGreenPixel-1))/fMultiplier : 0;
-						g2 = (wx-x<AHDWS-1) ? (*(pHGreenPixel+1))/fMultiplier : 0;
-
-						valH = (v1+v2)/2.0 + (2.0*g - g1 - g2)/4.0;
-						valH = Median(v1, v2, valH);
-					};
-
-					if (bBlueLine)
-					{
-						*pVBluePixel = ClampPixel(valV*fMultiplier);
-						*pHBluePixel = ClampPixel(valH*fMultiplier);
-					}
-					else
-					{
-						*pVRedPixel = ClampPixel(valV*fMultiplier);
-						*pHRedPixel = ClampPixel(valH*fMultiplier);
+						valV = g + (v1 + v2 - pVGreen[-1] - pVGreen[1])/2.0f;
+						valH = (v1 + v2)/2.0f + (2.0f*g - pHGreen[-1] - pHGreen[1])/4.0f;
+						valH = static_cast<float>(Median(v1, v2, valH));
 					};
+					*pVHColour = Clamp(valV);
+					*pHHColour = Clamp(valH);
 
 					// interpolating vertically
 					//   v1
 					//  [v]
 					//   v2
-					v1 = (wy>0) ? (*(pGrayPixel-lWidth))/fMultiplier : 0;
-					v2 = (wy<lHeight-1) ? (*(pGrayPixel+lWidth))/fMultiplier : 0;
-
+					v1 = pGray[-lStride];
+					v2 = pGray[lStride];
 					if (v1 == v2)
 						valH = valV = v1;
 					else
 					{
-						double		g1, g2;
-
-						g1 = (wy-y>0) ? (*(pHGreenPixel-AHDWS))/fMultiplier : 0;
-						g2 = (wy-y<AHDWS-1) ? (*(pHGreenPixel+AHDWS))/fMultiplier : 0;
-
-						valH = g + (v1 + v2 - g1 - g2)/2.0;
-						//valH = Median(v1, v2, valH);
-
-						g1 = (wy-y>0) ? (*(pVGreenPixel-AHDWS))/fMultiplier : 0;
-						g2 = (wy-y<AHDWS-1) ? (*(pVGreenPixel+AHDWS))/fMultiplier : 0;
-
-						valV = (v1+v2)/2.0 + (2*g - g1 - g2)/4.0;
-						valV = Median(v1, v2, valV);
-					};
-
-					if (bBlueLine)
-					{
-						*pVRedPixel = ClampPixel(valV*fMultiplier);
-						*pHRedPixel = ClampPixel(valH*fMultiplier);
-					}
-					else
-					{
-						*pVBluePixel = ClampPixel(valV*fMultiplier);
-						*pHBluePixel = ClampPixel(valH*fMultiplier);
+						valH = g + (v1 + v2 - pHGreen[-lStride] - pHGreen[lStride])/2.0f;
+						valV = (v1 + v2)/2.0f + (2.0f*g - pVGreen[-lStride] - pVGreen[lStride])/4.0f;
+						valV = static_cast<float>(Median(v1, v2, valV));
 					};
+					*pVVColour = Clamp(valV);
+					*pHVColour = Clamp(valH);
 				};
 				break;
 			};
-
-			pHRedPixel++;		pHGreenPixel++;			pHBluePixel++;
-			pVRedPixel++;		pVGreenPixel++;			pVBluePixel++;
-			pGrayPixel++;
 		};
-		bBlueLine = !bBlueLine;
 	};
 
 	// Transform to Lab
-	for (wy = y;wy<lHeight && wy<y+AHDWS;wy++)
+	for (LONG y = lRBY0;y<lRBY1;y++)
 	{
-		TType *					pHGreenPixel;
-		TType *					pVGreenPixel;
-		TType *					pHRedPixel;
-		TType *					pVRedPixel;
-		TType *					pHBluePixel;
-		TType *					pVBluePixel;
-		float *					pHLPixel;
-		float *					pHaPixel;
-		float *					pHbPixel;
-		float *					pVLPixel;
-		float *					pVaPixel;
-		float *					pVbPixel;
-
-		pHGreenPixel	= pHBaseGreenPixel + (wy-y)*AHDWS;
-		pVGreenPixel	= pVBaseGreenPixel + (wy-y)*AHDWS;
-		pHRedPixel		= pHBaseRedPixel + (wy-y)*AHDWS;
-		pVRedPixel		= pVBaseRedPixel + (wy-y)*AHDWS;
-		pHBluePixel		= pHBaseBluePixel + (wy-y)*AHDWS;
-		pVBluePixel		= pVBaseBluePixel + (wy-y)*AHDWS;
-
-		pHLPixel		= pHBaseLPixel + (wy-y)*AHDWS;
-		pHaPixel		= pHBaseaPixel + (wy-y)*AHDWS;
-		pHbPixel		= pHBasebPixel + (wy-y)*AHDWS;
-		pVLPixel		= pVBaseLPixel + (wy-y)*AHDWS;
-		pVaPixel		= pVBaseaPixel + (wy-y)*AHDWS;
-		pVbPixel		= pVBasebPixel + (wy-y)*AHDWS;
-
-		for (wx = x;wx<lWidth && wx <x+AHDWS;wx++)
-		{
-			double				fRed, fGreen, fBlue;
-			double				L, a, b;
-
-			fRed	= (*pHRedPixel)/fMultiplier;
-			fGreen	= (*pHGreenPixel)/fMultiplier;
-			fBlue	= (*pHBluePixel)/fMultiplier;
-			RGBToLab.RGBToLab(fRed, fGreen, fBlue, L, a, b);
-			*pHLPixel = L;
-			*pHaPixel = a;
-			*pHbPixel = b;
-
-			fRed	= (*pVRedPixel)/fMultiplier;
-			fGreen	= (*pVGreenPixel)/fMultiplier;
-			fBlue	= (*pVBluePixel)/fMultiplier;
-			RGBToLab.RGBToLab(fRed, fGreen, fBlue, L, a, b);
-			*pVLPixel = L;
-			*pVaPixel = a;
-			*pVbPixel = b;
-
-			pHRedPixel++;	pHGreenPixel++;	pHBluePixel++;;
-			pVRedPixel++;	pVGreenPixel++;	pVBluePixel++;;
-
-			pHLPixel++;		pHaPixel++;		pHbPixel++;
-			pVLPixel++;		pVaPixel++;		pVbPixel++;
-		};
+		const size_t			lOffset = buf.Offset(lRBX0, y);
+		const size_t			lCount = lRBX1 - lRBX0;
+
+		Kernels.rgbToLab(buf.pRGBH[0] + lOffset, buf.pRGBH[1] + lOffset, buf.pRGBH[2] + lOffset, buf.pLabH[0] + lOffset, buf.pLabH[1] + lOffset, buf.pLabH[2] + lOffset, lCount);
+		Kernels.rgbToLab(buf.pRGBV[0] + lOffset, buf.pRGBV[1] + lOffset, buf.pRGBV[2] + lOffset, buf.pLabV[0] + lOffset, buf.pLabV[1] + lOffset, buf.pLabV[2] + lOffset, lCount);
 	};
 
-	// Build homogeneity maps from the CIELab images
-	double								lDiffH[4],
-										lDiffV[4],
-										abDiffH[4],
-										abDiffV[4],
-										lEpsilon,
-										abEpsilon;
-	const int							dir[4] = {-1, 1, -AHDWS, AHDWS};
+	// Build homogeneity maps from the CIELab images (0 on the borders of the image)
+	const LONG					lHomoX0 = max(x0-1, 1L),
+								lHomoX1 = min(x1+1, lWidth-1);
 
-	for (wy = y+1;wy<lHeight && wy<y+AHDWS-1;wy++)
+	for (LONG y = y0-1;y<y1+1;y++)
 	{
-		float *					pHLPixel;
-		float *					pHaPixel;
-		float *					pHbPixel;
-		float *					pVLPixel;
-		float *					pVaPixel;
-		float *					pVbPixel;
-		BYTE *					pHHomoPixel;
-		BYTE *					pVHomoPixel;
-
-		pHLPixel		= pHBaseLPixel + (wy-y)*AHDWS;
-		pHaPixel		= pHBaseaPixel + (wy-y)*AHDWS;
-		pHbPixel		= pHBasebPixel + (wy-y)*AHDWS;
-		pVLPixel		= pVBaseLPixel + (wy-y)*AHDWS;
-		pVaPixel		= pVBaseaPixel + (wy-y)*AHDWS;
-		pVbPixel		= pVBasebPixel + (wy-y)*AHDWS;
-		pHHomoPixel		= pHBaseHomoPixel + (wy-y)*AHDWS;
-		pVHomoPixel		= pVBaseHomoPixel + (wy-y)*AHDWS;
-
-		for (wx = x;wx<lWidth && wx <x+AHDWS;wx++)
-		{
-			LONG				i;
-
-			*pHHomoPixel = *pVHomoPixel = 0;
-
-			// For each pixel in the V and H approximations
-			// iterate over its neighbors
-			for(i=0; i<4; i++)
-			{
-				lDiffH[i] = fabs((*pHLPixel) - (*(pHLPixel+dir[i])));
-				lDiffV[i] = fabs((*pVLPixel) - (*(pVLPixel+dir[i])));
-			}
-
-			lEpsilon = min(max(lDiffH[0], lDiffH[1]), max(lDiffV[2], lDiffV[3]));
-
-			for(i=0; i<4; i++)
-			{
-				double	aDiff, bDiff;
-
-				if (lDiffH[i] <= lEpsilon || i < 2)
-				{
-					aDiff = ((*pHaPixel)-(*(pHaPixel+dir[i])));
-					bDiff = ((*pHbPixel)-(*(pHbPixel+dir[i])));
-
-					abDiffH[i] = aDiff*aDiff + bDiff*bDiff;
-				}
-				else
-					abDiffH[i] = 0;
+		const size_t			lOffset = buf.Offset(x0-1, y);
 
-				if (lDiffV[i] <= lEpsilon || i >= 2)
-				{
-					aDiff = ((*pVaPixel)-(*(pVaPixel+dir[i])));
-					bDiff = ((*pVbPixel)-(*(pVbPixel+dir[i])));
-					abDiffV[i] = aDiff*aDiff + bDiff*bDiff;
-				}
-				else
-					abDiffV[i] = 0;
-			}
-
-			abEpsilon = min(max(abDiffH[0], abDiffH[1]), max(abDiffV[2], abDiffV[3]));
-
-			// iterate over neighbors
-			for(i=0; i<4; ++i)
-			{
-				if ((lDiffH[i] <= lEpsilon) && (abDiffH[i] <= abEpsilon))
-					(*pHHomoPixel)++;
-				if ((lDiffV[i] <= lEpsilon) && (abDiffV[i] <= abEpsilon))
-					(*pVHomoPixel)++;;
-			}
+		memset(buf.pHomoH + lOffset, 0, x1-x0+2);
+		memset(buf.pHomoV + lOffset, 0, x1-x0+2);
+		if (y >= 1 && y < lHeight-1 && lHomoX1 > lHomoX0)
+		{
+			const size_t		lHomoOffset = buf.Offset(lHomoX0, y);
+			const float * const	pLabH[3] = { buf.pLabH[0] + lHomoOffset, buf.pLabH[1] + lHomoOffset, buf.pLabH[2] + lHomoOffset };
+			const float * const	pLabV[3] = { buf.pLabV[0] + lHomoOffset, buf.pLabV[1] + lHomoOffset, buf.pLabV[2] + lHomoOffset };
 
-			pHHomoPixel++;		pVHomoPixel++;
-			pHLPixel++;			pHaPixel++;		pHbPixel++;
-			pVLPixel++;			pVaPixel++;		pVbPixel++;
+			Kernels.ahdHomogeneity(pLabH, pLabV, lStride, buf.pHomoH + lHomoOffset, buf.pHomoV + lHomoOffset, lHomoX1 - lHomoX0);
 		};
 	};
 
 	// Combine the most homogenous pixels for the final result
-	for (wy = y+1;wy<lHeight-1 && wy<y+AHDWS-1;wy++)
+	const LONG					lOutX0 = max(x0, 1L),
+								lOutX1 = min(x1, lWidth-1),
+								lOutY0 = max(y0, 1L),
+								lOutY1 = min(y1, lHeight-1);
+
+	for (LONG y = lOutY0;y<lOutY1;y++)
 	{
-		TType *					pHGreenPixel;
-		TType *					pVGreenPixel;
-		TType *					pHRedPixel;
-		TType *					pVRedPixel;
-		TType *					pHBluePixel;
-		TType *					pVBluePixel;
-		BYTE *					pHHomoPixel;
-		BYTE *					pVHomoPixel;
-		TType *					pOutputRedPixel;
-		TType *					pOutputGreenPixel;
-		TType *					pOutputBluePixel;
-
-		pOutputRedPixel		= pBaseOutputRedPixel + (wy-y) * lWidth + 1 ;
-		pOutputGreenPixel	= pBaseOutputGreenPixel + (wy-y) * lWidth + 1;
-		pOutputBluePixel	= pBaseOutputBluePixel + (wy-y) * lWidth + 1;
-
-		pHGreenPixel	= pHBaseGreenPixel + (wy-y)*AHDWS+1;
-		pVGreenPixel	= pVBaseGreenPixel + (wy-y)*AHDWS+1;
-		pHRedPixel		= pHBaseRedPixel + (wy-y)*AHDWS+1;
-		pVRedPixel		= pVBaseRedPixel + (wy-y)*AHDWS+1;
-		pHBluePixel		= pHBaseBluePixel + (wy-y)*AHDWS+1;
-		pVBluePixel		= pVBaseBluePixel + (wy-y)*AHDWS+1;
-		pHHomoPixel		= pHBaseHomoPixel + (wy-y)*AHDWS+1;
-		pVHomoPixel		= pVBaseHomoPixel + (wy-y)*AHDWS+1;
-
-		for (wx = x+1;wx<lWidth-1 && wx <x+AHDWS-1;wx++)
+		const size_t			lOffset = buf.Offset(lOutX0, y);
+		const BYTE *			pHHomo = buf.pHomoH + lOffset;
+		const BYTE *			pVHomo = buf.pHomoV + lOffset;
+		TType *					pOutputRedPixel = pColorBitmap->GetRedPixel(lOutX0, y);
+		TType *					pOutputGreenPixel = pColorBitmap->GetGreenPixel(lOutX0, y);
+		TType *					pOutputBluePixel = pColorBitmap->GetBluePixel(lOutX0, y);
+
+		for (LONG x = lOutX0;x<lOutX1;x++, pHHomo++, pVHomo++)
 		{
-			LONG			hmV,
-							hmH;
-
-			hmV = *(pVHomoPixel) + (*(pVHomoPixel-1)) + (*(pVHomoPixel+1)) +
-				  (*(pVHomoPixel-AHDWS)) + (*(pVHomoPixel-AHDWS-1)) + (*(pVHomoPixel-AHDWS+1)) +
-				  (*(pVHomoPixel+AHDWS)) + (*(pVHomoPixel+AHDWS-1)) + (*(pVHomoPixel+AHDWS+1));
-
-			hmH = *(pHHomoPixel) + (*(pHHomoPixel-1)) + (*(pHHomoPixel+1)) +
-				  (*(pHHomoPixel-AHDWS)) + (*(pHHomoPixel-AHDWS-1)) + (*(pHHomoPixel-AHDWS+1)) +
-				  (*(pHHomoPixel+AHDWS)) + (*(pHHomoPixel+AHDWS-1)) + (*(pHHomoPixel+AHDWS+1));
+			const size_t		lPixel = lOffset + (x - lOutX0);
+			const LONG			hmV = pVHomo[-lStride-1] + pVHomo[-lStride] + pVHomo[-lStride+1] +
+									  pVHomo[-1] + pVHomo[0] + pVHomo[1] +
+									  pVHomo[lStride-1] + pVHomo[lStride] + pVHomo[lStride+1];
+			const LONG			hmH = pHHomo[-lStride-1] + pHHomo[-lStride] + pHHomo[-lStride+1] +
+									  pHHomo[-1] + pHHomo[0] + pHHomo[1] +
+									  pHHomo[lStride-1] + pHHomo[lStride] + pHHomo[lStride+1];
+			float				fRed, fGreen, fBlue;
 
 			if (hmV > hmH)
 			{
-				*pOutputRedPixel	= *pVRedPixel;
-				*pOutputGreenPixel	= *pVGreenPixel;
-				*pOutputBluePixel	= *pVBluePixel;
+				fRed	= buf.pRGBV[0][lPixel];
+				fGreen	= buf.pRGBV[1][lPixel];
+				fBlue	= buf.pRGBV[2][lPixel];
 			}
 			else if (hmV < hmH)
 			{
-				*pOutputRedPixel	= *pHRedPixel;
-				*pOutputGreenPixel	= *pHGreenPixel;
-				*pOutputBluePixel	= *pHBluePixel;
+				fRed	= buf.pRGBH[0][lPixel];
+				fGreen	= buf.pRGBH[1][lPixel];
+				fBlue	= buf.pRGBH[2][lPixel];
 			}
 			else
 			{
-				*pOutputRedPixel	= ((*pVRedPixel)	+ (*pHRedPixel))/2.0;
-				*pOutputGreenPixel	= ((*pVGreenPixel)	+ (*pHGreenPixel))/2.0;
-				*pOutputBluePixel	= ((*pVBluePixel)	+ (*pHBluePixel))/2.0;
-			}
+				fRed	= (buf.pRGBV[0][lPixel] + buf.pRGBH[0][lPixel])/2.0f;
+				fGreen	= (buf.pRGBV[1][lPixel] + buf.pRGBH[1][lPixel])/2.0f;
+				fBlue	= (buf.pRGBV[2][lPixel] + buf.pRGBH[2][lPixel])/2.0f;
+			};
 
-			pHHomoPixel++;		pVHomoPixel++;
-			pHRedPixel++;		pHGreenPixel++;			pHBluePixel++;;
-			pVRedPixel++;		pVGreenPixel++;			pVBluePixel++;;
-			pOutputRedPixel++;	pOutputGreenPixel++;	pOutputBluePixel++;
+			*pOutputRedPixel++		= static_cast<TType>(fRed * fMultiplier);
+			*pOutputGreenPixel++	= static_cast<TType>(fGreen * fMultiplier);
+			*pOutputBluePixel++		= static_cast<TType>(fBlue * fMultiplier);
 		};
 	};
+
+	// Borders of the image, they need the output of their inner neighbour
+	for (LONG y = lOutY0;y<lOutY1;y++)
+	{
+		if (x0 == 0)
+			InterpolateBorderPixel(0, y, 1, lWidth, true);
+		if (x1 == lWidth)
+			InterpolateBorderPixel(lWidth-1, y, -1, lWidth, true);
+	};
+	for (LONG x = lOutX0;x<lOutX1;x++)
+	{
+		if (y0 == 0)
+			InterpolateBorderPixel(x, 0, lWidth, 1, false);
+		if (y1 == lHeight)
+			InterpolateBorderPixel(x, lHeight-1, -lWidth, 1, false);
+	};
+
+	// And the 4 corners, which need the borders
+	if (x0 == 0 && y0 == 0)
+		InterpolateCorner(0, 0, 1, 1);
+	if (x1 == lWidth && y0 == 0)
+		InterpolateCorner(lWidth-1, 0, -1, 1);
+	if (x0 == 0 && y1 == lHeight)
+		InterpolateCorner(0, lHeight-1, 1, -1);
+	if (x1 == lWidth && y1 == lHeight)
+		InterpolateCorner(lWidth-1, lHeight-1, -1, -1);
 };
 
 /* ------------------------------------------------------------------- */
 
 template <typename TType>
-inline bool	CAHDTask<TType>::DoTask(HANDLE hEvent)
+inline void	CAHDTask<TType>::InterpolateBorderPixel(LONG x, LONG y, LONG lInward, LONG lAlong, bool bColumn)
 {
-	LONG						x, y;
-	bool						bEnd = false;
-	MSG							msg;
-	CAHDTaskVariables<TType>	var;
-
-	if (var.Init())
+	// lInward is the offset of the neighbour inside the image, lAlong the
+	// offset of the neighbours along the border
+	const TType *				pGrayPixel = pGrayBitmap->GetGrayPixel(x, y);
+	TType *						pOutputRedPixel = pColorBitmap->GetRedPixel(x, y);
+	TType *						pOutputGreenPixel = pColorBitmap->GetGreenPixel(x, y);
+	TType *						pOutputBluePixel = pColorBitmap->GetBluePixel(x, y);
+	const bool					bBlueLine = IsBayerBlueLine(y, pGrayBitmap->GetCFAType(), pGrayBitmap->yOffset());
+	const TType					Along = static_cast<TType>((static_cast<double>(pGrayPixel[-lAlong]) + pGrayPixel[lAlong])/2.0);
+
+	switch (pGrayBitmap->GetBayerColor(x, y))
 	{
-		// Create a message queue and signal the event
-		PeekMessage(&msg, nullptr, 0, 0, PM_NOREMOVE);
-		SetEvent(hEvent);
-		while (!bEnd && GetMessage(&msg, nullptr, 0, 0))
+	case BAYER_GREEN :
+		*pOutputGreenPixel = *pGrayPixel;
+		// The inner neighbour of a column is on the same line, the one of a line on the other line
+		if (bBlueLine == bColumn)
 		{
-			if (msg.message == WM_MT_PROCESS)
-			{
-				x = msg.wParam;
-				y = msg.lParam;
-				DoSubWindow(x, y, var);
-				SetEvent(hEvent);
-			}
-			else if (msg.message == WM_MT_STOP)
-				bEnd = true;
+			*pOutputBluePixel = pGrayPixel[lInward];
+			*pOutputRedPixel = Along;
+		}
+		else
+		{
+			*pOutputRedPixel = pGrayPixel[lInward];
+			*pOutputBluePixel = Along;
 		};
+		break;
+	case BAYER_RED :
+		*pOutputRedPixel = *pGrayPixel;
+		*pOutputGreenPixel = Along;
+		*pOutputBluePixel = pOutputBluePixel[lInward];
+		break;
+	case BAYER_BLUE :
+		*pOutputBluePixel = *pGrayPixel;
+		*pOutputGreenPixel = Along;
+		*pOutputRedPixel = pOutputRedPixel[lInward];
+		break;
 	};
-
-	return true;
 };
 
 /* ------------------------------------------------------------------- */
 
 template <typename TType>
-inline void	CAHDTask<TType>::InterpolateBorders()
+inline void	CAHDTask<TType>::InterpolateCorner(LONG x, LONG y, LONG dx, LONG dy)
 {
-	LONG							x, y;
-	TType *							pGrayPixel1;
-	TType *							pGrayPixel2;
-	TType *							pOutputRedPixel1;
-	TType *							pOutputRedPixel2;
-	TType *							pOutputGreenPixel1;
-	TType *							pOutputGreenPixel2;
-	TType *							pOutputBluePixel1;
-	TType *							pOutputBluePixel2;
-	LONG							x1 = 0,
-									x2 = lWidth-1;
-	bool							bBlueLine;
-
-	pGrayPixel1			= pGrayBitmap->GetGrayPixel(0, 1);
-	pGrayPixel2			= pGrayBitmap->GetGrayPixel(lWidth-1, 1);
-	pOutputRedPixel1	= pColorBitmap->GetRedPixel(0, 1);
-	pOutputGreenPixel1	= pColorBitmap->GetGreenPixel(0, 1);
-	pOutputBluePixel1	= pColorBitmap->GetBluePixel(0, 1);
-	pOutputRedPixel2	= pColorBitmap->GetRedPixel(lWidth-1, 1);
-	pOutputGreenPixel2	= pColorBitmap->GetGreenPixel(lWidth-1, 1);
-	pOutputBluePixel2	= pColorBitmap->GetBluePixel(lWidth-1, 1);
-	// Vertical interpolation
-	bBlueLine = IsBayerBlueLine(1, pGrayBitmap->GetCFAType(), pGrayBitmap->yOffset());
-	for (y = 1;y<lHeight-1;y++)
-	{
-		BAYERCOLOR				BayerColor;
-		TType					v1, v2;
+	const LONG					dxy = dx + dy * lWidth;
+	TType *						pOutputPixels[3] = { pColorBitmap->GetRedPixel(x, y), pColorBitmap->GetGreenPixel(x, y), pColorBitmap->GetBluePixel(x, y) };
 
-		BayerColor = pGrayBitmap->GetBayerColor(x1, y);
-		v1 = *(pGrayPixel1-lWidth);
-		v2 = *(pGrayPixel1+lWidth);
-		switch (BayerColor)
-		{
-		case BAYER_GREEN :
-			*pOutputGreenPixel1 = *pGrayPixel1;
-			if (bBlueLine)
-			{
-				*pOutputBluePixel1 = *(pGrayPixel1+1);
-				*pOutputRedPixel1 = (v1+v2)/2.0;
-			}
-			else
-			{
-				*pOutputRedPixel1 = *(pGrayPixel1+1);
-				*pOutputBluePixel1 = (v1+v2)/2.0;
-			};
-			break;
-		case BAYER_RED :
-			*pOutputRedPixel1 = *pGrayPixel1;
-			*pOutputGreenPixel1 = (v1+v2)/2.0;
-			*pOutputBluePixel1  = *(pOutputBluePixel1+1);
-			break;
-		case BAYER_BLUE :
-			*pOutputBluePixel1 = *pGrayPixel1;
-			*pOutputGreenPixel1 = (v1+v2)/2.0;
-			*pOutputRedPixel1   = *(pOutputRedPixel1+1);
-			break;
-		};
+	for (TType * pOutputPixel : pOutputPixels)
+		*pOutputPixel = static_cast<TType>((static_cast<double>(pOutputPixel[dx]) + pOutputPixel[dy * lWidth] + pOutputPixel[dxy])/3.0);
+};
 
-		BayerColor = pGrayBitmap->GetBayerColor(x2, y);
-		v1 = *(pGrayPixel2-lWidth);
-		v2 = *(pGrayPixel2+lWidth);
-		switch (BayerColor)
-		{
-		case BAYER_GREEN :
-			*pOutputGreenPixel2 = *pGrayPixel2;
-			if (bBlueLine)
-			{
-				*pOutputBluePixel2 = *(pGrayPixel2-1);
-				*pOutputRedPixel2 = (v1+v2)/2.0;
-			}
-			else
-			{
-				*pOutputRedPixel2 = *(pGrayPixel2-1);
-				*pOutputBluePixel2 = (v1+v2)/2.0;
-			};
-			break;
-		case BAYER_RED :
-			*pOutputRedPixel2 = *pGrayPixel2;
-			*pOutputGreenPixel2 = (v1+v2)/2.0;
-			*pOutputBluePixel2  = *(pOutputBluePixel2-1);
-			break;
-		case BAYER_BLUE :
-			*pOutputBluePixel2 = *pGrayPixel2;
-			*pOutputGreenPixel2 = (v1+v2)/2.0;
-			*pOutputRedPixel2   = *(pOutputRedPixel2-1);
-			break;
-		};
+/* ------------------------------------------------------------------- */
 
-		pOutputRedPixel1+=lWidth;		pOutputGreenPixel1+=lWidth;	pOutputBluePixel1+=lWidth;
-		pOutputRedPixel2+=lWidth;		pOutputGreenPixel2+=lWidth;	pOutputBluePixel2+=lWidth;
-		pGrayPixel1+=lWidth;			pGrayPixel2+=lWidth;
+template <typename TType>
+inline bool	CAHDTask<TType>::DoTask()
+{
+	LONG						lStart, lCount;
+	CAHDTileBuffers				buf;
 
-		bBlueLine = !bBlueLine;
-	};
+	// The last tile of a line or column can be one pixel wider
+	buf.Init(AHDTILESIZE + 1 + 2*AHDMARGIN);
 
-	LONG								y1 = 0,
-										y2 = lHeight-1;
-	bool								bBlueLine1,
-										bBlueLine2;
-
-	pGrayPixel1			= pGrayBitmap->GetGrayPixel(1, 0);
-	pGrayPixel2			= pGrayBitmap->GetGrayPixel(1, lHeight-1);
-	pOutputRedPixel1	= pColorBitmap->GetRedPixel(1, 0);
-	pOutputGreenPixel1	= pColorBitmap->GetGreenPixel(1, 0);
-	pOutputBluePixel1	= pColorBitmap->GetBluePixel(1, 0);
-	pOutputRedPixel2	= pColorBitmap->GetRedPixel(1, lHeight-1);
-	pOutputGreenPixel2	= pColorBitmap->GetGreenPixel(1, lHeight-1);
-	pOutputBluePixel2	= pColorBitmap->GetBluePixel(1, lHeight-1);
-	// Vertical interpolation
-	bBlueLine1 = IsBayerBlueLine(0, pGrayBitmap->GetCFAType(), pGrayBitmap->yOffset());
-	bBlueLine2 = IsBayerBlueLine(lHeight-1, pGrayBitmap->GetCFAType(), pGrayBitmap->yOffset());
-	for (x = 1;x<lWidth-1;x++)
+	// Each chunk is one tile, numbered row by row
+	while (GetNextChunk(lStart, lCount))
 	{
-		BAYERCOLOR				BayerColor;
-		TType					v1, v2;
-
-		BayerColor = pGrayBitmap->GetBayerColor(x, y1);
-		v1 = *(pGrayPixel1-1);
-		v2 = *(pGrayPixel1+1);
-		switch (BayerColor)
+		for (LONG lTile = lStart;lTile<lStart+lCount;lTile++)
 		{
-		case BAYER_GREEN :
-			*pOutputGreenPixel1 = *pGrayPixel1;
-			if (bBlueLine1)
-			{
-				*pOutputBluePixel1 = (v1+v2)/2.0;
-				*pOutputRedPixel1 = *(pGrayPixel1+lWidth);
-			}
-			else
-			{
-				*pOutputBluePixel1 = *(pGrayPixel1+lWidth);
-				*pOutputRedPixel1 = (v1+v2)/2.0;
-			};
-			break;
-		case BAYER_RED :
-			*pOutputRedPixel1 = *pGrayPixel1;
-			*pOutputGreenPixel1 = (v1+v2)/2.0;
-			*pOutputBluePixel1  = *(pOutputBluePixel1+lWidth);
-			break;
-		case BAYER_BLUE :
-			*pOutputBluePixel1 = *pGrayPixel1;
-			*pOutputGreenPixel1 = (v1+v2)/2.0;
-			*pOutputRedPixel1   = *(pOutputRedPixel1+lWidth);
-			break;
+			const LONG			lTileX = lTile % lNrTilesX,
+								lTileY = lTile / lNrTilesX;
+			const LONG			x0 = lTileX * AHDTILESIZE,
+								y0 = lTileY * AHDTILESIZE;
+			const LONG			x1 = (lTileX == lNrTilesX-1) ? lWidth : x0 + AHDTILESIZE,
+								y1 = (lTileY == lNrTilesY-1) ? lHeight : y0 + AHDTILESIZE;
+
+			ProcessTile(x0, y0, x1, y1, buf);
 		};
-
-		BayerColor = pGrayBitmap->GetBayerColor(x, y2);
-		v1 = *(pGrayPixel2-1);
-		v2 = *(pGrayPixel2+1);
-		switch (BayerColor)
-		{
-		case BAYER_GREEN :
-			*pOutputGreenPixel2 = *pGrayPixel2;
-			if (bBlueLine2)
-			{
-				*pOutputBluePixel2 = (v1+v2)/2.0;
-				*pOutputRedPixel2 = *(pGrayPixel2-lWidth);
-			}
-			else
-			{
-				*pOutputRedPixel2 = (v1+v2)/2.0;
-				*pOutputBluePixel2 = *(pGrayPixel2-lWidth);
-			};
-			break;
-		case BAYER_RED :
-			*pOutputRedPixel2 = *pGrayPixel2;
-			*pOutputGreenPixel2 = (v1+v2)/2.0;
-			*pOutputBluePixel2  = *(pOutputBluePixel2-lWidth);
-			break;
-		case BAYER_BLUE :
-			*pOutputBluePixel2 = *pGrayPixel2;
-			*pOutputGreenPixel2 = (v1+v2)/2.0;
-			*pOutputRedPixel2   = *(pOutputRedPixel2-lWidth);
-			break;
-		};
-
-		pOutputRedPixel1++;		pOutputGreenPixel1++;	pOutputBluePixel1++;
-		pOutputRedPixel2++;		pOutputGreenPixel2++;	pOutputBluePixel2++;
-		pGrayPixel1++;			pGrayPixel2++;
 	};
 
-	// Interpolate the 4 corners
-	pOutputRedPixel1	= pColorBitmap->GetRedPixel(0, 0);
-	pOutputGreenPixel1	= pColorBitmap->GetGreenPixel(0, 0);
-	pOutputBluePixel1	= pColorBitmap->GetBluePixel(0, 0);
-
-	*pOutputRedPixel1   = ((*(pOutputRedPixel1+1)) + (*(pOutputRedPixel1+lWidth)) + (*(pOutputRedPixel1+1+lWidth)))/3.0;
-	*pOutputGreenPixel1 = ((*(pOutputGreenPixel1+1)) + (*(pOutputGreenPixel1+lWidth)) + (*(pOutputGreenPixel1+1+lWidth)))/3.0;
-	*pOutputBluePixel1  = ((*(pOutputBluePixel1+1)) + (*(pOutputBluePixel1+lWidth)) + (*(pOutputBluePixel1+1+lWidth)))/3.0;
-
-	pOutputRedPixel1	= pColorBitmap->GetRedPixel(0, lHeight-1);
-	pOutputGreenPixel1	= pColorBitmap->GetGreenPixel(0, lHeight-1);
-	pOutputBluePixel1	= pColorBitmap->GetBluePixel(0, lHeight-1);
-
-	*pOutputRedPixel1   = ((*(pOutputRedPixel1+1)) + (*(pOutputRedPixel1-lWidth)) + (*(pOutputRedPixel1+1-lWidth)))/3.0;
-	*pOutputGreenPixel1   = ((*(pOutputGreenPixel1+1)) + (*(pOutputGreenPixel1-lWidth)) + (*(pOutputGreenPixel1+1-lWidth)))/3.0;
-	*pOutputBluePixel1   = ((*(pOutputBluePixel1+1)) + (*(pOutputBluePixel1-lWidth)) + (*(pOutputBluePixel1+1-lWidth)))/3.0;
-
-	pOutputRedPixel1	= pColorBitmap->GetRedPixel(lWidth-1, lHeight-1);
-	pOutputGreenPixel1	= pColorBitmap->GetGreenPixel(lWidth-1, lHeight-1);
-	pOutputBluePixel1	= pColorBitmap->GetBluePixel(lWidth-1, lHeight-1);
-
-	*pOutputRedPixel1   = ((*(pOutputRedPixel1-1)) + (*(pOutputRedPixel1-lWidth)) + (*(pOutputRedPixel1-1-lWidth)))/3.0;
-	*pOutputGreenPixel1   = ((*(pOutputGreenPixel1-1)) + (*(pOutputGreenPixel1-lWidth)) + (*(pOutputGreenPixel1-1-lWidth)))/3.0;
-	*pOutputBluePixel1   = ((*(pOutputBluePixel1-1)) + (*(pOutputBluePixel1-lWidth)) + (*(pOutputBluePixel1-1-lWidth)))/3.0;
-
-	pOutputRedPixel1	= pColorBitmap->GetRedPixel(lWidth-1, 0);
-	pOutputGreenPixel1	= pColorBitmap->GetGreenPixel(lWidth-1, 0);
-	pOutputBluePixel1	= pColorBitmap->GetBluePixel(lWidth-1, 0);
-
-	*pOutputRedPixel1   = ((*(pOutputRedPixel1-1)) + (*(pOutputRedPixel1+lWidth)) + (*(pOutputRedPixel1-1+lWidth)))/3.0;
-	*pOutputGreenPixel1   = ((*(pOutputGreenPixel1-1)) + (*(pOutputGreenPixel1+lWidth)) + (*(pOutputGreenPixel1-1+lWidth)))/3.0;
-	*pOutputBluePixel1   = ((*(pOutputBluePixel1-1)) + (*(pOutputBluePixel1+lWidth)) + (*(pOutputBluePixel1-1+lWidth)))/3.0;
+	return true;
 };
 
 /* ------------------------------------------------------------------- */
@@ -979,7 +558,6 @@ inline bool	AHDDemosaicing(CGrayBitmapT<TType> * pGrayBitmap, CMemoryBitmap ** p
 		AHDTask.StartThreads();
 		AHDTask.Process();
 
-		AHDTask.InterpolateBorders();
 		AHDTask.pOutputBitmap.Attach(AHDTask.pColorBitmap);
 		AHDTask.pOutputBitmap.CopyTo(ppColorBitmap);
 	};
@@ -44,7 +44,7 @@ public :
 		m_vBlueHisto.resize((LONG)MAXWORD+1);
 	};
 
-	virtual bool	DoTask(HANDLE hEvent);
+	virtual bool	DoTask();
 	virtual bool	Process();
 };
 
@@ -64,14 +64,13 @@ void	CBackgroundCalibrationTask::AddToMainHistograms(const std::vector<LONG> & v
 
 /* ------------------------------------------------------------------- */
 
-bool	CBackgroundCalibrationTask::DoTask(HANDLE hEvent)
+bool	CBackgroundCalibrationTask::DoTask()
 {
 	ZFUNCTRACE_RUNTIME();
 	bool				bResult = true;
 
 	LONG				i, j;
-	bool				bEnd = false;
-	MSG					msg;
+	LONG				lStart, lCount;
 	LONG				lWidth = m_pBitmap->Width();
 	double				fMultiplier = m_pBackgroundCalibration->m_fMultiplier;
 	std::vector<LONG>	vRedHisto;
@@ -84,49 +83,40 @@ bool	CBackgroundCalibrationTask::DoTask(HANDLE hEvent)
 
 	AvxHistogram avxHistogram(*m_pBitmap);
 
-	// Create a message queue and signal the event
-	PeekMessage(&msg, nullptr, 0, 0, PM_NOREMOVE);
-	SetEvent(hEvent);
-	while (!bEnd && GetMessage(&msg, nullptr, 0, 0))
+	while (GetNextChunk(lStart, lCount))
 	{
-		if (msg.message == WM_MT_PROCESS)
+		if (avxHistogram.calcHistogram(lStart, lStart + lCount) != 0)
 		{
-			if (avxHistogram.calcHistogram(msg.wParam, msg.wParam + msg.lParam) != 0)
+			for (j = lStart; j < lStart + lCount; j++)
 			{
-				for (j = msg.wParam; j < msg.wParam + msg.lParam; j++)
+				for (i = 0; i < lWidth; i++)
 				{
-					for (i = 0; i < lWidth; i++)
-					{
-						COLORREF16		crColor;
-						double			fRed, fGreen, fBlue;
-
-						m_pBitmap->GetPixel(i, j, fRed, fGreen, fBlue);
-						fRed *= fMultiplier * 256.0;
-						fGreen *= fMultiplier * 256.0;
-						fBlue *= fMultiplier * 256.0;
-
-						crColor.red = min(fRed, static_cast<double>(MAXWORD));
-						crColor.blue = min(fBlue, static_cast<double>(MAXWORD));
-						crColor.green = min(fGreen, static_cast<double>(MAXWORD));
-
-						vRedHisto[crColor.red]++;
-						vGreenHisto[crColor.green]++;
-						vBlueHisto[crColor.blue]++;
-					};
+					COLORREF16		crColor;
+					double			fRed, fGreen, fBlue;
+
+					m_pBitmap->GetPixel(i, j, fRed, fGreen, fBlue);
+					fRed *= fMultiplier * 256.0;
+					fGreen *= fMultiplier * 256.0;
+					fBlue *= fMultiplier * 256.0;
+
+					crColor.red = min(fRed, static_cast<double>(MAXWORD));
+					crColor.blue = min(fBlue, static_cast<double>(MAXWORD));
+					crColor.green = min(fGreen, static_cast<double>(MAXWORD));
+
+					vRedHisto[crColor.red]++;
+					vGreenHisto[crColor.green]++;
+					vBlueHisto[crColor.blue]++;
 				};
 			};
-
-			SetEvent(hEvent);
-		}
-		else if (msg.message == WM_MT_STOP)
-			bEnd = true;
+		};
 	};
 
 	int rval = 1;
 	if (avxHistogram.histogramSuccessful())
-	#pragma omp critical(HistoMergeOmpLock)
 	{
+		m_CriticalSection.Lock();
 		rval = avxHistogram.mergeHistograms(m_vRedHisto, m_vGreenHisto, m_vBlueHisto);
+		m_CriticalSection.Unlock();
 	}
 	if (rval != 0)
 		AddToMainHistograms(vRedHisto, vGreenHisto, vBlueHisto);
@@ -141,33 +131,12 @@ bool	CBackgroundCalibrationTask::Process()
 	ZFUNCTRACE_RUNTIME();
 	bool				bResult = true;
 	LONG				lHeight = m_pBitmap->Height();
-	LONG				i = 0;
+	LONG				i;
 	LONG				lStep;
-	LONG				lRemaining;
 
-	if (m_pProgress)
-		m_pProgress->SetNrUsedProcessors(GetNrThreads());
 	lStep		= max(1L, lHeight/50);
-	lRemaining	= lHeight;
-
-	while (i<lHeight)
-	{
-		LONG			lAdd = min(lStep, lRemaining);
-		DWORD			dwThreadId;
-
-		dwThreadId = GetAvailableThreadId();
-		PostThreadMessage(dwThreadId, WM_MT_PROCESS, i, lAdd);
-
-		i			+=lAdd;
-		lRemaining	-= lAdd;
-		if (m_pProgress)
-			m_pProgress->Progress2(nullptr, i);
-	};
-
-	CloseAllThreads();
 
-	if (m_pProgress)
-		m_pProgress->SetNrUsedProcessors();
+	bResult = ProcessChunks(0, lHeight, lStep, m_pProgress);
 
 	double				fMax = 0;
 
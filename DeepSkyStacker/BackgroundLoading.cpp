@@ -68,6 +68,13 @@ void CBackgroundLoading::LoadCurrentImage()
 
 		if (LoadPicture(strImage, adb))
 		{
+			// The reduced levels drawn when zoomed out are built here, out of the GUI thread
+			if (adb.m_pWndBitmap)
+			{
+				adb.m_pWndBitmap->CreateLevels();
+				adb.m_pWndBitmap->UpdateLevels();
+			};
+
 			m_CriticalSection.Lock();
 			CLoadedImage			li;
 
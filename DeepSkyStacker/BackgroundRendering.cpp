@@ -0,0 +1,214 @@
+#include <stdafx.h>
+#include "BackgroundRendering.h"
+#include <algorithm>
+
+/* ------------------------------------------------------------------- */
+
+CBackgroundRendering::CBackgroundRendering() :
+	m_bStop(false),
+	m_bRendering(false),
+	m_lGeneration(0),
+	m_pStackedBitmap(nullptr),
+	m_pBitmap(nullptr),
+	m_lNrPendingTiles(0),
+	m_lNrTiles(0),
+	m_lNrRenderedTiles(0),
+	m_bUpdated(false)
+{
+};
+
+/* ------------------------------------------------------------------- */
+
+CBackgroundRendering::~CBackgroundRendering()
+{
+	{
+		std::lock_guard<std::mutex>	Lock(m_Mutex);
+
+		m_bStop = true;
+		m_lGeneration++;
+	}
+	m_Condition.notify_all();
+
+	if (m_Thread.joinable())
+		m_Thread.join();
+};
+
+/* ------------------------------------------------------------------- */
+
+void CBackgroundRendering::AddJob(const std::vector<CRect> & vRects, const CRect & rcVisible, LONG lLevel)
+{
+	// Called with the mutex locked
+	CRenderingJob		Job;
+	const LONG			lScale = 1L << lLevel;
+	const LONG			lWidth = m_pBitmap->GetLevel(lLevel)->Width(),
+						lHeight = m_pBitmap->GetLevel(lLevel)->Height();
+	const CRect			rcLevelVisible(rcVisible.left / lScale, rcVisible.top / lScale,
+									   (rcVisible.right + lScale - 1) / lScale, (rcVisible.bottom + lScale - 1) / lScale);
+
+	Job.m_lLevel = lLevel;
+	for (const CRect & rcRect : vRects)
+	{
+		const CRect		rc(rcRect.left / lScale, rcRect.top / lScale,
+						   min(lWidth, (rcRect.right + lScale - 1) / lScale), min(lHeight, (rcRect.bottom + lScale - 1) / lScale));
+
+		for (LONG j = rc.top;j<rc.bottom;j+=TILESIZE)
+			for (LONG i = rc.left;i<rc.right;i+=TILESIZE)
+				Job.m_vTiles.emplace_back(i, j, min(i + TILESIZE, rc.right), min(j + TILESIZE, rc.bottom));
+	};
+	std::stable_partition(Job.m_vTiles.begin(), Job.m_vTiles.end(), [&rcLevelVisible](const CRect & rcTile)
+	{
+		CRect		rcIntersect;
+
+		return rcIntersect.IntersectRect(&rcTile, &rcLevelVisible) != FALSE;
+	});
+
+	m_lNrPendingTiles += static_cast<LONG>(Job.m_vTiles.size());
+	m_qJobs.push_back(std::move(Job));
+
+	if (!m_Thread.joinable())
+		m_Thread = std::thread(&CBackgroundRendering::RenderingThread, this);
+};
+
+/* ------------------------------------------------------------------- */
+
+void CBackgroundRendering::Start(CStackedBitmap & StackedBitmap, C32BitsBitmap & Bitmap, const CBezierAdjust & BezierAdjust, const CRGBHistogramAdjust & HistoAdjust, const std::vector<CRect> & vRects, const CRect & rcVisible, LONG lLevel)
+{
+	{
+		std::lock_guard<std::mutex>	Lock(m_Mutex);
+
+		m_lGeneration++;
+		m_pStackedBitmap	= &StackedBitmap;
+		m_pBitmap			= &Bitmap;
+		m_BezierAdjust		= BezierAdjust;
+		m_HistoAdjust		= HistoAdjust;
+
+		m_qJobs.clear();
+		m_lNrPendingTiles	= 0;
+		AddJob(vRects, rcVisible, lLevel);
+	}
+	m_Condition.notify_all();
+};
+
+/* ------------------------------------------------------------------- */
+
+void CBackgroundRendering::Add(const std::vector<CRect> & vRects, const CRect & rcVisible, LONG lLevel)
+{
+	{
+		std::lock_guard<std::mutex>	Lock(m_Mutex);
+
+		if (m_pBitmap)
+			AddJob(vRects, rcVisible, lLevel);
+	}
+	m_Condition.notify_all();
+};
+
+/* ------------------------------------------------------------------- */
+
+void CBackgroundRendering::Cancel()
+{
+	std::unique_lock<std::mutex>	Lock(m_Mutex);
+
+	m_lGeneration++;
+	m_qJobs.clear();
+	m_lNrPendingTiles = 0;
+	m_pStackedBitmap  = nullptr;
+	m_pBitmap		  = nullptr;
+	m_Condition.wait(Lock, [this]() { return !m_bRendering; });
+	m_lNrTiles		  = 0;
+};
+
+/* ------------------------------------------------------------------- */
+
+float CBackgroundRendering::GetPercentageComplete()
+{
+	std::lock_guard<std::mutex>	Lock(m_Mutex);
+	const LONG		lNrTiles = m_lNrTiles + m_lNrPendingTiles;
+
+	if (!lNrTiles)
+		return 100.0f;
+	else
+		return static_cast<float>(m_lNrRenderedTiles) * 100.0f / static_cast<float>(lNrTiles);
+};
+
+/* ------------------------------------------------------------------- */
+
+void CBackgroundRendering::Render(CStackedBitmap & StackedBitmap, C32BitsBitmap & Bitmap, const CStackedBitmapLUT & LUT, const CRenderingJob & Job, LONG lGeneration)
+{
+	C32BitsBitmap &		LevelBitmap = *Bitmap.GetLevel(Job.m_lLevel);
+
+	ParallelFor(0, static_cast<LONG>(Job.m_vTiles.size()), 1, [&](LONG lStart, LONG lEnd)
+	{
+		for (LONG i = lStart;i<lEnd && m_lGeneration == lGeneration;i++)
+		{
+			StackedBitmap.RenderBitmap(LevelBitmap, LUT, Job.m_vTiles[i], Job.m_lLevel);
+			m_lNrRenderedTiles++;
+			m_bUpdated = true;
+		};
+	});
+};
+
+/* ------------------------------------------------------------------- */
+
+void CBackgroundRendering::RenderingThread()
+{
+	std::unique_lock<std::mutex>	Lock(m_Mutex);
+	CStackedBitmapLUT				LUT;
+	LONG							lLUTGeneration = -1;
+
+	for (;;)
+	{
+		m_Condition.wait(Lock, [this]() { return m_bStop || !m_qJobs.empty(); });
+		if (m_bStop)
+			break;
+
+		CStackedBitmap *		pStackedBitmap = m_pStackedBitmap;
+		C32BitsBitmap *			pBitmap = m_pBitmap;
+		CRenderingJob			Job = std::move(m_qJobs.front());
+		const LONG				lGeneration = m_lGeneration;
+		CBezierAdjust			BezierAdjust;
+		CRGBHistogramAdjust		HistoAdjust;
+		const bool				bNewSettings = (lGeneration != lLUTGeneration);
+
+		// The queued levels use the same settings: the LUT is only compiled
+		// once per generation
+		if (bNewSettings)
+		{
+			BezierAdjust	= m_BezierAdjust;
+			HistoAdjust		= m_HistoAdjust;
+		};
+
+		// The progress counts all the levels rendered with the same settings
+		if (bNewSettings)
+		{
+			m_lNrTiles			= 0;
+			m_lNrRenderedTiles	= 0;
+		};
+		m_qJobs.pop_front();
+		m_lNrPendingTiles  -= static_cast<LONG>(Job.m_vTiles.size());
+		m_lNrTiles		   += static_cast<LONG>(Job.m_vTiles.size());
+		m_bRendering		= true;
+		Lock.unlock();
+
+		try
+		{
+			if (bNewSettings)
+			{
+				LUT.Init(HistoAdjust, BezierAdjust, pStackedBitmap->GetNrStackedFrames(), pStackedBitmap->IsMonochrome());
+				lLUTGeneration = lGeneration;
+			};
+			Render(*pStackedBitmap, *pBitmap, LUT, Job, lGeneration);
+		}
+		catch (...)
+		{
+			// The job is dropped (out of memory...): the LUT is compiled
+			// again with the next one, and Cancel() must not wait forever
+			lLUTGeneration = -1;
+		};
+
+		Lock.lock();
+		m_bRendering = false;
+		m_Condition.notify_all();
+	};
+};
+
+/* ------------------------------------------------------------------- */
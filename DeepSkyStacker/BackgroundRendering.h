@@ -0,0 +1,99 @@
+#ifndef __BACKGROUNDRENDERING_H__
+#define __BACKGROUNDRENDERING_H__
+
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <thread>
+#include "BezierAdjust.h"
+#include "Histogram.h"
+#include "StackedBitmap.h"
+
+/* ------------------------------------------------------------------- */
+
+// Render the stacked bitmap into the 8 bits preview bitmap with the processing
+// settings, out of the GUI thread.
+//
+// Each rendering compiles the settings into a CStackedBitmapLUT and renders its
+// rectangles split into tiles of at most TILESIZE x TILESIZE pixels, in
+// parallel: the tiles in the visible rectangle first, then the others in the
+// order of the rectangles.
+// A rendering is done at one level of the preview (see BitmapPyramid.h): the
+// reduced levels of the stacked bitmap are rendered into the reduced levels of
+// the preview bitmap, so a zoomed out preview never touches the full
+// resolution pixels. The other levels needed with the same settings are
+// queued after it.
+// Starting a rendering with new settings drops the tiles of the previous ones
+// that are not rendered yet: the renderings are done one after the other so an
+// old one never overwrites the result of a newer one.
+class CBackgroundRendering
+{
+private :
+	static constexpr LONG		TILESIZE = 256;
+
+	class CRenderingJob
+	{
+	public :
+		LONG					m_lLevel;
+		std::vector<CRect>		m_vTiles;
+
+	public :
+		CRenderingJob() :
+			m_lLevel(0)
+		{
+		};
+	};
+
+	std::thread					m_Thread;
+	std::mutex					m_Mutex;
+	std::condition_variable		m_Condition;
+	bool						m_bStop;
+	bool						m_bRendering;
+	std::atomic<LONG>			m_lGeneration;
+
+	// Settings of the current generation and pending renderings
+	CStackedBitmap *			m_pStackedBitmap;
+	C32BitsBitmap *				m_pBitmap;
+	CBezierAdjust				m_BezierAdjust;
+	CRGBHistogramAdjust			m_HistoAdjust;
+	std::deque<CRenderingJob>	m_qJobs;
+	LONG						m_lNrPendingTiles;
+
+	// Current rendering
+	LONG						m_lNrTiles;
+	std::atomic<LONG>			m_lNrRenderedTiles;
+	std::atomic<bool>			m_bUpdated;
+
+private :
+	void	RenderingThread();
+	void	Render(CStackedBitmap & StackedBitmap, C32BitsBitmap & Bitmap, const CStackedBitmapLUT & LUT, const CRenderingJob & Job, LONG lGeneration);
+	void	AddJob(const std::vector<CRect> & vRects, const CRect & rcVisible, LONG lLevel);
+
+public :
+	CBackgroundRendering();
+	virtual ~CBackgroundRendering();
+
+	// The rectangles are in full resolution coordinates, lLevel is the level
+	// of the bitmaps to render
+	void	Start(CStackedBitmap & StackedBitmap, C32BitsBitmap & Bitmap, const CBezierAdjust & BezierAdjust, const CRGBHistogramAdjust & HistoAdjust, const std::vector<CRect> & vRects, const CRect & rcVisible, LONG lLevel);
+
+	// Render another level with the settings of the last Start
+	void	Add(const std::vector<CRect> & vRects, const CRect & rcVisible, LONG lLevel);
+
+	// Drop the pending tiles and wait until the bitmaps are not used anymore
+	void	Cancel();
+
+	// True if tiles were rendered since the last call
+	bool	IsUpdated()
+	{
+		return m_bUpdated.exchange(false);
+	};
+
+	float	GetPercentageComplete();
+};
+
+/* ------------------------------------------------------------------- */
+
+#endif // __BACKGROUNDRENDERING_H__
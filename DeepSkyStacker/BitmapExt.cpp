@@ -9,11 +9,16 @@
 #include "RAWUtils.h"
 #include <set>
 #include <list>
+#include <vector>
 #include <float.h>
 #include "Multitask.h"
+#include "BitmapPyramid.h"
 #include "Workspace.h"
 #include <iostream>
+#include <atomic>
+#include <mutex>
 #include <zexcept.h>
+#include <QSettings>
 
 
 #include <GdiPlus.h>
@@ -123,6 +128,65 @@ void	CYMGToRGB(double fCyan, double fYellow, double fMagenta, double fGreen2, do
 };
 
 
+/* ------------------------------------------------------------------- */
+
+static std::atomic<__int64>		g_lDemosaicCacheSize(0);
+
+bool CDemosaicCacheBudget::Reserve(size_t lSize)
+{
+	const __int64		lLimit = GetMemoryLimit();
+	__int64				lCurrent = g_lDemosaicCacheSize;
+
+	do
+	{
+		if (lCurrent + (__int64)lSize > lLimit)
+			return false;
+	} while (!g_lDemosaicCacheSize.compare_exchange_weak(lCurrent, lCurrent + (__int64)lSize));
+
+	return true;
+};
+
+/* ------------------------------------------------------------------- */
+
+void CDemosaicCacheBudget::Release(size_t lSize)
+{
+	g_lDemosaicCacheSize -= (__int64)lSize;
+};
+
+/* ------------------------------------------------------------------- */
+
+__int64 CDemosaicCacheBudget::GetMemoryLimit()
+{
+	QSettings		settings;
+	__int64			lResult;
+
+	// In MB - 0 means a quarter of the available physical memory
+	lResult = settings.value("Stacking/DemosaicCacheLimit", (uint)0).toUInt();
+	if (lResult)
+		lResult *= 1024 * 1024;
+	else
+	{
+		MEMORYSTATUSEX		MemoryStatus;
+
+		MemoryStatus.dwLength = sizeof(MemoryStatus);
+		if (GlobalMemoryStatusEx(&MemoryStatus))
+			lResult = MemoryStatus.ullAvailPhys / 4;
+		else
+			lResult = (__int64)256 * 1024 * 1024;
+	};
+
+	return lResult;
+};
+
+/* ------------------------------------------------------------------- */
+
+void CDemosaicCacheBudget::SetMemoryLimit(LONG lLimitMB)
+{
+	QSettings	settings;
+
+	settings.setValue("Stacking/DemosaicCacheLimit", (uint)max(0L, lLimitMB));
+};
+
 /* ------------------------------------------------------------------- */
 
 int GetEncoderClsid(const WCHAR* format, CLSID* pClsid)
@@ -802,6 +866,50 @@ bool	C32BitsBitmap::InitFrom(CMemoryBitmap * pBitmap)
 
 /* ------------------------------------------------------------------- */
 
+void	C32BitsBitmap::CreateLevels()
+{
+	ZFUNCTRACE_RUNTIME();
+	const LONG		lNrLevels = GetNrPyramidLevels(m_lWidth, m_lHeight);
+
+	m_vLevels.clear();
+	for (LONG i = 1;i<lNrLevels;i++)
+	{
+		CSmartPtr<C32BitsBitmap>	pLevel;
+
+		pLevel.Create();
+		if (!pLevel->Create(GetPyramidLevelSize(m_lWidth, i), GetPyramidLevelSize(m_lHeight, i)))
+		{
+			m_vLevels.clear();
+			break;
+		};
+		m_vLevels.push_back(pLevel);
+	};
+};
+
+/* ------------------------------------------------------------------- */
+
+void	C32BitsBitmap::UpdateLevels()
+{
+	ZFUNCTRACE_RUNTIME();
+	C32BitsBitmap *	pPrevious = this;
+
+	// Each level is computed from the previous one: only the rows are parallel
+	for (C32BitsBitmap * pLevel : m_vLevels)
+	{
+		const std::ptrdiff_t	lInStride = pPrevious->m_lHeight > 1 ? pPrevious->GetPixelBase(0, 1) - pPrevious->GetPixelBase(0, 0) : 0;
+		const std::ptrdiff_t	lOutStride = pLevel->m_lHeight > 1 ? pLevel->GetPixelBase(0, 1) - pLevel->GetPixelBase(0, 0) : 0;
+
+		ParallelFor(0, pLevel->m_lHeight, 16, [&](LONG lStart, LONG lEnd)
+		{
+			ReducePyramidRows(pPrevious->GetPixelBase(0, 0), lInStride, pPrevious->m_lWidth, pPrevious->m_lHeight,
+							  pLevel->GetPixelBase(0, 0), lOutStride, lStart, lEnd);
+		});
+		pPrevious = pLevel;
+	};
+};
+
+/* ------------------------------------------------------------------- */
+
 void CGammaTransformation::InitTransformation(double fBlackPoint, double fGrayPoint, double fWhitePoint)
 {
 	ZFUNCTRACE_RUNTIME();
@@ -993,17 +1101,168 @@ bool	ApplyGammaTransformation(C32BitsBitmap * pOutBitmap, CMemoryBitmap * pInBit
 	else if (p32BitFloatGrayBitmap)
 		bResult = ApplyGammaTransformation(pOutBitmap, p32BitFloatGrayBitmap, gammatrans);
 
+	if (bResult)
+		pOutBitmap->UpdateLevels();
+
 	return bResult;
 };
 
 /* ------------------------------------------------------------------- */
 
+static int	LoadRAWPictureOrSkip(LPCTSTR szFileName, CBitmapInfo & BitmapInfo, CMemoryBitmap ** ppBitmap, CDSSProgress * pProgress)
+{
+	// Like the other loaders: -1 when the file could not be loaded as a RAW file.
+	// A file already identified as RAW by GetPictureInfo is not probed again.
+	if ((BitmapInfo.m_Format == PICTUREFORMAT_RAW || IsRAWPicture(szFileName, BitmapInfo)) && LoadRAWPicture(szFileName, ppBitmap, pProgress))
+		return 0;
+	return -1;
+};
+
+/* ------------------------------------------------------------------- */
+
+static int	LoadOtherPictureOrSkip(LPCTSTR szFileName, CBitmapInfo &, CMemoryBitmap ** ppBitmap, CDSSProgress * pProgress)
+{
+	return LoadOtherPicture(szFileName, ppBitmap, pProgress) ? 0 : -1;
+};
+
+/* ------------------------------------------------------------------- */
+
+typedef bool (*ISPICTUREPROC)(LPCTSTR szFileName, CBitmapInfo & BitmapInfo);
+
+//
+// Meanings of the result of a LOADPICTUREPROC:
+//
+//		-1		Not a file of the appropriate type
+//		0		File successfully loaded
+//		1		File failed to load
+//
+typedef int (*LOADPICTUREPROC)(LPCTSTR szFileName, CBitmapInfo & BitmapInfo, CMemoryBitmap ** ppBitmap, CDSSProgress * pProgress);
+
+class CPictureLoader
+{
+public :
+	PICTUREFORMAT		m_Format;
+	ISPICTUREPROC		m_pIsPicture;
+	LOADPICTUREPROC		m_pLoadPicture;
+};
+
+static const CPictureLoader		g_PictureLoaders[] =
+{
+	{ PICTUREFORMAT_RAW,	static_cast<ISPICTUREPROC>(IsRAWPicture),	LoadRAWPictureOrSkip },
+	{ PICTUREFORMAT_TIFF,	IsTIFFPicture,								LoadTIFFPicture },
+	{ PICTUREFORMAT_FITS,	IsFITSPicture,								LoadFITSPicture },
+	{ PICTUREFORMAT_OTHER,	IsOtherPicture,								LoadOtherPictureOrSkip }
+};
+
+/* ------------------------------------------------------------------- */
+
+// Returns the loaders to try, in order, for a file of the given format
+static std::vector<const CPictureLoader *>	GetPictureLoaders(PICTUREFORMAT Format)
+{
+	std::vector<PICTUREFORMAT>				vFormats;
+	std::vector<const CPictureLoader *>		vLoaders;
+
+	switch (Format)
+	{
+	case PICTUREFORMAT_RAW :
+		// TIFF based RAW files are tried as RAW first
+		vFormats = { PICTUREFORMAT_RAW, PICTUREFORMAT_TIFF, PICTUREFORMAT_OTHER };
+		break;
+	case PICTUREFORMAT_TIFF :
+		// GDI+ reads the TIFF layouts which are not supported by CTIFFReader
+		vFormats = { PICTUREFORMAT_TIFF, PICTUREFORMAT_OTHER };
+		break;
+	case PICTUREFORMAT_FITS :
+		vFormats = { PICTUREFORMAT_FITS };
+		break;
+	case PICTUREFORMAT_OTHER :
+		vFormats = { PICTUREFORMAT_OTHER };
+		break;
+	default :
+		vFormats = { PICTUREFORMAT_RAW, PICTUREFORMAT_TIFF, PICTUREFORMAT_FITS, PICTUREFORMAT_OTHER };
+		break;
+	};
+
+	for (const PICTUREFORMAT & CandidateFormat : vFormats)
+	{
+		for (const CPictureLoader & Loader : g_PictureLoaders)
+		{
+			if (Loader.m_Format == CandidateFormat)
+				vLoaders.push_back(&Loader);
+		};
+	};
+
+	return vLoaders;
+};
+
+/* ------------------------------------------------------------------- */
+
 #endif // DSSFILEDECODING
 
 /* ------------------------------------------------------------------- */
 
+PICTUREFORMAT	GetPictureFormat(LPCTSTR szFileName)
+{
+	ZFUNCTRACE_RUNTIME();
+	PICTUREFORMAT		Result = PICTUREFORMAT_UNKNOWN;
+	BYTE				Header[16] = { 0 };
+	size_t				lNrBytes = 0;
+	FILE *				hFile;
+
+	hFile = _tfopen(szFileName, _T("rb"));
+	if (hFile)
+	{
+		lNrBytes = fread(Header, 1, sizeof(Header), hFile);
+		fclose(hFile);
+	};
+
+	const auto			StartsWith = [&](const char * szMagic, size_t lOffset = 0) -> bool
+	{
+		const size_t	lLength = strlen(szMagic);
+
+		return (lNrBytes >= lOffset + lLength) && !memcmp(Header + lOffset, szMagic, lLength);
+	};
+
+	TCHAR				szExt[1+_MAX_EXT];
+	CString				strExt;
+
+	_tsplitpath(szFileName, nullptr, nullptr, nullptr, szExt);
+	strExt = szExt;
+	strExt.MakeUpper();
+
+	if (StartsWith("SIMPLE"))
+		Result = PICTUREFORMAT_FITS;
+	else if ((lNrBytes >= 4) &&
+			 ((!memcmp(Header, "II", 2) && (Header[2] == 42 || Header[2] == 43) && !Header[3]) ||
+			  (!memcmp(Header, "MM", 2) && !Header[2] && (Header[3] == 42 || Header[3] == 43))))
+	{
+		// Most of the RAW files are TIFF files, the extension makes the difference
+		if ((strExt == _T(".TIF")) || (strExt == _T(".TIFF")))
+			Result = PICTUREFORMAT_TIFF;
+		else
+			Result = PICTUREFORMAT_RAW;
+	}
+	else if (StartsWith("FUJIFILM") ||					// RAF
+			 StartsWith("IIRO") || StartsWith("IIRS") ||	// ORF
+			 StartsWith("MMOR") ||
+			 StartsWith("IIU") ||						// RW2
+			 StartsWith("ftypcrx", 4) ||				// CR3
+			 StartsWith("HEAPCCDR", 6) ||				// CRW
+			 StartsWith("FOVb") ||						// X3F
+			 StartsWith("MRM", 1))						// MRW
+		Result = PICTUREFORMAT_RAW;
+	else if ((lNrBytes >= 3 && Header[0] == 0xFF && Header[1] == 0xD8 && Header[2] == 0xFF) ||
+			 StartsWith("\x89PNG") || StartsWith("GIF8") || StartsWith("BM"))
+		Result = PICTUREFORMAT_OTHER;
+
+	return Result;
+};
+
+/* ------------------------------------------------------------------- */
+
 static		std::set<CBitmapInfo>			g_sBitmapInfoCache;
 static		SYSTEMTIME						g_BitmapInfoTime;
+static		std::mutex						g_BitmapInfoCacheMutex;
 
 /* ------------------------------------------------------------------- */
 
@@ -1016,53 +1275,62 @@ bool	GetPictureInfo(LPCTSTR szFileName, CBitmapInfo & BitmapInfo)
 	if (IsPCLPicture(szFileName, BitmapInfo))
 		bResult = true;
 #else
-	// First try to find the info in the cache
-	if (g_sBitmapInfoCache.size())
+	// First try to find the info in the cache (GetPictureInfo is called
+	// from several threads, DeepSkyStackerLive)
 	{
-		// Check that the cache is not old (more than 5 minutes)
-		SYSTEMTIME			st;
-		FILETIME			ft1, ft2;
-		ULARGE_INTEGER		ulft1, ulft2;
+		std::lock_guard<std::mutex>		Lock(g_BitmapInfoCacheMutex);
 
-		GetSystemTime(&st);
+		if (g_sBitmapInfoCache.size())
+		{
+			// Check that the cache is not old (more than 5 minutes)
+			SYSTEMTIME			st;
+			FILETIME			ft1, ft2;
+			ULARGE_INTEGER		ulft1, ulft2;
 
-		SystemTimeToFileTime(&g_BitmapInfoTime, &ft1);
-		SystemTimeToFileTime(&st, &ft2);
+			GetSystemTime(&st);
 
-		__int64				diff;
+			SystemTimeToFileTime(&g_BitmapInfoTime, &ft1);
+			SystemTimeToFileTime(&st, &ft2);
 
-		ulft1.LowPart = ft1.dwLowDateTime;
-		ulft1.HighPart = ft1.dwHighDateTime;
+			__int64				diff;
 
-		ulft2.LowPart = ft2.dwLowDateTime;
-		ulft2.HighPart = ft2.dwHighDateTime;
+			ulft1.LowPart = ft1.dwLowDateTime;
+			ulft1.HighPart = ft1.dwHighDateTime;
 
-		diff = ulft2.QuadPart-ulft1.QuadPart;
+			ulft2.LowPart = ft2.dwLowDateTime;
+			ulft2.HighPart = ft2.dwHighDateTime;
 
-		// diff is in 100 of nanoseconds (1e6 millisecond = 1 nanosecond)
-		if (diff > 10000.0*1000.0*60.0*5.0)
-			g_sBitmapInfoCache.clear();
+			diff = ulft2.QuadPart-ulft1.QuadPart;
 
-		std::set<CBitmapInfo>::iterator		it;
+			// diff is in 100 of nanoseconds (1e6 millisecond = 1 nanosecond)
+			if (diff > 10000.0*1000.0*60.0*5.0)
+				g_sBitmapInfoCache.clear();
 
-		it = g_sBitmapInfoCache.find(CBitmapInfo(szFileName));
-		if (it != g_sBitmapInfoCache.end())
-		{
-			BitmapInfo = *it;
-			bResult = true;
+			std::set<CBitmapInfo>::iterator		it;
+
+			it = g_sBitmapInfoCache.find(CBitmapInfo(szFileName));
+			if (it != g_sBitmapInfoCache.end())
+			{
+				BitmapInfo = *it;
+				bResult = true;
+			};
 		};
 	};
 
 	if (!bResult)
 	{
-		if (IsRAWPicture(szFileName, BitmapInfo))
-			bResult = true;
-		else if (IsTIFFPicture(szFileName, BitmapInfo))
-			bResult = true;
-		else if (IsFITSPicture(szFileName, BitmapInfo))
-			bResult = true;
-		else if (IsOtherPicture(szFileName, BitmapInfo))
-			bResult = true;
+		//
+		// Only the loaders matching the first bytes of the file are tried
+		//
+		for (const CPictureLoader * pLoader : GetPictureLoaders(GetPictureFormat(szFileName)))
+		{
+			if (pLoader->m_pIsPicture(szFileName, BitmapInfo))
+			{
+				BitmapInfo.m_Format = pLoader->m_Format;
+				bResult = true;
+				break;
+			};
+		};
 
 		if (bResult)
 		{
@@ -1089,6 +1357,8 @@ bool	GetPictureInfo(LPCTSTR szFileName, CBitmapInfo & BitmapInfo)
 
 			BitmapInfo.m_strDateTime.Format(_T("%s %s"), szDate, szTime);
 
+			std::lock_guard<std::mutex>		Lock(g_BitmapInfoCacheMutex);
+
 			if (!g_sBitmapInfoCache.size())
 				GetSystemTime(&g_BitmapInfoTime);
 			g_sBitmapInfoCache.insert(BitmapInfo);
@@ -1101,7 +1371,7 @@ bool	GetPictureInfo(LPCTSTR szFileName, CBitmapInfo & BitmapInfo)
 
 /* ------------------------------------------------------------------- */
 
-bool	LoadPicture(LPCTSTR szFileName, CMemoryBitmap ** ppBitmap, CDSSProgress * pProgress)
+bool	LoadPicture(LPCTSTR szFileName, CMemoryBitmap ** ppBitmap, CDSSProgress * pProgress, PICTUREFORMAT Format)
 {
 	ZFUNCTRACE_RUNTIME();
 	bool				bResult = false;
@@ -1111,56 +1381,32 @@ bool	LoadPicture(LPCTSTR szFileName, CMemoryBitmap ** ppBitmap, CDSSProgress * p
 		CBitmapInfo					BitmapInfo;
 		CSmartPtr<CMemoryBitmap>	pBitmap;
 		*ppBitmap = nullptr;
-		int loadResult = 0;
 
 #if DSSFILEDECODING==0
 		if (IsPCLPicture(szFileName, BitmapInfo))
 			bResult = LoadPCLPicture(szFileName, &pBitmap, pProgress);
 #else
-		do  // Once only 
+		//
+		// When the format is already known (from GetPictureInfo) the file is not
+		// identified again, else it is identified from its first bytes.
+		// The loaders of the other formats which can read the file are still
+		// tried if the first one cannot load it (RAW, then TIFF, then GDI+).
+		//
+		if (Format == PICTUREFORMAT_UNKNOWN)
+			Format = GetPictureFormat(szFileName);
+		else
+			BitmapInfo.m_Format = Format;
+
+		for (const CPictureLoader * pLoader : GetPictureLoaders(Format))
 		{
-			if (IsRAWPicture(szFileName, BitmapInfo))
-				bResult = LoadRAWPicture(szFileName, &pBitmap, pProgress);
-			if (bResult)
-				break;		// All done - file has been loaded 
-			
-			//
-			// Meanings of loadResult:
-			//
-			//		-1		Not a file of the appropriate type
-			//		0		File successfully loaded
-			//		1		File failed to load
-			//
-			// If the file loaded or failed to load, leave the loop with an appropriate
-			// value of bResult set.
-			//
-			loadResult = LoadTIFFPicture(szFileName, BitmapInfo, &pBitmap, pProgress);
-			if (0 == loadResult)
-			{
-				bResult = true;
-				break;		// All done - file has been loaded 
-			}
-			else if (1 == loadResult)
-				break;		// All done - file failed to load
+			const int		loadResult = pLoader->m_pLoadPicture(szFileName, BitmapInfo, &pBitmap, pProgress);
 
-			//
-			// It wasn't a TIFF file, so try to load a FITS file
-			//
-			loadResult = LoadFITSPicture(szFileName, BitmapInfo, &pBitmap, pProgress);
+			// If the file loaded or failed to load, stop with an appropriate value of bResult
 			if (0 == loadResult)
-			{
 				bResult = true;
-				break;		// All done - file has been loaded 
-			}
-			else if (1 == loadResult)
-				break;		// All done - file failed to load
-
-			//
-			// It wasn't a FITS file, so try to load other stuff ...
-			//
-			bResult = LoadOtherPicture(szFileName, &pBitmap, pProgress);
-
-		} while (false);
+			if (-1 != loadResult)
+				break;
+		};
 
 #endif
 
@@ -1325,17 +1571,16 @@ public :
 	};
 
 	virtual bool	Process();
-	virtual bool	DoTask(HANDLE hEvent);
+	virtual bool	DoTask();
 };
 
 /* ------------------------------------------------------------------- */
 
-bool	CSubtractTask::DoTask(HANDLE hEvent)
+bool	CSubtractTask::DoTask()
 {
 	ZFUNCTRACE_RUNTIME();
 	LONG			i, j;
-	bool			bEnd = false;
-	MSG				msg;
+	LONG			lStart, lCount;
 	LONG			lWidth = m_pTarget->RealWidth();
 	LONG			lExtraWidth = 0;
 
@@ -1351,94 +1596,85 @@ bool	CSubtractTask::DoTask(HANDLE hEvent)
 		lWidth -= lExtraWidth;
 	};
 
-	// Create a message queue and signal the event
-	PeekMessage(&msg, nullptr, 0, 0, PM_NOREMOVE);
-	SetEvent(hEvent);
-	while (!bEnd && GetMessage(&msg, nullptr, 0, 0))
+	while (GetNextChunk(lStart, lCount))
 	{
-		if (msg.message == WM_MT_PROCESS)
-		{
-			LONG			lTgtStartX = 0,
-							lTgtStartY = msg.wParam,
-							lSrcStartX = 0,
-							lSrcStartY = msg.wParam;
+		LONG			lTgtStartX = 0,
+						lTgtStartY = lStart,
+						lSrcStartX = 0,
+						lSrcStartY = lStart;
 
-			if (m_fXShift>0)
-			{
-				// Target is moved
-				lTgtStartX += m_fXShift+0.5;
-			}
-			else if (m_fXShift<0)
-			{
-				// Source is moved
-				lSrcStartX += fabs(m_fXShift)+0.5;
-			};
-			if (m_fYShift>0)
-			{
-				// Target is moved
-				lTgtStartY += m_fYShift+0.5;
-			}
-			else
-			{
-				// Source is moved
-				lSrcStartY += fabs(m_fYShift)+0.5;
-			};
+		if (m_fXShift>0)
+		{
+			// Target is moved
+			lTgtStartX += m_fXShift+0.5;
+		}
+		else if (m_fXShift<0)
+		{
+			// Source is moved
+			lSrcStartX += fabs(m_fXShift)+0.5;
+		};
+		if (m_fYShift>0)
+		{
+			// Target is moved
+			lTgtStartY += m_fYShift+0.5;
+		}
+		else
+		{
+			// Source is moved
+			lSrcStartY += fabs(m_fYShift)+0.5;
+		};
 
-			PixelItTgt->Reset(lTgtStartX, lTgtStartY);
-			PixelItSrc->Reset(lSrcStartX, lSrcStartY);
+		PixelItTgt->Reset(lTgtStartX, lTgtStartY);
+		PixelItSrc->Reset(lSrcStartX, lSrcStartY);
 
-			for (j = 0;j<msg.lParam;j++)
+		for (j = 0;j<lCount;j++)
+		{
+			for (i = 0;i<lWidth;i++)
 			{
-				for (i = 0;i<lWidth;i++)
+				if (m_bMonochrome)
 				{
-					if (m_bMonochrome)
-					{
-						double			fSrcGray,
-										fTgtGray;
+					double			fSrcGray,
+									fTgtGray;
 
-						PixelItTgt->GetPixel(fTgtGray);
-						PixelItSrc->GetPixel(fSrcGray);
+					PixelItTgt->GetPixel(fTgtGray);
+					PixelItSrc->GetPixel(fSrcGray);
 
-						if (m_bAddMode)
-							fTgtGray = min(max(0.0, fTgtGray+fSrcGray * m_fGrayFactor), 256.0);
-						else
-							fTgtGray = max(m_fMinimum, fTgtGray-fSrcGray * m_fGrayFactor);
-						PixelItTgt->SetPixel(fTgtGray);
+					if (m_bAddMode)
+						fTgtGray = min(max(0.0, fTgtGray+fSrcGray * m_fGrayFactor), 256.0);
+					else
+						fTgtGray = max(m_fMinimum, fTgtGray-fSrcGray * m_fGrayFactor);
+					PixelItTgt->SetPixel(fTgtGray);
+				}
+				else
+				{
+					double			fSrcRed, fSrcGreen, fSrcBlue;
+					double			fTgtRed, fTgtGreen, fTgtBlue;
+
+					PixelItTgt->GetPixel(fTgtRed, fTgtGreen, fTgtBlue);
+					PixelItSrc->GetPixel(fSrcRed, fSrcGreen, fSrcBlue);
+					if (m_bAddMode)
+					{
+						fTgtRed		= min(max(0.0, fTgtRed + fSrcRed * m_fRedFactor), 256.0);
+						fTgtGreen	= min(max(0.0, fTgtGreen + fSrcGreen * m_fGreenFactor), 256.0);
+						fTgtBlue	= min(max(0.0, fTgtBlue + fSrcBlue * m_fBlueFactor), 256.0);
 					}
 					else
 					{
-						double			fSrcRed, fSrcGreen, fSrcBlue;
-						double			fTgtRed, fTgtGreen, fTgtBlue;
-
-						PixelItTgt->GetPixel(fTgtRed, fTgtGreen, fTgtBlue);
-						PixelItSrc->GetPixel(fSrcRed, fSrcGreen, fSrcBlue);
-						if (m_bAddMode)
-						{
-							fTgtRed		= min(max(0.0, fTgtRed + fSrcRed * m_fRedFactor), 256.0);
-							fTgtGreen	= min(max(0.0, fTgtGreen + fSrcGreen * m_fGreenFactor), 256.0);
-							fTgtBlue	= min(max(0.0, fTgtBlue + fSrcBlue * m_fBlueFactor), 256.0);
-						}
-						else
-						{
-							fTgtRed		= max(m_fMinimum, fTgtRed - fSrcRed * m_fRedFactor);
-							fTgtGreen	= max(m_fMinimum, fTgtGreen - fSrcGreen * m_fGreenFactor);
-							fTgtBlue	= max(m_fMinimum, fTgtBlue - fSrcBlue * m_fBlueFactor);
-						};
-						PixelItTgt->SetPixel(fTgtRed, fTgtGreen, fTgtBlue);
+						fTgtRed		= max(m_fMinimum, fTgtRed - fSrcRed * m_fRedFactor);
+						fTgtGreen	= max(m_fMinimum, fTgtGreen - fSrcGreen * m_fGreenFactor);
+						fTgtBlue	= max(m_fMinimum, fTgtBlue - fSrcBlue * m_fBlueFactor);
 					};
-
-					(*PixelItTgt)++;
-
-					(*PixelItSrc)++;
+					PixelItTgt->SetPixel(fTgtRed, fTgtGreen, fTgtBlue);
 				};
-				(*PixelItTgt)+=lExtraWidth;
 
-				(*PixelItSrc) += lExtraWidth;				
+				(*PixelItTgt)++;
+
+				(*PixelItSrc)++;
 			};
-			SetEvent(hEvent);
-		}
-		else if (msg.message == WM_MT_STOP)
-			bEnd = true;
+			(*PixelItTgt)+=lExtraWidth;
+
+			(*PixelItSrc) += lExtraWidth;				
+		};
 	};
 
 	return true;
@@ -1452,43 +1688,19 @@ bool CSubtractTask::Process()
 	bool			bResult = true;
 	LONG			lHeight = m_pTarget->RealHeight();
 	LONG			lStep;
-	LONG			lRemaining;
-	LONG			i = 0;
 
 	if (m_fYShift)
 		lHeight -= fabs(m_fYShift)+0.5;
 
 	if (m_pProgress)
-	{
 		m_pProgress->Start2(nullptr, lHeight);
-		m_pProgress->SetNrUsedProcessors(GetNrThreads());
-	};
 
-	bResult = true;
 	lStep = max(1L, lHeight/50);
-	lRemaining = lHeight;
-
-	while (i<lHeight)
-	{
-		DWORD			dwThreadId;
-		LONG			lAdd = min(lStep, lRemaining);
-
-		dwThreadId = GetAvailableThreadId();
-		PostThreadMessage(dwThreadId, WM_MT_PROCESS, i, lAdd);
-
-		i			+= lAdd;
-		lRemaining	-= lAdd;
 
-		if (m_pProgress)
-			m_pProgress->Progress2(nullptr, i);
-	};
+	bResult = ProcessChunks(0, lHeight, lStep, m_pProgress);
 
-	CloseAllThreads();
 	if (m_pProgress)
-	{
-		m_pProgress->SetNrUsedProcessors();
 		m_pProgress->End2();
-	};
 
 	return bResult;
 };
@@ -1646,61 +1858,51 @@ public :
 	};
 
 	virtual bool	Process();
-	virtual bool	DoTask(HANDLE hEvent);
+	virtual bool	DoTask();
 };
 
 /* ------------------------------------------------------------------- */
 
-bool	CMultiplyTask::DoTask(HANDLE hEvent)
+bool	CMultiplyTask::DoTask()
 {
 	ZFUNCTRACE_RUNTIME();
 	LONG			i, j;
-	bool			bEnd = false;
-	MSG				msg;
+	LONG			lStart, lCount;
 	LONG			lWidth = m_pTarget->RealWidth();
 
 	PixelIterator	PixelItTgt;
 
 	m_pTarget->GetIterator(&PixelItTgt);
 
-	// Create a message queue and signal the event
-	PeekMessage(&msg, nullptr, 0, 0, PM_NOREMOVE);
-	SetEvent(hEvent);
-	while (!bEnd && GetMessage(&msg, nullptr, 0, 0))
+	while (GetNextChunk(lStart, lCount))
 	{
-		if (msg.message == WM_MT_PROCESS)
+		PixelItTgt->Reset(0, lStart);
+		for (j = lStart;j<lStart+lCount;j++)
 		{
-			PixelItTgt->Reset(0, msg.wParam);
-			for (j = msg.wParam;j<msg.wParam+msg.lParam;j++)
+			for (i = 0;i<lWidth;i++)
 			{
-				for (i = 0;i<lWidth;i++)
+				if (m_bMonochrome)
 				{
-					if (m_bMonochrome)
-					{
-						double			fTgtGray;
+					double			fTgtGray;
 
-						PixelItTgt->GetPixel(fTgtGray);
-						fTgtGray = min(256.0, max(0.0, fTgtGray * m_fGrayFactor));
-						PixelItTgt->SetPixel(fTgtGray);
-					}
-					else
-					{
-						double			fTgtRed, fTgtGreen, fTgtBlue;
-
-						PixelItTgt->GetPixel(fTgtRed, fTgtGreen, fTgtBlue);
-						fTgtRed		= min(256.0, max(0.0, fTgtRed * m_fRedFactor));
-						fTgtGreen	= min(256.0, max(0.0, fTgtGreen * m_fGreenFactor));
-						fTgtBlue	= min(256.0, max(0.0, fTgtBlue * m_fBlueFactor));
-						PixelItTgt->SetPixel(fTgtRed, fTgtGreen, fTgtBlue);
-					};
+					PixelItTgt->GetPixel(fTgtGray);
+					fTgtGray = min(256.0, max(0.0, fTgtGray * m_fGrayFactor));
+					PixelItTgt->SetPixel(fTgtGray);
+				}
+				else
+				{
+					double			fTgtRed, fTgtGreen, fTgtBlue;
 
-					(*PixelItTgt)++;
+					PixelItTgt->GetPixel(fTgtRed, fTgtGreen, fTgtBlue);
+					fTgtRed		= min(256.0, max(0.0, fTgtRed * m_fRedFactor));
+					fTgtGreen	= min(256.0, max(0.0, fTgtGreen * m_fGreenFactor));
+					fTgtBlue	= min(256.0, max(0.0, fTgtBlue * m_fBlueFactor));
+					PixelItTgt->SetPixel(fTgtRed, fTgtGreen, fTgtBlue);
 				};
+
+				(*PixelItTgt)++;
 			};
-			SetEvent(hEvent);
-		}
-		else if (msg.message == WM_MT_STOP)
-			bEnd = true;
+		};
 	};
 
 	return true;
@@ -1714,40 +1916,16 @@ bool CMultiplyTask::Process()
 	bool			bResult = true;
 	LONG			lHeight = m_pTarget->RealHeight();
 	LONG			lStep;
-	LONG			lRemaining;
-	LONG			i = 0;
 
 	if (m_pProgress)
-	{
 		m_pProgress->Start2(nullptr, lHeight);
-		m_pProgress->SetNrUsedProcessors(GetNrThreads());
-	};
 
-	bResult = true;
 	lStep = max(1L, lHeight/50);
-	lRemaining = lHeight;
-
-	while (i<lHeight)
-	{
-		DWORD			dwThreadId;
-		LONG			lAdd = min(lStep, lRemaining);
 
-		dwThreadId = GetAvailableThreadId();
-		PostThreadMessage(dwThreadId, WM_MT_PROCESS, i, lAdd);
+	bResult = ProcessChunks(0, lHeight, lStep, m_pProgress);
 
-		i			+= lAdd;
-		lRemaining	-= lAdd;
-
-		if (m_pProgress)
-			m_pProgress->Progress2(nullptr, i);
-	};
-
-	CloseAllThreads();
 	if (m_pProgress)
-	{
-		m_pProgress->SetNrUsedProcessors();
 		m_pProgress->End2();
-	};
 
 	return bResult;
 };
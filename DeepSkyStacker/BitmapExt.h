@@ -5,6 +5,7 @@
 #include <QString>
 
 #include "Multitask.h"
+#include "avx_simd.h"
 #include <zexcept.h>
 #include "resource.h"
 
@@ -377,53 +378,78 @@ inline QString formatMethod(MULTIBITMAPPROCESSMETHOD Method, double fKappa, LONG
 
 /* ------------------------------------------------------------------- */
 
-class CBitmapPartFile
+class CBitmapPart
 {
 public :
-	CString						m_strFile;
 	LONG						m_lStartRow;
 	LONG						m_lEndRow;
-	LONG						m_lWidth;
-	LONG						m_lNrBitmaps;
+	__int64						m_llOffset;
+	bool						m_bInMemory;
 
-private :
-	void	CopyFrom(const CBitmapPartFile & bp)
+public :
+	CBitmapPart(LONG lStartRow, LONG lEndRow, __int64 llOffset, bool bInMemory)
 	{
-		m_strFile	= bp.m_strFile;
-		m_lStartRow = bp.m_lStartRow;
-		m_lEndRow	= bp.m_lEndRow;
-		m_lWidth	= bp.m_lWidth;
-		m_lNrBitmaps= bp.m_lNrBitmaps;
+		m_lStartRow = lStartRow;
+		m_lEndRow	= lEndRow;
+		m_llOffset	= llOffset;
+		m_bInMemory	= bInMemory;
 	};
 
+	LONG	GetNrRows() const
+	{
+		return m_lEndRow - m_lStartRow + 1;
+	};
+};
+
+typedef std::vector<CBitmapPart>	BITMAPPARTVECTOR;
+
+/* ------------------------------------------------------------------- */
+
+// Preallocated scratch area accessed through a single view: either committed
+// memory or a temporary file mapped in memory (deleted when closed).
+class CScratchStore
+{
+private :
+	HANDLE						m_hFile;
+	HANDLE						m_hMapping;
+	BYTE *						m_pView;
+	__int64						m_llSize;
+	CString						m_strFile;
+	bool						m_bInMemory;
+
+private :
+	CScratchStore(const CScratchStore &) = delete;
+	CScratchStore & operator = (const CScratchStore &) = delete;
+
 public :
-	CBitmapPartFile(LPCTSTR szFile, LONG lStartRow, LONG lEndRow)
+	CScratchStore() :
+		m_hFile(INVALID_HANDLE_VALUE),
+		m_hMapping(nullptr),
+		m_pView(nullptr),
+		m_llSize(0),
+		m_bInMemory(false)
 	{
-		m_strFile	= szFile;
-		m_lStartRow = lStartRow;
-		m_lEndRow	= lEndRow;
-        m_lWidth    = 0;
-        m_lNrBitmaps = 0;
 	};
 
-	CBitmapPartFile(const CBitmapPartFile & bp)
+	~CScratchStore()
 	{
-		CopyFrom(bp);
+		Close();
 	};
 
-	const CBitmapPartFile & operator = (const CBitmapPartFile & bp)
+	bool	Create(__int64 llSize, bool bInMemory);
+	void	Close();
+
+	BYTE *	GetView() const
 	{
-		CopyFrom(bp);
-		return (*this);
+		return m_pView;
 	};
 
-	virtual ~CBitmapPartFile()
+	__int64	GetSize() const
 	{
+		return m_llSize;
 	};
 };
 
-typedef std::vector<CBitmapPartFile>	BITMAPPARTFILEVECTOR;
-
 class CMultiBitmap : public CRefCount
 {
 protected :
@@ -434,7 +460,10 @@ protected :
 	LONG						m_lNrIterations;
 	LONG						m_lNrBitmaps;
 	LONG						m_lNrAddedBitmaps;
-	BITMAPPARTFILEVECTOR		m_vFiles;
+	BITMAPPARTVECTOR			m_vParts;
+	CScratchStore				m_MemoryStore;
+	CScratchStore				m_FileStore;
+	LONG						m_lScanLineSize;
 	LONG						m_lWidth,
 								m_lHeight;
 	bool						m_bInitDone;
@@ -444,9 +473,14 @@ protected :
 
 private :
 	void	DestroyTempFiles();
-	void	InitParts();
+	bool	InitParts();
 	void	SmoothOut(CMemoryBitmap * pBitmap, CMemoryBitmap ** ppOutBitmap);
 
+	BYTE *	GetPartBuffer(const CBitmapPart & bp) const
+	{
+		return (bp.m_bInMemory ? m_MemoryStore.GetView() : m_FileStore.GetView()) + bp.m_llOffset;
+	};
+
 public :
 	virtual bool	SetScanLines(CMemoryBitmap * pBitmap, LONG lLine, const std::vector<void*>	& vScanLines) = 0;
 
@@ -942,6 +976,14 @@ public :
 	virtual void	RemoveHotPixels(CDSSProgress * pProgress = nullptr) {};
 	virtual void	GetMedianFilterEngine(CMedianFilterEngine ** pMedianFilterEngine)  = 0;
 
+	// Interpolate once for all the colours returned by GetPixel (only for the CFA bitmaps).
+	// The cache is a snapshot of the pixels: build it once they are final and release it when done.
+	virtual bool	BuildDemosaicCache()
+	{
+		return false;
+	};
+	virtual void	ReleaseDemosaicCache() {};
+
 	virtual void	GetIterator(CPixelIterator ** ppIterator, LONG x = 0, LONG y = 0) = 0;
 	virtual double	GetMaximumValue()  =0;
 	virtual void	GetCharacteristics(CBitmapCharacteristics & bc) = 0;
@@ -951,6 +993,20 @@ typedef CSmartPtr<CMemoryBitmap::CPixelIterator>	PixelIterator;
 
 /* ------------------------------------------------------------------- */
 
+// Memory used by the demosaic caches of all the bitmaps.
+// A cache is not built when it would exceed the limit (it is only a speed up).
+class CDemosaicCacheBudget
+{
+public :
+	static bool		Reserve(size_t lSize);
+	static void		Release(size_t lSize);
+
+	static __int64	GetMemoryLimit();
+	static void		SetMemoryLimit(LONG lLimitMB);
+};
+
+/* ------------------------------------------------------------------- */
+
 bool Subtract(CMemoryBitmap * pTarget, CMemoryBitmap * pSource, CDSSProgress * pProgress = nullptr, double fRedFactor = 1.0, double fGreenFactor = 1.0, double fBlueFactor = 1.0);
 bool Add(CMemoryBitmap * pTarget, CMemoryBitmap * pSource, CDSSProgress * pProgress = nullptr);
 bool ShiftAndSubtract(CMemoryBitmap * pTarget, CMemoryBitmap * pSource, CDSSProgress * pProgress = nullptr, double fXShift = 0, double fYShift = 0);
@@ -1433,6 +1489,16 @@ protected :
 		}
 		pCurrentValue = pOutputScanLine;
 
+		if (m_Method == MBP_MEDIAN && !m_bHomogenization && !m_vImageOrder.size())
+		{
+			// Plain median: the pixels are processed by batches instead of one by one
+			LineMedian<TType>(vScanLines, 0, lWidth, 0, pOutputScanLine);
+
+			pBitmap->SetScanLine(lLine, pOutputScanLine);
+			free(pOutputScanLine);
+			return true;
+		};
+
 		vValues.reserve(vScanLines.size());
 		vAuxValues.reserve(vScanLines.size());
 		vWorkingBuffer1.reserve(vScanLines.size());
@@ -1657,56 +1723,45 @@ public :
 			m_pProgress = pProgress;
 		};
 
-		virtual bool	DoTask(HANDLE hEvent)
+		virtual bool	DoTask()
 		{
 			bool				bResult = true;
 
 			LONG					i, j;
-			bool					bEnd = false;
-			MSG						msg;
+			LONG					lStart, lCount;
 			LONG					lWidth = m_pBitmap->Width();
 			std::vector<size_t>		vHotOffsets;
 
-			// Create a message queue and signal the event
-			PeekMessage(&msg, nullptr, 0, 0, PM_NOREMOVE);
-			SetEvent(hEvent);
-			while (!bEnd && GetMessage(&msg, nullptr, 0, 0))
+			while (GetNextChunk(lStart, lCount))
 			{
-				if (msg.message == WM_MT_PROCESS)
+				for (j = lStart;j<lStart+lCount;j++)
 				{
-					for (j = msg.wParam;j<msg.wParam+msg.lParam;j++)
+					for (i = 2;i<lWidth-2;i++)
 					{
-						for (i = 2;i<lWidth-2;i++)
+						size_t				lOffset = m_pBitmap->GetOffset(i, j);
+						size_t				vOffsets[4];
+
+						vOffsets[0] = m_pBitmap->GetOffset(i-1, j);
+						vOffsets[1] = m_pBitmap->GetOffset(i+1, j);
+						vOffsets[2] = m_pBitmap->GetOffset(i, j+1);
+						vOffsets[3] = m_pBitmap->GetOffset(i, j-1);
+
+						TType				fValue = m_pBitmap->m_vPixels[lOffset];
+						bool				bHot = true;
+
+						for (LONG k = 0;k<4 && bHot;k++)
 						{
-							size_t				lOffset = m_pBitmap->GetOffset(i, j);
-							size_t				vOffsets[4];
-
-							vOffsets[0] = m_pBitmap->GetOffset(i-1, j);
-							vOffsets[1] = m_pBitmap->GetOffset(i+1, j);
-							vOffsets[2] = m_pBitmap->GetOffset(i, j+1);
-							vOffsets[3] = m_pBitmap->GetOffset(i, j-1);
-
-							TType				fValue = m_pBitmap->m_vPixels[lOffset];
-							bool				bHot = true;
-
-							for (LONG k = 0;k<4 && bHot;k++)
-							{
-								if (fValue <= 4.0 * m_pBitmap->m_vPixels[vOffsets[k]])
-									bHot = false;
-							};
-
-							if (bHot)
-							{
-								vHotOffsets.push_back(lOffset);
-								i++; // The next one cannot be a hot pixel
-							};
+							if (fValue <= 4.0 * m_pBitmap->m_vPixels[vOffsets[k]])
+								bHot = false;
 						};
-					};
 
-					SetEvent(hEvent);
-				}
-				else if (msg.message == WM_MT_STOP)
-					bEnd = true;
+						if (bHot)
+						{
+							vHotOffsets.push_back(lOffset);
+							i++; // The next one cannot be a hot pixel
+						};
+					};
+				};
 			};
 
 			// Add the vHotOffsets vector to the main one
@@ -1721,33 +1776,16 @@ public :
 		{
 			bool				bResult = true;
 			LONG				lHeight = m_pBitmap->Height()-4;
-			LONG				i = 2;
 			LONG				lStep;
-			LONG				lRemaining;
+			LONG				lEnd;
 
-			if (m_pProgress)
-				m_pProgress->SetNrUsedProcessors(GetNrThreads());
 			lStep		= max(1L, lHeight/50);
-			lRemaining	= lHeight;
 
-			while (i<lHeight)
-			{
-				LONG			lAdd = min(lStep, lRemaining);
-				DWORD			dwThreadId;
-
-				dwThreadId = GetAvailableThreadId();
-				PostThreadMessage(dwThreadId, WM_MT_PROCESS, i, lAdd);
-
-				i			+=lAdd;
-				lRemaining	-= lAdd;
-				if (m_pProgress)
-					m_pProgress->Progress2(nullptr, i);
-			};
+			// Same rows as before: chunks of lStep rows are started from row 2
+			// as long as their first row is below lHeight
+			lEnd		= min(2 + (lHeight - 2 + lStep - 1) / lStep * lStep, lHeight + 2);
 
-			CloseAllThreads();
-
-			if (m_pProgress)
-				m_pProgress->SetNrUsedProcessors();
+			bResult = ProcessChunks(2, lEnd, lStep, m_pProgress);
 
 			return bResult;
 		};
@@ -1768,10 +1806,12 @@ private :
 	bool				m_bDWord;
 	bool				m_bFloat;
 	double				m_fMultiplier;
+	std::vector<float>	m_vDemosaiced;		// Missing colours (RGB order) of the inner pixels, 2 planes
 
 private :
 	bool	InitInternals()
 	{
+		ReleaseDemosaicCache();
 		m_vPixels.clear();
 		m_vPixels.resize(m_lWidth * m_lHeight);
 
@@ -2053,13 +2093,21 @@ public :
 			m_fMultiplier = 256.0 * 65536.0;
 	};
 
-	virtual ~CGrayBitmapT() {};
+	virtual ~CGrayBitmapT()
+	{
+		ReleaseDemosaicCache();
+	};
 
 	void	SetMultiplier(double fMultiplier)
 	{
 		m_fMultiplier = fMultiplier;
 	};
 
+	double	GetMultiplier() const
+	{
+		return m_fMultiplier;
+	};
+
 	virtual bool	Init(LONG lWidth, LONG lHeight)
 	{
 		m_lWidth	= lWidth;
@@ -2137,6 +2185,7 @@ public :
 	virtual void SetValue(LONG i, LONG j, double fGray)
 	{
 		CheckXY(i, j);
+		ASSERT(m_vDemosaiced.empty());
 		m_vPixels[GetOffset(i, j)] = fGray;
 
 		return;
@@ -2252,6 +2301,33 @@ public :
 							fValue[CMYGZeroIndex(BAYER_GREEN2)]/m_fMultiplier,
 							fRed, fGreen, fBlue);
 			}
+			else if (!m_vDemosaiced.empty() && i > 0 && j > 0 && i < m_lWidth-1 && j < m_lHeight-1)
+			{
+				// Already interpolated by BuildDemosaicCache
+				const size_t	lOffset = GetOffset(i, j);
+				const double	fValue  = m_vPixels[lOffset]/m_fMultiplier;
+				const double	fFirst  = m_vDemosaiced[lOffset]/m_fMultiplier;
+				const double	fSecond = m_vDemosaiced[m_vPixels.size() + lOffset]/m_fMultiplier;
+
+				switch (::GetBayerColor(i, j, m_CFAType, m_xBayerOffset, m_yBayerOffset))
+				{
+				case BAYER_RED :
+					fRed	= fValue;
+					fGreen	= fFirst;
+					fBlue	= fSecond;
+					break;
+				case BAYER_GREEN :
+					fRed	= fFirst;
+					fGreen	= fValue;
+					fBlue	= fSecond;
+					break;
+				case BAYER_BLUE :
+					fRed	= fFirst;
+					fGreen	= fSecond;
+					fBlue	= fValue;
+					break;
+				};
+			}
 			else
 			{
 				TType *			pValue = &(m_vPixels[GetOffset(i, j)]);
@@ -2313,6 +2389,7 @@ public :
 
 		if (j<m_lHeight)
 		{
+			ReleaseDemosaicCache();
 			memcpy(&(m_vPixels[j*m_lWidth]), pScanLine, sizeof(TType)*m_lWidth);
 			bResult = true;
 		};
@@ -2382,12 +2459,72 @@ public :
 				pProgress->Progress2(nullptr, i+1);
 		};*/
 
+		if (HotPixelTask.m_vHotOffsets.size())
+			ReleaseDemosaicCache();
+
 		for (LONG i = 0;i<HotPixelTask.m_vHotOffsets.size();i++)
 		{
 			m_vPixels[HotPixelTask.m_vHotOffsets[i]] = 0;
 		};
 	};
 
+	virtual bool BuildDemosaicCache()
+	{
+		// Only the bilinear interpolation of the RGB Bayer matrices (the AHD interpolation
+		// falls back to it in GetPixel)
+		if (!m_bWord || m_bCYMG || m_lWidth < 3 || m_lHeight < 3 ||
+			((m_CFATransform != CFAT_BILINEAR) && (m_CFATransform != CFAT_AHD)))
+			return false;
+
+		if (!m_vDemosaiced.empty())
+			return true;
+
+		const size_t	lNrPixels = m_vPixels.size();
+		const size_t	lSize = 2 * lNrPixels * sizeof(float);
+
+		if (!CDemosaicCacheBudget::Reserve(lSize))
+			return false;
+
+		try
+		{
+			m_vDemosaiced.resize(2 * lNrPixels);
+		}
+		catch (const std::bad_alloc &)
+		{
+			m_vDemosaiced = std::vector<float>();
+			CDemosaicCacheBudget::Release(lSize);
+			return false;
+		};
+
+		// m_bWord: TType is WORD
+		const std::uint16_t *	pPixels = reinterpret_cast<const std::uint16_t *>(m_vPixels.data());
+		const auto				CfaBilinear = SimdKernels::get().cfaBilinear;
+
+		ParallelFor(1, m_lHeight-1, 16, [&](const LONG lStartRow, const LONG lEndRow)
+		{
+			for (LONG j = lStartRow; j < lEndRow; j++)
+			{
+				const size_t	lOffset = (size_t)m_lWidth * (size_t)j + 1;
+
+				CfaBilinear(pPixels + lOffset - m_lWidth, pPixels + lOffset, pPixels + lOffset + m_lWidth,
+							&m_vDemosaiced[lOffset], &m_vDemosaiced[lNrPixels + lOffset], m_lWidth - 2,
+							::GetBayerColor(1, j, m_CFAType, m_xBayerOffset, m_yBayerOffset) == BAYER_GREEN,
+							IsBayerBlueLine(j, m_CFAType, m_yBayerOffset));
+			};
+		});
+
+		return true;
+	};
+
+	virtual void ReleaseDemosaicCache()
+	{
+		if (!m_vDemosaiced.empty())
+		{
+			CDemosaicCacheBudget::Release(m_vDemosaiced.size() * sizeof(float));
+			m_vDemosaiced = std::vector<float>();
+		};
+	};
+
 	virtual void GetIterator(CPixelIterator ** ppIterator, LONG x = 0, LONG y = 0)
 	{
 		CSmartPtr<CPixelIterator>	pResult;
@@ -2488,6 +2625,7 @@ private :
 						m_lHeight;
 	LPBYTE*				m_pLine;
 	DWORD				m_dwByteWidth;
+	std::vector<CSmartPtr<C32BitsBitmap> >	m_vLevels;
 
 private :
 	void	InitInternals()
@@ -2614,6 +2752,7 @@ public :
 		if (m_pLine)
 			free(m_pLine);
 		m_pLine = nullptr;
+		m_vLevels.clear();
 	};
 
 	HBITMAP	Detach()
@@ -2664,6 +2803,33 @@ public :
 			*(LPDWORD)pPixel = *(LPDWORD)(&rgbq);
 		};
 	};
+
+	// Reduced copies of the bitmap used to draw it zoomed out (see BitmapPyramid.h).
+	// Level 0 is the bitmap itself, the levels are created empty and must be
+	// updated each time the bitmap is modified.
+	void	CreateLevels();
+	void	UpdateLevels();
+
+	LONG	GetNrLevels()
+	{
+		return static_cast<LONG>(m_vLevels.size()) + 1;
+	};
+
+	C32BitsBitmap *	GetLevel(LONG lLevel)
+	{
+		if (lLevel)
+			return m_vLevels[lLevel - 1];
+		else
+			return this;
+	};
+
+	// The reduced levels only (1 to GetNrLevels()-1) as expected by CWndImage::SetImgLevels
+	void	GetLevels(std::vector<HBITMAP> & vLevels)
+	{
+		vLevels.clear();
+		for (C32BitsBitmap * pLevel : m_vLevels)
+			vLevels.push_back(pLevel->GetHBITMAP());
+	};
 };
 
 class	CGammaTransformation
@@ -2758,6 +2924,20 @@ protected :
 		pGreenCurrentValue = pRedCurrentValue + lWidth;
 		pBlueCurrentValue  = pGreenCurrentValue + lWidth;
 
+		if (m_Method == MBP_MEDIAN && !m_bHomogenization && !m_vImageOrder.size())
+		{
+			// Plain median: the pixels are processed by batches instead of one by one
+			const int			nValueShift = (sizeof(TType) == 4 && std::is_integral<TType>::value) ? 16 : 0;
+
+			LineMedian<TType>(vScanLines, 0, lWidth, nValueShift, pRedCurrentValue);
+			LineMedian<TType>(vScanLines, lWidth, lWidth, nValueShift, pGreenCurrentValue);
+			LineMedian<TType>(vScanLines, 2 * static_cast<size_t>(lWidth), lWidth, nValueShift, pBlueCurrentValue);
+
+			pBitmap->SetScanLine(lLine, pOutputScanLine);
+			free(pOutputScanLine);
+			return true;
+		};
+
 		vRedValues.reserve(vScanLines.size());
 		vGreenValues.reserve(vScanLines.size());
 		vBlueValues.reserve(vScanLines.size());
@@ -3476,6 +3656,7 @@ public :
 	LONG				m_xBayerOffset;
 	LONG				m_yBayerOffset;
 	CString				m_filterName;
+	PICTUREFORMAT		m_Format;
 
 private :
 	void	CopyFrom(const CBitmapInfo & bi)
@@ -3503,6 +3684,7 @@ private :
 		m_xBayerOffset  =bi.m_xBayerOffset;
 		m_yBayerOffset	=bi.m_yBayerOffset;
 		m_filterName	=bi.m_filterName;
+		m_Format		=bi.m_Format;
 	};
 
     void Init()
@@ -3524,6 +3706,7 @@ private :
 		m_InfoTime = { 0 };
 		m_xBayerOffset = 0;
 		m_yBayerOffset = 0;
+		m_Format = PICTUREFORMAT_UNKNOWN;
     }
 
 public :
@@ -3672,9 +3855,10 @@ bool	LoadPicture(LPCTSTR szFileName, CAllDepthBitmap & AllDepthBitmap, CDSSProgr
 bool	DebayerPicture(CMemoryBitmap * pInBitmap, CMemoryBitmap ** ppOutBitmap, CDSSProgress * pProgress);
 
 #endif // DSSFILEDECODING
-bool	LoadPicture(LPCTSTR szFileName, CMemoryBitmap ** ppBitmap, CDSSProgress * pProgress);
+bool	LoadPicture(LPCTSTR szFileName, CMemoryBitmap ** ppBitmap, CDSSProgress * pProgress, PICTUREFORMAT Format = PICTUREFORMAT_UNKNOWN);
 
 bool	GetPictureInfo(LPCTSTR szFileName, CBitmapInfo & BitmapInfo);
+PICTUREFORMAT	GetPictureFormat(LPCTSTR szFileName);
 
 bool	GetFilteredImage(CMemoryBitmap * pInBitmap, CMemoryBitmap ** ppOutBitmap, LONG lFilterSize, CDSSProgress * pProgress = nullptr);
 
@@ -0,0 +1,111 @@
+#ifndef __BITMAPPYRAMID_H__
+#define __BITMAPPYRAMID_H__
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+/* ------------------------------------------------------------------- */
+
+// Multi-resolution (mip-map) pyramids of the preview bitmaps.
+//
+// Level 0 is the full resolution bitmap, each level is half the size of the
+// previous one (rounded up) and each of its pixels is the average of the 2x2
+// pixels of the previous level (the last row/column is repeated when the
+// size is odd).
+// The levels are created until the largest side of the next one would be
+// smaller than PYRAMIDMINSIZE, so that a zoomed out view never draws more
+// than about twice its size in pixels.
+
+const int	PYRAMIDMINSIZE = 256;
+
+inline int	GetNrPyramidLevels(int lWidth, int lHeight)
+{
+	int			lNrLevels = 1;
+
+	while (std::max((lWidth + 1) / 2, (lHeight + 1) / 2) >= PYRAMIDMINSIZE)
+	{
+		lWidth	= (lWidth + 1) / 2;
+		lHeight	= (lHeight + 1) / 2;
+		lNrLevels++;
+	};
+
+	return lNrLevels;
+};
+
+inline int	GetPyramidLevelSize(int lSize, int lLevel)
+{
+	for (int i = 0;i<lLevel;i++)
+		lSize = (lSize + 1) / 2;
+
+	return lSize;
+};
+
+/* ------------------------------------------------------------------- */
+
+// Level to draw with a zoom factor (screen pixels per bitmap pixel): the most
+// reduced level that still has at least one pixel per screen pixel
+inline int	GetPyramidLevel(double fZoom, int lNrLevels)
+{
+	int			lLevel = 0;
+
+	while (lLevel + 1 < lNrLevels && fZoom * static_cast<double>(1 << (lLevel + 1)) <= 1.0)
+		lLevel++;
+
+	return lLevel;
+};
+
+/* ------------------------------------------------------------------- */
+
+// Compute the rows [lStartRow, lEndRow) of the next level of a 32 bits per
+// pixel bitmap (4 bytes per pixel, each byte averaged on its own).
+// The strides are in bytes and may be negative (bottom-up bitmaps), so the
+// rows can be split between threads.
+inline void	ReducePyramidRows(const std::uint8_t * pIn, std::ptrdiff_t lInStride, int lInWidth, int lInHeight,
+							  std::uint8_t * pOut, std::ptrdiff_t lOutStride, int lStartRow, int lEndRow)
+{
+	const int	lOutWidth = (lInWidth + 1) / 2;
+
+	for (int j = lStartRow;j<lEndRow;j++)
+	{
+		const std::uint8_t *	pIn0 = pIn + lInStride * (2 * j);
+		const std::uint8_t *	pIn1 = pIn + lInStride * std::min(2 * j + 1, lInHeight - 1);
+		std::uint8_t *			pOutLine = pOut + lOutStride * j;
+
+		for (int i = 0;i<lOutWidth;i++)
+		{
+			const int	x0 = 8 * i;
+			const int	x1 = 4 * std::min(2 * i + 1, lInWidth - 1);
+
+			for (int k = 0;k<4;k++)
+				pOutLine[4 * i + k] = static_cast<std::uint8_t>((pIn0[x0 + k] + pIn0[x1 + k] + pIn1[x0 + k] + pIn1[x1 + k] + 2) / 4);
+		};
+	};
+};
+
+/* ------------------------------------------------------------------- */
+
+// Same for a plane of float values
+inline void	ReducePyramidRows(const float * pIn, int lInWidth, int lInHeight, float * pOut, int lStartRow, int lEndRow)
+{
+	const int	lOutWidth = (lInWidth + 1) / 2;
+
+	for (int j = lStartRow;j<lEndRow;j++)
+	{
+		const float *	pIn0 = pIn + static_cast<std::ptrdiff_t>(lInWidth) * (2 * j);
+		const float *	pIn1 = pIn + static_cast<std::ptrdiff_t>(lInWidth) * std::min(2 * j + 1, lInHeight - 1);
+		float *			pOutLine = pOut + static_cast<std::ptrdiff_t>(lOutWidth) * j;
+
+		for (int i = 0;i<lOutWidth;i++)
+		{
+			const int	x0 = 2 * i;
+			const int	x1 = std::min(2 * i + 1, lInWidth - 1);
+
+			pOutLine[i] = (pIn0[x0] + pIn0[x1] + pIn1[x0] + pIn1[x1]) * 0.25f;
+		};
+	};
+};
+
+/* ------------------------------------------------------------------- */
+
+#endif // __BITMAPPYRAMID_H__
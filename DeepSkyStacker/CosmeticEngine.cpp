@@ -118,72 +118,61 @@ public :
 		m_pProgress		= pProgress;
 	};
 
-	virtual bool	DoTask(HANDLE hEvent)
+	virtual bool	DoTask()
 	{
 		ZFUNCTRACE_RUNTIME();
 		bool					bResult = true;
 		LONG					i, j;
-		bool					bEnd = false;
-		MSG						msg;
+		LONG					lStart, lCount;
 		LONG					lWidth  = m_pBitmap->RealWidth(),
 								lHeight = m_pBitmap->RealHeight();
 		bool					bMonochrome = m_pBitmap->IsMonochrome();
 		LONG					lNrHotPixels = 0,
 								lNrColdPixels = 0;
 
-		// Create a message queue and signal the event
-		PeekMessage(&msg, nullptr, 0, 0, PM_NOREMOVE);
-		SetEvent(hEvent);
-		while (!bEnd && GetMessage(&msg, nullptr, 0, 0))
+		while (GetNextChunk(lStart, lCount))
 		{
-			if (msg.message == WM_MT_PROCESS)
+			for (j = lStart;j<lStart+lCount;j++)
 			{
-				for (j = msg.wParam;j<msg.wParam+msg.lParam;j++)
+				for (i = 0;i<lWidth;i++)
 				{
-					for (i = 0;i<lWidth;i++)
+					bool				bChanged = false;
+
+					if (bMonochrome)
 					{
-						bool				bChanged = false;
+						double			fGray,
+										fMedianGray;
+
+						m_pBitmap->GetPixel(i, j, fGray);
+						m_pMedian->GetPixel(i, j, fMedianGray);
 
-						if (bMonochrome)
-						{
-							double			fGray,
-											fMedianGray;
+						bChanged = AdjustPixel(fGray, fMedianGray);
+					}
+					else
+					{
+						double			fRed, fGreen, fBlue,
+										fMedianRed, fMedianGreen, fMedianBlue;
 
-							m_pBitmap->GetPixel(i, j, fGray);
-							m_pMedian->GetPixel(i, j, fMedianGray);
+						m_pBitmap->GetPixel(i, j, fRed, fGreen, fBlue);
+						m_pMedian->GetPixel(i, j, fMedianRed, fMedianGreen, fMedianBlue);
 
-							bChanged = AdjustPixel(fGray, fMedianGray);
-						}
+						bChanged = AdjustPixel(fRed, fMedianRed);
+						bChanged = AdjustPixel(fGreen, fMedianGreen) || bChanged;
+						bChanged = AdjustPixel(fBlue, fMedianBlue) || bChanged;
+					};
+
+					if (bChanged)
+					{
+						if (m_bHot)
+							lNrHotPixels++;
 						else
-						{
-							double			fRed, fGreen, fBlue,
-											fMedianRed, fMedianGreen, fMedianBlue;
-
-							m_pBitmap->GetPixel(i, j, fRed, fGreen, fBlue);
-							m_pMedian->GetPixel(i, j, fMedianRed, fMedianGreen, fMedianBlue);
-
-							bChanged = AdjustPixel(fRed, fMedianRed);
-							bChanged = AdjustPixel(fGreen, fMedianGreen) || bChanged;
-							bChanged = AdjustPixel(fBlue, fMedianBlue) || bChanged;
-						};
-
-						if (bChanged)
-						{
-							if (m_bHot)
-								lNrHotPixels++;
-							else
-								lNrColdPixels++;
-						};
-
-						if (m_pDelta && (bChanged || m_bInitDelta))
-							m_pDelta->SetPixel(i, j, bChanged ? (m_bHot ? 255 : 50) : 128);
+							lNrColdPixels++;
 					};
-				};
 
-				SetEvent(hEvent);
-			}
-			else if (msg.message == WM_MT_STOP)
-				bEnd = true;
+					if (m_pDelta && (bChanged || m_bInitDelta))
+						m_pDelta->SetPixel(i, j, bChanged ? (m_bHot ? 255 : 50) : 128);
+				};
+			};
 		};
 
 		m_CriticalSection.Lock();
@@ -198,33 +187,11 @@ public :
 		ZFUNCTRACE_RUNTIME();
 		bool				bResult = true;
 		LONG				lHeight = m_pBitmap->RealHeight();
-		LONG				i = 0;
 		LONG				lStep;
-		LONG				lRemaining;
 
-		if (m_pProgress)
-			m_pProgress->SetNrUsedProcessors(GetNrThreads());
 		lStep		= max(1L, lHeight/50);
-		lRemaining	= lHeight;
-
-		while (i<lHeight)
-		{
-			LONG			lAdd = min(lStep, lRemaining);
-			DWORD			dwThreadId;
-
-			dwThreadId = GetAvailableThreadId();
-			PostThreadMessage(dwThreadId, WM_MT_PROCESS, i, lAdd);
-
-			i			+=lAdd;
-			lRemaining	-= lAdd;
-			if (m_pProgress)
-				m_pProgress->Progress2(nullptr, i);
-		};
-
-		CloseAllThreads();
 
-		if (m_pProgress)
-			m_pProgress->SetNrUsedProcessors();
+		bResult = ProcessChunks(0, lHeight, lStep, m_pProgress);
 
 		return bResult;
 	};
@@ -332,49 +299,38 @@ public :
 		};
 	};
 
-	virtual bool	DoTask(HANDLE hEvent)
+	virtual bool	DoTask()
 	{
 		ZFUNCTRACE_RUNTIME();
 		bool					bResult = true;
 		LONG					i, j;
-		bool					bEnd = false;
-		MSG						msg;
+		LONG					lStart, lCount;
 		bool					bMonochrome = m_pOutBitmap->IsMonochrome();
 		bool					bCFA = m_pOutBitmap->IsCFA();
 
-		// Create a message queue and signal the event
-		PeekMessage(&msg, nullptr, 0, 0, PM_NOREMOVE);
-		SetEvent(hEvent);
-		while (!bEnd && GetMessage(&msg, nullptr, 0, 0))
+		while (GetNextChunk(lStart, lCount))
 		{
-			if (msg.message == WM_MT_PROCESS)
+			for (j = lStart;j<lStart+lCount;j++)
 			{
-				for (j = msg.wParam;j<msg.wParam+msg.lParam;j++)
+				for (i = 0;i<m_lWidth;i++)
 				{
-					for (i = 0;i<m_lWidth;i++)
+					bool				bChanged = false;
+					double				fDelta;
+
+					m_pDelta->GetPixel(i, j, fDelta);
+
+					if (fDelta > 200)
 					{
-						bool				bChanged = false;
-						double				fDelta;
-
-						m_pDelta->GetPixel(i, j, fDelta);
-
-						if (fDelta > 200)
-						{
-							// Hot pixel to fix
-							FixHotPixel(i, j);
-						}
-						else if (fDelta < 100)
-						{
-							// Cold pixel to fix
-							FixColdPixel(i, j);
-						};
+						// Hot pixel to fix
+						FixHotPixel(i, j);
+					}
+					else if (fDelta < 100)
+					{
+						// Cold pixel to fix
+						FixColdPixel(i, j);
 					};
 				};
-
-				SetEvent(hEvent);
-			}
-			else if (msg.message == WM_MT_STOP)
-				bEnd = true;
+			};
 		};
 
 		return true;
@@ -384,33 +340,11 @@ public :
 	{
 		ZFUNCTRACE_RUNTIME();
 		bool				bResult = true;
-		LONG				i = 0;
 		LONG				lStep;
-		LONG				lRemaining;
 
-		if (m_pProgress)
-			m_pProgress->SetNrUsedProcessors(GetNrThreads());
 		lStep		= max(1L, m_lHeight/50);
-		lRemaining	= m_lHeight;
-
-		while (i<m_lHeight)
-		{
-			LONG			lAdd = min(lStep, lRemaining);
-			DWORD			dwThreadId;
-
-			dwThreadId = GetAvailableThreadId();
-			PostThreadMessage(dwThreadId, WM_MT_PROCESS, i, lAdd);
-
-			i			+=lAdd;
-			lRemaining	-= lAdd;
-			if (m_pProgress)
-				m_pProgress->Progress2(nullptr, i);
-		};
-
-		CloseAllThreads();
 
-		if (m_pProgress)
-			m_pProgress->SetNrUsedProcessors();
+		bResult = ProcessChunks(0, m_lHeight, lStep, m_pProgress);
 
 		return bResult;
 	};
@@ -85,6 +85,15 @@ enum PICTURETYPE : short
 	PICTURETYPE_DARKFLATFRAME = 6
 };
 
+enum PICTUREFORMAT : short
+{
+	PICTUREFORMAT_UNKNOWN	= 0,		// Not identified, every loader is tried
+	PICTUREFORMAT_RAW		= 1,
+	PICTUREFORMAT_TIFF		= 2,
+	PICTUREFORMAT_FITS		= 3,
+	PICTUREFORMAT_OTHER		= 4			// JPEG, PNG, BMP, GIF (GDI+)
+};
+
 typedef enum TIFFFORMAT
 {
 	TF_UNKNOWN			= 0,
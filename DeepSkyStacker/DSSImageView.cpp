@@ -34,10 +34,17 @@
 **
 ****************************************************************************/
 #include <algorithm>
+using std::min;
+using std::max;
 #include <cmath>
 #include <iostream>
 
+#define _WIN32_WINNT _WIN32_WINNT_WIN7
+#include <windows.h>
+
 #include "dssimageview.h"
+#include "BitmapPyramid.h"
+#include "Multitask.h"
 
 #include <QCursor>
 #include <QDebug>
@@ -56,6 +63,37 @@
 constexpr int alpha = 155;
 constexpr qreal MAX_ZOOM = 7.25;
 
+namespace
+{
+    //
+    // Build the reduced levels of the image drawn when zoomed out (see BitmapPyramid.h).
+    // The rows of each level are computed by the thread pool (like C32BitsBitmap::UpdateLevels).
+    //
+    std::vector<QPixmap> buildPyramid(const QPixmap& pixmap)
+    {
+        std::vector<QPixmap> levels;
+        QImage previous{ pixmap.toImage().convertToFormat(QImage::Format_RGB32) };
+        const int nrLevels = GetNrPyramidLevels(previous.width(), previous.height());
+
+        for (int level = 1; level < nrLevels; ++level)
+        {
+            QImage image((previous.width() + 1) / 2, (previous.height() + 1) / 2, QImage::Format_RGB32);
+            const uchar* const in = previous.constBits();
+            uchar* const out = image.bits();
+
+            ParallelFor(0, image.height(), 16, [&](LONG start, LONG end)
+                {
+                    ReducePyramidRows(in, previous.bytesPerLine(), previous.width(), previous.height(),
+                        out, image.bytesPerLine(), start, end);
+                });
+
+            levels.push_back(QPixmap::fromImage(image));
+            previous = std::move(image);
+        }
+        return levels;
+    }
+}
+
 DSSImageView::DSSImageView(QWidget* parent)
     : QWidget(parent),
     m_scale(1.0),
@@ -155,9 +193,20 @@ void DSSImageView::drawOnPixmap()
         painter.translate(-m_origin);
 
         //
-        // Draw the rectangle of interest at the origin location
+        // Draw the rectangle of interest at the origin location, from the
+        // reduced level matching the zoom when zoomed out
         //
-        painter.drawPixmap(m_origin, *pPixmap, rectOfInterest);
+        const int level = GetPyramidLevel(m_zoom * m_scale, static_cast<int>(m_pyramid.size()) + 1);
+        if (0 == level)
+        {
+            painter.drawPixmap(m_origin, *pPixmap, rectOfInterest);
+        }
+        else
+        {
+            const qreal levelScale = static_cast<qreal>(1 << level);
+            painter.drawPixmap(QRectF(m_origin, rectOfInterest.size()), m_pyramid[level - 1],
+                QRectF(rectOfInterest.topLeft() / levelScale, rectOfInterest.size() / levelScale));
+        }
         painter.restore();
 
         //
@@ -408,6 +457,9 @@ void DSSImageView::paintZoomImage(QPainter& painter)
 void DSSImageView::setPixmap(const std::shared_ptr<QPixmap>& p)
 {
     pPixmap = p;
+    m_pyramid.clear();
+    if (nullptr != pPixmap && !pPixmap->isNull())
+        m_pyramid = buildPyramid(*pPixmap);
     drawOnPixmap();
     update();
 }
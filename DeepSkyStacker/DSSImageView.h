@@ -41,6 +41,7 @@ class QRubberBand;
 class QToolBar;
 class QWheelEvent;
 
+#include <vector>
 #include <QtWidgets/QWidget>
 #include <QDebug>
 
@@ -133,6 +134,7 @@ private:
     qreal m_scale, m_zoom;
     QPointF m_origin;
     std::shared_ptr<QPixmap> pPixmap;
+    std::vector<QPixmap> m_pyramid;     // Reduced levels of pPixmap, each half the size of the previous one
     std::shared_ptr<QPixmap> pOverlayPixmap;
     QPixmap m_drawingPixmap;
     QRectF rectOfInterest;
@@ -415,7 +415,7 @@ double Median(std::vector<T>& values)
 
     const int size = static_cast<int>(values.size());
 
-	return qMedian(values.data(), size, size / 2);
+	return FastMedian(values.data(), size);
 /*
     // benchmarked: at around 40 elements, partial sort stars becoming faster
     // O(N) or O(2*N) for even count vs O(N*log(N))
@@ -982,7 +982,7 @@ double	KappaSigmaClip(const std::vector<T> & vValues, double fKappa, LONG lItera
 	//
 	vAuxValues = vValues;
 
-	std::sort(vAuxValues.begin(), vAuxValues.end());
+	FastSort(vAuxValues.data(), static_cast<int>(vAuxValues.size()));
 
 	FillDynamicStat(vAuxValues, DynStats);
 
@@ -1719,14 +1719,13 @@ public :
 		m_RGBHistogram.SetSize(256.0, (LONG)65535);
 	};
 
-	virtual bool	DoTask(HANDLE hEvent)
+	virtual bool	DoTask()
 	{
 		ZFUNCTRACE_RUNTIME();
 		bool				bResult = true;
 
 		LONG				i, j;
-		bool				bEnd = false;
-		MSG					msg;
+		LONG				lStart, lCount;
 		LONG				lWidth = m_pBitmap->RealWidth();
 
 		CRGBHistogram		RGBHistogram;
@@ -1736,40 +1735,30 @@ public :
 
 		m_pBitmap->GetIterator(&PixelIt);
 
-		// Create a message queue and signal the event
-		PeekMessage(&msg, nullptr, 0, 0, PM_NOREMOVE);
-		SetEvent(hEvent);
-		while (!bEnd && GetMessage(&msg, nullptr, 0, 0))
+		while (GetNextChunk(lStart, lCount))
 		{
-			if (msg.message == WM_MT_PROCESS)
+			PixelIt->Reset(0, lStart);
+			for (j = lStart;j<lStart+lCount;j++)
 			{
-				PixelIt->Reset(0, msg.wParam);
-				for (j = msg.wParam;j<msg.wParam+msg.lParam;j++)
+				for (i = 0;i<lWidth;i++)
 				{
-					for (i = 0;i<lWidth;i++)
-					{
-						double			fRed, fGreen, fBlue, fGray;
+					double			fRed, fGreen, fBlue, fGray;
 
-						if (m_bMonochrome)
-						{
-							PixelIt->GetPixel(fGray);
-							//m_pBitmap->GetPixel(i, j, fGray);
-							RGBHistogram.AddValues(fGray, fGray, fGray);
-						}
-						else
-						{
-							PixelIt->GetPixel(fRed, fGreen, fBlue);
-							//m_pBitmap->GetPixel(i, j, fRed, fGreen, fBlue);
-							RGBHistogram.AddValues(fRed, fGreen, fBlue);
-						};
-						(*PixelIt)++;
+					if (m_bMonochrome)
+					{
+						PixelIt->GetPixel(fGray);
+						//m_pBitmap->GetPixel(i, j, fGray);
+						RGBHistogram.AddValues(fGray, fGray, fGray);
+					}
+					else
+					{
+						PixelIt->GetPixel(fRed, fGreen, fBlue);
+						//m_pBitmap->GetPixel(i, j, fRed, fGreen, fBlue);
+						RGBHistogram.AddValues(fRed, fGreen, fBlue);
 					};
+					(*PixelIt)++;
 				};
-
-				SetEvent(hEvent);
-			}
-			else if (msg.message == WM_MT_STOP)
-				bEnd = true;
+			};
 		};
 
 		m_CriticalSection.Lock();
@@ -1783,33 +1772,11 @@ public :
 		ZFUNCTRACE_RUNTIME();
 		bool				bResult = true;
 		LONG				lHeight = m_pBitmap->RealHeight();
-		LONG				i = 0;
 		LONG				lStep;
-		LONG				lRemaining;
 
-		if (m_pProgress)
-			m_pProgress->SetNrUsedProcessors(GetNrThreads());
 		lStep		= max(1L, lHeight/50);
-		lRemaining	= lHeight;
-
-		while (i<lHeight)
-		{
-			LONG			lAdd = min(lStep, lRemaining);
-			DWORD			dwThreadId;
 
-			dwThreadId = GetAvailableThreadId();
-			PostThreadMessage(dwThreadId, WM_MT_PROCESS, i, lAdd);
-
-			i			+=lAdd;
-			lRemaining	-= lAdd;
-			if (m_pProgress)
-				m_pProgress->Progress2(nullptr, i);
-		};
-
-		CloseAllThreads();
-
-		if (m_pProgress)
-			m_pProgress->SetNrUsedProcessors();
+		bResult = ProcessChunks(0, lHeight, lStep, m_pProgress);
 
 		return bResult;
 	};
@@ -2098,19 +2065,13 @@ void	CDarkFrame::InterpolateHotPixels(CMemoryBitmap * pBitmap, CDSSProgress * pP
 
 /* ------------------------------------------------------------------- */
 
-bool	CDarkFrame::Subtract(CMemoryBitmap * pTarget, CDSSProgress * pProgress)
+void	CDarkFrame::GetSubtractions(CMemoryBitmap * pTarget, DARKSUBTRACTIONVECTOR & vSubtractions, CDSSProgress * pProgress)
 {
 	ZFUNCTRACE_RUNTIME();
-	bool				bResult = true;
 
+	vSubtractions.clear();
 	if (m_pMasterDark && m_pMasterDark->IsOk())
 	{
-		CString			strText;
-
-		double			fRedDarkFactor = 1.0,
-						fGreenDarkFactor = 1.0,
-						fBlueDarkFactor = 1.0;
-
 		if ((m_bHotPixelsDetection || m_bBadLinesDetection) && !m_bHotPixelDetected)
 		{
 			if (m_bHotPixelsDetection)
@@ -2121,6 +2082,7 @@ bool	CDarkFrame::Subtract(CMemoryBitmap * pTarget, CDSSProgress * pProgress)
 
 		if (m_bDarkOptimization)
 		{
+			CString				strText;
 			double				fHotDark = 1.0,
 								fAmpGlow = 1.0;
 
@@ -2132,47 +2094,38 @@ bool	CDarkFrame::Subtract(CMemoryBitmap * pTarget, CDSSProgress * pProgress)
 				strText.LoadString(IDS_OPTIMIZINGDARKMATCHING);
 				pProgress->Start2(strText, 0);
 			};
+			// The factors depend on the target: it must already be offset subtracted
 			ComputeDarkFactorFromMedian(pTarget, fHotDark, fAmpGlow, pProgress);
-			/*CSmartPtr<CMemoryBitmap>		pAmpGlow;
-			CSmartPtr<CMemoryBitmap>		pDarkCurrent;
 
-			pAmpGlow.Attach(m_pAmpGlow->Clone());
-			Multiply(pAmpGlow, fAmpGlow, fAmpGlow, fAmpGlow, pProgress);*/
+			vSubtractions.emplace_back(m_pAmpGlow, fAmpGlow);
+			vSubtractions.emplace_back(m_pDarkCurrent, fHotDark);
+		}
+		else
+			vSubtractions.emplace_back(m_pMasterDark, m_fDarkFactor);
+	};
+};
 
-			if (pProgress)
-			{
-				strText.LoadString(IDS_SUBSTRACTINGDARK);
-				pProgress->Start2(strText, 0);
-			};
-			::Subtract(pTarget, m_pAmpGlow, pProgress, fAmpGlow, fAmpGlow, fAmpGlow);
-			::Subtract(pTarget, m_pDarkCurrent, pProgress, fHotDark, fHotDark, fHotDark);
+/* ------------------------------------------------------------------- */
 
-			// Now check that if modified dark current is removed from
-			// the target - there is no more negative pixels
-			/*pDarkCurrent.Attach(m_pDarkCurrent->Clone());
-			Multiply(pDarkCurrent, fHotDark, fHotDark, fHotDark, pProgress);
+bool	CDarkFrame::Subtract(CMemoryBitmap * pTarget, CDSSProgress * pProgress)
+{
+	ZFUNCTRACE_RUNTIME();
+	bool				bResult = true;
 
-			ComputeOptimalDistributionRatio(pTarget, pDarkCurrent, fHotDark, pProgress);
-			::Subtract(pTarget, pDarkCurrent, pProgress, fHotDark, fHotDark, fHotDark);*/
-		}
-		else if (m_fDarkFactor != 1.0)
-		{
-			if (pProgress)
-			{
-				strText.LoadString(IDS_SUBSTRACTINGDARK);
-				pProgress->Start2(strText, 0);
-			};
-			::Subtract(pTarget, m_pMasterDark, pProgress, m_fDarkFactor, m_fDarkFactor, m_fDarkFactor);
-		}
-		else
+	if (m_pMasterDark && m_pMasterDark->IsOk())
+	{
+		CString					strText;
+		DARKSUBTRACTIONVECTOR	vSubtractions;
+
+		GetSubtractions(pTarget, vSubtractions, pProgress);
+
+		if (pProgress)
 		{
-			if (pProgress)
-			{
-				strText.LoadString(IDS_SUBSTRACTINGDARK);
-				pProgress->Start2(strText, 0);
-			};
-			::Subtract(pTarget, m_pMasterDark, pProgress);
+			strText.LoadString(IDS_SUBSTRACTINGDARK);
+			pProgress->Start2(strText, 0);
 		};
+		for (const CDarkSubtraction & Subtraction : vSubtractions)
+			::Subtract(pTarget, Subtraction.m_pDark, pProgress, Subtraction.m_fFactor, Subtraction.m_fFactor, Subtraction.m_fFactor);
 	};
 
 	return bResult;
@@ -154,6 +154,24 @@ typedef EXCLUDEDPIXELSET::iterator			EXCLUDEDPIXELITERATOR;
 
 /* ------------------------------------------------------------------- */
 
+class CDarkSubtraction
+{
+public :
+	CMemoryBitmap *				m_pDark;
+	double						m_fFactor;
+
+public :
+	CDarkSubtraction(CMemoryBitmap * pDark = nullptr, double fFactor = 1.0) :
+		m_pDark(pDark),
+		m_fFactor(fFactor)
+	{
+	};
+};
+
+typedef std::vector<CDarkSubtraction>		DARKSUBTRACTIONVECTOR;
+
+/* ------------------------------------------------------------------- */
+
 class CDarkFrameHotParameters
 {
 public :
@@ -318,6 +336,7 @@ public :
 	};
 
 	bool	Subtract(CMemoryBitmap * pTarget, CDSSProgress * pProgress = nullptr);
+	void	GetSubtractions(CMemoryBitmap * pTarget, DARKSUBTRACTIONVECTOR & vSubtractions, CDSSProgress * pProgress = nullptr);
 
 	void	InterpolateHotPixels(CMemoryBitmap * pBitmap, CDSSProgress * pProgress = nullptr);
 
@@ -325,6 +344,11 @@ public :
 	{
 		return (m_pMasterDark != nullptr);
 	};
+
+	bool	GetDarkOptimization() const
+	{
+		return m_bDarkOptimization;
+	};
 };
 
 #endif // __DARKFRAME_H__
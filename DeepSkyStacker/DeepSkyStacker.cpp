@@ -339,6 +339,8 @@ int WINAPI _tWinMain(HINSTANCE hInstance,  // handle to current instance
 		QCoreApplication::setApplicationName("DeepSkyStacker5");
 		QCoreApplication::setAttribute(Qt::AA_UseHighDpiPixmaps);
 
+		CMultitask::LoadSettings();
+
 		QApplication* app = qApp;
 
 		//
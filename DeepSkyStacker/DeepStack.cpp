@@ -130,10 +130,14 @@ bool CDeepStack::LoadStackedInfo(LPCTSTR szStackedInfoFile)
 	ZFUNCTRACE_RUNTIME();
 	bool				bResult;
 
+	m_Rendering.Cancel();
 	bResult = m_StackedBitmap.Load(szStackedInfoFile, m_pProgress);
 
 	if (bResult)
+	{
 		ComputeOriginalHistogram(m_OriginalHisto);
+		m_StackedBitmap.BuildLevels();
+	};
 
 	return bResult;
 };
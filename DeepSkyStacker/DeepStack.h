@@ -11,6 +11,7 @@
 #include "StackedBitmap.h"
 #include "DSSProgress.h"
 #include "RegisterEngine.h"
+#include "BackgroundRendering.h"
 
 #ifndef PI
 #define PI 3.141592654
@@ -27,6 +28,7 @@ private :
 	C32BitsBitmap			m_Bitmap;
 	bool					m_bNewStackedBitmap;
 	CDSSProgress *			m_pProgress;
+	CBackgroundRendering	m_Rendering;		// Uses m_StackedBitmap and m_Bitmap: destroyed first
 
 public :
 	CDeepStack()
@@ -38,6 +40,7 @@ public :
 
 	void	Clear()
 	{
+		m_Rendering.Cancel();
 		m_StackedBitmap.Clear();
 		m_Bitmap.Free();
 		m_OriginalHisto.Clear();
@@ -77,14 +80,48 @@ public :
 	void	SaveStackedInfo(LPCTSTR szStackedInfoFile, LPRECT pRect = nullptr);
 	bool	LoadStackedInfo(LPCTSTR szStackedInfoFile);
 
-	HBITMAP PartialProcess(RECT rcProcess, const CBezierAdjust & BezierAdjust, const CRGBHistogramAdjust & HistogramAdjust)
+	// The preview bitmap and its reduced levels (created on the first call)
+	HBITMAP	GetProcessBitmap(std::vector<HBITMAP> & vLevels)
 	{
 		if (m_Bitmap.IsEmpty())
+		{
 			m_Bitmap.Create(GetWidth(), GetHeight());
+			m_Bitmap.CreateLevels();
+		};
+		m_Bitmap.GetLevels(vLevels);
+		return m_Bitmap.GetHBITMAP();
+	};
+
+	// Start the rendering of the rectangles (full resolution coordinates) at
+	// the level lLevel of the preview bitmap in the background (the part in
+	// rcVisible first).
+	// With bNewSettings the tiles still to render for the previous settings are
+	// dropped, otherwise the level is rendered after the pending ones.
+	void	StartProcess(const std::vector<CRect> & vRects, const CRect & rcVisible, LONG lLevel, bool bNewSettings, const CBezierAdjust & BezierAdjust, const CRGBHistogramAdjust & HistogramAdjust)
+	{
+		std::vector<HBITMAP>	vLevels;
+
+		GetProcessBitmap(vLevels);
+		lLevel = max(0L, min(lLevel, min(m_Bitmap.GetNrLevels(), m_StackedBitmap.GetNrLevels()) - 1));
+
+		if (bNewSettings)
+		{
+			m_StackedBitmap.SetBezierAdjust(BezierAdjust);
+			m_StackedBitmap.SetHistogramAdjust(HistogramAdjust);
+			m_Rendering.Start(m_StackedBitmap, m_Bitmap, BezierAdjust, HistogramAdjust, vRects, rcVisible, lLevel);
+		}
+		else
+			m_Rendering.Add(vRects, rcVisible, lLevel);
+	};
 
-		m_StackedBitmap.SetBezierAdjust(BezierAdjust);
-		m_StackedBitmap.SetHistogramAdjust(HistogramAdjust);
-		return m_StackedBitmap.GetBitmap(m_Bitmap, &rcProcess);
+	bool	IsProcessUpdated()
+	{
+		return m_Rendering.IsUpdated();
+	};
+
+	float	GetProcessPercentage()
+	{
+		return m_Rendering.GetPercentageComplete();
 	};
 
 	CStackedBitmap & GetStackedBitmap()
@@ -2,6 +2,8 @@
 #include "EntropyInfo.h"
 #include "DSSProgress.h"
 #include "avx_entropy.h"
+#include <atomic>
+#include <thread>
 /* ------------------------------------------------------------------- */
 
 void CEntropyInfo::InitSquareEntropies()
@@ -23,42 +25,56 @@ void CEntropyInfo::InitSquareEntropies()
 	m_vBlueEntropies.resize(m_lNrSquaresX*m_lNrSquaresY);
 
 	if (m_pProgress)
-		m_pProgress->Start2(nullptr, m_lNrSquaresX);
+		m_pProgress->Start2(nullptr, m_lNrSquaresY);
 
 	AvxEntropy avxEntropy(*m_pBitmap, *this, nullptr);
 	if (avxEntropy.calcEntropies(lSquareSize, m_lNrSquaresX, m_lNrSquaresY, m_vRedEntropies, m_vGreenEntropies, m_vBlueEntropies) != 0)
 	{
-		for (long i = 0; i < m_lNrSquaresX; i++)
-		{
-			LONG			lMinX,
-				lMaxX;
-
-			lMinX = i * lSquareSize;
-			lMaxX = min((i + 1) * lSquareSize - 1, m_pBitmap->Width() - 1);
+		const std::thread::id		MainThreadId = std::this_thread::get_id();
+		std::atomic<LONG>			lNrRowsDone(0);
 
-			for (long j = 0; j < m_lNrSquaresY; j++)
+		ParallelFor(0, m_lNrSquaresY, 4, [&](const LONG lStartRow, const LONG lEndRow)
+		{
+			// Reused for all the squares of the chunk - the histograms are cleared
+			// by ComputeEntropies (only the used entries)
+			std::vector<COLORREF16>		vPixels;
+			std::vector<LONG>			vRedHisto((LONG)MAXWORD+1);
+			std::vector<LONG>			vGreenHisto((LONG)MAXWORD+1);
+			std::vector<LONG>			vBlueHisto((LONG)MAXWORD+1);
+
+			for (LONG j = lStartRow;j<lEndRow;j++)
 			{
 				LONG		lMinY,
-					lMaxY;
-				double		fRedEntropy,
-					fGreenEntropy,
-					fBlueEntropy;
+							lMaxY;
 
 				lMinY = j * lSquareSize;
 				lMaxY = min((j + 1) * lSquareSize - 1, m_pBitmap->Height() - 1);
-				// Compute the entropy for this square
-				ComputeEntropies(lMinX, lMinY, lMaxX, lMaxY, fRedEntropy, fGreenEntropy, fBlueEntropy);
 
-				m_vRedEntropies[i + j * m_lNrSquaresX] = fRedEntropy;
-				m_vGreenEntropies[i + j * m_lNrSquaresX] = fGreenEntropy;
-				m_vBlueEntropies[i + j * m_lNrSquaresX] = fBlueEntropy;
+				for (LONG i = 0;i<m_lNrSquaresX;i++)
+				{
+					LONG		lMinX,
+								lMaxX;
+					double		fRedEntropy,
+								fGreenEntropy,
+								fBlueEntropy;
+
+					lMinX = i * lSquareSize;
+					lMaxX = min((i + 1) * lSquareSize - 1, m_pBitmap->Width() - 1);
+
+					// Compute the entropy for this square
+					ComputeEntropies(lMinX, lMinY, lMaxX, lMaxY, vPixels, vRedHisto, vGreenHisto, vBlueHisto, fRedEntropy, fGreenEntropy, fBlueEntropy);
+
+					m_vRedEntropies[i + j * m_lNrSquaresX] = fRedEntropy;
+					m_vGreenEntropies[i + j * m_lNrSquaresX] = fGreenEntropy;
+					m_vBlueEntropies[i + j * m_lNrSquaresX] = fBlueEntropy;
+				};
 			};
 
-			if (m_pProgress)
-				if (0 == i % m_lWindowSize)
-					m_pProgress->Progress2(nullptr, 1 + i);
-		};
-	}
+			lNrRowsDone += lEndRow - lStartRow;
+			if (m_pProgress && std::this_thread::get_id() == MainThreadId)
+				m_pProgress->Progress2(nullptr, lNrRowsDone);
+		});
+	};
 
 	if (m_pProgress)
 		m_pProgress->End2();
@@ -66,12 +82,8 @@ void CEntropyInfo::InitSquareEntropies()
 
 /* ------------------------------------------------------------------- */
 
-void CEntropyInfo::ComputeEntropies(LONG lMinX, LONG lMinY, LONG lMaxX, LONG lMaxY, double & fRedEntropy, double & fGreenEntropy, double & fBlueEntropy)
+void CEntropyInfo::ComputeEntropies(LONG lMinX, LONG lMinY, LONG lMaxX, LONG lMaxY, std::vector<COLORREF16> & vPixels, std::vector<LONG> & vRedHisto, std::vector<LONG> & vGreenHisto, std::vector<LONG> & vBlueHisto, double & fRedEntropy, double & fGreenEntropy, double & fBlueEntropy)
 {
-	LONG						i, j;
-	std::vector<WORD>			vRedHisto;
-	std::vector<WORD>			vGreenHisto;
-	std::vector<WORD>			vBlueHisto;
 	LONG						lNrPixels;
 
 	fRedEntropy = 0.0;
@@ -79,41 +91,155 @@ void CEntropyInfo::ComputeEntropies(LONG lMinX, LONG lMinY, LONG lMaxX, LONG lMa
 	fBlueEntropy = 0.0;
 
 	lNrPixels = (lMaxX-lMinX+1)*(lMaxY-lMinY+1);
-	vRedHisto.resize((LONG)MAXWORD+1);
-	vGreenHisto.resize((LONG)MAXWORD+1);
-	vBlueHisto.resize((LONG)MAXWORD+1);
 
-	COLORREF16		crColor;
-	for (i = lMinX;i<=lMaxX;i++)
+	// Read the pixels once
+	vPixels.resize(0);
+	for (LONG j = lMinY;j<=lMaxY;j++)
 	{
-		for (j = lMinY;j<=lMaxY;j++)
+		for (LONG i = lMinX;i<=lMaxX;i++)
 		{
+			COLORREF16		crColor;
+
 			m_pBitmap->GetPixel16(i, j, crColor);
+			vPixels.push_back(crColor);
 			vRedHisto[crColor.red]++;
 			vGreenHisto[crColor.green]++;
 			vBlueHisto[crColor.blue]++;
 		};
 	};
 
-	for (i = lMinX;i<=lMaxX;i++)
+	for (const COLORREF16 & crColor : vPixels)
 	{
-		for (j = lMinY;j<=lMaxY;j++)
-		{
-			double			qRed,
-							qBlue,
-							qGreen;
+		double			qRed,
+						qBlue,
+						qGreen;
 
-			m_pBitmap->GetPixel16(i, j, crColor);
+		qRed	= (double)vRedHisto[crColor.red]/(double)lNrPixels;
+		qGreen	= (double)vGreenHisto[crColor.green]/(double)lNrPixels;
+		qBlue	= (double)vBlueHisto[crColor.blue]/(double)lNrPixels;
+
+		fRedEntropy += -qRed * log(qRed)/log(2.0);
+		fGreenEntropy += -qGreen * log(qGreen)/log(2.0);
+		fBlueEntropy += -qBlue * log(qBlue)/log(2.0);
+	};
 
-			qRed	= (double)vRedHisto[crColor.red]/(double)lNrPixels;
-			qGreen	= (double)vGreenHisto[crColor.green]/(double)lNrPixels;
-			qBlue	= (double)vBlueHisto[crColor.blue]/(double)lNrPixels;
+	// Leave the histograms empty for the next square
+	for (const COLORREF16 & crColor : vPixels)
+	{
+		vRedHisto[crColor.red]		= 0;
+		vGreenHisto[crColor.green]	= 0;
+		vBlueHisto[crColor.blue]	= 0;
+	};
+};
+
+/* ------------------------------------------------------------------- */
+
+void CEntropyInfo::InitPixelEntropies()
+{
+	ZFUNCTRACE_RUNTIME();
+	const LONG			lWidth = m_pBitmap->Width();
+	const LONG			lHeight = m_pBitmap->Height();
+	const bool			bColor = !m_pBitmap->IsMonochrome() || m_pBitmap->IsCFA();
+
+	// The stacking reads the entropies of each pixel of each frame: interpolate
+	// them once. The rows are padded (with the last pixel) to a multiple of 16
+	// pixels so that the vectorised code can read whole vectors.
+	m_lPixelStride = (lWidth + 15) & ~15L;
+
+	const size_t		lSize = (size_t)m_lPixelStride * (size_t)lHeight;
+
+	m_vRedPixelEntropies.resize(lSize);
+	m_vGreenPixelEntropies.resize(bColor ? lSize : 0);
+	m_vBluePixelEntropies.resize(bColor ? lSize : 0);
+
+	ParallelFor(0, lHeight, 16, [&](const LONG lStartRow, const LONG lEndRow)
+	{
+		for (LONG j = lStartRow;j<lEndRow;j++)
+		{
+			const size_t		lOffset = (size_t)m_lPixelStride * (size_t)j;
 
-			fRedEntropy += -qRed * log(qRed)/log(2.0);
-			fGreenEntropy += -qGreen * log(qGreen)/log(2.0);
-			fBlueEntropy += -qBlue * log(qBlue)/log(2.0);
+			for (LONG i = 0;i<m_lPixelStride;i++)
+			{
+				double			fRedEntropy,
+								fGreenEntropy,
+								fBlueEntropy;
+
+				ComputePixelEntropies(min(i, lWidth - 1), j, fRedEntropy, fGreenEntropy, fBlueEntropy);
+				m_vRedPixelEntropies[lOffset + i] = fRedEntropy;
+				if (bColor)
+				{
+					m_vGreenPixelEntropies[lOffset + i] = fGreenEntropy;
+					m_vBluePixelEntropies[lOffset + i] = fBlueEntropy;
+				};
+			};
 		};
+	});
+};
+
+/* ------------------------------------------------------------------- */
+
+void CEntropyInfo::ComputePixelEntropies(LONG x, LONG y, double & fRedEntropy, double & fGreenEntropy, double & fBlueEntropy)
+{
+	LONG			lSquareX,
+					lSquareY;
+
+	lSquareX = x / (m_lWindowSize * 2 + 1);
+	lSquareY = y / (m_lWindowSize * 2 + 1);
+
+	CPointExt			ptCenter;
+	CEntropySquare		Squares[3];
+	size_t				sizeSquares = 0;
+
+	GetSquareCenter(lSquareX, lSquareY, ptCenter);
+	AddSquare(Squares[sizeSquares++], lSquareX, lSquareY);
+	if (ptCenter.X > x)
+	{
+		if (lSquareX > 0)
+			AddSquare(Squares[sizeSquares++], lSquareX-1, lSquareY);
+	}
+	else if (ptCenter.X < x)
+	{
+		if (lSquareX < m_lNrSquaresX - 1)
+			AddSquare(Squares[sizeSquares++], lSquareX+1, lSquareY);
 	};
+
+	if (ptCenter.Y > y)
+	{
+		if (lSquareY > 0)
+			AddSquare(Squares[sizeSquares++], lSquareX, lSquareY-1);
+	}
+	else if (ptCenter.Y < y)
+	{
+		if (lSquareY < m_lNrSquaresY - 1)
+			AddSquare(Squares[sizeSquares++], lSquareX, lSquareY+1);
+	};
+
+	// Compute the gradient entropy from the nearby squares
+	fRedEntropy		= 0.0;
+	fGreenEntropy	= 0.0;
+	fBlueEntropy	= 0.0;
+	CPointExt			ptPixel(x, y);
+	double				fTotalWeight = 0.0;
+
+	for (size_t i = 0; i < sizeSquares; i++)
+	{
+		double		fDistance;
+		double		fWeight = 1.0;
+
+		fDistance = Distance(ptPixel, Squares[i].m_ptCenter);
+		if (fDistance > 0)
+			fWeight = 1.0/fDistance;
+
+		fRedEntropy		+= fWeight * Squares[i].m_fRedEntropy;
+		fGreenEntropy	+= fWeight * Squares[i].m_fGreenEntropy;
+		fBlueEntropy	+= fWeight * Squares[i].m_fBlueEntropy;
+
+		fTotalWeight += fWeight;
+	};
+
+	fRedEntropy		/= fTotalWeight;
+	fGreenEntropy	/= fTotalWeight;
+	fBlueEntropy	/= fTotalWeight;
 };
 
 /* ------------------------------------------------------------------- */
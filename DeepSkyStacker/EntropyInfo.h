@@ -67,11 +67,17 @@ private :
 	std::vector<float>			m_vRedEntropies;
 	std::vector<float>			m_vGreenEntropies;
 	std::vector<float>			m_vBlueEntropies;
+	LONG						m_lPixelStride;
+	std::vector<float>			m_vRedPixelEntropies;		// Interpolated entropy of each pixel
+	std::vector<float>			m_vGreenPixelEntropies;		// (empty for monochrome bitmaps)
+	std::vector<float>			m_vBluePixelEntropies;
 	CDSSProgress *				m_pProgress;
 
 private :
 	void	InitSquareEntropies();
-	void	ComputeEntropies(LONG lMinX, LONG lMinY, LONG lMaxX, LONG lMaxY, double & fRedEntropy, double & fGreenEntropy, double & fBlueEntropy);
+	void	InitPixelEntropies();
+	void	ComputeEntropies(LONG lMinX, LONG lMinY, LONG lMaxX, LONG lMaxY, std::vector<COLORREF16> & vPixels, std::vector<LONG> & vRedHisto, std::vector<LONG> & vGreenHisto, std::vector<LONG> & vBlueHisto, double & fRedEntropy, double & fGreenEntropy, double & fBlueEntropy);
+	void	ComputePixelEntropies(LONG x, LONG y, double & fRedEntropy, double & fGreenEntropy, double & fBlueEntropy);
 	void	GetSquareCenter(LONG lX, LONG lY, CPointExt & ptCenter)
 	{
 		ptCenter.X = lX * (m_lWindowSize * 2 + 1) + m_lWindowSize;
@@ -94,6 +100,7 @@ public :
         m_lNrPixels = 0;
         m_lNrSquaresX = 0;
         m_lNrSquaresY = 0;
+        m_lPixelStride = 0;
     }
 
 	virtual ~CEntropyInfo()
@@ -107,78 +114,30 @@ public :
 	const int nrSquaresY() const { return m_lNrSquaresY; }
 	const int windowSize() const { return m_lWindowSize; }
 
+	// The rows of the pixel entropies are padded to a multiple of 16 pixels
+	const float* redPixelEntropyData() const { return m_vRedPixelEntropies.data(); }
+	const float* greenPixelEntropyData() const { return m_vGreenPixelEntropies.empty() ? m_vRedPixelEntropies.data() : m_vGreenPixelEntropies.data(); }
+	const float* bluePixelEntropyData() const { return m_vBluePixelEntropies.empty() ? m_vRedPixelEntropies.data() : m_vBluePixelEntropies.data(); }
+	size_t pixelEntropyOffset(const int x, const int y) const { return static_cast<size_t>(y) * m_lPixelStride + x; }
+
 	void	Init(CMemoryBitmap * pBitmap, LONG lWindowSize = 10, CDSSProgress * pProgress = nullptr)
 	{
 		m_pBitmap.Attach(pBitmap);
 		m_lWindowSize = lWindowSize;
 		m_pProgress   = pProgress;
 		InitSquareEntropies();
+		InitPixelEntropies();
 	};
 
 	void	GetPixel(LONG x, LONG y, double & fRedEntropy, double & fGreenEntropy, double & fBlueEntropy, COLORREF16 & crResult)
 	{
-		LONG			lSquareX,
-						lSquareY;
+		const size_t	lOffset = pixelEntropyOffset(x, y);
 
 		m_pBitmap->GetPixel16(x, y, crResult);
 
-		lSquareX = x / (m_lWindowSize * 2 + 1);
-		lSquareY = y / (m_lWindowSize * 2 + 1);
-
-		CPointExt			ptCenter;
-		CEntropySquare		Squares[3];
-		size_t				sizeSquares = 0;
-
-		GetSquareCenter(lSquareX, lSquareY, ptCenter);
-		AddSquare(Squares[sizeSquares++], lSquareX, lSquareY);
-		if (ptCenter.X > x)
-		{
-			if (lSquareX > 0)
-				AddSquare(Squares[sizeSquares++], lSquareX-1, lSquareY);
-		}
-		else if (ptCenter.X < x)
-		{
-			if (lSquareX < m_lNrSquaresX - 1)
-				AddSquare(Squares[sizeSquares++], lSquareX+1, lSquareY);
-		};
-
-		if (ptCenter.Y > y)
-		{
-			if (lSquareY > 0)
-				AddSquare(Squares[sizeSquares++], lSquareX, lSquareY-1);
-		}
-		else if (ptCenter.Y < y)
-		{
-			if (lSquareY < m_lNrSquaresY - 1)
-				AddSquare(Squares[sizeSquares++], lSquareX, lSquareY+1);
-		};
-
-		// Compute the gradient entropy from the nearby squares
-		fRedEntropy		= 0.0;
-		fGreenEntropy	= 0.0;
-		fBlueEntropy	= 0.0;
-		CPointExt			ptPixel(x, y);
-		double				fTotalWeight = 0.0;
-
-		for (size_t i = 0; i < sizeSquares; i++)
-		{
-			double		fDistance;
-			double		fWeight = 1.0;
-
-			fDistance = Distance(ptPixel, Squares[i].m_ptCenter);
-			if (fDistance > 0)
-				fWeight = 1.0/fDistance;
-
-			fRedEntropy		+= fWeight * Squares[i].m_fRedEntropy;
-			fGreenEntropy	+= fWeight * Squares[i].m_fGreenEntropy;
-			fBlueEntropy	+= fWeight * Squares[i].m_fBlueEntropy;
-
-			fTotalWeight += fWeight;
-		};
-
-		fRedEntropy		/= fTotalWeight;
-		fGreenEntropy	/= fTotalWeight;
-		fBlueEntropy	/= fTotalWeight;
+		fRedEntropy		= m_vRedPixelEntropies[lOffset];
+		fGreenEntropy	= m_vGreenPixelEntropies.empty() ? fRedEntropy : m_vGreenPixelEntropies[lOffset];
+		fBlueEntropy	= m_vBluePixelEntropies.empty() ? fRedEntropy : m_vBluePixelEntropies[lOffset];
 	};
 };
 
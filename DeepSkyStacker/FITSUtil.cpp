@@ -6,8 +6,12 @@
 #include <limits>
 #include <memory>
 #include <map>
+#include <mutex>
+#include <thread>
+#include <atomic>
 
 #include "Workspace.h"
+#include "Multitask.h"
 #include <QSettings>
 #include <QString>
 
@@ -639,6 +643,65 @@ bool CFITSReader::Open()
 
 /* ------------------------------------------------------------------- */
 
+bool CFITSReader::ReadPlane(LONG lPlane, int nDataType, void * pPlane)
+{
+	ZFUNCTRACE_RUNTIME();
+	char error_text[31] = "";			// Error text for FITS errors.
+	LONGLONG fPixel[3] = { 1, 1, lPlane + 1 };
+	int status = 0;
+
+	//
+	// cfitsio applies BZERO/BSCALE while converting the pixels to nDataType.
+	// Values outside of the range of nDataType are clipped and reported with
+	// NUM_OVERFLOW, which is not an error here.
+	//
+	fits_read_pixll(m_fits, nDataType, fPixel, LONGLONG{ m_lWidth } * m_lHeight, nullptr, pPlane, nullptr, &status);
+	if (NUM_OVERFLOW == status)
+		status = 0;
+
+	if (0 != status)
+	{
+		fits_get_errstatus(status, error_text);
+		CStringA errMsg;
+		errMsg.Format(
+			"fits_read_pixll returned a status of %d, error text is \"%s\"",
+			status,
+			error_text);
+
+		ZException exc(errMsg, status, ZException::unrecoverable);
+		exc.addLocation(ZEXCEPTION_LOCATION());
+		exc.logExceptionData();
+		throw exc;
+	}
+
+	return true;
+};
+
+/* ------------------------------------------------------------------- */
+
+void CFITSReader::AdjustFloatRange(double & fMin, double & fMax)
+{
+	double		fZero, fScale;
+
+	if (ReadKey("BZERO", fZero) && ReadKey("BSCALE", fScale))
+	{
+		fMax = (fMax + fZero) / fScale;
+		fMin = fZero / fScale;
+	}
+	else if (fMin >= 0 && fMin <= 1 && fMax >= 0 && fMax <= 1)
+	{
+		fMin = 0;
+		fMax = 1;
+	}
+	if (m_bDSI && (fMax > 1))
+	{
+		fMin = min(0.0, fMin);
+		fMax = max(fMax, 65535.0);
+	};
+};
+
+/* ------------------------------------------------------------------- */
+
 bool CFITSReader::Read()
 {
 	constexpr double scaleFactorInt16 = double{ 1 + UCHAR_MAX };
@@ -662,6 +725,13 @@ bool CFITSReader::Read()
 		if (m_pProgress)
 			m_pProgress->Start2(nullptr, m_lHeight);
 
+		//
+		// Let the derived class read the image planes straight into their final
+		// location when it can, the pixel per pixel OnRead path is used otherwise
+		//
+		if (OnReadPlanes())
+			break;
+
 		LONGLONG fPixel[3] = { 1, 1, 1 };		// want to start reading at column 1, row 1, plane 1
 
 		ZTRACE_RUNTIME("FITS colours=%d, bps=%d, w=%d, h=%d", colours, m_lBitsPerPixel, m_lWidth, m_lHeight);
@@ -718,24 +788,7 @@ bool CFITSReader::Read()
 #if defined(_OPENMP)
 			}
 #endif
-			double		fZero, fScale;
-
-			if (ReadKey("BZERO", fZero) && ReadKey("BSCALE", fScale))
-			{
-				fMax = (fMax + fZero) / fScale;
-				fMin = fZero / fScale;
-			}
-			else if (fMin >= 0 && fMin <= 1 && fMax >= 0 && fMax <= 1)
-			{
-				fMin = 0;
-				fMax = 1;
-			}
-			if (m_bDSI && (fMax > 1))
-			{
-				fMin = min(0.0, fMin);
-				fMax = max(fMax, 65535.0);
-			};
-
+			AdjustFloatRange(fMin, fMax);
 		}
 		else
 		{
@@ -867,8 +920,13 @@ public :
 	virtual bool Close() { return OnClose(); };
 
 	virtual bool	OnOpen();
+	virtual bool	OnReadPlanes();
 	virtual bool	OnRead(LONG lX, LONG lY, double fRed, double fGreen, double fBlue);
 	virtual bool	OnClose();
+
+private :
+	template <typename TType>
+	bool	ReadPlanes(int nDataType);
 };
 
 /* ------------------------------------------------------------------- */
@@ -1022,6 +1080,191 @@ bool CFITSReadInMemoryBitmap::OnOpen()
 
 /* ------------------------------------------------------------------- */
 
+template <typename TType>
+bool CFITSReadInMemoryBitmap::ReadPlanes(int nDataType)
+{
+	std::vector<TType> *	pvPlanes[3] = { nullptr, nullptr, nullptr };
+	LONG					lNrPlanes = 0;
+	double					fMultiplier = 1.0;
+
+	if (m_lNrChannels == 1)
+	{
+		CGrayBitmapT<TType> *	pGrayBitmap = dynamic_cast<CGrayBitmapT<TType> *>(m_pBitmap.m_p);
+
+		if (pGrayBitmap)
+		{
+			pvPlanes[lNrPlanes++] = &pGrayBitmap->m_vPixels;
+			fMultiplier = pGrayBitmap->GetMultiplier();
+		};
+	}
+	else if (m_lNrChannels == 3)
+	{
+		CColorBitmapT<TType> *	pColorBitmap = dynamic_cast<CColorBitmapT<TType> *>(m_pBitmap.m_p);
+
+		if (pColorBitmap && pColorBitmap->isTopDown())
+		{
+			pvPlanes[lNrPlanes++] = &pColorBitmap->m_Red.m_vPixels;
+			pvPlanes[lNrPlanes++] = &pColorBitmap->m_Green.m_vPixels;
+			pvPlanes[lNrPlanes++] = &pColorBitmap->m_Blue.m_vPixels;
+			fMultiplier = pColorBitmap->GetMultiplier();
+		};
+	};
+
+	if (!lNrPlanes)
+		return false;
+	for (LONG k = 0;k<lNrPlanes;k++)
+	{
+		if (pvPlanes[k]->size() != (size_t)m_lWidth * m_lHeight)
+			return false;
+	};
+
+	// The planes are read in the type of the bitmap
+	for (LONG k = 0;k<lNrPlanes;k++)
+		ReadPlane(k, nDataType, pvPlanes[k]->data());
+
+	//
+	// Floating point images are normalized with the range of their values
+	//
+	double					fMin = 0.0,
+							fMax = 0.0;
+
+	if (m_bFloat)
+	{
+		std::mutex			Mutex;
+
+		for (LONG k = 0;k<lNrPlanes;k++)
+		{
+			const TType *	pPixels = pvPlanes[k]->data();
+
+			ParallelFor(0, m_lHeight, 64, [&](const LONG lStartRow, const LONG lEndRow)
+			{
+				double		fLocalMin = 0.0,
+							fLocalMax = 0.0;
+
+				for (size_t i = (size_t)m_lWidth * lStartRow;i<(size_t)m_lWidth * lEndRow;i++)
+				{
+					const double	fValue = pPixels[i];
+
+					if (!std::isnan(fValue))
+					{
+						fLocalMin = std::min(fLocalMin, fValue);
+						fLocalMax = std::max(fLocalMax, fValue);
+					};
+				};
+
+				std::lock_guard<std::mutex>		Lock(Mutex);
+				fMin = std::min(fMin, fLocalMin);
+				fMax = std::max(fMax, fLocalMax);
+			});
+		};
+		AdjustFloatRange(fMin, fMax);
+	};
+
+	//
+	// Scale and clip the values in place, the same way OnRead does it
+	//
+	double					fRatios[4][2];
+	const double			fNormalization = (double{ USHORT_MAX } / 256.0) / (fMax - fMin);
+
+	for (LONG y = 0;y<4;y++)
+	{
+		for (LONG x = 0;x<2;x++)
+		{
+			fRatios[y][x] = 1.0;
+			if (lNrPlanes == 1 && m_CFAType != CFATYPE_NONE)
+			{
+				switch (::GetBayerColor(x, y, m_CFAType, m_xBayerOffset, m_yBayerOffset))
+				{
+				case BAYER_BLUE :
+					fRatios[y][x] = m_fBlueRatio;
+					break;
+				case BAYER_GREEN :
+					fRatios[y][x] = m_fGreenRatio;
+					break;
+				case BAYER_RED :
+					fRatios[y][x] = m_fRedRatio;
+					break;
+				};
+			}
+			else if (lNrPlanes == 1)
+				fRatios[y][x] = m_fBrightnessRatio;
+		};
+	};
+
+	const std::thread::id		MainThreadId = std::this_thread::get_id();
+	std::atomic<LONG>			lNrRowsDone(0);
+
+	ParallelFor(0, m_lHeight, 16, [&](const LONG lStartRow, const LONG lEndRow)
+	{
+		for (LONG j = lStartRow;j<lEndRow;j++)
+		{
+			const double *		pRatios = fRatios[j & 3];
+
+			for (LONG k = 0;k<lNrPlanes;k++)
+			{
+				TType *			pRow = pvPlanes[k]->data() + (size_t)m_lWidth * j;
+
+				for (LONG i = 0;i<m_lWidth;i++)
+				{
+					double		fValue;
+
+					if (m_bFloat)
+						fValue = AdjustColor((pRow[i] - fMin) * fNormalization);
+					else
+						fValue = AdjustColor(pRow[i] / fMultiplier);
+					if (lNrPlanes == 1)
+						fValue = min(255.0, fValue * pRatios[i & 1]);
+					pRow[i] = fValue * fMultiplier;
+				};
+			};
+		};
+
+		lNrRowsDone += lEndRow - lStartRow;
+		if (m_pProgress && std::this_thread::get_id() == MainThreadId)
+			m_pProgress->Progress2(nullptr, lNrRowsDone);
+	});
+
+	return true;
+};
+
+/* ------------------------------------------------------------------- */
+
+bool CFITSReadInMemoryBitmap::OnReadPlanes()
+{
+	ZFUNCTRACE_RUNTIME();
+	bool			bResult = false;
+
+	//
+	// Integer and single precision images are read by cfitsio directly in the
+	// planes of the bitmap (BZERO/BSCALE are applied during the conversion).
+	// Other layouts (64 bits images) go through OnRead.
+	//
+	if (m_pBitmap)
+	{
+		switch (m_bitPix)
+		{
+		case BYTE_IMG :
+			bResult = ReadPlanes<BYTE>(TBYTE);
+			break;
+		case SHORT_IMG :
+		case USHORT_IMG :
+			bResult = ReadPlanes<WORD>(TUSHORT);
+			break;
+		case LONG_IMG :
+		case ULONG_IMG :
+			bResult = ReadPlanes<DWORD>(TULONG);
+			break;
+		case FLOAT_IMG :
+			bResult = ReadPlanes<float>(TFLOAT);
+			break;
+		};
+	};
+
+	return bResult;
+};
+
+/* ------------------------------------------------------------------- */
+
 bool CFITSReadInMemoryBitmap::OnRead(LONG lX, LONG lY, double fRed, double fGreen, double fBlue)
 {
 	//
@@ -129,6 +129,10 @@ private :
 	bool	ReadKey(LPSTR szKey, CString & strValue);
 	void	ReadAllKeys();
 
+protected :
+	bool	ReadPlane(LONG lPlane, int nDataType, void * pPlane);
+	void	AdjustFloatRange(double & fMin, double & fMax);
+
 public :
 	CFITSReader(LPCTSTR szFileName, CDSSProgress *	pProgress)
 	{
@@ -152,6 +156,7 @@ public :
 	virtual bool	Close();
 
 	virtual bool	OnOpen() { return true; };
+	virtual bool	OnReadPlanes() { return false; };
 	virtual bool	OnRead(LONG lX, LONG lY, double fRed, double fGreen, double fBlue) { return false;};
 	virtual bool	OnClose() { return true; };
 };
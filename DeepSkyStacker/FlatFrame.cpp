@@ -48,61 +48,51 @@ public :
 	};
 
 	virtual bool	Process();
-	virtual bool	DoTask(HANDLE hEvent);
+	virtual bool	DoTask();
 };
 
 /* ------------------------------------------------------------------- */
 
-bool	CFlatDivideTask::DoTask(HANDLE hEvent)
+bool	CFlatDivideTask::DoTask()
 {
 	ZFUNCTRACE_RUNTIME();
 	bool			bResult = true;
 
 	LONG			i, j;
-	bool			bEnd = false;
-	MSG				msg;
+	LONG			lStart, lCount;
 	LONG			lWidth = m_pTarget->RealWidth();
 
-	// Create a message queue and signal the event
-	PeekMessage(&msg, nullptr, 0, 0, PM_NOREMOVE);
-	SetEvent(hEvent);
-	while (!bEnd && GetMessage(&msg, nullptr, 0, 0))
+	while (GetNextChunk(lStart, lCount))
 	{
-		if (msg.message == WM_MT_PROCESS)
+		for (j = lStart;j<lStart+lCount;j++)
 		{
-			for (j = msg.wParam;j<msg.wParam+msg.lParam;j++)
+			for (i = 0;i<lWidth;i++)
 			{
-				for (i = 0;i<lWidth;i++)
+				if (m_bUseGray)
 				{
-					if (m_bUseGray)
-					{
-						double			fSrcGray;
-						double			fTgtGray;
+					double			fSrcGray;
+					double			fTgtGray;
 
-						m_pTarget->GetPixel(i, j, fTgtGray);
-						m_pFlatFrame->m_pFlatFrame->GetPixel(i, j, fSrcGray);
-						if (m_bUseCFA)
-							m_pFlatFrame->m_FlatNormalization.Normalize(fTgtGray, fSrcGray, m_pFlatFrame->m_pFlatFrame->GetBayerColor(i, j));
-						else
-							m_pFlatFrame->m_FlatNormalization.Normalize(fTgtGray, fSrcGray);
-						m_pTarget->SetPixel(i, j, fTgtGray);
-					}
+					m_pTarget->GetPixel(i, j, fTgtGray);
+					m_pFlatFrame->m_pFlatFrame->GetPixel(i, j, fSrcGray);
+					if (m_bUseCFA)
+						m_pFlatFrame->m_FlatNormalization.Normalize(fTgtGray, fSrcGray, m_pFlatFrame->m_pFlatFrame->GetBayerColor(i, j));
 					else
-					{
-						double			fSrcRed, fSrcGreen, fSrcBlue;
-						double			fTgtRed, fTgtGreen, fTgtBlue;
+						m_pFlatFrame->m_FlatNormalization.Normalize(fTgtGray, fSrcGray);
+					m_pTarget->SetPixel(i, j, fTgtGray);
+				}
+				else
+				{
+					double			fSrcRed, fSrcGreen, fSrcBlue;
+					double			fTgtRed, fTgtGreen, fTgtBlue;
 
-						m_pTarget->GetPixel(i, j, fTgtRed, fTgtGreen, fTgtBlue);
-						m_pFlatFrame->m_pFlatFrame->GetPixel(i, j, fSrcRed, fSrcGreen, fSrcBlue);
-						m_pFlatFrame->m_FlatNormalization.Normalize(fTgtRed, fTgtGreen, fTgtBlue, fSrcRed, fSrcGreen, fSrcBlue);
-						m_pTarget->SetPixel(i, j, fTgtRed, fTgtGreen, fTgtBlue);
-					};
+					m_pTarget->GetPixel(i, j, fTgtRed, fTgtGreen, fTgtBlue);
+					m_pFlatFrame->m_pFlatFrame->GetPixel(i, j, fSrcRed, fSrcGreen, fSrcBlue);
+					m_pFlatFrame->m_FlatNormalization.Normalize(fTgtRed, fTgtGreen, fTgtBlue, fSrcRed, fSrcGreen, fSrcBlue);
+					m_pTarget->SetPixel(i, j, fTgtRed, fTgtGreen, fTgtBlue);
 				};
 			};
-			SetEvent(hEvent);
-		}
-		else if (msg.message == WM_MT_STOP)
-			bEnd = true;
+		};
 	};
 
 	return true;
@@ -116,40 +106,16 @@ bool	CFlatDivideTask::Process()
 	bool			bResult = true;
 	LONG			lHeight = m_pTarget->RealHeight();
 	LONG			lStep;
-	LONG			lRemaining;
-	LONG			i = 0;
 
 	if (m_pProgress)
-	{
 		m_pProgress->Start2(nullptr, lHeight);
-		m_pProgress->SetNrUsedProcessors(GetNrThreads());
-	};
 
 	lStep		= max(1L, lHeight/50);
-	lRemaining	= lHeight;
-
-	bResult = true;
-	while (i<lHeight)
-	{
-		LONG			lAdd = min(lStep, lRemaining);
-		DWORD			dwThreadId;
-
-		dwThreadId = GetAvailableThreadId();
-		PostThreadMessage(dwThreadId, WM_MT_PROCESS, i, lAdd);
 
-		i			+= lAdd;
-		lRemaining	-= lAdd;
+	bResult = ProcessChunks(0, lHeight, lStep, m_pProgress);
 
-		if (m_pProgress)
-			m_pProgress->Progress2(nullptr, i);
-	};
-
-	CloseAllThreads();
 	if (m_pProgress)
-	{
-		m_pProgress->SetNrUsedProcessors();
 		m_pProgress->End2();
-	};
 
 	return bResult;
 };
@@ -2,6 +2,9 @@
 #include "MasterFrames.h"
 #include "DSSProgress.h"
 #include "DeBloom.h"
+#include "Multitask.h"
+#include <atomic>
+#include <thread>
 
 /* ------------------------------------------------------------------- */
 
@@ -98,6 +101,213 @@ void	CMasterFrames::ApplyHotPixelInterpolation(CMemoryBitmap * pBitmap, CDSSProg
 
 /* ------------------------------------------------------------------- */
 
+template <typename TType>
+static bool GetGrayRow(CMemoryBitmap * pBitmap, LONG j, double * pValues)
+{
+	CGrayBitmapT<TType> *		pGrayBitmap = dynamic_cast<CGrayBitmapT<TType> *>(pBitmap);
+
+	if (pGrayBitmap)
+	{
+		const LONG				lWidth = pGrayBitmap->RealWidth();
+		const double			fMultiplier = pGrayBitmap->GetMultiplier();
+		const TType *			pRow = pGrayBitmap->m_vPixels.data() + (size_t)lWidth * j;
+
+		for (LONG i = 0;i<lWidth;i++)
+			pValues[i] = (double)pRow[i] / fMultiplier;
+	};
+
+	return pGrayBitmap != nullptr;
+};
+
+/* ------------------------------------------------------------------- */
+
+static void	GetMasterRow(CMemoryBitmap * pBitmap, LONG j, double * pValues)
+{
+	// Same values as GetPixel(i, j, fGray) without a virtual call per pixel
+	if (!GetGrayRow<WORD>(pBitmap, j, pValues) &&
+		!GetGrayRow<float>(pBitmap, j, pValues) &&
+		!GetGrayRow<DWORD>(pBitmap, j, pValues) &&
+		!GetGrayRow<double>(pBitmap, j, pValues) &&
+		!GetGrayRow<BYTE>(pBitmap, j, pValues))
+	{
+		for (LONG i = 0;i<pBitmap->RealWidth();i++)
+			pBitmap->GetPixel(i, j, pValues[i]);
+	};
+};
+
+/* ------------------------------------------------------------------- */
+
+// Subtracts the offset and dark frames and divides by the flat frame in a single sweep.
+// The rows of the light frame are processed in parallel, each row going through all the
+// steps while it is in the cache.
+// The value is stored back in the light frame type after each step, exactly as the
+// separate ::Subtract and CFlatFrame::ApplyFlat passes do, so the results are identical.
+template <typename TType>
+static bool	ApplyFusedCalibration(CMemoryBitmap * pBitmap, const DARKSUBTRACTIONVECTOR & vSubtractions, CFlatFrame * pFlatFrame, CDSSProgress * pProgress)
+{
+	CGrayBitmapT<TType> *		pTarget = dynamic_cast<CGrayBitmapT<TType> *>(pBitmap);
+
+	if (!pTarget)
+		return false;
+
+	const LONG					lWidth = pTarget->RealWidth();
+	const LONG					lHeight = pTarget->RealHeight();
+	const double				fMultiplier = pTarget->GetMultiplier();
+	const LONG					lNrSubtractions = (LONG)vSubtractions.size();
+	CMemoryBitmap *				pFlat = pFlatFrame ? (CMemoryBitmap *)pFlatFrame->m_pFlatFrame : nullptr;
+	double						fFlatMeans[4][2];
+
+	// The CFA pattern of the flat frame repeats every 2 columns and 4 rows
+	if (pFlat)
+	{
+		const bool				bUseCFA = pFlatFrame->IsCFA();
+
+		for (LONG y = 0;y<4;y++)
+			for (LONG x = 0;x<2;x++)
+				fFlatMeans[y][x] = pFlatFrame->m_FlatNormalization.GetMean(bUseCFA ? pFlat->GetBayerColor(x, y) : BAYER_UNKNOWN);
+	};
+
+	const std::thread::id		MainThreadId = std::this_thread::get_id();
+	std::atomic<LONG>			lNrRowsDone(0);
+
+	ParallelFor(0, lHeight, 16, [&](const LONG lStartRow, const LONG lEndRow)
+	{
+		std::vector<double>		vMasterRows((size_t)lWidth * (lNrSubtractions + 1));
+		double *				pFlatRow = vMasterRows.data() + (size_t)lWidth * lNrSubtractions;
+
+		for (LONG j = lStartRow;j<lEndRow;j++)
+		{
+			TType *				pRow = pTarget->m_vPixels.data() + (size_t)lWidth * j;
+
+			for (LONG k = 0;k<lNrSubtractions;k++)
+			{
+				double *		pMasterRow = vMasterRows.data() + (size_t)lWidth * k;
+				const double	fFactor = vSubtractions[k].m_fFactor;
+
+				GetMasterRow(vSubtractions[k].m_pDark, j, pMasterRow);
+				for (LONG i = 0;i<lWidth;i++)
+					pRow[i] = max(0.0, (double)pRow[i] / fMultiplier - pMasterRow[i] * fFactor) * fMultiplier;
+			};
+
+			if (pFlat)
+			{
+				const double *	pMeans = fFlatMeans[j & 3];
+
+				GetMasterRow(pFlat, j, pFlatRow);
+				for (LONG i = 0;i<lWidth;i++)
+				{
+					double		fValue = (double)pRow[i] / fMultiplier;
+
+					fValue *= pMeans[i & 1] / max(1.0, pFlatRow[i]);
+					pRow[i] = min(fValue, 255.0) * fMultiplier;
+				};
+			};
+		};
+
+		lNrRowsDone += lEndRow - lStartRow;
+		if (pProgress && std::this_thread::get_id() == MainThreadId)
+			pProgress->Progress2(nullptr, lNrRowsDone);
+	});
+
+	return true;
+};
+
+/* ------------------------------------------------------------------- */
+
+static bool	IsFusedCalibrationSupported(CMemoryBitmap * pBitmap)
+{
+	return	dynamic_cast<CGrayBitmapT<WORD> *>(pBitmap) ||
+			dynamic_cast<CGrayBitmapT<float> *>(pBitmap) ||
+			dynamic_cast<CGrayBitmapT<DWORD> *>(pBitmap) ||
+			dynamic_cast<CGrayBitmapT<double> *>(pBitmap) ||
+			dynamic_cast<CGrayBitmapT<BYTE> *>(pBitmap);
+};
+
+/* ------------------------------------------------------------------- */
+
+bool	CMasterFrames::ApplyFusedMasters(CMemoryBitmap * pBitmap, CDSSProgress * pProgress)
+{
+	ZFUNCTRACE_RUNTIME();
+	bool					bOffset = m_pMasterOffset && m_pMasterOffset->IsOk();
+	const bool				bDark = m_MasterDark.IsOk();
+	bool					bFlat = m_MasterFlat.IsOk();
+	CString					strText;
+
+	// Only monochrome (and CFA) light frames are calibrated in a single sweep, and the flat
+	// frame must be normalized on its gray (or CFA) values.
+	if (!IsFusedCalibrationSupported(pBitmap))
+		return false;
+	if (bFlat)
+	{
+		m_MasterFlat.ComputeFlatNormalization(pProgress);
+		if (!m_MasterFlat.m_FlatNormalization.UseGray())
+			return false;
+	};
+
+	// The dark optimization factors are computed on the offset subtracted light frame
+	if (bDark && m_MasterDark.GetDarkOptimization())
+	{
+		ApplyMasterOffset(pBitmap, pProgress);
+		bOffset = false;
+	};
+
+	DARKSUBTRACTIONVECTOR	vCandidates;
+	DARKSUBTRACTIONVECTOR	vSubtractions;
+
+	if (bOffset)
+		vCandidates.emplace_back(m_pMasterOffset, 1.0);
+	if (bDark)
+	{
+		DARKSUBTRACTIONVECTOR	vDarks;
+
+		m_MasterDark.GetSubtractions(pBitmap, vDarks, pProgress);
+		vCandidates.insert(vCandidates.end(), vDarks.cbegin(), vDarks.cend());
+	};
+
+	// Same checks as ::Subtract and CFlatFrame::ApplyFlat
+	for (const CDarkSubtraction & Subtraction : vCandidates)
+	{
+		CMemoryBitmap *			pSource = Subtraction.m_pDark;
+
+		if (pSource && (pBitmap->RealWidth() == pSource->RealWidth()) &&
+			(pBitmap->RealHeight() == pSource->RealHeight()) &&
+			pSource->IsMonochrome())
+			vSubtractions.push_back(Subtraction);
+		else
+			ZTRACE_RUNTIME("Subtraction skipped");
+	};
+	if (bFlat && ((pBitmap->RealWidth() != m_MasterFlat.m_pFlatFrame->RealWidth()) ||
+				  (pBitmap->RealHeight() != m_MasterFlat.m_pFlatFrame->RealHeight())))
+	{
+		ZTRACE_RUNTIME("Flat frame skipped");
+		bFlat = false;
+	};
+
+	if (vSubtractions.empty() && !bFlat)
+		return true;
+
+	if (pProgress)
+	{
+		strText.LoadString(bOffset ? IDS_SUBSTRACTINGOFFSET : (bDark ? IDS_SUBSTRACTINGDARK : IDS_APPLYINGFLAT));
+		pProgress->Start2(strText, pBitmap->RealHeight());
+	};
+
+	CFlatFrame *			pFlatFrame = bFlat ? &m_MasterFlat : nullptr;
+
+	ApplyFusedCalibration<WORD>(pBitmap, vSubtractions, pFlatFrame, pProgress) ||
+	ApplyFusedCalibration<float>(pBitmap, vSubtractions, pFlatFrame, pProgress) ||
+	ApplyFusedCalibration<DWORD>(pBitmap, vSubtractions, pFlatFrame, pProgress) ||
+	ApplyFusedCalibration<double>(pBitmap, vSubtractions, pFlatFrame, pProgress) ||
+	ApplyFusedCalibration<BYTE>(pBitmap, vSubtractions, pFlatFrame, pProgress);
+
+	if (pProgress)
+		pProgress->End2();
+
+	return true;
+};
+
+/* ------------------------------------------------------------------- */
+
 void	CMasterFrames::ApplyAllMasters(CMemoryBitmap * pBitmap, STARVECTOR * pStars, CDSSProgress * pProgress)
 {
 	ZFUNCTRACE_RUNTIME();
@@ -107,9 +317,12 @@ void	CMasterFrames::ApplyAllMasters(CMemoryBitmap * pBitmap, STARVECTOR * pStars
 	if (m_fDebloom)
 		bDebloom = debloom.CreateBloomMask(pBitmap, pProgress);
 
-	ApplyMasterOffset(pBitmap, pProgress);
-	ApplyMasterDark(pBitmap, pStars, pProgress);
-	ApplyMasterFlat(pBitmap, pProgress);
+	if (!ApplyFusedMasters(pBitmap, pProgress))
+	{
+		ApplyMasterOffset(pBitmap, pProgress);
+		ApplyMasterDark(pBitmap, pStars, pProgress);
+		ApplyMasterFlat(pBitmap, pProgress);
+	};
 	ApplyHotPixelInterpolation(pBitmap, pProgress);
 
 	if (bDebloom)
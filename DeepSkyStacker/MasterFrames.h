@@ -17,6 +17,9 @@ private :
 	CFlatFrame					m_MasterFlat;
 	bool						m_fDebloom;
 
+private :
+	bool	ApplyFusedMasters(CMemoryBitmap * pBitmap, CDSSProgress * pProgress);
+
 public :
 	CMasterFrames()
 	{
@@ -63,68 +63,54 @@ static bool AreCornersLocked()
 
 /* ------------------------------------------------------------------- */
 
-void	CMatchingStars::ComputeStarDistances(const POINTEXTVECTOR & vStars, STARDISTVECTOR & vStarDist)
+void	CMatchingStars::ComputeStarDistances(const CStarDistanceMatrix & DistanceMatrix, STARDISTVECTOR & vStarDist)
 {
-	LONG				i, j;
+	const LONG			lNrStars = DistanceMatrix.NrStars();
 
-	double				fMaxDistance = 0;
+	vStarDist.clear();
+	vStarDist.reserve(lNrStars * (lNrStars-1)/2);
 
-	vStarDist.reserve(vStars.size() * (vStars.size()-1)/2);
-
-	for (i = 0;i<vStars.size();i++)
+	for (LONG i = 0;i<lNrStars;i++)
 	{
-		CPointExt		pt1(vStars[i].X, vStars[i].Y);
-
-		for (j = i+1;j<vStars.size();j++)
-		{
-			CPointExt		pt2(vStars[j].X, vStars[j].Y);
-			double			fDistance;
-
-			fDistance = Distance(pt1, pt2);
-			fMaxDistance = max(fDistance, fMaxDistance);
-
-			vStarDist.emplace_back(i, j, fDistance);
-		};
+		for (LONG j = i+1;j<lNrStars;j++)
+			vStarDist.emplace_back(i, j, DistanceMatrix.Distance(i, j));
 	};
 
-	std::sort(vStarDist.begin(), vStarDist.end());
+	// Largest distances first
+	std::sort(vStarDist.begin(), vStarDist.end(), [](const CStarDist & sd1, const CStarDist & sd2)
+		{
+			return sd1.m_fDistance > sd2.m_fDistance;
+		});
 };
 
 /* ------------------------------------------------------------------- */
 
-void	CMatchingStars::ComputeTriangles(const POINTEXTVECTOR & vStars, STARTRIANGLEVECTOR & vTriangles)
+void	CMatchingStars::ComputeTriangles(const CStarDistanceMatrix & DistanceMatrix, STARTRIANGLEVECTOR & vTriangles)
 {
 	ZFUNCTRACE_RUNTIME();
-	STARDISTVECTOR			vStarDist;
-	LONG					i, j, k;
-	STARDISTITERATOR		it;
-	std::vector<float>		vDistances;
+	const LONG				lNrStars = DistanceMatrix.NrStars();
+	float					fDistances[3];
 
-	ComputeStarDistances(vStars, vStarDist);
-	vDistances.resize(3);
-
-	for (i = 0;i<vStars.size();i++)
+	for (LONG i = 0;i<lNrStars;i++)
 	{
-		for (j = i+1;j<vStars.size();j++)
+		for (LONG j = i+1;j<lNrStars;j++)
 		{
-			it = std::lower_bound(vStarDist.begin(), vStarDist.end(), CStarDist(i, j));
-			vDistances[0] = (*it).m_fDistance;
+			const float		fDistance12 = DistanceMatrix.Distance(i, j);
 
-			for (k = j+1;k<vStars.size();k++)
+			for (LONG k = j+1;k<lNrStars;k++)
 			{
-				it = std::lower_bound(vStarDist.begin(), vStarDist.end(), CStarDist(j, k));
-				vDistances[1] = (*it).m_fDistance;
-				it = std::lower_bound(vStarDist.begin(), vStarDist.end(), CStarDist(i, k));
-				vDistances[2] = (*it).m_fDistance;
+				fDistances[0] = fDistance12;
+				fDistances[1] = DistanceMatrix.Distance(j, k);
+				fDistances[2] = DistanceMatrix.Distance(i, k);
 
-				std::sort(vDistances.begin(), vDistances.end());
+				std::sort(fDistances, fDistances+3);
 
-				if (vDistances[2] > 0)
+				if (fDistances[2] > 0)
 				{
 					float		fX, fY;
 
-					fX = vDistances[1]/vDistances[2];
-					fY = vDistances[0]/vDistances[2];
+					fX = fDistances[1]/fDistances[2];
+					fY = fDistances[0]/fDistances[2];
 
 					// Filter
 					if (fX < 0.9)
@@ -136,8 +122,6 @@ void	CMatchingStars::ComputeTriangles(const POINTEXTVECTOR & vStars, STARTRIANGL
 			};
 		};
 	};
-
-	std::sort(vTriangles.begin(), vTriangles.end());
 };
 
 /* ------------------------------------------------------------------- */
@@ -947,58 +931,43 @@ bool	CMatchingStars::ComputeMatchingTriangleTransformation(CBilinearParameters &
 	bool				bResult = false;
 
 	// First compute the triangles for reference and target
-	if (!m_vRefTriangles.size())
-		ComputeTriangles(m_vRefStars, m_vRefTriangles);
+	if (m_RefTriangles.IsEmpty())
+	{
+		STARTRIANGLEVECTOR		vRefTriangles;
+
+		ComputeTriangles(m_RefDistanceMatrix, vRefTriangles);
+		m_RefTriangles.Init(vRefTriangles, TRIANGLETOLERANCE);
+	};
 
-	ComputeTriangles(m_vTgtStars, m_vTgtTriangles);
+	m_vTgtTriangles.clear();
+	ComputeTriangles(m_TgtDistanceMatrix, m_vTgtTriangles);
 
 	// Then match the triangle filling the voting grid in the process
-	// At this point the triangles vectors are sorted along the X axis
-	bool						bEnd = false;
-	STARTRIANGLEITERATOR		itRef,
-								itLastUsedRef,
-								itTgt;
-	VOTINGPAIRVECTOR			vVotingPairs,
-								vOutputVotingPairs;
+	// Only the reference triangles in the cells around each target triangle are checked
+	VOTINGPAIRVECTOR			vVotingPairs;
+	const LONG					lNrTgtStars = (LONG)m_vTgtStars.size();
 
 	InitVotingGrid(vVotingPairs);
 
-	itLastUsedRef = m_vRefTriangles.begin();
-
-	for (itTgt = m_vTgtTriangles.begin();(itTgt != m_vTgtTriangles.end()) && !bEnd;itTgt++)
+	for (const CStarTriangle & tgt : m_vTgtTriangles)
 	{
-		while (itLastUsedRef != m_vRefTriangles.end() &&
-			   (*itTgt).m_fX > (*itLastUsedRef).m_fX+TRIANGLETOLERANCE)
-			   itLastUsedRef++;
-
-		if (itLastUsedRef == m_vRefTriangles.end())
-			bEnd = true;
-		else
+		m_RefTriangles.ForEachNeighbour(tgt.m_fX, tgt.m_fY, [&tgt, &vVotingPairs, lNrTgtStars](const CStarTriangle & ref)
 		{
-			// At this point (*itLastUsedRef).m_fX is less than (*itTgt).m_fX
-			itRef = itLastUsedRef;
-			while ((itRef != m_vRefTriangles.end()) && ((*itRef).m_fX < (*itTgt).m_fX + TRIANGLETOLERANCE))
+			// Check real distance between triangles
+			if (Distance(ref.m_fX, ref.m_fY, tgt.m_fX, tgt.m_fY) <= TRIANGLETOLERANCE)
 			{
-				// Check real distance between triangles
-				float			fDistance;
-
-				fDistance = Distance((*itRef).m_fX, (*itRef).m_fY, (*itTgt).m_fX, (*itTgt).m_fY);
-				if (fDistance <= TRIANGLETOLERANCE)
-				{
-					// Vote for the all the pairs
-					AddVote((*itRef).m_Star1, (*itTgt).m_Star1, vVotingPairs, (LONG)m_vTgtStars.size());
-					AddVote((*itRef).m_Star1, (*itTgt).m_Star2, vVotingPairs, (LONG)m_vTgtStars.size());
-					AddVote((*itRef).m_Star1, (*itTgt).m_Star3, vVotingPairs, (LONG)m_vTgtStars.size());
-					AddVote((*itRef).m_Star2, (*itTgt).m_Star1, vVotingPairs, (LONG)m_vTgtStars.size());
-					AddVote((*itRef).m_Star2, (*itTgt).m_Star2, vVotingPairs, (LONG)m_vTgtStars.size());
-					AddVote((*itRef).m_Star2, (*itTgt).m_Star3, vVotingPairs, (LONG)m_vTgtStars.size());
-					AddVote((*itRef).m_Star3, (*itTgt).m_Star1, vVotingPairs, (LONG)m_vTgtStars.size());
-					AddVote((*itRef).m_Star3, (*itTgt).m_Star2, vVotingPairs, (LONG)m_vTgtStars.size());
-					AddVote((*itRef).m_Star3, (*itTgt).m_Star3, vVotingPairs, (LONG)m_vTgtStars.size());
-				};
-				itRef++;
+				// Vote for the all the pairs
+				AddVote(ref.m_Star1, tgt.m_Star1, vVotingPairs, lNrTgtStars);
+				AddVote(ref.m_Star1, tgt.m_Star2, vVotingPairs, lNrTgtStars);
+				AddVote(ref.m_Star1, tgt.m_Star3, vVotingPairs, lNrTgtStars);
+				AddVote(ref.m_Star2, tgt.m_Star1, vVotingPairs, lNrTgtStars);
+				AddVote(ref.m_Star2, tgt.m_Star2, vVotingPairs, lNrTgtStars);
+				AddVote(ref.m_Star2, tgt.m_Star3, vVotingPairs, lNrTgtStars);
+				AddVote(ref.m_Star3, tgt.m_Star1, vVotingPairs, lNrTgtStars);
+				AddVote(ref.m_Star3, tgt.m_Star2, vVotingPairs, lNrTgtStars);
+				AddVote(ref.m_Star3, tgt.m_Star3, vVotingPairs, lNrTgtStars);
 			};
-		};
+		});
 	};
 
 /*	InitVotingGrid(vOutputVotingPairs);
@@ -1043,41 +1012,17 @@ bool	CMatchingStars::ComputeMatchingTriangleTransformation(CBilinearParameters &
 
 const double			MAXSTARDISTANCEDELTA = 2.0;
 
-CComAutoCriticalSection	g_StarDistSection;
-STARDISTVECTOR *		g_pvDists = nullptr;
-
-inline bool CompareStarDistances (LONG lDist1, LONG lDist2)
-{
-	return (*g_pvDists)[lDist1].m_fDistance > (*g_pvDists)[lDist2].m_fDistance;
-};
-
 bool	CMatchingStars::ComputeLargeTriangleTransformation(CBilinearParameters & BilinearParameters)
 {
 	bool					bResult = false;
 	LONG					i = 0,
 							j = 0;
 
-	// Compute patterns
+	// Compute patterns (pairs of stars sorted by decreasing distance)
 	if (!m_vRefStarDistances.size())
-	{
-		ComputeStarDistances(m_vRefStars, m_vRefStarDistances);
-		for (i = 0;i<m_vRefStarDistances.size();i++)
-			m_vRefStarIndices.push_back(i);
-	};
-
-	ComputeStarDistances(m_vTgtStars, m_vTgtStarDistances);
-	for (i = 0;i<m_vTgtStarDistances.size();i++)
-		m_vTgtStarIndices.push_back(i);
-
-	g_StarDistSection.Lock();
-	g_pvDists = &m_vRefStarDistances;
-	std::sort(m_vRefStarIndices.begin(), m_vRefStarIndices.end(), CompareStarDistances);
+		ComputeStarDistances(m_RefDistanceMatrix, m_vRefStarDistances);
 
-	g_pvDists = &m_vTgtStarDistances;
-	std::sort(m_vTgtStarIndices.begin(), m_vTgtStarIndices.end(), CompareStarDistances);
-
-	g_pvDists = nullptr;
-	g_StarDistSection.Unlock();
+	ComputeStarDistances(m_TgtDistanceMatrix, m_vTgtStarDistances);
 
 	VOTINGPAIRVECTOR			vVotingPairs,
 								vOutputVotingPairs;
@@ -1087,7 +1032,7 @@ bool	CMatchingStars::ComputeLargeTriangleTransformation(CBilinearParameters & Bi
 
 	while (i<m_vTgtStarDistances.size() && j<m_vRefStarDistances.size())
 	{
-		if (fabs(m_vTgtStarDistances[m_vTgtStarIndices[i]].m_fDistance-m_vRefStarDistances[m_vRefStarIndices[j]].m_fDistance) <= MAXSTARDISTANCEDELTA)
+		if (fabs(m_vTgtStarDistances[i].m_fDistance-m_vRefStarDistances[j].m_fDistance) <= MAXSTARDISTANCEDELTA)
 		{
 			// These are within 2 pixels ... find all the others stars
 			// using the same stars in Target and check if the distances
@@ -1100,31 +1045,23 @@ bool	CMatchingStars::ComputeLargeTriangleTransformation(CBilinearParameters & Bi
 			double				fTgtDistance12,
 								fRefDistance12;
 
-			fRefDistance12 = m_vRefStarDistances[m_vRefStarIndices[j]].m_fDistance;
-			fTgtDistance12 = m_vTgtStarDistances[m_vTgtStarIndices[i]].m_fDistance;
+			fRefDistance12 = m_vRefStarDistances[j].m_fDistance;
+			fTgtDistance12 = m_vTgtStarDistances[i].m_fDistance;
 
-			lRefStar1 = m_vRefStarDistances[m_vRefStarIndices[j]].m_Star1;
-			lRefStar2 = m_vRefStarDistances[m_vRefStarIndices[j]].m_Star2;
+			lRefStar1 = m_vRefStarDistances[j].m_Star1;
+			lRefStar2 = m_vRefStarDistances[j].m_Star2;
 
-			lTgtStar1 = m_vTgtStarDistances[m_vTgtStarIndices[i]].m_Star1;
-			lTgtStar2 = m_vTgtStarDistances[m_vTgtStarIndices[i]].m_Star2;
+			lTgtStar1 = m_vTgtStarDistances[i].m_Star1;
+			lTgtStar2 = m_vTgtStarDistances[i].m_Star2;
 
 			for (LONG lTgtStar3 = 0;lTgtStar3 < m_vTgtStars.size();lTgtStar3++)
 			{
 				if ((lTgtStar3 != lTgtStar1) && (lTgtStar3 != lTgtStar2))
 				{
-					STARDISTITERATOR		it;
-					double					fTgtDistance13 = 0.0;
-					double					fTgtDistance23 = 0.0;
+					double					fTgtDistance13 = m_TgtDistanceMatrix.Distance(lTgtStar1, lTgtStar3);
+					double					fTgtDistance23 = m_TgtDistanceMatrix.Distance(lTgtStar2, lTgtStar3);
 					double					fRatio;
 
-					it = std::lower_bound(m_vTgtStarDistances.begin(), m_vTgtStarDistances.end(), CStarDist(lTgtStar1, lTgtStar3));
-					if (it != m_vTgtStarDistances.end())
-						fTgtDistance13 = (*it).m_fDistance;
-					it = std::lower_bound(m_vTgtStarDistances.begin(), m_vTgtStarDistances.end(), CStarDist(lTgtStar2, lTgtStar3));
-					if (it != m_vTgtStarDistances.end())
-						fTgtDistance23 = (*it).m_fDistance;
-
 					fRatio = max(fTgtDistance13, fTgtDistance23) / fTgtDistance12;
 					// Filter triangle because :
 					// Larger triangle are already used
@@ -1138,15 +1075,8 @@ bool	CMatchingStars::ComputeLargeTriangleTransformation(CBilinearParameters & Bi
 						{
 							if ((lRefStar3 != lRefStar1) && (lRefStar3 != lRefStar2))
 							{
-								double		fRefDistance13 = 0.0;
-								double		fRefDistance23 = 0.0;
-
-								it = std::lower_bound(m_vRefStarDistances.begin(), m_vRefStarDistances.end(), CStarDist(lRefStar1, lRefStar3));
-								if (it != m_vRefStarDistances.end())
-									fRefDistance13 = (*it).m_fDistance;
-								it = std::lower_bound(m_vRefStarDistances.begin(), m_vRefStarDistances.end(), CStarDist(lRefStar2, lRefStar3));
-								if (it != m_vRefStarDistances.end())
-									fRefDistance23 = (*it).m_fDistance;
+								double		fRefDistance13 = m_RefDistanceMatrix.Distance(lRefStar1, lRefStar3);
+								double		fRefDistance23 = m_RefDistanceMatrix.Distance(lRefStar2, lRefStar3);
 
 								if ((fabs(fRefDistance13 - fTgtDistance13) < MAXSTARDISTANCEDELTA) &&
 									(fabs(fRefDistance23 - fTgtDistance23) < MAXSTARDISTANCEDELTA))
@@ -1171,7 +1101,7 @@ bool	CMatchingStars::ComputeLargeTriangleTransformation(CBilinearParameters & Bi
 			};
 		};
 
-		if (m_vTgtStarDistances[m_vTgtStarIndices[i]].m_fDistance<m_vRefStarDistances[m_vRefStarIndices[j]].m_fDistance)
+		if (m_vTgtStarDistances[i].m_fDistance<m_vRefStarDistances[j].m_fDistance)
 			j++;
 		else
 			i++;
@@ -1256,6 +1186,10 @@ bool	CMatchingStars::ComputeCoordinateTransformation(CBilinearParameters & Bilin
 		//AdjustSize();
 		if (m_vRefStars.size()>=8 && m_vTgtStars.size()>=8)
 		{
+			if (m_RefDistanceMatrix.IsEmpty())
+				m_RefDistanceMatrix.Init(m_vRefStars);
+			m_TgtDistanceMatrix.Init(m_vTgtStars);
+
 			bResult = ComputeLargeTriangleTransformation(BilinearParameters);
 			if (!bResult)
 				bResult = ComputeMatchingTriangleTransformation(BilinearParameters);
@@ -190,6 +190,142 @@ typedef STARDISTVECTOR::iterator		STARDISTITERATOR;
 
 /* ------------------------------------------------------------------- */
 
+// Distances between all the pairs of stars, directly indexed by the star numbers.
+class CStarDistanceMatrix
+{
+private :
+	std::vector<float>		m_vDistances;
+	LONG					m_lNrStars;
+
+public :
+	CStarDistanceMatrix()
+	{
+		m_lNrStars = 0;
+	};
+
+	virtual ~CStarDistanceMatrix()
+	{
+	};
+
+	void	Init(const POINTEXTVECTOR & vStars)
+	{
+		m_lNrStars = (LONG)vStars.size();
+		m_vDistances.assign(m_lNrStars * m_lNrStars, 0.0f);
+
+		for (LONG i = 0;i<m_lNrStars;i++)
+		{
+			for (LONG j = i+1;j<m_lNrStars;j++)
+			{
+				const float		fDistance = (float)::Distance(vStars[i], vStars[j]);
+
+				m_vDistances[i * m_lNrStars + j] = fDistance;
+				m_vDistances[j * m_lNrStars + i] = fDistance;
+			};
+		};
+	};
+
+	void	Clear()
+	{
+		m_vDistances.clear();
+		m_lNrStars = 0;
+	};
+
+	bool	IsEmpty() const
+	{
+		return m_vDistances.empty();
+	};
+
+	LONG	NrStars() const
+	{
+		return m_lNrStars;
+	};
+
+	float	Distance(LONG lStar1, LONG lStar2) const
+	{
+		return m_vDistances[lStar1 * m_lNrStars + lStar2];
+	};
+};
+
+/* ------------------------------------------------------------------- */
+
+// Triangles bucketed on a regular grid of their invariants (m_fX, m_fY), both in [0, 1].
+// With a cell size equal to the matching tolerance all the triangles close to a given
+// one are in the 3x3 cells around it.
+class CStarTriangleGrid
+{
+private :
+	STARTRIANGLEVECTOR		m_vTriangles;		// Sorted by cell
+	std::vector<LONG>		m_vCellStarts;		// Index of the first triangle of each cell (+ end)
+	LONG					m_lNrCells;			// On each axis
+	float					m_fCellSize;
+
+	LONG	CellIndex(float fValue) const
+	{
+		return std::clamp((LONG)(fValue / m_fCellSize), (LONG)0, m_lNrCells-1);
+	};
+
+public :
+	CStarTriangleGrid()
+	{
+		m_lNrCells  = 0;
+		m_fCellSize = 1.0f;
+	};
+
+	virtual ~CStarTriangleGrid()
+	{
+	};
+
+	void	Init(const STARTRIANGLEVECTOR & vTriangles, float fCellSize)
+	{
+		m_fCellSize = fCellSize;
+		m_lNrCells  = (LONG)(1.0f / fCellSize) + 2;
+		m_vCellStarts.assign(m_lNrCells * m_lNrCells + 1, 0);
+
+		// Counting sort of the triangles on their cell
+		for (const CStarTriangle & st : vTriangles)
+			m_vCellStarts[CellIndex(st.m_fY) * m_lNrCells + CellIndex(st.m_fX) + 1]++;
+		for (size_t i = 1;i<m_vCellStarts.size();i++)
+			m_vCellStarts[i] += m_vCellStarts[i-1];
+
+		std::vector<LONG>		vPositions(m_vCellStarts.cbegin(), m_vCellStarts.cend()-1);
+
+		m_vTriangles.resize(vTriangles.size());
+		for (const CStarTriangle & st : vTriangles)
+			m_vTriangles[vPositions[CellIndex(st.m_fY) * m_lNrCells + CellIndex(st.m_fX)]++] = st;
+	};
+
+	void	Clear()
+	{
+		m_vTriangles.clear();
+		m_vCellStarts.clear();
+		m_lNrCells = 0;
+	};
+
+	bool	IsEmpty() const
+	{
+		return m_vCellStarts.empty();
+	};
+
+	// Calls Function(const CStarTriangle &) for all the triangles of the cells around (fX, fY)
+	template <class Function>
+	void	ForEachNeighbour(float fX, float fY, Function function) const
+	{
+		const LONG		lCellX = CellIndex(fX);
+		const LONG		lCellY = CellIndex(fY);
+
+		for (LONG lY = max(lCellY-1, (LONG)0);lY <= min(lCellY+1, m_lNrCells-1);lY++)
+		{
+			const LONG	lFirst = m_vCellStarts[lY * m_lNrCells + max(lCellX-1, (LONG)0)];
+			const LONG	lLast  = m_vCellStarts[lY * m_lNrCells + min(lCellX+1, m_lNrCells-1) + 1];
+
+			for (LONG i = lFirst;i<lLast;i++)
+				function(m_vTriangles[i]);
+		};
+	};
+};
+
+/* ------------------------------------------------------------------- */
+
 const	LONG			VPFLAG_ACTIVE			  = 0x00000001;
 const	LONG			VPFLAG_CORNER_TOPLEFT	  = 0x00000010;
 const	LONG			VPFLAG_CORNER_TOPRIGHT    = 0x00000020;
@@ -315,12 +451,13 @@ private :
 	POINTEXTVECTOR			m_vRefStars;
 	POINTEXTVECTOR			m_vTgtStars;
 
-	STARTRIANGLEVECTOR		m_vRefTriangles;
 	STARTRIANGLEVECTOR		m_vTgtTriangles;
+	CStarTriangleGrid		m_RefTriangles;
 
-	std::vector<LONG>		m_vRefStarIndices;
-	std::vector<LONG>		m_vTgtStarIndices;
+	CStarDistanceMatrix		m_RefDistanceMatrix;
+	CStarDistanceMatrix		m_TgtDistanceMatrix;
 
+	// All the pairs of stars sorted by decreasing distance
 	STARDISTVECTOR			m_vRefStarDistances;
 	STARDISTVECTOR			m_vTgtStarDistances;
 
@@ -350,8 +487,8 @@ private :
 
 	void	InitVotingGrid(VOTINGPAIRVECTOR & vVotingPairs);
 	void	AdjustVoting(const VOTINGPAIRVECTOR & vInVotingPairs, VOTINGPAIRVECTOR & vOutVotingPairs, LONG lNrTgtStars);
-	void	ComputeStarDistances(const POINTEXTVECTOR & vStars, STARDISTVECTOR & vStarDist);
-	void	ComputeTriangles(const POINTEXTVECTOR & vStars, STARTRIANGLEVECTOR & vTriangles);
+	void	ComputeStarDistances(const CStarDistanceMatrix & DistanceMatrix, STARDISTVECTOR & vStarDist);
+	void	ComputeTriangles(const CStarDistanceMatrix & DistanceMatrix, STARTRIANGLEVECTOR & vTriangles);
 
 	double	ValidateTransformation(const VOTINGPAIRVECTOR & vVotingPairs, const CBilinearParameters & BilinearParameters);
 	bool	ComputeCoordinatesTransformation(VOTINGPAIRVECTOR & vVotingPairs, CBilinearParameters & BilinearParameters, TRANSFORMATIONTYPE TType);
@@ -393,10 +530,10 @@ public :
 	void	ClearReference()
 	{
 		m_vRefStars.clear();
-		m_vRefTriangles.clear();
+		m_RefTriangles.Clear();
 		m_vRefCorners.clear();
+		m_RefDistanceMatrix.Clear();
 		m_vRefStarDistances.clear();
-		m_vRefStarIndices.clear();
 	};
 
 	void	ClearTarget()
@@ -404,8 +541,8 @@ public :
 		m_vTgtStars.clear();
 		m_vTgtTriangles.clear();
 		m_vTgtCorners.clear();
+		m_TgtDistanceMatrix.Clear();
 		m_vTgtStarDistances.clear();
-		m_vTgtStarIndices.clear();
 	};
 
 	void	SetSizes(LONG lWidth, LONG lHeight)
@@ -39,12 +39,11 @@ public :
 			m_pProgress = pProgress;
 		};
 
-		virtual bool	DoTask(HANDLE hEvent)
+		virtual bool	DoTask()
 		{
 			bool					bResult = true;
 			LONG					i, j;
-			bool					bEnd = false;
-			MSG						msg;
+			LONG					lStart, lCount;
 			LONG					lWidth  = m_pEngine->m_lWidth,
 									lHeight = m_pEngine->m_lHeight,
 									lFilterSize = m_pEngine->m_lFilterSize;
@@ -55,104 +54,94 @@ public :
 			vValues.reserve((m_pEngine->m_lFilterSize*2+1)*(m_pEngine->m_lFilterSize*2+1));
 			AvxImageFilter avxFilter(m_pEngine);
 
-			// Create a message queue and signal the event
-			PeekMessage(&msg, nullptr, 0, 0, PM_NOREMOVE);
-			SetEvent(hEvent);
-			while (!bEnd && GetMessage(&msg, nullptr, 0, 0))
+			while (GetNextChunk(lStart, lCount))
 			{
-				if (msg.message == WM_MT_PROCESS)
+				if (avxFilter.filter(lStart, lStart + lCount) != 0)
 				{
-					if (avxFilter.filter(msg.wParam, msg.wParam + msg.lParam) != 0)
+					if (CFAType != CFATYPE_NONE)
 					{
-						if (CFAType != CFATYPE_NONE)
-						{
-							TType* pOutValues = m_pEngine->m_pvOutValues;
+						TType* pOutValues = m_pEngine->m_pvOutValues;
 
-							pOutValues += msg.wParam * lWidth;
+						pOutValues += lStart * lWidth;
 
-							for (j = msg.wParam; j < msg.wParam + msg.lParam; j++)
+						for (j = lStart; j < lStart + lCount; j++)
+						{
+							for (i = 0; i < lWidth; i++)
 							{
-								for (i = 0; i < lWidth; i++)
+								// Compute the min and max values in X and Y
+								LONG			lXMin, lXMax,
+									lYMin, lYMax;
+								BAYERCOLOR		BayerColor = GetBayerColor(i, j, CFAType);
+
+								lXMin = max(0L, i - lFilterSize);
+								lXMax = min(i + lFilterSize, lWidth - 1);
+								lYMin = max(0L, j - lFilterSize);
+								lYMax = min(j + lFilterSize, lHeight - 1);
+
+								// Fill the array with the values
+								TType* pInLine = m_pEngine->m_pvInValues;
+								pInLine += lXMin + (lYMin * lWidth);
+								vValues.resize(0);
+								for (LONG k = lYMin; k <= lYMax; k++)
 								{
-									// Compute the min and max values in X and Y
-									LONG			lXMin, lXMax,
-										lYMin, lYMax;
-									BAYERCOLOR		BayerColor = GetBayerColor(i, j, CFAType);
-
-									lXMin = max(0L, i - lFilterSize);
-									lXMax = min(i + lFilterSize, lWidth - 1);
-									lYMin = max(0L, j - lFilterSize);
-									lYMax = min(j + lFilterSize, lHeight - 1);
-
-									// Fill the array with the values
-									TType* pInLine = m_pEngine->m_pvInValues;
-									pInLine += lXMin + (lYMin * lWidth);
-									vValues.resize(0);
-									for (LONG k = lYMin; k <= lYMax; k++)
+									TType* pInValues = pInLine;
+
+									for (LONG l = lXMin; l <= lXMax; l++)
 									{
-										TType* pInValues = pInLine;
-
-										for (LONG l = lXMin; l <= lXMax; l++)
-										{
-											if (GetBayerColor(l, k, CFAType) == BayerColor)
-												vValues.push_back(*pInValues);
-											pInValues++;
-										};
-										pInLine += lWidth;
+										if (GetBayerColor(l, k, CFAType) == BayerColor)
+											vValues.push_back(*pInValues);
+										pInValues++;
 									};
+									pInLine += lWidth;
+								};
 
-									TType			fMedian = Median(vValues);
+								TType			fMedian = Median(vValues);
 
-									*pOutValues = fMedian;
-									pOutValues++;
-								};
+								*pOutValues = fMedian;
+								pOutValues++;
 							};
-						}
-						else
-						{
-							TType* pOutValues = m_pEngine->m_pvOutValues;
+						};
+					}
+					else
+					{
+						TType* pOutValues = m_pEngine->m_pvOutValues;
 
-							pOutValues += msg.wParam * lWidth;
+						pOutValues += lStart * lWidth;
 
-							for (j = msg.wParam; j < msg.wParam + msg.lParam; j++)
+						for (j = lStart; j < lStart + lCount; j++)
+						{
+							for (i = 0; i < lWidth; i++)
 							{
-								for (i = 0; i < lWidth; i++)
+								// Compute the min and max values in X and Y
+								LONG			lXMin, lXMax,
+									lYMin, lYMax;
+
+								lXMin = max(0L, i - lFilterSize);
+								lXMax = min(i + lFilterSize, lWidth - 1);
+								lYMin = max(0L, j - lFilterSize);
+								lYMax = min(j + lFilterSize, lHeight - 1);
+
+								vValues.resize((lXMax - lXMin + 1) * (lYMax - lYMin + 1));
+
+								// Fill the array with the values
+								TType* pInValues = m_pEngine->m_pvInValues;
+								TType* pAreaValues = &(vValues[0]);
+								pInValues += lXMin + (lYMin * lWidth);
+								for (LONG k = lYMin; k <= lYMax; k++)
 								{
-									// Compute the min and max values in X and Y
-									LONG			lXMin, lXMax,
-										lYMin, lYMax;
-
-									lXMin = max(0L, i - lFilterSize);
-									lXMax = min(i + lFilterSize, lWidth - 1);
-									lYMin = max(0L, j - lFilterSize);
-									lYMax = min(j + lFilterSize, lHeight - 1);
-
-									vValues.resize((lXMax - lXMin + 1) * (lYMax - lYMin + 1));
-
-									// Fill the array with the values
-									TType* pInValues = m_pEngine->m_pvInValues;
-									TType* pAreaValues = &(vValues[0]);
-									pInValues += lXMin + (lYMin * lWidth);
-									for (LONG k = lYMin; k <= lYMax; k++)
-									{
-										memcpy(pAreaValues, pInValues, sizeof(TType) * (lXMax - lXMin + 1));
-										pInValues += lWidth;
-										pAreaValues += lXMax - lXMin + 1;
-									};
+									memcpy(pAreaValues, pInValues, sizeof(TType) * (lXMax - lXMin + 1));
+									pInValues += lWidth;
+									pAreaValues += lXMax - lXMin + 1;
+								};
 
-									TType			fMedian = Median(vValues);
+								TType			fMedian = Median(vValues);
 
-									*pOutValues = fMedian;
-									pOutValues++;
-								};
+								*pOutValues = fMedian;
+								pOutValues++;
 							};
 						};
 					};
-
-					SetEvent(hEvent);
-				}
-				else if (msg.message == WM_MT_STOP)
-					bEnd = true;
+				};
 			};
 
 			return true;
@@ -162,33 +151,11 @@ public :
 		{
 			bool				bResult = true;
 			LONG				lHeight = m_pEngine->m_lHeight;
-			LONG				i = 0;
 			LONG				lStep;
-			LONG				lRemaining;
 
-			if (m_pProgress)
-				m_pProgress->SetNrUsedProcessors(GetNrThreads());
 			lStep		= max(1L, lHeight/50);
-			lRemaining	= lHeight;
-
-			while (i<lHeight)
-			{
-				LONG			lAdd = min(lStep, lRemaining);
-				DWORD			dwThreadId;
-
-				dwThreadId = GetAvailableThreadId();
-				PostThreadMessage(dwThreadId, WM_MT_PROCESS, i, lAdd);
-
-				i			+=lAdd;
-				lRemaining	-= lAdd;
-				if (m_pProgress)
-					m_pProgress->Progress2(nullptr, i);
-			};
-
-			CloseAllThreads();
 
-			if (m_pProgress)
-				m_pProgress->SetNrUsedProcessors();
+			bResult = ProcessChunks(0, lHeight, lStep, m_pProgress);
 
 			return bResult;
 		};
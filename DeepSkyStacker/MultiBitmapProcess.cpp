@@ -6,6 +6,9 @@
 #include "DSSProgress.h"
 #include <algorithm>
 #include <iostream>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
 #include "Multitask.h"
 #include "avx_output.h"
 
@@ -24,77 +27,154 @@ static void GetTempFileName(CString & strFile)
 /* ------------------------------------------------------------------- */
 /* ------------------------------------------------------------------- */
 
-void CMultiBitmap::SetBitmapModel(CMemoryBitmap * pBitmap)
+bool CScratchStore::Create(__int64 llSize, bool bInMemory)
 {
-	m_pBitmapModel.Attach(pBitmap->Clone(true));
+	ZFUNCTRACE_RUNTIME();
+	bool				bResult = false;
+
+	Close();
+	m_bInMemory = bInMemory;
+	if (bInMemory)
+	{
+		// Pages are zeroed on first access - nothing is touched here
+		m_pView = (BYTE *)VirtualAlloc(nullptr, llSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+	}
+	else
+	{
+		GetTempFileName(m_strFile);
+
+		m_hFile = CreateFile(m_strFile, GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+							 FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, nullptr);
+		if (m_hFile != INVALID_HANDLE_VALUE)
+		{
+			DWORD			dwReturned = 0;
+			LARGE_INTEGER	liSize;
+
+			// Sparse file: the frames are written band by band all over the file, which
+			// would otherwise force the file system to zero fill it up to each written tile
+			DeviceIoControl(m_hFile, FSCTL_SET_SPARSE, nullptr, 0, nullptr, 0, &dwReturned, nullptr);
+
+			liSize.QuadPart = llSize;
+			if (SetFilePointerEx(m_hFile, liSize, nullptr, FILE_BEGIN) && SetEndOfFile(m_hFile))
+			{
+				m_hMapping = CreateFileMapping(m_hFile, nullptr, PAGE_READWRITE, liSize.HighPart, liSize.LowPart, nullptr);
+				if (m_hMapping)
+					m_pView = (BYTE *)MapViewOfFile(m_hMapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+			};
+		};
+	};
+
+	if (m_pView)
+	{
+		m_llSize = llSize;
+		bResult = true;
+	}
+	else
+		Close();
+
+	return bResult;
 };
 
 /* ------------------------------------------------------------------- */
 
-void CMultiBitmap::DestroyTempFiles()
+void CScratchStore::Close()
 {
-	for (LONG i = 0;i<m_vFiles.size();i++)
+	if (m_pView)
 	{
-		if (m_vFiles[i].m_strFile.GetLength())
-			DeleteFile(m_vFiles[i].m_strFile);
-		m_vFiles[i].m_strFile.Empty();
+		if (m_bInMemory)
+			VirtualFree(m_pView, 0, MEM_RELEASE);
+		else
+			UnmapViewOfFile(m_pView);
 	};
-	m_vFiles.clear();
+	if (m_hMapping)
+		CloseHandle(m_hMapping);
+	if (m_hFile != INVALID_HANDLE_VALUE)
+		CloseHandle(m_hFile);
+	else if (m_strFile.GetLength())
+		DeleteFile(m_strFile);	// Created by GetTempFileName but never opened
+
+	m_pView		= nullptr;
+	m_hMapping	= nullptr;
+	m_hFile		= INVALID_HANDLE_VALUE;
+	m_llSize	= 0;
+	m_strFile.Empty();
 };
 
+/* ------------------------------------------------------------------- */
 /* ------------------------------------------------------------------- */
 
-void CMultiBitmap::InitParts()
+void CMultiBitmap::SetBitmapModel(CMemoryBitmap * pBitmap)
 {
-	ZFUNCTRACE_RUNTIME();
-	LONG				lNrLinesPerFile;
-	LONG				lNrLines;
-	LONG				lNrParts;
-	LONG				lLineSize;
-	LONG				lNrRemainingLines;
-	LONG				lNrOffsetLine = 0;
+	m_pBitmapModel.Attach(pBitmap->Clone(true));
+};
 
-	// make files a maximum of 50 Mb
+/* ------------------------------------------------------------------- */
 
-	lLineSize = (GetNrBytesPerChannel() * GetNrChannels() * m_lWidth);
+void CMultiBitmap::DestroyTempFiles()
+{
+	m_MemoryStore.Close();
+	m_FileStore.Close();
+	m_vParts.clear();
+	m_bInitDone = false;
+};
 
-	lNrLinesPerFile = 50000000L / lLineSize;
-	lNrLines = lNrLinesPerFile / m_lNrBitmaps;
-	lNrRemainingLines = lNrLinesPerFile % m_lNrBitmaps;
+/* ------------------------------------------------------------------- */
 
+bool CMultiBitmap::InitParts()
+{
+	ZFUNCTRACE_RUNTIME();
+	LONG				lNrLines;
+	const __int64		llMemoryLimit = CAllStackingTasks::GetInMemoryStackingLimit();
+	__int64				llMemorySize = 0;
+	__int64				llFileSize = 0;
+
+	// All the frames are split in row bands of about 50 Mb. Each band holds its
+	// rows for all the frames (frame after frame) so that the combine step gets
+	// each band as one contiguous block.
+	// The bands are kept in memory up to the in-memory stacking limit and the
+	// remaining ones spill to a single scratch file mapped in memory.
+	m_lScanLineSize = (GetNrBytesPerChannel() * GetNrChannels() * m_lWidth);
+
+	lNrLines = 50000000L / (m_lScanLineSize * max(1L, m_lNrBitmaps));
 	if (!lNrLines)
 		lNrLines = 1;
 
-	lNrParts = m_lNrBitmaps * m_lHeight/lNrLinesPerFile;
-	if ((m_lNrBitmaps * m_lHeight) % lNrLinesPerFile != 0)
-		lNrParts++;
-
-	m_vFiles.clear();
-
-	LONG			lStartRow = -1;
-	LONG			lEndRow	  = -1;
+	m_vParts.clear();
 
-	while (lEndRow <m_lHeight-1)
+	for (LONG lStartRow = 0;lStartRow<m_lHeight;lStartRow += lNrLines)
 	{
-		CString			strFile;
+		const LONG		lEndRow = min(lStartRow + lNrLines, m_lHeight) - 1;
+		const __int64	llPartSize = (__int64)m_lScanLineSize * m_lNrBitmaps * (lEndRow - lStartRow + 1);
 
-		GetTempFileName(strFile);
-
-		lStartRow = lEndRow+1;
-		lEndRow   = lStartRow + lNrLines;
-		if (lNrRemainingLines)
+		if (!llFileSize && llMemorySize + llPartSize <= llMemoryLimit)
+		{
+			m_vParts.emplace_back(lStartRow, lEndRow, llMemorySize, true);
+			llMemorySize += llPartSize;
+		}
+		else
 		{
-			lEndRow++;
-			lNrRemainingLines--;
+			m_vParts.emplace_back(lStartRow, lEndRow, llFileSize, false);
+			llFileSize += llPartSize;
 		};
-		lEndRow = min(lEndRow, m_lHeight-1);
-
-		CBitmapPartFile		bp(strFile, lStartRow, lEndRow);
+	};
 
-		m_vFiles.push_back(bp);
+	if (llMemorySize && !m_MemoryStore.Create(llMemorySize, true))
+	{
+		// Not enough memory after all - everything goes to the scratch file
+		llFileSize = 0;
+		for (CBitmapPart & bp : m_vParts)
+		{
+			bp.m_llOffset	= llFileSize;
+			bp.m_bInMemory	= false;
+			llFileSize += (__int64)m_lScanLineSize * m_lNrBitmaps * bp.GetNrRows();
+		};
 	};
 
-	m_bInitDone = true;
+	m_bInitDone = !llFileSize || m_FileStore.Create(llFileSize, false);
+	if (!m_bInitDone)
+		DestroyTempFiles();
+
+	return m_bInitDone;
 };
 
 /* ------------------------------------------------------------------- */
@@ -104,55 +184,41 @@ bool CMultiBitmap::AddBitmap(CMemoryBitmap * pBitmap, CDSSProgress * pProgress)
 	ZFUNCTRACE_RUNTIME();
 	bool					bResult = false;
 
-	// Save the bitmap to the temporary file
+	// Save the bitmap to the scratch file
 	if (!m_bInitDone)
 	{
 		m_lWidth = pBitmap->RealWidth();
 		m_lHeight = pBitmap->RealHeight();
-		InitParts();
 		m_lNrAddedBitmaps = 0;
+		InitParts();
 	};
 
+	if (m_bInitDone && m_lNrAddedBitmaps < m_lNrBitmaps)
 	{
-		// Save the bitmap to the file
-		void *				pScanLine = nullptr;
-		LONG				lScanLineSize;
-
-		lScanLineSize = (pBitmap->BitPerSample() * (pBitmap->IsMonochrome() ? 1 : 3) * m_lWidth/8);
-
-		pScanLine = (void*)malloc(lScanLineSize);
-
-		if (pScanLine)
-			bResult = true;
+		bResult = true;
 		if (pProgress)
 			pProgress->Start2(nullptr, m_lHeight);
 
-		for (LONG k = 0;k<m_vFiles.size() && bResult;k++)
+		// The scan lines are written directly in the frame tile of each band
+		for (LONG k = 0;k<m_vParts.size() && bResult;k++)
 		{
-			FILE *				hFile;
+			const CBitmapPart &	bp = m_vParts[k];
+			BYTE *				pTile;
+
+			pTile = GetPartBuffer(bp) + (__int64)m_lNrAddedBitmaps * bp.GetNrRows() * m_lScanLineSize;
 
-			hFile = _tfopen(m_vFiles[k].m_strFile, _T("a+b"));
-			if (hFile)
+			for (LONG j = bp.m_lStartRow;j<=bp.m_lEndRow && bResult;j++)
 			{
-				bResult = true;
-				fseek(hFile, 0, SEEK_END);
+				bResult = pBitmap->GetScanLine(j, pTile);
+				pTile += m_lScanLineSize;
 			};
-			for (LONG j = m_vFiles[k].m_lStartRow;j<=m_vFiles[k].m_lEndRow && bResult;j++)
-			{
-				pBitmap->GetScanLine(j, pScanLine);
-				bResult = (fwrite(pScanLine, lScanLineSize, 1, hFile) == 1);
 
-				if (pProgress)
-					pProgress->Progress2(nullptr, j+1);
-			};
-			if (hFile)
-				fclose(hFile);
+			if (pProgress)
+				pProgress->Progress2(nullptr, bp.m_lEndRow+1);
 		};
 
 		if (pProgress)
 			pProgress->End2();
-		if (pScanLine)
-			free(pScanLine);
 		m_lNrAddedBitmaps++;
 	};
 
@@ -201,68 +267,52 @@ public :
 		m_pHomBitmap	= pHomBitmap;
 	};
 
-	virtual bool	DoTask(HANDLE hEvent);
+	virtual bool	DoTask();
 	virtual bool	Process();
 };
 
 /* ------------------------------------------------------------------- */
 
-bool	CCombineTask::DoTask(HANDLE hEvent)
+bool	CCombineTask::DoTask()
 {
 	ZFUNCTRACE_RUNTIME();
 	bool				bResult = true;
 
 	LONG				i;
-	bool				bEnd = false;
-	MSG					msg;
+	LONG				lStart, lCount;
 	LONG				lNrBitmaps = m_pMultiBitmap->GetNrAddedBitmaps();
 	std::vector<void *>	vScanLines;
 
 	vScanLines.reserve(lNrBitmaps);
-	// Create a message queue and signal the event
-	PeekMessage(&msg, nullptr, 0, 0, PM_NOREMOVE);
-	SetEvent(hEvent);
 	try
 	{
 		AvxOutputComposition avxOutputComposition(*m_pMultiBitmap, *m_pBitmap);
 
-		while (!bEnd && GetMessage(&msg, nullptr, 0, 0))
+		while (GetNextChunk(lStart, lCount))
 		{
-			if (msg.message == WM_MT_PROCESS)
+			for (i = lStart; i < lStart + lCount; i++)
 			{
-				for (i = msg.wParam; i < msg.wParam + msg.lParam && !bEnd; i++)
-				{
-					void *				pScanLine;
+				void *				pScanLine;
 
-					vScanLines.resize(0);
+				vScanLines.resize(0);
 
-					for (LONG k = 0; k < lNrBitmaps && !bEnd; k++)
-					{
-						LONG			lOffset;
-
-						lOffset = k * (m_lEndRow - m_lStartRow + 1) * m_lScanLineSize
-							+ (i - m_lStartRow) * m_lScanLineSize;
-						pScanLine = (void*)(((BYTE*)m_pBuffer) + lOffset);
+				for (LONG k = 0; k < lNrBitmaps; k++)
+				{
+					LONG			lOffset;
 
-						vScanLines.push_back(pScanLine);
-						if (m_pProgress)
-							bEnd = m_pProgress->IsCanceled();
-					};
+					lOffset = k * (m_lEndRow - m_lStartRow + 1) * m_lScanLineSize
+						+ (i - m_lStartRow) * m_lScanLineSize;
+					pScanLine = (void*)(((BYTE*)m_pBuffer) + lOffset);
 
-					if (!bEnd)
-					{
-						// First try AVX accelerated code, if not supported -> run conventional code.
-						if (avxOutputComposition.compose(i, vScanLines) != 0)
-						{
-							m_pMultiBitmap->SetScanLines(m_pBitmap, i, vScanLines);
-						}
-					}
+					vScanLines.push_back(pScanLine);
 				};
 
-				SetEvent(hEvent);
-			}
-			else if (msg.message == WM_MT_STOP)
-				bEnd = true;
+				// First try AVX accelerated code, if not supported -> run conventional code.
+				if (avxOutputComposition.compose(i, vScanLines) != 0)
+				{
+					m_pMultiBitmap->SetScanLines(m_pBitmap, i, vScanLines);
+				}
+			};
 		};
 	}
 	catch (std::exception & e)
@@ -324,147 +374,305 @@ bool	CCombineTask::Process()
 {
 	ZFUNCTRACE_RUNTIME();
 	bool			bResult = true;
-	LONG			i = m_lStartRow;
 	LONG			lStep;
-	LONG			lRemaining;
 
-	if (m_pProgress)
-		m_pProgress->SetNrUsedProcessors(GetNrThreads());
 	lStep		= max(1L, (m_lEndRow-m_lStartRow+1)/50);
-	lRemaining	= m_lEndRow-m_lStartRow+1;
 
-	while (i<=m_lEndRow && bResult)
-	{
-		DWORD			dwThreadId;
-		LONG			lAdd = min(lStep, lRemaining);
+	bResult = ProcessChunks(m_lStartRow, m_lEndRow+1, lStep, m_pProgress, true);
 
-		dwThreadId = GetAvailableThreadId();
+	return bResult;
+};
+
+/* ------------------------------------------------------------------- */
 
-		PostThreadMessage(dwThreadId, WM_MT_PROCESS, i, lAdd);
+void	CMultiBitmap::SmoothOut(CMemoryBitmap * pBitmap, CMemoryBitmap ** ppOutBitmap)
+{
+	ZFUNCTRACE_RUNTIME();
+	if (m_pHomBitmap)
+	{
+		CSmartPtr<CMemoryBitmap>	pOutBitmap;
+		CMemoryBitmap *				pHomBitmap = m_pHomBitmap;
+		const LONG					lWidth = pBitmap->Width();
+		const LONG					lHeight = pBitmap->Height();
+		const LONG					lNrChannels = pBitmap->IsMonochrome() ? 1 : 3;
+		constexpr LONG				lRadius = 5;
+		constexpr LONG				lWindow = 2 * lRadius + 1;
 
-		i			+= lAdd;
-		lRemaining	-= lAdd;
+		pOutBitmap.Attach(pBitmap->Clone());
 
-		if (m_pProgress)
+		// Each pixel is replaced by the weighted average of the 11x11 area around it
+		// (clipped to the picture), each pixel of the area having a weight of
+		// 1/(1+homogenization value).
+		// The sums over the area are running sums - first along the rows, then along
+		// the columns - so the cost per pixel does not depend on the size of the area.
+		// Bands of rows are processed in parallel.
+		ParallelFor(0, lHeight, 64, [&](const LONG lStartRow, const LONG lEndRow)
 		{
-			m_pProgress->Progress2(nullptr, i);
-			bResult = !m_pProgress->IsCanceled();
-		}
-	};
+			const LONG				lNrValues = lWidth * lNrChannels;
+			std::vector<double>		vPixelValues(lNrValues);
+			std::vector<double>		vPixelWeights(lNrValues);
+			// Row sums of the last 11 rows (ring buffer indexed by row % 11)
+			std::vector<double>		vRowValues(lWindow * lNrValues);
+			std::vector<double>		vRowWeights(lWindow * lNrValues);
+			// Sums over the area for the current row
+			std::vector<double>		vValues(lNrValues, 0.0);
+			std::vector<double>		vWeights(lNrValues, 0.0);
+
+			const auto	computeRowSums = [&](const LONG j)
+			{
+				double * const		pRowValues = vRowValues.data() + (j % lWindow) * lNrValues;
+				double * const		pRowWeights = vRowWeights.data() + (j % lWindow) * lNrValues;
 
-	CloseAllThreads();
+				for (LONG i = 0, k = 0;i<lWidth;i++)
+				{
+					if (lNrChannels == 1)
+					{
+						double		fGray, fWGray;
 
-	if (m_pProgress)
-		m_pProgress->SetNrUsedProcessors();
+						pBitmap->GetPixel(i, j, fGray);
+						pHomBitmap->GetPixel(i, j, fWGray);
+						vPixelValues[k]  = fGray/(1.0+fWGray);
+						vPixelWeights[k++] = 1.0/(1.0+fWGray);
+					}
+					else
+					{
+						double		fRed, fGreen, fBlue;
+						double		fWRed, fWGreen, fWBlue;
+
+						pBitmap->GetPixel(i, j, fRed, fGreen, fBlue);
+						pHomBitmap->GetPixel(i, j, fWRed, fWGreen, fWBlue);
+						vPixelValues[k]  = fRed/(1.0+fWRed);
+						vPixelWeights[k++] = 1.0/(1.0+fWRed);
+						vPixelValues[k]  = fGreen/(1.0+fWGreen);
+						vPixelWeights[k++] = 1.0/(1.0+fWGreen);
+						vPixelValues[k]  = fBlue/(1.0+fWBlue);
+						vPixelWeights[k++] = 1.0/(1.0+fWBlue);
+					};
+				};
 
-	return bResult;
+				for (LONG c = 0;c<lNrChannels;c++)
+				{
+					double		fSumValues = 0.0;
+					double		fSumWeights = 0.0;
+
+					for (LONG i = 0;i<min(lRadius, lWidth);i++)
+					{
+						fSumValues  += vPixelValues[i*lNrChannels+c];
+						fSumWeights += vPixelWeights[i*lNrChannels+c];
+					};
+					for (LONG i = 0;i<lWidth;i++)
+					{
+						if (i + lRadius < lWidth)
+						{
+							fSumValues  += vPixelValues[(i+lRadius)*lNrChannels+c];
+							fSumWeights += vPixelWeights[(i+lRadius)*lNrChannels+c];
+						};
+						if (i - lRadius - 1 >= 0)
+						{
+							fSumValues  -= vPixelValues[(i-lRadius-1)*lNrChannels+c];
+							fSumWeights -= vPixelWeights[(i-lRadius-1)*lNrChannels+c];
+						};
+						pRowValues[i*lNrChannels+c]  = fSumValues;
+						pRowWeights[i*lNrChannels+c] = fSumWeights;
+					};
+				};
+
+				for (LONG k = 0;k<lNrValues;k++)
+				{
+					vValues[k]  += pRowValues[k];
+					vWeights[k] += pRowWeights[k];
+				};
+			};
+
+			const auto	removeRowSums = [&](const LONG j)
+			{
+				const double * const	pRowValues = vRowValues.data() + (j % lWindow) * lNrValues;
+				const double * const	pRowWeights = vRowWeights.data() + (j % lWindow) * lNrValues;
+
+				for (LONG k = 0;k<lNrValues;k++)
+				{
+					vValues[k]  -= pRowValues[k];
+					vWeights[k] -= pRowWeights[k];
+				};
+			};
+
+			for (LONG j = max(0L, lStartRow - lRadius);j<min(lHeight, lStartRow + lRadius);j++)
+				computeRowSums(j);
+
+			for (LONG j = lStartRow;j<lEndRow;j++)
+			{
+				// The row leaving the area uses the same ring buffer slot as the one entering it
+				if (j - lRadius - 1 >= 0)
+					removeRowSums(j - lRadius - 1);
+				if (j + lRadius < lHeight)
+					computeRowSums(j + lRadius);
+
+				for (LONG i = 0;i<lWidth;i++)
+				{
+					const double *	pValue = &vValues[i*lNrChannels];
+					const double *	pWeight = &vWeights[i*lNrChannels];
+
+					if (lNrChannels == 1)
+						pOutBitmap->SetPixel(i, j, pValue[0]/pWeight[0]);
+					else
+						pOutBitmap->SetPixel(i, j, pValue[0]/pWeight[0], pValue[1]/pWeight[1], pValue[2]/pWeight[2]);
+				};
+			};
+		});
+
+		pOutBitmap.CopyTo(ppOutBitmap);
+	};
 };
 
+/* ------------------------------------------------------------------- */
 /* ------------------------------------------------------------------- */
 
-static	void ComputeWeightedAverage(LONG x, LONG y, CMemoryBitmap * pBitmap, CMemoryBitmap * pHomBitmap, CMemoryBitmap * pOutBitmap)
+// Reads the bands stored in the scratch file in a background thread, ahead of the one
+// being combined, so that the disk and the processors are busy at the same time.
+// Up to lNrBuffers bands (including the one being combined) are in flight.
+// The reader mostly waits for the disk or for the combining: it has its own thread
+// instead of blocking a worker of the pool (it could also never start when the
+// caller is the only worker).
+class CPartReader
 {
-	//ZFUNCTRACE_RUNTIME();
-	bool			bColor = pBitmap->IsMonochrome();
-	LONG			lWidth = pBitmap->Width();
-	LONG			lHeight = pBitmap->Height();
-
-	if (bColor)
+public :
+	class CBuffer
 	{
-		double		fRed = 0, fGreen = 0, fBlue = 0;
-		double		fWRed = 0, fWGreen = 0, fWBlue = 0;
+	public :
+		const BYTE *			pBuffer = nullptr;	// nullptr for the bands kept in memory
+		__int64					llSize = 0;
+	};
 
-		for (LONG i = max(0L, x-5);i<=min(lWidth-1, x+5);i++)
-		{
-			for (LONG j = max(0L, y-5);j<=min(lHeight-1, y+5);j++)
-			{
-				double		fRed1, fGreen1, fBlue1;
-				double		fWRed1, fWGreen1, fWBlue1;
+private :
+	std::vector<CBuffer>		m_vBuffers;
+	LONG						m_lNrBuffers;
+	LONG						m_lNrRead;
+	LONG						m_lNrCombined;
+	bool						m_bStop;
+	std::mutex					m_Mutex;
+	std::condition_variable		m_Condition;
+	std::thread					m_Reader;
 
-				pBitmap->GetPixel(i, j, fRed1, fGreen1, fBlue1);
-				pHomBitmap->GetPixel(i, j, fWRed1, fWGreen1, fWBlue1);
+private :
+	static void	ReadBuffer(const CBuffer & Buffer)
+	{
+		// Layout of WIN32_MEMORY_RANGE_ENTRY (only declared when targeting Windows 8)
+		struct MEMORYRANGE
+		{
+			PVOID		VirtualAddress;
+			SIZE_T		NumberOfBytes;
+		};
+		typedef BOOL (WINAPI * PREFETCHVIRTUALMEMORY)(HANDLE, ULONG_PTR, MEMORYRANGE *, ULONG);
+		static const PREFETCHVIRTUALMEMORY	pPrefetchVirtualMemory = reinterpret_cast<PREFETCHVIRTUALMEMORY>(
+			GetProcAddress(GetModuleHandle(_T("kernel32.dll")), "PrefetchVirtualMemory"));
+		volatile BYTE			bSink = 0;
 
-				fRed	+= fRed1/(1.0+fWRed1);
-				fGreen	+= fGreen1/(1.0+fWGreen1);
-				fBlue	+= fBlue1/(1.0+fWBlue1);
+		// Ask for the whole band at once when possible (Windows 8 and later)...
+		if (pPrefetchVirtualMemory)
+		{
+			MEMORYRANGE			Range;
 
-				fWRed   += 1.0/(1.0+fWRed1);
-				fWGreen += 1.0/(1.0+fWGreen1);
-				fWBlue  += 1.0/(1.0+fWBlue1);
-			};
+			Range.VirtualAddress = const_cast<BYTE *>(Buffer.pBuffer);
+			Range.NumberOfBytes  = static_cast<SIZE_T>(Buffer.llSize);
+			pPrefetchVirtualMemory(GetCurrentProcess(), 1, &Range, 0);
 		};
 
-		fRed   /= fWRed;
-		fGreen /= fWGreen;
-		fBlue  /= fWBlue;
+		// ... and touch every page so that the band is resident when it is combined
+		for (__int64 i = 0;i<Buffer.llSize;i += 4096)
+			bSink += Buffer.pBuffer[i];
+	};
 
-		pOutBitmap->SetPixel(x, y, fRed, fGreen, fBlue);
-	}
-	else
+	void	ReadParts()
 	{
-		double		fGray = 0;
-		double		fWGray = 0;
-
-		for (LONG i = max(0L, x-5);i<=min(lWidth-1, x+5);i++)
+		for (LONG lPart = 0;lPart<(LONG)m_vBuffers.size();lPart++)
 		{
-			for (LONG j = max(0L, y-5);j<=min(lHeight-1, y+5);j++)
 			{
-				double		fGray1;
-				double		fWGray1;
+				std::unique_lock<std::mutex>	Lock(m_Mutex);
 
-				pBitmap->GetPixel(i, j, fGray1);
-				pHomBitmap->GetPixel(i, j, fWGray1);
+				m_Condition.wait(Lock, [&]() { return m_bStop || lPart < m_lNrCombined + m_lNrBuffers; });
+				if (m_bStop)
+					break;
+			};
 
-				fGray	+= fGray1/(1.0+fWGray1);
+			if (m_vBuffers[lPart].pBuffer)
+				ReadBuffer(m_vBuffers[lPart]);
 
-				fWGray   += 1.0/(1.0+fWGray1);
+			{
+				std::lock_guard<std::mutex>		Lock(m_Mutex);
+
+				m_lNrRead = lPart + 1;
 			};
+			m_Condition.notify_all();
 		};
+	};
 
-		fGray   /= fWGray;
+public :
+	CPartReader() :
+		m_lNrBuffers(1),
+		m_lNrRead(LONG_MAX),
+		m_lNrCombined(0),
+		m_bStop(false)
+	{
+	};
 
-		pOutBitmap->SetPixel(x, y, fGray);
+	~CPartReader()
+	{
+		Stop();
 	};
-};
 
-/* ------------------------------------------------------------------- */
+	void	Start(std::vector<CBuffer> && vBuffers, LONG lNrBuffers)
+	{
+		const bool		bFromFile = std::any_of(vBuffers.cbegin(), vBuffers.cend(), [](const CBuffer & Buffer) { return Buffer.pBuffer != nullptr; });
 
-void	CMultiBitmap::SmoothOut(CMemoryBitmap * pBitmap, CMemoryBitmap ** ppOutBitmap)
-{
-	if (m_pHomBitmap)
+		if (lNrBuffers > 1 && bFromFile)
+		{
+			m_vBuffers	 = std::move(vBuffers);
+			m_lNrBuffers = lNrBuffers;
+			m_lNrRead	 = 0;
+			m_Reader	 = std::thread(&CPartReader::ReadParts, this);
+		};
+	};
+
+	void	WaitForPart(LONG lPart)
 	{
-		CSmartPtr<CMemoryBitmap>	pOutBitmap;
+		std::unique_lock<std::mutex>	Lock(m_Mutex);
 
-		pOutBitmap.Attach(pBitmap->Clone());
+		m_Condition.wait(Lock, [&]() { return m_lNrRead > lPart; });
+	};
 
-		for (LONG i = 0;i<m_lWidth;i++)
+	void	SetPartCombined(LONG lPart)
+	{
 		{
-			for (LONG j = 0;j<m_lHeight;j++)
-			{
-				// Compute the weighted average of a 11x11 area around each pixel
-				// It can be lengthy!
-				ComputeWeightedAverage(i, j, pBitmap, m_pHomBitmap, pOutBitmap);
-			};
+			std::lock_guard<std::mutex>		Lock(m_Mutex);
+
+			m_lNrCombined = lPart + 1;
 		};
+		m_Condition.notify_all();
+	};
 
-		pOutBitmap.CopyTo(ppOutBitmap);
+	void	Stop()
+	{
+		{
+			std::lock_guard<std::mutex>		Lock(m_Mutex);
+
+			m_bStop = true;
+		};
+		m_Condition.notify_all();
+		if (m_Reader.joinable())
+			m_Reader.join();
 	};
 };
 
-/* ------------------------------------------------------------------- */
 /* ------------------------------------------------------------------- */
 
 bool CMultiBitmap::GetResult(CMemoryBitmap ** ppBitmap, CDSSProgress * pProgress)
 {
 	ZFUNCTRACE_RUNTIME();
 	bool						bResult = false;
-	LONG						lScanLineSize;
-	LONG						/*i, k, */l;
+	LONG						l;
 	CSmartPtr<CMemoryBitmap>	pBitmap;
-	LONG						lBufferSize = 0;
-	void *						pBuffer = nullptr;
 
-	if (m_bInitDone && m_vFiles.size())
+	if (m_bInitDone && m_vParts.size())
 	{
 		*ppBitmap = nullptr;
 		bResult = false;
@@ -488,55 +696,48 @@ bool CMultiBitmap::GetResult(CMemoryBitmap ** ppBitmap, CDSSProgress * pProgress
 		if (pProgress && bResult)
 			pProgress->Start2(nullptr, m_lHeight);
 
-		lScanLineSize = (GetNrBytesPerChannel() * GetNrChannels() * m_lWidth);
+		// The bands are combined straight from the memory or the mapped scratch file.
+		// The bands stored in the scratch file are read ahead of the one being combined.
+		CPartReader					PartReader;
 
-		//lScanLineSize = m_lWidth * GetNrChannels() * GetNrBytesPerChannel();
-		for (l = 0;l<m_vFiles.size() && bResult;l++)
+		if (bResult)
 		{
-			// Read the full bitmap in memory
-			LONG					lFileSize;
-			FILE *					hFile;
-
-			lFileSize = lScanLineSize * m_lNrAddedBitmaps*
-						(m_vFiles[l].m_lEndRow - m_vFiles[l].m_lStartRow+1);
+			std::vector<CPartReader::CBuffer>	vBuffers;
 
-			if (lFileSize > lBufferSize)
+			for (const CBitmapPart & bp : m_vParts)
 			{
-				if (pBuffer)
-					free(pBuffer);
-				pBuffer = (void *)malloc(lFileSize);
-				lBufferSize = lFileSize;
+				CPartReader::CBuffer	Buffer;
+
+				if (!bp.m_bInMemory)
+				{
+					Buffer.pBuffer = GetPartBuffer(bp);
+					Buffer.llSize  = (__int64)m_lScanLineSize * m_lNrAddedBitmaps * bp.GetNrRows();
+				};
+				vBuffers.push_back(Buffer);
 			};
-			hFile = _tfopen(m_vFiles[l].m_strFile, _T("rb"));
-			if (hFile)
-			{
-				bResult = (fread(pBuffer, 1, lFileSize, hFile) == lFileSize);
-				fclose(hFile);
-			}
-			else
-				bResult = false;
+			PartReader.Start(std::move(vBuffers), CAllStackingTasks::GetCombineBuffers());
+		};
 
+		for (l = 0;l<m_vParts.size() && bResult;l++)
+		{
+			PartReader.WaitForPart(l);
 			{
 				CCombineTask		CombineTask;
 
-				CombineTask.Init(m_vFiles[l].m_lStartRow, m_vFiles[l].m_lEndRow, lScanLineSize,
-								 pBuffer, pProgress, this, pBitmap);
+				CombineTask.Init(m_vParts[l].m_lStartRow, m_vParts[l].m_lEndRow, m_lScanLineSize,
+								 GetPartBuffer(m_vParts[l]), pProgress, this, pBitmap);
 				CombineTask.StartThreads();
 				CombineTask.Process();
 			};
+			PartReader.SetPartCombined(l);
 
 			if (pProgress)
-			{
-				pProgress->End2();
 				bResult = !pProgress->IsCanceled();
-			}
 		};
+		PartReader.Stop();
 
-		if (pBuffer)
-		{
-			free(pBuffer);
-			pBuffer = nullptr;
-		};
+		if (pProgress)
+			pProgress->End2();
 
 		if (bResult)
 		{
@@ -1,22 +1,82 @@
 #include <stdafx.h>
 
 #include "Multitask.h"
+#include "DSSProgress.h"
+#include "avx_simd.h"
+
+#include <chrono>
 
 #include <QSettings>
 /* ------------------------------------------------------------------- */
 
+namespace
+{
+	// Maximum number of threads for the jobs started by this thread (0 = no limit)
+	thread_local LONG	g_lThreadBudget = 0;
+
+	// The multitask settings are read at the first use and then kept up to date
+	// by the setters, since they are read by every ParallelFor.
+	class CMultitaskSettings
+	{
+	public :
+		std::atomic<DWORD>	m_dwMaxProcessors;
+		std::atomic<bool>	m_bReducedThreadsPriority;
+		std::atomic<bool>	m_bUseSimd;
+
+		CMultitaskSettings()
+		{
+			QSettings		settings;
+
+			m_dwMaxProcessors			= settings.value("MaxProcessors", (uint)0).toUInt();
+			m_bReducedThreadsPriority	= settings.value("ReducedThreadPriority", true).toBool();
+			m_bUseSimd					= settings.value("UseSimd", true).toBool();
+			SimdKernels::setUseSimd(m_bUseSimd);
+		};
+	};
+
+	CMultitaskSettings & GetSettings()
+	{
+		static CMultitaskSettings	Settings;
+
+		return Settings;
+	};
+
+	// Sets the thread budget of the thread running a task to the one of the
+	// thread which started it (0 = no limit) and restores it afterwards
+	class CInheritedThreadBudget
+	{
+	private :
+		LONG				m_lPreviousBudget;
+
+	public :
+		explicit CInheritedThreadBudget(LONG lThreadBudget) :
+			m_lPreviousBudget(g_lThreadBudget)
+		{
+			g_lThreadBudget = lThreadBudget;
+		};
+
+		~CInheritedThreadBudget()
+		{
+			g_lThreadBudget = m_lPreviousBudget;
+		};
+	};
+};
+
+/* ------------------------------------------------------------------- */
+
 LONG	CMultitask::GetNrProcessors(bool bReal)
 {
 	LONG				lResult = 1;
-	QSettings			settings;
 	SYSTEM_INFO			SysInfo;
 	
-	DWORD dwMaxProcessors = settings.value("MaxProcessors", (uint)0).toUInt();
+	DWORD dwMaxProcessors = GetSettings().m_dwMaxProcessors;
 
 	GetSystemInfo(&SysInfo);
 	lResult		= SysInfo.dwNumberOfProcessors;
 	if (!bReal && dwMaxProcessors)
 		lResult = min(static_cast<long>(dwMaxProcessors), lResult);
+	if (!bReal && g_lThreadBudget)
+		lResult = min(g_lThreadBudget, lResult);
 
 	return lResult;
 };
@@ -27,20 +87,30 @@ void	CMultitask::SetUseAllProcessors(bool bUseAll)
 {
 	QSettings			settings;
 
-	if (bUseAll)
-		settings.setValue("MaxProcessors", (uint)0);
-	else
-		settings.setValue("MaxProcessors", (uint)1);
+	GetSettings().m_dwMaxProcessors = bUseAll ? 0 : 1;
+	settings.setValue("MaxProcessors", (uint)GetSettings().m_dwMaxProcessors);
 };
 
 /* ------------------------------------------------------------------- */
 
-bool	CMultitask::GetReducedThreadsPriority()
+CThreadBudget::CThreadBudget(LONG lNrThreads) :
+	m_lPreviousBudget(g_lThreadBudget)
 {
-	QSettings			settings;
+	g_lThreadBudget = max(1L, lNrThreads);
+};
+
+/* ------------------------------------------------------------------- */
 
-	return settings.value("ReducedThreadPriority", true).toBool();
+CThreadBudget::~CThreadBudget()
+{
+	g_lThreadBudget = m_lPreviousBudget;
+};
+
+/* ------------------------------------------------------------------- */
 
+bool	CMultitask::GetReducedThreadsPriority()
+{
+	return GetSettings().m_bReducedThreadsPriority;
 };
 
 /* ------------------------------------------------------------------- */
@@ -49,135 +119,334 @@ void	CMultitask::SetReducedThreadsPriority(bool bReduced)
 {
 	QSettings			settings;
 
+	GetSettings().m_bReducedThreadsPriority = bReduced;
 	settings.setValue("ReducedThreadPriority", bReduced);
 };
 
 bool CMultitask::GetUseSimd()
 {
-	return QSettings{}.value("UseSimd", true).toBool();
+	return GetSettings().m_bUseSimd;
 }
 
 void CMultitask::SetUseSimd(const bool bUseSimd)
 {
+	GetSettings().m_bUseSimd = bUseSimd;
+	SimdKernels::setUseSimd(bUseSimd);
 	QSettings{}.setValue("UseSimd", bUseSimd);
 }
 
 /* ------------------------------------------------------------------- */
 
-DWORD	WINAPI	StartThreadProc(LPVOID lpParameter)
+void	CMultitask::LoadSettings()
 {
-	DWORD				dwResult = 0;
-	CMultitask *		pMultitask = reinterpret_cast<CMultitask *>(lpParameter);
+	GetSettings();
+};
 
-	if (pMultitask)
-		pMultitask->DoTask(pMultitask->GetThreadEvent(GetCurrentThreadId()));
+/* ------------------------------------------------------------------- */
 
-	return dwResult;
+namespace
+{
+	// Index of the pool worker running on this thread, -1 for other threads
+	thread_local LONG	g_lWorkerIndex = -1;
 };
 
 /* ------------------------------------------------------------------- */
 
-HANDLE	CMultitask::GetAvailableThread()
+CThreadPool::CThreadPool() :
+	m_lNrQueued(0),
+	m_lNextQueue(0),
+	m_bStop(false),
+	m_bReducedPriority(CMultitask::GetReducedThreadsPriority())
 {
-	HANDLE				hResult = nullptr;
-	DWORD				dwResult;
+	// The calling thread always takes part in the work, so one thread less is needed
+	LONG				lNrWorkers = max(1L, (LONG)std::thread::hardware_concurrency() - 1);
+
+	for (LONG i = 0;i<lNrWorkers;i++)
+		m_vQueues.push_back(std::make_unique<CWorkerQueue>());
+	for (LONG i = 0;i<lNrWorkers;i++)
+		m_vThreads.emplace_back(&CThreadPool::WorkerLoop, this, i);
+};
+
+/* ------------------------------------------------------------------- */
 
-	dwResult = WaitForMultipleObjects((DWORD)m_vEvents.size(), &(m_vEvents[0]), false, INFINITE);
-	if ((dwResult >= WAIT_OBJECT_0) && (dwResult < WAIT_OBJECT_0+(DWORD)m_vEvents.size()))
+CThreadPool::~CThreadPool()
+{
 	{
-		// An event was triggered
-		LONG			lIndice = dwResult-WAIT_OBJECT_0;
+		std::lock_guard<std::mutex>	Lock(m_WakeMutex);
+		m_bStop = true;
+	};
+	m_WakeCondition.notify_all();
+
+	for (std::thread & Thread : m_vThreads)
+		Thread.join();
+};
+
+/* ------------------------------------------------------------------- */
+
+CThreadPool & CThreadPool::GetInstance()
+{
+	// Never destroyed: the workers must stay alive until the process exits
+	// (some tasks call exit() from a worker thread).
+	static CThreadPool *	s_pThreadPool = new CThreadPool;
+
+	return *s_pThreadPool;
+};
+
+/* ------------------------------------------------------------------- */
+
+LONG	CThreadPool::GetCurrentWorkerIndex()
+{
+	return g_lWorkerIndex;
+};
+
+/* ------------------------------------------------------------------- */
+
+void	CThreadPool::Submit(TASK Task)
+{
+	LONG				lIndex = g_lWorkerIndex;
+
+	// Tasks submitted by a worker go to its own queue (LIFO, cache friendly),
+	// other tasks are spread over all the queues.
+	if (lIndex < 0)
+		lIndex = (m_lNextQueue++ & 0x7FFFFFFF) % (LONG)m_vQueues.size();
 
-		ResetEvent(m_vEvents[lIndice]);
-		hResult = m_vThreads[lIndice];
+	{
+		std::lock_guard<std::mutex>	Lock(m_vQueues[lIndex]->m_Mutex);
+		m_vQueues[lIndex]->m_qTasks.push_back(std::move(Task));
 	};
 
-	return hResult;
+	{
+		std::lock_guard<std::mutex>	Lock(m_WakeMutex);
+		m_lNrQueued++;
+	};
+	m_WakeCondition.notify_one();
 };
+
 /* ------------------------------------------------------------------- */
 
-DWORD	CMultitask::GetAvailableThreadId()
+bool	CThreadPool::PopTask(LONG lIndex, TASK & Task)
 {
-	DWORD				hResult = 0;
-	DWORD				dwResult;
+	bool				bResult = false;
+	const LONG			lNrQueues = (LONG)m_vQueues.size();
+
+	if (m_lNrQueued <= 0)
+		return false;
+
+	// First the own queue (newest task)
+	if (lIndex >= 0)
+	{
+		CWorkerQueue &				Queue = *m_vQueues[lIndex];
+		std::lock_guard<std::mutex>	Lock(Queue.m_Mutex);
 
-	dwResult = WaitForMultipleObjects((DWORD)m_vEvents.size(), &(m_vEvents[0]), false, INFINITE);
-	if ((dwResult >= WAIT_OBJECT_0) && (dwResult < WAIT_OBJECT_0+m_vEvents.size()))
+		if (!Queue.m_qTasks.empty())
+		{
+			Task = std::move(Queue.m_qTasks.back());
+			Queue.m_qTasks.pop_back();
+			bResult = true;
+		};
+	};
+
+	// Then steal the oldest task of another queue
+	for (LONG i = 1;i<=lNrQueues && !bResult;i++)
 	{
-		// An event was triggered
-		LONG			lIndice = dwResult-WAIT_OBJECT_0;
+		CWorkerQueue &				Queue = *m_vQueues[(max(lIndex, 0L) + i) % lNrQueues];
+		std::lock_guard<std::mutex>	Lock(Queue.m_Mutex);
 
-		ResetEvent(m_vEvents[lIndice]);
-		hResult = m_vThreadIds[lIndice];
+		if (!Queue.m_qTasks.empty())
+		{
+			Task = std::move(Queue.m_qTasks.front());
+			Queue.m_qTasks.pop_front();
+			bResult = true;
+		};
 	};
 
-	return hResult;
+	if (bResult)
+		m_lNrQueued--;
+
+	return bResult;
 };
 
 /* ------------------------------------------------------------------- */
 
-void	CMultitask::StartThreads(LONG lNrThreads)
+void	CThreadPool::WorkerLoop(LONG lIndex)
 {
-	LONG				i;
-
-	if (!lNrThreads)
-		lNrThreads = GetNrProcessors();
+	bool				bReducedPriority = false;
 
-	for (i = 0;i<lNrThreads;i++)
+	g_lWorkerIndex = lIndex;
+	while (!m_bStop)
 	{
-		// Create a thread for each task
-		DWORD			dwThreadID;
-		HANDLE			hEvent;
-		HANDLE			hThread;
+		TASK			Task;
 
-		hEvent	= CreateEvent(nullptr, true, false, nullptr);
-		if (hEvent)
+		if (PopTask(lIndex, Task))
 		{
-			m_vEvents.push_back(hEvent);
-			hThread = CreateThread(nullptr, 0, StartThreadProc, (LPVOID)this, CREATE_SUSPENDED, &dwThreadID);
-			if (hThread)
+			if (bReducedPriority != m_bReducedPriority)
 			{
-				m_vThreads.push_back(hThread);
-				m_vThreadIds.push_back(dwThreadID);
+				bReducedPriority = m_bReducedPriority;
+#if defined(_WIN32)
+				SetThreadPriority(GetCurrentThread(), bReducedPriority ? THREAD_PRIORITY_BELOW_NORMAL : THREAD_PRIORITY_NORMAL);
+#endif
 			};
+			Task();
+		}
+		else
+		{
+			std::unique_lock<std::mutex>	Lock(m_WakeMutex);
+
+			m_WakeCondition.wait(Lock, [this]() { return m_bStop || m_lNrQueued > 0; });
 		};
 	};
+};
+
+/* ------------------------------------------------------------------- */
+/* ------------------------------------------------------------------- */
+
+bool	CTaskGroup::CState::RunNextTask()
+{
+	std::function<void()>	Task;
+
+	{
+		std::lock_guard<std::mutex>	Lock(m_Mutex);
+
+		if (m_qTasks.empty())
+			return false;
+		Task = std::move(m_qTasks.front());
+		m_qTasks.pop_front();
+	};
 
-	if (GetReducedThreadsPriority())
+	try
 	{
-		for (i = 0;i<lNrThreads;i++)
-			SetThreadPriority(m_vThreads[i], THREAD_PRIORITY_BELOW_NORMAL);
+		Task();
+	}
+	catch (...)
+	{
+		std::lock_guard<std::mutex>	Lock(m_Mutex);
+
+		if (!m_pException)
+			m_pException = std::current_exception();
 	};
 
-	for (i = 0;i<lNrThreads;i++)
-		ResumeThread(m_vThreads[i]);
+	std::lock_guard<std::mutex>	Lock(m_Mutex);
+	if (--m_lNrPending == 0)
+		m_Condition.notify_all();
+
+	return true;
 };
 
 /* ------------------------------------------------------------------- */
 
-void	CMultitask::CloseAllThreads()
+void	CTaskGroup::Run(std::function<void()> Task)
 {
-	if (m_vThreads.size())
+	// The task is run with the thread budget of the thread which started it,
+	// whichever thread runs it
+	const LONG			lThreadBudget = g_lThreadBudget;
+
 	{
-		WaitForMultipleObjects((DWORD)m_vEvents.size(), &(m_vEvents[0]), true, INFINITE);
+		std::lock_guard<std::mutex>	Lock(m_pState->m_Mutex);
 
-		for (LONG i = 0;i<m_vThreads.size();i++)
+		m_pState->m_qTasks.push_back([Task = std::move(Task), lThreadBudget]()
 		{
-			PostThreadMessage(m_vThreadIds[i], WM_MT_STOP, 0, 0);
-		};
+			CInheritedThreadBudget	ThreadBudget(lThreadBudget);
 
-		WaitForMultipleObjects((DWORD)m_vThreads.size(), &(m_vThreads[0]), true, INFINITE);
+			Task();
+		});
+		m_pState->m_lNrPending++;
+	};
 
-		for (LONG i = 0;i<m_vThreads.size();i++)
-		{
-			CloseHandle(m_vThreads[i]);
-			CloseHandle(m_vEvents[i]);
-		};
+	// The pool task runs one task of the group, if the waiting thread did
+	// not already run it
+	CThreadPool::GetInstance().Submit([pState = m_pState]()
+	{
+		pState->RunNextTask();
+	});
+};
+
+/* ------------------------------------------------------------------- */
+
+void	CTaskGroup::Wait()
+{
+	// Run the tasks not started yet, then wait for the ones started by the workers
+	while (m_pState->RunNextTask())
+		;
+
+	std::exception_ptr				pException;
+	std::unique_lock<std::mutex>	Lock(m_pState->m_Mutex);
+
+	m_pState->m_Condition.wait(Lock, [this]() { return m_pState->m_lNrPending == 0; });
+	std::swap(pException, m_pState->m_pException);
+	Lock.unlock();
+
+	if (pException)
+		std::rethrow_exception(pException);
+};
+
+/* ------------------------------------------------------------------- */
+/* ------------------------------------------------------------------- */
+
+void	CMultitask::StartThreads(LONG lNrThreads)
+{
+	if (!lNrThreads)
+		lNrThreads = GetNrProcessors();
+
+	m_lNrThreads = max(1L, min(lNrThreads, CThreadPool::GetInstance().GetNrWorkers() + 1));
+	CThreadPool::GetInstance().SetReducedPriority(GetReducedThreadsPriority());
+};
+
+/* ------------------------------------------------------------------- */
+
+bool	CMultitask::GetNextChunk(LONG & lStart, LONG & lCount)
+{
+	if (m_bCanceled)
+		return false;
+
+	lStart = m_lNextChunk.fetch_add(m_lStep);
+	if (lStart >= m_lEnd)
+		return false;
+
+	lCount = min(m_lStep, m_lEnd - lStart);
+
+	// Only the thread which started the processing reports the progress
+	if (m_pChunkProgress && IsMainThread())
+	{
+		m_pChunkProgress->Progress2(nullptr, lStart + lCount);
+		if (m_bCancelable && m_pChunkProgress->IsCanceled())
+			m_bCanceled = true;
+	};
+
+	return true;
+};
+
+/* ------------------------------------------------------------------- */
+
+bool	CMultitask::ProcessChunks(LONG lBegin, LONG lEnd, LONG lStep, CDSSProgress * pProgress, bool bCancelable)
+{
+	ZFUNCTRACE_RUNTIME();
+
+	m_lEnd				= lEnd;
+	m_lStep				= max(1L, lStep);
+	m_lNextChunk		= lBegin;
+	m_bCanceled			= false;
+	m_MainThreadId		= std::this_thread::get_id();
+	m_pChunkProgress	= pProgress;
+	m_bCancelable		= bCancelable;
+
+	if (pProgress)
+		pProgress->SetNrUsedProcessors(GetNrThreads());
 
-		m_vThreads.clear();
-		m_vThreadIds.clear();
-		m_vEvents.clear();
+	{
+		CTaskGroup		Group;
+		LONG			lNrRunners = min(GetNrThreads(), (lEnd - lBegin + m_lStep - 1) / m_lStep);
+
+		for (LONG i = 1;i<lNrRunners;i++)
+			Group.Run([this]() { DoTask(); });
+		DoTask();
+		Group.Wait();
 	};
+
+	if (pProgress)
+		pProgress->SetNrUsedProcessors();
+	m_pChunkProgress = nullptr;
+
+	return !m_bCanceled;
 };
 
 /* ------------------------------------------------------------------- */
@@ -1,31 +1,185 @@
 #ifndef __MULTITASK_H__
 #define __MULTITASK_H__
 
-const DWORD				WM_MT_PROCESS	= WM_USER+1;
-const DWORD				WM_MT_STOP		= WM_USER+2;
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class CDSSProgress;
+
+/* ------------------------------------------------------------------- */
+
+// Persistent work-stealing thread pool shared by all the parallel engines.
+// Each worker owns a deque: it pops its own tasks from the back and steals
+// from the front of the other workers' deques when it runs out of work.
+// Threads waiting for a task group run the tasks of this group that are not
+// started yet (see CTaskGroup), so nested parallel work never deadlocks.
+class CThreadPool
+{
+private :
+	typedef std::function<void()>	TASK;
+
+	class CWorkerQueue
+	{
+	public :
+		std::mutex					m_Mutex;
+		std::deque<TASK>			m_qTasks;
+	};
+
+	std::vector<std::thread>		m_vThreads;
+	std::vector<std::unique_ptr<CWorkerQueue>>	m_vQueues;
+	std::mutex						m_WakeMutex;
+	std::condition_variable			m_WakeCondition;
+	std::atomic<LONG>				m_lNrQueued;
+	std::atomic<LONG>				m_lNextQueue;
+	std::atomic<bool>				m_bStop;
+	std::atomic<bool>				m_bReducedPriority;
+
+private :
+	CThreadPool();
+	CThreadPool(const CThreadPool &) = delete;
+	CThreadPool & operator = (const CThreadPool &) = delete;
+
+	void	WorkerLoop(LONG lIndex);
+	bool	PopTask(LONG lIndex, TASK & Task);
+
+public :
+	~CThreadPool();
+
+	static CThreadPool & GetInstance();
+	static LONG	GetCurrentWorkerIndex();
+
+	LONG	GetNrWorkers() const
+	{
+		return (LONG)m_vThreads.size();
+	};
+
+	void	SetReducedPriority(bool bReduced)
+	{
+		m_bReducedPriority = bReduced;
+	};
+
+	void	Submit(TASK Task);
+};
+
+/* ------------------------------------------------------------------- */
+
+// A set of tasks running on the shared pool which can be waited for as a whole.
+// The first exception thrown by a task is rethrown by Wait().
+//
+// The tasks are queued in the group and each of them is run either by a pool
+// worker or by the thread calling Wait(), whichever takes it first. Wait() only
+// ever runs tasks of its own group: a thread holding a lock while it waits
+// never runs unrelated tasks which could try to take the same lock.
+class CTaskGroup
+{
+private :
+	// Shared with the pool tasks, which may run after the group is destroyed
+	class CState
+	{
+	public :
+		std::mutex							m_Mutex;
+		std::condition_variable				m_Condition;
+		std::deque<std::function<void()>>	m_qTasks;
+		LONG								m_lNrPending;
+		std::exception_ptr					m_pException;
+
+	public :
+		CState() :
+			m_lNrPending(0)
+		{
+		};
+
+		// Run the next task not started yet, false when there is none
+		bool	RunNextTask();
+	};
+
+	std::shared_ptr<CState>			m_pState;
+
+public :
+	CTaskGroup() :
+		m_pState(std::make_shared<CState>())
+	{
+	};
+
+	~CTaskGroup()
+	{
+		try
+		{
+			Wait();
+		}
+		catch (...)
+		{
+		};
+	};
+
+	CTaskGroup(const CTaskGroup &) = delete;
+	CTaskGroup & operator = (const CTaskGroup &) = delete;
+
+	void	Run(std::function<void()> Task);
+	void	Wait();
+};
+
+/* ------------------------------------------------------------------- */
 
 class CMultitask
 {
+private :
+	LONG					m_lNrThreads;
+	LONG					m_lEnd;
+	LONG					m_lStep;
+	std::atomic<LONG>		m_lNextChunk;
+	std::atomic<bool>		m_bCanceled;
+	std::thread::id			m_MainThreadId;
+	CDSSProgress *			m_pChunkProgress;
+	bool					m_bCancelable;
+
 protected :
 	CComAutoCriticalSection	m_CriticalSection;
-	std::vector<HANDLE>		m_vThreads;
-	std::vector<DWORD>		m_vThreadIds;
-	std::vector<HANDLE>		m_vEvents;
 
 protected :
 	LONG	GetNrThreads()
 	{
-		return (LONG)m_vThreads.size();
+		return m_lNrThreads;
+	};
+
+	bool	IsMainThread() const
+	{
+		return std::this_thread::get_id() == m_MainThreadId;
 	};
 
+	void	CancelRemainingChunks()
+	{
+		m_bCanceled = true;
+	};
+
+	// Called from DoTask to get the next chunk of work [lStart, lStart+lCount)
+	bool	GetNextChunk(LONG & lStart, LONG & lCount);
+
+	// Runs DoTask on GetNrThreads() threads of the shared pool until all the chunks
+	// of [lBegin, lEnd) are processed. The progress is reported by the calling thread.
+	bool	ProcessChunks(LONG lBegin, LONG lEnd, LONG lStep, CDSSProgress * pProgress = nullptr, bool bCancelable = false);
+
 public :
-	CMultitask()
+	CMultitask() :
+		m_lNrThreads(1),
+		m_lEnd(0),
+		m_lStep(1),
+		m_lNextChunk(0),
+		m_bCanceled(false),
+		m_pChunkProgress(nullptr),
+		m_bCancelable(false)
 	{
 	};
 
 	virtual ~CMultitask()
 	{
-		CloseAllThreads();
 	};
 
 	static LONG	GetNrProcessors(bool bReal = false);
@@ -34,27 +188,70 @@ public :
 	static void	SetReducedThreadsPriority(bool bReduced);
 	static bool GetUseSimd();
 	static void SetUseSimd(const bool bUseSimd);
+	// Reads the settings above (they are cached), to be called at startup
+	// once QSettings is set up so that the SIMD kernels follow the UseSimd setting
+	static void	LoadSettings();
 
-	HANDLE	GetThreadEvent(DWORD dwThreadId)
-	{
-		HANDLE			hResult = nullptr;
+	// Reserves lNrThreads threads of the shared pool (default: MaxProcessors setting)
+	void	StartThreads(LONG lNrThreads = 0);
 
-		for (size_t i = 0;(i<m_vThreadIds.size()) && !hResult;i++)
-		{
-			if (dwThreadId == m_vThreadIds[i])
-				hResult = m_vEvents[i];
-		};
+	virtual bool	DoTask()  = 0;
+	virtual bool	Process() = 0;
+};
+
+/* ------------------------------------------------------------------- */
+
+// Limits GetNrProcessors() for the calling thread, and the tasks it starts with
+// CTaskGroup::Run (ParallelFor included), during the lifetime of the object,
+// so that several jobs running at once share the processors instead of each of them
+// using all of them.
+class CThreadBudget
+{
+private :
+	LONG					m_lPreviousBudget;
+
+public :
+	explicit CThreadBudget(LONG lNrThreads);
+	~CThreadBudget();
+
+	CThreadBudget(const CThreadBudget &) = delete;
+	CThreadBudget & operator = (const CThreadBudget &) = delete;
+};
+
+/* ------------------------------------------------------------------- */
 
-		return hResult;
+// Calls Function(lStart, lEnd) on dynamically claimed chunks of [lBegin, lEnd)
+// using at most lNrThreads threads of the pool (the calling thread included,
+// default: MaxProcessors setting).
+template <typename TFunction>
+void	ParallelFor(LONG lBegin, LONG lEnd, LONG lGrain, TFunction && Function, LONG lNrThreads = 0)
+{
+	if (lEnd <= lBegin)
+		return;
+
+	lGrain = max(1L, lGrain);
+
+	const LONG			lNrChunks = (lEnd - lBegin + lGrain - 1) / lGrain;
+	LONG				lNrRunners = lNrThreads ? lNrThreads : CMultitask::GetNrProcessors();
+	std::atomic<LONG>	lNextStart(lBegin);
+
+	lNrRunners = min(min(lNrRunners, lNrChunks), CThreadPool::GetInstance().GetNrWorkers() + 1);
+	CThreadPool::GetInstance().SetReducedPriority(CMultitask::GetReducedThreadsPriority());
+
+	auto				Runner = [&]()
+	{
+		LONG			lStart;
+
+		while ((lStart = lNextStart.fetch_add(lGrain)) < lEnd)
+			Function(lStart, min(lStart + lGrain, lEnd));
 	};
 
-	void	CloseAllThreads();
-	void	StartThreads(LONG lNrThreads = 0);
-	HANDLE	GetAvailableThread();
-	DWORD	GetAvailableThreadId();
+	CTaskGroup			Group;
 
-	virtual bool	DoTask(HANDLE hEvent)   = 0;
-	virtual bool	Process() = 0;
+	for (LONG i = 1;i<lNrRunners;i++)
+		Group.Run(Runner);
+	Runner();
+	Group.Wait();
 };
 
-#endif // __MULTITASK_H__
\ No newline at end of file
+#endif // __MULTITASK_H__
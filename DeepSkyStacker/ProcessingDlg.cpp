@@ -1433,30 +1433,48 @@ void CProcessingDlg::ShowOriginalHistogram(bool bLog)
 
 void CProcessingDlg::OnTimer(UINT_PTR nIDEvent)
 {
-	CRect			rcCell;
+	std::vector<CRect>	vRects;
 
-	if (m_ToProcess.GetNextUnProcessedRect(rcCell))
+	if (m_ToProcess.IsToProcess() && !m_Picture.GetBitmap())
 	{
-		HBITMAP			hBitmap = nullptr;
-		bool			bInitialized = true;
+		// The preview is shown first so that its zoom gives the level to render
+		std::vector<HBITMAP>	vLevels;
+		HBITMAP					hBitmap = GetDeepStack(this).GetProcessBitmap(vLevels);
 
-		hBitmap = m_Picture.GetBitmap();
-		if (!hBitmap)
-			bInitialized = false;
+		m_Picture.SetImg(hBitmap, true);
+		m_Picture.SetImgLevels(vLevels);
+	};
 
-		hBitmap = GetDeepStack(this).PartialProcess(rcCell, m_ProcessParams.m_BezierAdjust, m_ProcessParams.m_HistoAdjust);
+	// The level drawn at the current zoom is rendered first, then the full
+	// resolution one that the magnifier uses. The other levels are rendered
+	// when the zoom changes
+	const LONG			lLevel = m_Picture.GetImgLevel();
+	const bool			bNewProcess = m_ToProcess.IsNewProcess();
+	CRect				rcVisible;
 
-		if (!bInitialized)
-			m_Picture.SetImg(hBitmap, true);
+	m_Picture.GetClientRect(&rcVisible);
+	m_Picture.ScreenToBitmap(rcVisible);
 
-		m_Picture.Invalidate(true);
+	if (m_ToProcess.GetRectsToProcess(vRects, lLevel))
+	{
+		// The rendering is done by the background threads
+		GetDeepStack(this).StartProcess(vRects, rcVisible, lLevel, bNewProcess, m_ProcessParams.m_BezierAdjust, m_ProcessParams.m_HistoAdjust);
 
 		if (!m_OriginalHistogram.GetBitmap())
 		{
 			ShowOriginalHistogram(false);
 			ResetSliders();
 		};
-		const int nProgress = static_cast<int>(m_ToProcess.GetPercentageComplete());
+	};
+
+	if (lLevel > 0 && m_ToProcess.GetRectsToProcess(vRects, 0))
+		GetDeepStack(this).StartProcess(vRects, rcVisible, 0, false, m_ProcessParams.m_BezierAdjust, m_ProcessParams.m_HistoAdjust);
+
+	if (GetDeepStack(this).IsProcessUpdated())
+	{
+		m_Picture.Invalidate(true);
+
+		const int nProgress = static_cast<int>(GetDeepStack(this).GetProcessPercentage());
 		m_ProcessingProgress.SetPos(min(max(0, nProgress), 100));
 	};
 
@@ -69,7 +69,7 @@ private :
 	LONG						m_lHeight;
 	LONG						m_lSize;
 	std::vector<CValuedRect>	m_vRects;
-	std::vector<bool>			m_vProcessed;
+	std::vector<bool>			m_vLevelsProcessed;
 	bool						m_bToProcess;
 	CRect						m_rcToProcess;
 
@@ -112,7 +112,7 @@ public :
 		m_lSize		= lRectSize;
 
 		m_vRects.clear();
-		m_vProcessed.clear();
+		m_vLevelsProcessed.clear();
 		for (i = 0;i<m_lWidth;i+=lRectSize)
 		{
 			for (j = 0;j<m_lHeight;j+=lRectSize)
@@ -127,7 +127,6 @@ public :
 				rcCell.m_fScore = fabs(((i+m_lSize/2.0) - m_lWidth/2.0)/(double)m_lWidth) + fabs(((j + m_lSize/2) - m_lHeight/2.0)/(double)m_lHeight);
 
 				m_vRects.push_back(rcCell);
-				m_vProcessed.push_back(false);
 			};
 		};
 		std::sort(m_vRects.begin(), m_vRects.end());
@@ -140,60 +139,44 @@ public :
 
 	void	Reset()
 	{
-		for (LONG i = 0;i<m_vProcessed.size();i++)
-			m_vProcessed[i] = false;
+		m_vLevelsProcessed.clear();
 		m_bToProcess = true;
 	};
 
-	bool	GetNextUnProcessedRect(CRect & rcCell)
+	bool	IsToProcess()
 	{
-		bool		bResult = false;
+		return m_bToProcess;
+	};
+
+	// True until a level is rendered with the current settings
+	bool	IsNewProcess()
+	{
+		return std::find(m_vLevelsProcessed.begin(), m_vLevelsProcessed.end(), true) == m_vLevelsProcessed.end();
+	};
 
-		if (m_bToProcess)
+	// All the rectangles to render (the cells from the center), once for each
+	// level of the preview
+	bool	GetRectsToProcess(std::vector<CRect> & vRects, LONG lLevel)
+	{
+		vRects.clear();
+
+		if (m_bToProcess && (static_cast<size_t>(lLevel) >= m_vLevelsProcessed.size() || !m_vLevelsProcessed[lLevel]))
 		{
 			if (!m_rcToProcess.IsRectEmpty() && IsProcessRectOk())
-			{
-				if (!m_vProcessed[0])
-				{
-					rcCell = m_rcToProcess;
-					m_vProcessed[0] = true;
-					bResult = true;
-				};
-			}
+				vRects.push_back(m_rcToProcess);
 			else
 			{
-				for (LONG i = 0;i<m_vProcessed.size() && !bResult;i++)
-				{
-					if (!m_vProcessed[i])
-					{
-						bResult = true;
-						rcCell  = m_vRects[i].m_rc;
-						m_vProcessed[i] = true;
-					};
-				};
+				for (const CValuedRect & rcCell : m_vRects)
+					vRects.push_back(rcCell.m_rc);
 			};
 
-			m_bToProcess = bResult;
+			if (static_cast<size_t>(lLevel) >= m_vLevelsProcessed.size())
+				m_vLevelsProcessed.resize(lLevel + 1, false);
+			m_vLevelsProcessed[lLevel] = true;
 		};
 
-		return bResult;
+		return !vRects.empty();
 	};
-
-	float GetPercentageComplete() const
-	{
-		if (m_vProcessed.size() == 0)
-			return 100.0f;
-
-		float fPercentage = 0.0f;
-		const float fDelta = 100.0f / static_cast<float>(m_vProcessed.size());
-
-		// The iteration loop here could be corrupted by a call to Init() on a different thread.
-		// To make totally thread safe this should really have a mutex lock associated with it.
-		for (bool bState : m_vProcessed)
-			fPercentage += bState ? fDelta : 0.0f;
-
-		return fPercentage;
-	}
 };
 
 /* ------------------------------------------------------------------- */
@@ -1,6 +1,7 @@
 
 #include <stdafx.h>
 #include "RegisterEngine.h"
+#include "RegisteringInfoCache.h"
 
 #include "MasterFrames.h"
 #include "BackgroundCalibration.h"
@@ -9,11 +10,13 @@
 #include "FITSUtil.h"
 #include "Filters.h"
 #include "avx_luminance.h"
+#include "avx.h"
 
 #define _USE_MATH_DEFINES
 #include <math.h>
 
-#include <omp.h>
+#include <chrono>
+#include <condition_variable>
 
 /* ------------------------------------------------------------------- */
 
@@ -175,7 +178,7 @@ bool	CRegisteredFrame::FindStarShape(CMemoryBitmap * pBitmap, CStar & star)
 
 /* ------------------------------------------------------------------- */
 
-bool	CRegisteredFrame::ComputeStarCenter(CMemoryBitmap * pBitmap, double & fX, double & fY, double & fRadius)
+bool	CRegisteredFrame::ComputeStarCenter(CMemoryBitmap * pBitmap, double fBackground, double & fX, double & fY, double & fRadius)
 {
 	bool				bResult = false;
 	LONG				i, j;
@@ -240,7 +243,7 @@ bool	CRegisteredFrame::ComputeStarCenter(CMemoryBitmap * pBitmap, double & fX, d
 	{
 		double			fValue;
 		pBitmap->GetPixel(i, fY, fValue);
-		fValue = max(0.0, fValue - m_fBackground);
+		fValue = max(0.0, fValue - fBackground);
 		fSumX		+= fValue * i;
 		fSquareSumX += pow(i - fX, 2)* fValue;
 		fNrValuesX	+= fValue;
@@ -255,7 +258,7 @@ bool	CRegisteredFrame::ComputeStarCenter(CMemoryBitmap * pBitmap, double & fX, d
 	{
 		double			fValue;
 		pBitmap->GetPixel(fX, i, fValue);
-		fValue = max(0.0, fValue - m_fBackground);
+		fValue = max(0.0, fValue - fBackground);
 		fSumY		+= fValue * i;
 		fSquareSumY += pow(i - fY, 2)*fValue;
 		fNrValuesY	+= fValue;
@@ -400,6 +403,8 @@ size_t CRegisteredFrame::RegisterSubRect(CMemoryBitmap* pBitmap, const CRect& rc
 	LONG				i, j, k;
 	std::vector<LONG>	vHistogram;
 	size_t nStars{ 0 };
+	// Local copy: the sub rects of a picture are registered in parallel
+	double				fBackground = m_fBackground;
 
 	// Work with a local buffer. Copy the pixel values for the rect.
 	const LONG width = (rc.right - rc.left);
@@ -414,7 +419,7 @@ size_t CRegisteredFrame::RegisterSubRect(CMemoryBitmap* pBitmap, const CRect& rc
 
 	// Read pixels from the memory bitmap
 	// First find the top luminance
-	if (m_fBackground == 0.0)
+	if (fBackground == 0.0)
 	{
 		vHistogram.resize(static_cast<LONG>(MAXWORD) + 1);
 		for (const auto value : values)
@@ -431,12 +436,12 @@ size_t CRegisteredFrame::RegisterSubRect(CMemoryBitmap* pBitmap, const CRect& rc
 			lNrValues += vHistogram[lIndice];
 			++lIndice;
 		};
-		m_fBackground = static_cast<double>(lIndice) / 256.0 / 256.0;
+		fBackground = static_cast<double>(lIndice) / 256.0 / 256.0;
 	}
 	else
 		fMaxIntensity = *std::max_element(values.cbegin(), values.cend());
 
-	if (fMaxIntensity >= m_fMinLuminancy + m_fBackground)
+	if (fMaxIntensity >= m_fMinLuminancy + fBackground)
 	{
 		// Find how many wanabee stars are existing above 90% maximum luminance
 
@@ -450,7 +455,7 @@ size_t CRegisteredFrame::RegisterSubRect(CMemoryBitmap* pBitmap, const CRect& rc
 //					pBitmap->GetPixel(i, j, fIntensity);
 					const double fIntensity = getValue(i, j);
 
-					if (fIntensity >= m_fMinLuminancy + m_fBackground)
+					if (fIntensity >= m_fMinLuminancy + fBackground)
 					{
 						// Check that this pixel is not already used in a wanabee star
 						bool bNew = true;
@@ -487,7 +492,7 @@ size_t CRegisteredFrame::RegisterSubRect(CMemoryBitmap* pBitmap, const CRect& rc
 								{
 									if (vPixels[k].m_Ok)
 									{
-										if (vPixels[k].m_fIntensity - m_fBackground < 0.25 * (fIntensity - m_fBackground))
+										if (vPixels[k].m_fIntensity - fBackground < 0.25 * (fIntensity - fBackground))
 										{
 											vPixels[k].m_fRadius = r;
 											--vPixels[k].m_Ok;
@@ -581,7 +586,7 @@ size_t CRegisteredFrame::RegisterSubRect(CMemoryBitmap* pBitmap, const CRect& rc
 									ms.m_fMeanRadius  = (fMeanRadius1 + fMeanRadius2) / 2.0;
 
 									// Compute the real position
-									if (ComputeStarCenter(pBitmap, ms.m_fX, ms.m_fY, ms.m_fMeanRadius))
+									if (ComputeStarCenter(pBitmap, fBackground, ms.m_fX, ms.m_fY, ms.m_fMeanRadius))
 									{
 										// Check last overlap condition
 										{
@@ -618,14 +623,23 @@ size_t CRegisteredFrame::RegisterSubRect(CMemoryBitmap* pBitmap, const CRect& rc
 		};
 	};
 
-	if  (vHistogram.size())
-		m_fBackground = 0;
-
 	return nStars;
 };
 
 /* ------------------------------------------------------------------- */
 
+// Value read back from the registering info file where it is written with nDecimals decimals
+static double	RoundAsInfoText(double fValue, int nDecimals)
+{
+	CHAR				szValue[100];
+
+	sprintf_s(szValue, sizeof(szValue), "%.*f", nDecimals, fValue);
+
+	return atof(szValue);
+};
+
+/* ------------------------------------------------------------------- */
+
 bool	CRegisteredFrame::SaveRegisteringInfo(LPCTSTR szInfoFileName)
 {
 	bool				bResult = false;
@@ -661,6 +675,44 @@ bool	CRegisteredFrame::SaveRegisteringInfo(LPCTSTR szInfoFileName)
 		};
 		fclose(hFile);
 		bResult = true;
+
+		// Cache what will be read back from the text file (the values are rounded)
+		CRegisteredFrame	rf;
+
+		rf.m_fOverallQuality		= RoundAsInfoText(m_fOverallQuality, 2);
+		rf.m_bComet					= m_bComet;
+		if (m_bComet)
+		{
+			rf.m_fXComet = RoundAsInfoText(m_fXComet, 2);
+			rf.m_fYComet = RoundAsInfoText(m_fYComet, 2);
+		};
+		rf.m_SkyBackground.m_fLight = RoundAsInfoText(m_SkyBackground.m_fLight, 4);
+		for (const CStar & star : m_vStars)
+		{
+			CStar			ms;
+
+			ms.m_fPercentage		= 0;
+			ms.m_fDeltaRadius		= 0;
+			ms.m_rcStar				= star.m_rcStar;
+			ms.m_fIntensity			= RoundAsInfoText(star.m_fIntensity, 2);
+			ms.m_fQuality			= RoundAsInfoText(star.m_fQuality, 2);
+			ms.m_fMeanRadius		= RoundAsInfoText(star.m_fMeanRadius, 2);
+			ms.m_fX					= RoundAsInfoText(star.m_fX, 2);
+			ms.m_fY					= RoundAsInfoText(star.m_fY, 2);
+			ms.m_fMajorAxisAngle	= RoundAsInfoText(star.m_fMajorAxisAngle, 2);
+			ms.m_fLargeMajorAxis	= RoundAsInfoText(star.m_fLargeMajorAxis, 2);
+			ms.m_fSmallMajorAxis	= RoundAsInfoText(star.m_fSmallMajorAxis, 2);
+			ms.m_fLargeMinorAxis	= RoundAsInfoText(star.m_fLargeMinorAxis, 2);
+			ms.m_fSmallMinorAxis	= RoundAsInfoText(star.m_fSmallMinorAxis, 2);
+
+			// Like ReadRegisteringInfo, which skips the invalid stars
+			if (ms.IsValid())
+				rf.m_vStars.push_back(ms);
+		};
+		rf.ComputeFWHM();
+		rf.m_bInfoOk = true;
+
+		CRegisteringInfoCache::Store(szInfoFileName, rf);
 	};
 
 	return bResult;
@@ -707,6 +759,18 @@ static bool GetNextValue(FILE * hFile, CString & strVariable, CString & strValue
 bool	CRegisteredFrame::LoadRegisteringInfo(LPCTSTR szInfoFileName)
 {
 	ZFUNCTRACE_RUNTIME();
+
+	// First try the binary cache of the folder
+	if (CRegisteringInfoCache::Load(szInfoFileName, *this))
+		return true;
+
+	return ReadRegisteringInfo(szInfoFileName);
+};
+
+/* ------------------------------------------------------------------- */
+
+bool	CRegisteredFrame::ReadRegisteringInfo(LPCTSTR szInfoFileName)
+{
 	bool				bResult = false;
 	FILE *				hFile;
 
@@ -900,6 +964,8 @@ bool	CRegisteredFrame::LoadRegisteringInfo(LPCTSTR szInfoFileName)
 
 		m_bInfoOk = true;
 		bResult = true;
+
+		CRegisteringInfoCache::Store(szInfoFileName, *this);
 	}
 	else
 		m_bInfoOk = false;
@@ -962,19 +1028,28 @@ void	CLightFrameInfo::RegisterPicture(CGrayBitmap & Bitmap)
 	const int nrSubrectsY = (calcHeight - 1) / stepSize + 1;
 	const int calcWidth = Bitmap.Width() - 2 * StarMaxSize;
 	const int nrSubrectsX = (calcWidth - 1) / stepSize + 1;
-	const int nrEnabledThreads = CMultitask::GetNrProcessors(false); // Returns 1 if multithreading disabled by user, otherwise # HW threads
 
-	STARSET stars1, stars2, stars3, stars4;
+	// The sub rects are grouped in tiles of Separation x Separation sub rects.
+	// The tiles are processed in 4 passes (even/odd column and row of tiles) so that
+	// two tiles processed at the same time are always separated by a full tile and
+	// cannot find the same star. All the tiles of a pass are processed in parallel,
+	// each of them seeing the stars found in its neighbourhood by the previous passes.
+	constexpr int tileSize = Separation;
+	const int nrTilesX = (nrSubrectsX + tileSize - 1) / tileSize;
+	const int nrTilesY = (nrSubrectsY + tileSize - 1) / tileSize;
+
+	STARSET stars;
 	std::atomic<int> nrSubrects{ 0 };
 	std::atomic<size_t> nStars{ 0 };
+	const std::thread::id mainThreadId = std::this_thread::get_id();
 
 	int masterCount{ 0 };
-	const auto progress = [this, &nrSubrects, &nStars, &masterCount]() -> void
+	const auto progress = [this, &nrSubrects, &nStars, &masterCount, mainThreadId]() -> void
 	{
 		if (m_pProgress == nullptr)
 			return;
 		++nrSubrects;
-		if (omp_get_thread_num() == 0 && (++masterCount % 25) == 0) // Only master thread
+		if (std::this_thread::get_id() == mainThreadId && (++masterCount % 25) == 0) // Only calling thread
 		{
 			CString str;
 			str.Format(IDS_REGISTERINGNAMEPLUSTARS, (LPCTSTR)m_strFileName, nStars.load());
@@ -982,69 +1057,82 @@ void	CLightFrameInfo::RegisterPicture(CGrayBitmap & Bitmap)
 		}
 	};
 
-	const auto processDisjointArea = [this, StarMaxSize, &Bitmap, stepSize, rectSize, &progress, &nStars](const int yStart, const int yEnd, const int xStart, const int xEnd, STARSET& stars) -> void
+	const auto overlaps = [StarMaxSize](const STARSET& starSet, const CStar& star) -> bool
+	{
+		const double fMaxDistance = star.m_fMeanRadius * 2.35 / 1.5 + StarMaxSize;
+
+		for (auto it = starSet.lower_bound(CStar(star.m_fX - fMaxDistance - StarMaxSize, 0)); it != starSet.end(); ++it)
+		{
+			if (Distance(CPointExt(star.m_fX, star.m_fY), CPointExt(it->m_fX, it->m_fY)) < (star.m_fMeanRadius + it->m_fMeanRadius) * 2.35 / 1.5)
+				return true;
+			else if (it->m_fX > star.m_fX + fMaxDistance)
+				break;
+		}
+		return false;
+	};
+
+	const auto processTile = [this, StarMaxSize, stepSize, rectSize, tileSize, &Bitmap, &stars, &progress, &nStars, nrSubrectsX, nrSubrectsY](const int tileX, const int tileY, std::vector<CStar>& newStars) -> void
 	{
 		const int rightmostColumn = static_cast<int>(Bitmap.Width()) - StarMaxSize;
+		const int bottommostRow = static_cast<int>(Bitmap.Height()) - StarMaxSize;
+		const int xStart = tileX * tileSize;
+		const int xEnd = std::min(xStart + tileSize, nrSubrectsX);
+		const int yStart = tileY * tileSize;
+		const int yEnd = std::min(yStart + tileSize, nrSubrectsY);
+
+		// Stars already found around the tile (they are only read during a pass)
+		const double fLeft = StarMaxSize + xStart * stepSize - rectSize;
+		const double fRight = StarMaxSize + xEnd * stepSize + 2 * rectSize;
+		const double fTop = StarMaxSize + yStart * stepSize - rectSize;
+		const double fBottom = StarMaxSize + yEnd * stepSize + 2 * rectSize;
+		STARSET tileStars;
+
+		for (auto it = stars.lower_bound(CStar(fLeft, 0)); it != stars.end() && it->m_fX <= fRight; ++it)
+			if (it->m_fY >= fTop && it->m_fY <= fBottom)
+				tileStars.insert(tileStars.end(), *it);
 
 		for (int rowNdx = yStart; rowNdx < yEnd; ++rowNdx)
 		{
 			const int top = StarMaxSize + rowNdx * stepSize;
-			const int bottom = std::min(static_cast<int>(Bitmap.Height()) - StarMaxSize, top + rectSize);
+			const int bottom = std::min(bottommostRow, top + rectSize);
 
 			for (int colNdx = xStart; colNdx < xEnd; ++colNdx, progress())
-				nStars += RegisterSubRect(&Bitmap, CRect(StarMaxSize + colNdx * stepSize, top, min(rightmostColumn, StarMaxSize + colNdx * stepSize + rectSize), bottom), stars);
+				nStars += RegisterSubRect(&Bitmap, CRect(StarMaxSize + colNdx * stepSize, top, min(rightmostColumn, StarMaxSize + colNdx * stepSize + rectSize), bottom), tileStars);
 		}
+
+		for (const CStar& star : tileStars)
+			if (stars.find(star) == stars.end())
+				newStars.push_back(star);
 	};
 
-#pragma omp parallel default(none) shared(stars1, stars2, stars3, stars4) if(nrEnabledThreads - 1)
-{
-#pragma omp sections
+	for (int pass = 0; pass < 4; ++pass)
 	{
-		// Upper left area
-#pragma omp section
-		processDisjointArea(0, (nrSubrectsY - Separation) / 2, 0, (nrSubrectsX - Separation) / 2, stars1);
-		// Upper right area
-#pragma omp section
-		processDisjointArea(0, (nrSubrectsY - Separation) / 2, (nrSubrectsX - Separation) / 2 + Separation, nrSubrectsX, stars2);
-		// Lower left area
-#pragma omp section
-		processDisjointArea((nrSubrectsY - Separation) / 2 + Separation, nrSubrectsY, 0, (nrSubrectsX - Separation) / 2, stars3);
-		// Lower right area
-#pragma omp section
-		processDisjointArea((nrSubrectsY - Separation) / 2 + Separation, nrSubrectsY, (nrSubrectsX - Separation) / 2 + Separation, nrSubrectsX, stars4);
-	}
+		std::vector<POINT> vTiles;
 
-#pragma omp sections
-	{
-#pragma omp section
-		stars1.merge(stars2);
-#pragma omp section
-		stars3.merge(stars4);
+		for (int tileY = pass / 2; tileY < nrTilesY; tileY += 2)
+			for (int tileX = pass % 2; tileX < nrTilesX; tileX += 2)
+				vTiles.push_back(POINT{ tileX, tileY });
+
+		std::vector<std::vector<CStar>> vNewStars(vTiles.size());
+
+		ParallelFor(0, static_cast<LONG>(vTiles.size()), 1, [&vTiles, &vNewStars, &processTile](const LONG lStart, const LONG lEnd)
+		{
+			for (LONG t = lStart; t < lEnd; ++t)
+				processTile(vTiles[t].x, vTiles[t].y, vNewStars[t]);
+		});
+
+		// Merge in tile order - a star overlapping a star from a previous tile is dropped,
+		// which keeps the result independent of the number of threads.
+		for (const auto& newStars : vNewStars)
+			for (const CStar& star : newStars)
+				if (!overlaps(stars, star))
+					stars.insert(star);
 	}
 
-#pragma omp single
-{
-	stars1.merge(stars3);
-	// Remaining areas, all are overlapping with at least one other.
-	// Vertically middle band, full height
-	processDisjointArea(0, nrSubrectsY, (nrSubrectsX - Separation) / 2, (nrSubrectsX - Separation) / 2 + Separation, stars1);
-	// Middle left
-	processDisjointArea((nrSubrectsY - Separation) / 2, (nrSubrectsY - Separation) / 2 + Separation, 0, (nrSubrectsX - Separation) / 2, stars1);
-	// Middle right
-	processDisjointArea((nrSubrectsY - Separation) / 2, (nrSubrectsY - Separation) / 2 + Separation, (nrSubrectsX - Separation) / 2 + Separation, nrSubrectsX, stars1);
-
-	m_vStars.assign(stars1.cbegin(), stars1.cend());
-}
-
-#pragma omp sections
-{
-#pragma omp section
+	m_vStars.assign(stars.cbegin(), stars.cend());
+
 	ComputeOverallQuality();
-#pragma omp section
 	ComputeFWHM();
-}
-
-}
 
 	if (m_pProgress)
 		m_pProgress->End2();
@@ -1077,49 +1165,38 @@ public :
 		m_pProgress				 = pProgress;
 	};
 
-	virtual bool	DoTask(HANDLE hEvent);
+	virtual bool	DoTask();
 	virtual bool	Process();
 };
 
 /* ------------------------------------------------------------------- */
 
-bool	CComputeLuminanceTask::DoTask(HANDLE hEvent)
+bool	CComputeLuminanceTask::DoTask()
 {
 	ZFUNCTRACE_RUNTIME();
 	bool				bResult = true;
 
 	LONG				i, j;
-	bool				bEnd = false;
-	MSG					msg;
+	LONG				lStart, lCount;
 	LONG				lWidth = m_pBitmap->Width();
 
 	AvxLuminance avxLuminance{ *m_pBitmap, *m_pGrayBitmap };
 
-	// Create a message queue and signal the event
-	PeekMessage(&msg, nullptr, 0, 0, PM_NOREMOVE);
-	SetEvent(hEvent);
-	while (!bEnd && GetMessage(&msg, nullptr, 0, 0))
+	while (GetNextChunk(lStart, lCount))
 	{
-		if (msg.message == WM_MT_PROCESS)
+		if (avxLuminance.computeLuminanceBitmap(lStart, lStart + lCount) != 0)
 		{
-			if (avxLuminance.computeLuminanceBitmap(msg.wParam, msg.wParam + msg.lParam) != 0)
+			for (j = lStart; j < lStart + lCount; j++)
 			{
-				for (j = msg.wParam; j < msg.wParam + msg.lParam; j++)
+				for (i = 0; i < lWidth; i++)
 				{
-					for (i = 0; i < lWidth; i++)
-					{
-						COLORREF16			crColor;
+					COLORREF16			crColor;
 
-						m_pBitmap->GetPixel16(i, j, crColor);
-						m_pGrayBitmap->SetPixel(i, j, GetLuminance(crColor));
-					};
+					m_pBitmap->GetPixel16(i, j, crColor);
+					m_pGrayBitmap->SetPixel(i, j, GetLuminance(crColor));
 				};
-			}
-
-			SetEvent(hEvent);
+			};
 		}
-		else if (msg.message == WM_MT_STOP)
-			bEnd = true;
 	};
 
 	return true;
@@ -1132,33 +1209,11 @@ bool	CComputeLuminanceTask::Process()
 	ZFUNCTRACE_RUNTIME();
 	bool				bResult = true;
 	LONG				lHeight = m_pBitmap->Height();
-	LONG				i = 0;
 	LONG				lStep;
-	LONG				lRemaining;
 
-	if (m_pProgress)
-		m_pProgress->SetNrUsedProcessors(GetNrThreads());
 	lStep		= max(1L, lHeight/50);
-	lRemaining	= lHeight;
-
-	while (i<lHeight)
-	{
-		LONG			lAdd = min(lStep, lRemaining);
-		DWORD			dwThreadId;
-
-		dwThreadId = GetAvailableThreadId();
-		PostThreadMessage(dwThreadId, WM_MT_PROCESS, i, lAdd);
-
-		i			+=lAdd;
-		lRemaining	-= lAdd;
-		if (m_pProgress)
-			m_pProgress->Progress2(nullptr, i);
-	};
-
-	CloseAllThreads();
 
-	if (m_pProgress)
-		m_pProgress->SetNrUsedProcessors();
+	bResult = ProcessChunks(0, lHeight, lStep, m_pProgress);
 
 	return bResult;
 };
@@ -1176,6 +1231,10 @@ void	CLightFrameInfo::ComputeLuminanceBitmap(CMemoryBitmap * pBitmap, CGrayBitma
 	if (m_bRemoveHotPixels)
 		pBitmap->RemoveHotPixels(m_pProgress);
 
+	// Without the vectorised CFA code the luminance is computed with GetPixel16
+	const bool					bDemosaicCache = (!AvxSupport::checkSimdAvailability() || !AvxSupport{ *pBitmap }.isMonochromeCfaBitmapOfType<WORD>()) &&
+												 pBitmap->BuildDemosaicCache();
+
 	// Try to find star by studying the variation of luminosity
 	if (m_pProgress)
 	{
@@ -1195,6 +1254,9 @@ void	CLightFrameInfo::ComputeLuminanceBitmap(CMemoryBitmap * pBitmap, CGrayBitma
 	ComputeLuminanceTask.StartThreads();
 	ComputeLuminanceTask.Process();
 
+	if (bDemosaicCache)
+		pBitmap->ReleaseDemosaicCache();
+
 	if (m_bApplyMedianFilter)
 	{
 		CMedianImageFilter			filter;
@@ -1383,7 +1445,7 @@ void CLightFrameInfo::RegisterPicture()
 		if (m_pProgress)
 			m_pProgress->Start2(strText, 0);
 
-		bLoaded = ::LoadPicture(m_strFileName, &pBitmap, m_pProgress);
+		bLoaded = ::LoadPicture(m_strFileName, &pBitmap, m_pProgress, bmpInfo.m_Format);
 
 		if (m_pProgress)
 			m_pProgress->End2();
@@ -1532,6 +1594,147 @@ bool	CRegisterEngine::SaveCalibratedLightFrame(CLightFrameInfo & lfi, CMemoryBit
 
 /* ------------------------------------------------------------------- */
 
+bool CRegisterEngine::RegisterLightFrame(CStackingInfo * pStackingInfo, CMasterFrames & MasterFrames, LPCTSTR szFileName, bool bForce, CDSSProgress * pProgress)
+{
+	ZFUNCTRACE_RUNTIME();
+	bool					bResult = false;
+	CLightFrameInfo			lfi;
+
+	ZTRACE_RUNTIME("Register %s", szFileName);
+
+	lfi.SetProgress(pProgress);
+	lfi.SetBitmap(szFileName, false, false);
+
+	if (bForce || !lfi.IsRegistered())
+	{
+		CBitmapInfo					bmpInfo;
+		CSmartPtr<CMemoryBitmap>	pBitmap;
+
+		{
+			// LibRaw is not reentrant - the frames are loaded one at a time
+			std::lock_guard<std::mutex>	Lock(m_LoadMutex);
+
+			// Load the bitmap
+			if (GetPictureInfo(lfi.m_strFileName, bmpInfo) && bmpInfo.CanLoad())
+			{
+				CString						strText;
+				CString						strDescription;
+
+				bmpInfo.GetDescription(strDescription);
+
+				if (bmpInfo.m_lNrChannels==3)
+					strText.Format(IDS_LOADRGBLIGHT, bmpInfo.m_lBitPerChannel, (LPCTSTR)strDescription, (LPCTSTR)lfi.m_strFileName);
+				else
+					strText.Format(IDS_LOADGRAYLIGHT, bmpInfo.m_lBitPerChannel, (LPCTSTR)strDescription, (LPCTSTR)lfi.m_strFileName);
+				if (pProgress)
+					pProgress->Start2(strText, 0);
+
+				bResult = ::LoadPicture(lfi.m_strFileName, &pBitmap, pProgress, bmpInfo.m_Format);
+			};
+		};
+
+		if (bResult)
+		{
+			{
+				// The master dark detects its hot pixels on first use - calibrate one frame at a time
+				std::lock_guard<std::mutex>	Lock(m_CalibrateMutex);
+
+				// Apply offset, dark and flat to lightframe
+				MasterFrames.ApplyAllMasters(pBitmap, nullptr, pProgress);
+			};
+
+			CString				strCalibratedFile;
+
+			if (m_bSaveCalibrated &&
+				(pStackingInfo->m_pDarkTask || pStackingInfo->m_pDarkFlatTask ||
+				pStackingInfo->m_pFlatTask || pStackingInfo->m_pOffsetTask))
+				SaveCalibratedLightFrame(lfi, pBitmap, pProgress, strCalibratedFile);
+
+			// Then register the light frame
+			lfi.SetProgress(pProgress);
+			lfi.RegisterPicture(pBitmap);
+			lfi.SaveRegisteringInfo();
+
+			if (strCalibratedFile.GetLength())
+			{
+				CString				strInfoFileName;
+				TCHAR				szDrive[1+_MAX_DRIVE];
+				TCHAR				szDir[1+_MAX_DIR];
+				TCHAR				szFile[1+_MAX_FNAME];
+
+				_tsplitpath(strCalibratedFile, szDrive, szDir, szFile, nullptr);
+				strInfoFileName.Format(_T("%s%s%s%s"), szDrive, szDir, szFile, _T(".Info.txt"));
+				lfi.CRegisteredFrame::SaveRegisteringInfo(strInfoFileName);
+			};
+		};
+
+		if (pProgress && bmpInfo.CanLoad())
+			pProgress->End2();
+	};
+
+	return bResult;
+};
+
+/* ------------------------------------------------------------------- */
+
+namespace
+{
+	// Progress of a frame registered at the same time as other frames:
+	// nothing is displayed, only the cancellation of the registration
+	// (checked by the thread reporting the progress) is forwarded.
+	class CParallelFrameProgress : public CDSSProgress
+	{
+	private :
+		const std::atomic<bool> &	m_bCanceled;
+
+	public :
+		CParallelFrameProgress(const std::atomic<bool> & bCanceled) :
+			m_bCanceled(bCanceled)
+		{
+		};
+
+		virtual ~CParallelFrameProgress() {};
+
+		virtual void	GetStartText(CString & strText) { strText.Empty(); };
+		virtual void	GetStart2Text(CString & strText) { strText.Empty(); };
+		virtual	void	Start(LPCTSTR szTitle, LONG lTotal1, bool bEnableCancel = true) {};
+		virtual void	Progress1(LPCTSTR szText, LONG lAchieved1) {};
+		virtual void	Start2(LPCTSTR szText, LONG lTotal2) {};
+		virtual void	Progress2(LPCTSTR szText, LONG lAchieved2) {};
+		virtual void	End2() {};
+		virtual bool	IsCanceled() { return m_bCanceled; };
+		virtual bool	Close() { return true; };
+	};
+};
+
+/* ------------------------------------------------------------------- */
+
+static LONG GetNrParallelFrames(const CStackingInfo * pStackingInfo)
+{
+	const FRAMEINFOVECTOR &	vBitmaps = pStackingInfo->m_pLightTask->m_vBitmaps;
+	LONG					lResult;
+	CBitmapInfo				bmpInfo;
+
+	// Give at least 4 threads to each frame - the luminance, filtering and star
+	// detection steps are parallel too.
+	lResult = min((LONG)vBitmaps.size(), max(1L, CMultitask::GetNrProcessors() / 4));
+
+	// Each frame in flight holds the calibrated bitmap and its luminance (double) bitmap
+	if (lResult > 1 && GetPictureInfo(vBitmaps[0].m_strFileName, bmpInfo))
+	{
+		__int64				lFrameSize;
+
+		lFrameSize = (__int64)bmpInfo.m_lWidth * bmpInfo.m_lHeight *
+					 (bmpInfo.m_lNrChannels * bmpInfo.m_lBitPerChannel / 8 + 2 * sizeof(double));
+		if (lFrameSize > 0)
+			lResult = (LONG)max((__int64)1, min((__int64)lResult, CAllStackingTasks::GetRegisterMemoryLimit() / lFrameSize));
+	};
+
+	return max(1L, lResult);
+};
+
+/* ------------------------------------------------------------------- */
+
 bool CRegisterEngine::RegisterLightFrames(CAllStackingTasks & tasks, bool bForce, CDSSProgress * pProgress)
 {
 	ZFUNCTRACE_RUNTIME();
@@ -1568,85 +1771,115 @@ bool CRegisterEngine::RegisterLightFrames(CAllStackingTasks & tasks, bool bForce
 		if (tasks.m_vStacks[i].m_pLightTask)
 			pStackingInfo = &(tasks.m_vStacks[i]);
 
-		if (pStackingInfo)
+		if (pStackingInfo && pStackingInfo->m_pLightTask->m_vBitmaps.size())
 		{
 			CMasterFrames				MasterFrames;
+			const FRAMEINFOVECTOR &		vBitmaps = pStackingInfo->m_pLightTask->m_vBitmaps;
+			const LONG					lNrFrames = (LONG)vBitmaps.size();
+			const LONG					lNrParallelFrames = GetNrParallelFrames(pStackingInfo);
 
 			MasterFrames.LoadMasters(pStackingInfo, pProgress);
 
-			for (j = 0;j<pStackingInfo->m_pLightTask->m_vBitmaps.size() && bResult;j++)
+			if (lNrParallelFrames == 1)
 			{
-				// Register this bitmap
-				CLightFrameInfo		lfi;
-
-				ZTRACE_RUNTIME("Register %s", (LPCTSTR)pStackingInfo->m_pLightTask->m_vBitmaps[j].m_strFileName);
+				for (j = 0;j<lNrFrames && bResult;j++)
+				{
+					lNrRegistered++;
+					if (pProgress)
+					{
+						strText.Format(IDS_REGISTERINGPICTURE, lNrRegistered, lTotalRegistered);
+						pProgress->Progress1(strText, lNrRegistered);
+					};
 
-				lfi.SetProgress(pProgress);
-				lfi.SetBitmap(pStackingInfo->m_pLightTask->m_vBitmaps[j].m_strFileName, false, false);
-				lNrRegistered++;
+					// Register this bitmap
+					RegisterLightFrame(pStackingInfo, MasterFrames, vBitmaps[j].m_strFileName, bForce, pProgress);
 
-				if (pProgress)
-				{
-					strText.Format(IDS_REGISTERINGPICTURE, lNrRegistered, lTotalRegistered);
-					pProgress->Progress1(strText, lNrRegistered);
+					if (pProgress)
+						bResult = !pProgress->IsCanceled();
 				};
-
-				if (bForce || !lfi.IsRegistered())
+			}
+			else
+			{
+				// Several frames are registered at once, each of them with its share
+				// of the processors. While a frame is loaded the others are calibrated
+				// and registered. Each frame is registered independently of the others
+				// so the registering info does not depend on the number of threads.
+				// Only this thread reports the progress, the frames only see the cancellation.
+				const LONG				lThreadBudget = max(1L, CMultitask::GetNrProcessors() / lNrParallelFrames);
+				std::atomic<LONG>		lNextFrame(0);
+				std::atomic<bool>		bCanceled(false);
+				std::mutex				DoneMutex;
+				std::condition_variable	DoneCondition;
+				LONG					lNrDone = 0;
+				LONG					lNrRunning = lNrParallelFrames;
+				LONG					lNrReported = 0;
+
+				auto	FrameDone = [&](bool bRunnerEnd)
 				{
-					CBitmapInfo		bmpInfo;
-					// Load the bitmap
-					if (GetPictureInfo(lfi.m_strFileName, bmpInfo) && bmpInfo.CanLoad())
 					{
-						CSmartPtr<CMemoryBitmap>	pBitmap;
-						CString						strText;
-						CString						strDescription;
+						std::lock_guard<std::mutex>	Lock(DoneMutex);
 
-						bmpInfo.GetDescription(strDescription);
-
-						if (bmpInfo.m_lNrChannels==3)
-							strText.Format(IDS_LOADRGBLIGHT, bmpInfo.m_lBitPerChannel, (LPCTSTR)strDescription, (LPCTSTR)lfi.m_strFileName);
+						if (bRunnerEnd)
+							lNrRunning--;
 						else
-							strText.Format(IDS_LOADGRAYLIGHT, bmpInfo.m_lBitPerChannel, (LPCTSTR)strDescription, (LPCTSTR)lfi.m_strFileName);
-						if (pProgress)
-							pProgress->Start2(strText, 0);
+							lNrDone++;
+					};
+					DoneCondition.notify_one();
+				};
+
+				auto	Runner = [&]()
+				{
+					CThreadBudget			ThreadBudget(lThreadBudget);
+					CParallelFrameProgress	FrameProgress(bCanceled);
+					LONG					lFrame;
 
-						if (::LoadPicture(lfi.m_strFileName, &pBitmap, pProgress))
+					try
+					{
+						while (!bCanceled && (lFrame = lNextFrame++) < lNrFrames)
 						{
-							// Apply offset, dark and flat to lightframe
-							MasterFrames.ApplyAllMasters(pBitmap, nullptr, pProgress);
+							RegisterLightFrame(pStackingInfo, MasterFrames, vBitmaps[lFrame].m_strFileName, bForce, &FrameProgress);
+							FrameDone(false);
+						};
+					}
+					catch (...)
+					{
+						bCanceled = true;
+						FrameDone(true);
+						throw;
+					};
+					FrameDone(true);
+				};
 
-							CString				strCalibratedFile;
+				CTaskGroup				Group;
 
-							if (m_bSaveCalibrated &&
-								(pStackingInfo->m_pDarkTask || pStackingInfo->m_pDarkFlatTask ||
-								pStackingInfo->m_pFlatTask || pStackingInfo->m_pOffsetTask))
-								SaveCalibratedLightFrame(lfi, pBitmap, pProgress, strCalibratedFile);
+				for (j = 0;j<lNrParallelFrames;j++)
+					Group.Run(Runner);
 
-							// Then register the light frame
-							lfi.SetProgress(pProgress);
-							lfi.RegisterPicture(pBitmap);
-							lfi.SaveRegisteringInfo();
+				{
+					std::unique_lock<std::mutex>	Lock(DoneMutex);
+
+					while (lNrRunning)
+					{
+						DoneCondition.wait_for(Lock, std::chrono::milliseconds(100));
 
-							if (strCalibratedFile.GetLength())
+						while (lNrReported < lNrDone)
+						{
+							lNrReported++;
+							lNrRegistered++;
+							if (pProgress)
 							{
-								CString				strInfoFileName;
-								TCHAR				szDrive[1+_MAX_DRIVE];
-								TCHAR				szDir[1+_MAX_DIR];
-								TCHAR				szFile[1+_MAX_FNAME];
-
-								_tsplitpath(strCalibratedFile, szDrive, szDir, szFile, nullptr);
-								strInfoFileName.Format(_T("%s%s%s%s"), szDrive, szDir, szFile, _T(".Info.txt"));
-								lfi.CRegisteredFrame::SaveRegisteringInfo(strInfoFileName);
+								strText.Format(IDS_REGISTERINGPICTURE, lNrRegistered, lTotalRegistered);
+								pProgress->Progress1(strText, lNrRegistered);
 							};
 						};
 
-						if (pProgress)
-						{
-							pProgress->End2();
-							bResult = !pProgress->IsCanceled();
-						};
+						if (pProgress && pProgress->IsCanceled())
+							bCanceled = true;
 					};
 				};
+
+				Group.Wait();
+				bResult = !bCanceled;
 			};
 		};
 	};
@@ -13,6 +13,7 @@
 #include <set>
 #include "Stars.h"
 #include "Workspace.h"
+#include <mutex>
 
 /* ------------------------------------------------------------------- */
 
@@ -237,11 +238,15 @@ public :
 
 
 //	void	RegisterPicture(CMemoryBitmap * pBitmap);
-	bool	ComputeStarCenter(CMemoryBitmap * pBitmap, double & fX, double & fY, double & fRadius);
+	bool	ComputeStarCenter(CMemoryBitmap * pBitmap, double fBackground, double & fX, double & fY, double & fRadius);
 	size_t	RegisterSubRect(CMemoryBitmap* pBitmap, const CRect& rc, STARSET& stars);
 
 	bool	SaveRegisteringInfo(LPCTSTR szInfoFileName);
 	bool	LoadRegisteringInfo(LPCTSTR szInfoFileName);
+
+private :
+	// Parse the text file (and update the cache) without looking up the cache
+	bool	ReadRegisteringInfo(LPCTSTR szInfoFileName);
 };
 
 /* ------------------------------------------------------------------- */
@@ -418,15 +423,24 @@ typedef std::vector<CLightFrameInfo>	LIGHTFRAMEINFOVECTOR;
 
 /* ------------------------------------------------------------------- */
 
+class CMasterFrames;
+
 class CRegisterEngine
 {
 private :
 	bool						m_bSaveCalibrated;
 	INTERMEDIATEFILEFORMAT		m_IntermediateFileFormat;
 	bool						m_bSaveCalibratedDebayered;
+	// Held by the registering runners while they load/calibrate a frame.
+	// The loading and the calibration use ParallelFor: this is safe because
+	// CTaskGroup::Wait only runs the tasks of its own group, never another
+	// runner which would lock the same mutex again on the same thread.
+	std::mutex					m_LoadMutex;
+	std::mutex					m_CalibrateMutex;
 
 private :
 	bool	SaveCalibratedLightFrame(CLightFrameInfo & lfi, CMemoryBitmap * pBitmap, CDSSProgress * pProgress, CString & strCalibratedFile);
+	bool	RegisterLightFrame(CStackingInfo * pStackingInfo, CMasterFrames & MasterFrames, LPCTSTR szFileName, bool bForce, CDSSProgress * pProgress);
 
 public :
 	CRegisterEngine()
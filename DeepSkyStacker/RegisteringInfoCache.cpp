@@ -0,0 +1,532 @@
+#include <stdafx.h>
+#include "RegisteringInfoCache.h"
+#include "RegisterEngine.h"
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <QSettings>
+
+/* ------------------------------------------------------------------- */
+
+namespace
+{
+	const DWORD			INDEXMAGIC		= 0x49525344;		// "DSRI"
+	const DWORD			INDEXVERSION	= 1;
+	const TCHAR			INDEXFILENAME[] = _T("DSSRegisteringInfo.bin");
+	const LONG			INDEXOPENRETRIES = 20;				// 50 ms apart
+
+	/* ------------------------------------------------------------------- */
+
+	template <typename T>
+	void	Append(std::vector<BYTE> & vBuffer, const T & Value)
+	{
+		const BYTE *	pValue = reinterpret_cast<const BYTE *>(&Value);
+
+		vBuffer.insert(vBuffer.end(), pValue, pValue + sizeof(T));
+	};
+
+	/* ------------------------------------------------------------------- */
+
+	class CRecordReader
+	{
+	private :
+		const BYTE *		m_pCurrent;
+		const BYTE *		m_pEnd;
+		bool				m_bOk;
+
+	public :
+		CRecordReader(const BYTE * pBegin, const BYTE * pEnd) :
+			m_pCurrent(pBegin),
+			m_pEnd(pEnd),
+			m_bOk(true)
+		{
+		};
+
+		template <typename T>
+		T		Read()
+		{
+			T			Value{};
+
+			if (m_bOk && m_pEnd - m_pCurrent >= (ptrdiff_t)sizeof(T))
+			{
+				memcpy(&Value, m_pCurrent, sizeof(T));
+				m_pCurrent += sizeof(T);
+			}
+			else
+				m_bOk = false;
+
+			return Value;
+		};
+
+		const BYTE *	Skip(size_t lSize)
+		{
+			const BYTE *	pResult = m_pCurrent;
+
+			if (m_bOk && (size_t)(m_pEnd - m_pCurrent) >= lSize)
+				m_pCurrent += lSize;
+			else
+				m_bOk = false;
+
+			return pResult;
+		};
+
+		bool	IsOk() const
+		{
+			return m_bOk;
+		};
+
+		bool	IsEnd() const
+		{
+			return m_pCurrent == m_pEnd;
+		};
+	};
+
+	/* ------------------------------------------------------------------- */
+
+	class CCacheRecord
+	{
+	public :
+		__int64				m_llInfoFileSize;
+		__int64				m_llInfoFileTime;
+		std::vector<BYTE>	m_vData;
+
+	public :
+		CCacheRecord() :
+			m_llInfoFileSize(0),
+			m_llInfoFileTime(0)
+		{
+		};
+	};
+
+	typedef std::map<CString, CCacheRecord>		CACHERECORDMAP;
+
+	/* ------------------------------------------------------------------- */
+
+	class CFolderIndex
+	{
+	public :
+		CACHERECORDMAP		m_mRecords;
+		size_t				m_lNrRecordsInFile;
+
+	public :
+		CFolderIndex() :
+			m_lNrRecordsInFile(0)
+		{
+		};
+	};
+
+	/* ------------------------------------------------------------------- */
+
+	class CCacheImpl
+	{
+	private :
+		std::mutex							m_Mutex;
+		std::map<CString, CFolderIndex>		m_mFolders;
+		std::atomic<bool>					m_bUseCache;
+
+	private :
+		static void	SplitInfoFileName(LPCTSTR szInfoFileName, CString & strFolder, CString & strName);
+		static bool	GetInfoFileStamp(LPCTSTR szInfoFileName, __int64 & llSize, __int64 & llTime);
+		static void	AppendRecord(std::vector<BYTE> & vBuffer, const CString & strName, const CCacheRecord & Record);
+		static HANDLE	OpenIndexFile(const CString & strFolder, DWORD dwAccess, DWORD dwShareMode, DWORD dwDisposition);
+		static bool		AppendToIndexFile(const CString & strFolder, const std::vector<BYTE> & vRecord);
+
+		CFolderIndex &	GetFolderIndex(const CString & strFolder);
+		void			ReadIndexFile(const CString & strFolder, CFolderIndex & Index);
+		void			RewriteIndexFile(const CString & strFolder, CFolderIndex & Index);
+
+	public :
+		CCacheImpl() :
+			m_bUseCache(CRegisteringInfoCache::GetUseCache())
+		{
+		};
+
+		static CCacheImpl & GetInstance()
+		{
+			static CCacheImpl		Instance;
+
+			return Instance;
+		};
+
+		void	SetUseCache(bool bUseCache)
+		{
+			m_bUseCache = bUseCache;
+		};
+
+		bool	Load(LPCTSTR szInfoFileName, CRegisteredFrame & rf);
+		void	Store(LPCTSTR szInfoFileName, const CRegisteredFrame & rf);
+	};
+
+	/* ------------------------------------------------------------------- */
+
+	void	CCacheImpl::SplitInfoFileName(LPCTSTR szInfoFileName, CString & strFolder, CString & strName)
+	{
+		TCHAR			szDrive[1+_MAX_DRIVE];
+		TCHAR			szDir[1+_MAX_DIR];
+		TCHAR			szFile[1+_MAX_FNAME];
+		TCHAR			szExt[1+_MAX_EXT];
+
+		_tsplitpath(szInfoFileName, szDrive, szDir, szFile, szExt);
+		strFolder = szDrive;
+		strFolder += szDir;
+		strFolder.MakeLower();
+		strName = szFile;
+		strName += szExt;
+		strName.MakeLower();
+	};
+
+	/* ------------------------------------------------------------------- */
+
+	bool	CCacheImpl::GetInfoFileStamp(LPCTSTR szInfoFileName, __int64 & llSize, __int64 & llTime)
+	{
+		bool						bResult = false;
+		WIN32_FILE_ATTRIBUTE_DATA	FileData;
+
+		if (GetFileAttributesEx(szInfoFileName, GetFileExInfoStandard, &FileData))
+		{
+			llSize = ((__int64)FileData.nFileSizeHigh << 32) | FileData.nFileSizeLow;
+			llTime = ((__int64)FileData.ftLastWriteTime.dwHighDateTime << 32) | FileData.ftLastWriteTime.dwLowDateTime;
+			bResult = true;
+		};
+
+		return bResult;
+	};
+
+	/* ------------------------------------------------------------------- */
+
+	void	CCacheImpl::AppendRecord(std::vector<BYTE> & vBuffer, const CString & strName, const CCacheRecord & Record)
+	{
+		const DWORD			dwNameLength = strName.GetLength();
+		const BYTE *		pName = reinterpret_cast<const BYTE *>((LPCTSTR)strName);
+
+		Append(vBuffer, dwNameLength);
+		vBuffer.insert(vBuffer.end(), pName, pName + dwNameLength * sizeof(TCHAR));
+		Append(vBuffer, Record.m_llInfoFileSize);
+		Append(vBuffer, Record.m_llInfoFileTime);
+		Append(vBuffer, (DWORD)Record.m_vData.size());
+		vBuffer.insert(vBuffer.end(), Record.m_vData.cbegin(), Record.m_vData.cend());
+	};
+
+	/* ------------------------------------------------------------------- */
+
+	// The index file may be shared by several processes (DeepSkyStacker,
+	// DeepSkyStackerCL, DeepSkyStackerLive): wait a little while another
+	// process is appending to it
+	HANDLE	CCacheImpl::OpenIndexFile(const CString & strFolder, DWORD dwAccess, DWORD dwShareMode, DWORD dwDisposition)
+	{
+		HANDLE				hFile = INVALID_HANDLE_VALUE;
+
+		for (LONG i = 0;i<INDEXOPENRETRIES && hFile == INVALID_HANDLE_VALUE;i++)
+		{
+			if (i)
+				Sleep(50);
+			hFile = CreateFile(strFolder + INDEXFILENAME, dwAccess, dwShareMode, nullptr, dwDisposition, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (hFile == INVALID_HANDLE_VALUE && GetLastError() != ERROR_SHARING_VIOLATION)
+				break;
+		};
+
+		return hFile;
+	};
+
+	/* ------------------------------------------------------------------- */
+
+	bool	CCacheImpl::AppendToIndexFile(const CString & strFolder, const std::vector<BYTE> & vRecord)
+	{
+		bool				bResult = false;
+		HANDLE				hFile;
+
+		// No sharing: the records appended by two processes must not interleave
+		hFile = OpenIndexFile(strFolder, FILE_APPEND_DATA | FILE_READ_ATTRIBUTES, 0, OPEN_ALWAYS);
+		if (hFile != INVALID_HANDLE_VALUE)
+		{
+			std::vector<BYTE>	vBuffer;
+			LARGE_INTEGER		liFileSize;
+			DWORD				dwWritten = 0;
+
+			// The header is written by the process which creates the file
+			if (GetFileSizeEx(hFile, &liFileSize) && !liFileSize.QuadPart)
+			{
+				Append(vBuffer, INDEXMAGIC);
+				Append(vBuffer, INDEXVERSION);
+			};
+			vBuffer.insert(vBuffer.end(), vRecord.cbegin(), vRecord.cend());
+
+			bResult = WriteFile(hFile, vBuffer.data(), (DWORD)vBuffer.size(), &dwWritten, nullptr) && dwWritten == vBuffer.size();
+			CloseHandle(hFile);
+		};
+
+		return bResult;
+	};
+
+	/* ------------------------------------------------------------------- */
+
+	void	CCacheImpl::ReadIndexFile(const CString & strFolder, CFolderIndex & Index)
+	{
+		ZFUNCTRACE_RUNTIME();
+		HANDLE				hFile;
+
+		hFile = OpenIndexFile(strFolder, GENERIC_READ, FILE_SHARE_READ, OPEN_EXISTING);
+		if (hFile != INVALID_HANDLE_VALUE)
+		{
+			std::vector<BYTE>	vBuffer;
+			LARGE_INTEGER		liFileSize;
+			DWORD				dwRead = 0;
+
+			if (GetFileSizeEx(hFile, &liFileSize) && liFileSize.QuadPart > 0 && liFileSize.QuadPart < MAXDWORD)
+			{
+				vBuffer.resize((size_t)liFileSize.QuadPart);
+				if (!ReadFile(hFile, vBuffer.data(), (DWORD)vBuffer.size(), &dwRead, nullptr) || dwRead != vBuffer.size())
+					vBuffer.clear();
+			};
+			CloseHandle(hFile);
+
+			CRecordReader		Reader(vBuffer.data(), vBuffer.data() + vBuffer.size());
+
+			if (Reader.Read<DWORD>() == INDEXMAGIC && Reader.Read<DWORD>() == INDEXVERSION)
+			{
+				// The records are appended - the last record of a frame is the valid one
+				while (Reader.IsOk() && !Reader.IsEnd())
+				{
+					const DWORD		dwNameLength = Reader.Read<DWORD>();
+					const BYTE *	pName = Reader.Skip(dwNameLength * sizeof(TCHAR));
+					CCacheRecord	Record;
+
+					Record.m_llInfoFileSize = Reader.Read<__int64>();
+					Record.m_llInfoFileTime = Reader.Read<__int64>();
+
+					const DWORD		dwDataSize = Reader.Read<DWORD>();
+					const BYTE *	pData = Reader.Skip(dwDataSize);
+
+					if (Reader.IsOk())
+					{
+						Record.m_vData.assign(pData, pData + dwDataSize);
+						Index.m_mRecords[CString(reinterpret_cast<LPCTSTR>(pName), dwNameLength)] = std::move(Record);
+						Index.m_lNrRecordsInFile++;
+					};
+				};
+			}
+			else
+				Index.m_lNrRecordsInFile = 1;	// Unknown version - rewrite it
+		};
+	};
+
+	/* ------------------------------------------------------------------- */
+
+	void	CCacheImpl::RewriteIndexFile(const CString & strFolder, CFolderIndex & Index)
+	{
+		ZFUNCTRACE_RUNTIME();
+		std::vector<BYTE>	vBuffer;
+		FILE *				hFile;
+		const CString		strIndexFile = strFolder + INDEXFILENAME;
+		CString				strTempFile;
+
+		// One temporary file per process, another process may compact the same index file
+		strTempFile.Format(_T("%s.%lu.tmp"), (LPCTSTR)strIndexFile, GetCurrentProcessId());
+
+		Append(vBuffer, INDEXMAGIC);
+		Append(vBuffer, INDEXVERSION);
+		for (const auto & Record : Index.m_mRecords)
+			AppendRecord(vBuffer, Record.first, Record.second);
+
+		hFile = _tfopen(strTempFile, _T("wb"));
+		if (hFile)
+		{
+			const bool		bWritten = (fwrite(vBuffer.data(), 1, vBuffer.size(), hFile) == vBuffer.size());
+
+			fclose(hFile);
+			if (bWritten && MoveFileEx(strTempFile, strIndexFile, MOVEFILE_REPLACE_EXISTING))
+				Index.m_lNrRecordsInFile = Index.m_mRecords.size();
+			else
+				DeleteFile(strTempFile);
+		};
+	};
+
+	/* ------------------------------------------------------------------- */
+
+	CFolderIndex &	CCacheImpl::GetFolderIndex(const CString & strFolder)
+	{
+		auto				it = m_mFolders.find(strFolder);
+
+		if (it == m_mFolders.end())
+		{
+			it = m_mFolders.emplace(strFolder, CFolderIndex()).first;
+			ReadIndexFile(strFolder, it->second);
+
+			// Too many outdated records - compact the file
+			if (it->second.m_lNrRecordsInFile > 2 * it->second.m_mRecords.size() + 16 ||
+				(it->second.m_lNrRecordsInFile && it->second.m_mRecords.empty()))
+				RewriteIndexFile(strFolder, it->second);
+		};
+
+		return it->second;
+	};
+
+	/* ------------------------------------------------------------------- */
+
+	bool	CCacheImpl::Load(LPCTSTR szInfoFileName, CRegisteredFrame & rf)
+	{
+		bool				bResult = false;
+		CString				strFolder;
+		CString				strName;
+		__int64				llSize;
+		__int64				llTime;
+		std::vector<BYTE>	vData;
+
+		if (m_bUseCache && GetInfoFileStamp(szInfoFileName, llSize, llTime))
+		{
+			SplitInfoFileName(szInfoFileName, strFolder, strName);
+
+			std::lock_guard<std::mutex>	Lock(m_Mutex);
+			CFolderIndex &		Index = GetFolderIndex(strFolder);
+			auto				it = Index.m_mRecords.find(strName);
+
+			if (it != Index.m_mRecords.end() &&
+				it->second.m_llInfoFileSize == llSize &&
+				it->second.m_llInfoFileTime == llTime)
+				vData = it->second.m_vData;
+		};
+
+		if (vData.size())
+		{
+			CRecordReader		Reader(vData.data(), vData.data() + vData.size());
+			STARVECTOR			vStars;
+
+			const double		fOverallQuality = Reader.Read<double>();
+			const double		fFWHM			= Reader.Read<double>();
+			const double		fSkyBackground	= Reader.Read<double>();
+			const bool			bComet			= Reader.Read<BYTE>() != 0;
+			const double		fXComet			= Reader.Read<double>();
+			const double		fYComet			= Reader.Read<double>();
+			const DWORD			dwNrStars		= Reader.Read<DWORD>();
+
+			for (DWORD i = 0;i<dwNrStars && Reader.IsOk();i++)
+			{
+				CStar			ms;
+
+				ms.m_fPercentage		= 0;
+				ms.m_fDeltaRadius		= 0;
+				ms.m_fIntensity			= Reader.Read<double>();
+				ms.m_fQuality			= Reader.Read<double>();
+				ms.m_fMeanRadius		= Reader.Read<double>();
+				ms.m_rcStar.left		= Reader.Read<LONG>();
+				ms.m_rcStar.top			= Reader.Read<LONG>();
+				ms.m_rcStar.right		= Reader.Read<LONG>();
+				ms.m_rcStar.bottom		= Reader.Read<LONG>();
+				ms.m_fX					= Reader.Read<double>();
+				ms.m_fY					= Reader.Read<double>();
+				ms.m_fMajorAxisAngle	= Reader.Read<double>();
+				ms.m_fLargeMajorAxis	= Reader.Read<double>();
+				ms.m_fSmallMajorAxis	= Reader.Read<double>();
+				ms.m_fLargeMinorAxis	= Reader.Read<double>();
+				ms.m_fSmallMinorAxis	= Reader.Read<double>();
+				vStars.push_back(ms);
+			};
+
+			if (Reader.IsOk() && Reader.IsEnd())
+			{
+				rf.m_fOverallQuality		= fOverallQuality;
+				rf.m_fFWHM					= fFWHM;
+				rf.m_SkyBackground.m_fLight = fSkyBackground;
+				rf.m_bComet					= bComet;
+				if (bComet)
+				{
+					rf.m_fXComet = fXComet;
+					rf.m_fYComet = fYComet;
+				};
+				rf.m_vStars.insert(rf.m_vStars.end(), vStars.cbegin(), vStars.cend());
+				rf.m_bInfoOk				= true;
+				bResult = true;
+			};
+		};
+
+		return bResult;
+	};
+
+	/* ------------------------------------------------------------------- */
+
+	void	CCacheImpl::Store(LPCTSTR szInfoFileName, const CRegisteredFrame & rf)
+	{
+		CString				strFolder;
+		CString				strName;
+		CCacheRecord		Record;
+
+		if (m_bUseCache && GetInfoFileStamp(szInfoFileName, Record.m_llInfoFileSize, Record.m_llInfoFileTime))
+		{
+			std::vector<BYTE> &	vData = Record.m_vData;
+
+			Append(vData, rf.m_fOverallQuality);
+			Append(vData, rf.m_fFWHM);
+			Append(vData, rf.m_SkyBackground.m_fLight);
+			Append(vData, (BYTE)(rf.m_bComet ? 1 : 0));
+			Append(vData, rf.m_fXComet);
+			Append(vData, rf.m_fYComet);
+			Append(vData, (DWORD)rf.m_vStars.size());
+			for (const CStar & ms : rf.m_vStars)
+			{
+				Append(vData, ms.m_fIntensity);
+				Append(vData, ms.m_fQuality);
+				Append(vData, ms.m_fMeanRadius);
+				Append(vData, (LONG)ms.m_rcStar.left);
+				Append(vData, (LONG)ms.m_rcStar.top);
+				Append(vData, (LONG)ms.m_rcStar.right);
+				Append(vData, (LONG)ms.m_rcStar.bottom);
+				Append(vData, ms.m_fX);
+				Append(vData, ms.m_fY);
+				Append(vData, ms.m_fMajorAxisAngle);
+				Append(vData, ms.m_fLargeMajorAxis);
+				Append(vData, ms.m_fSmallMajorAxis);
+				Append(vData, ms.m_fLargeMinorAxis);
+				Append(vData, ms.m_fSmallMinorAxis);
+			};
+
+			SplitInfoFileName(szInfoFileName, strFolder, strName);
+
+			std::lock_guard<std::mutex>	Lock(m_Mutex);
+			CFolderIndex &		Index = GetFolderIndex(strFolder);
+			std::vector<BYTE>	vBuffer;
+
+			AppendRecord(vBuffer, strName, Record);
+			if (AppendToIndexFile(strFolder, vBuffer))
+				Index.m_lNrRecordsInFile++;
+
+			Index.m_mRecords[strName] = std::move(Record);
+		};
+	};
+};
+
+/* ------------------------------------------------------------------- */
+/* ------------------------------------------------------------------- */
+
+bool	CRegisteringInfoCache::Load(LPCTSTR szInfoFileName, CRegisteredFrame & rf)
+{
+	return CCacheImpl::GetInstance().Load(szInfoFileName, rf);
+};
+
+/* ------------------------------------------------------------------- */
+
+void	CRegisteringInfoCache::Store(LPCTSTR szInfoFileName, const CRegisteredFrame & rf)
+{
+	CCacheImpl::GetInstance().Store(szInfoFileName, rf);
+};
+
+/* ------------------------------------------------------------------- */
+
+bool	CRegisteringInfoCache::GetUseCache()
+{
+	QSettings			settings;
+
+	return settings.value("Register/UseInfoCache", true).toBool();
+};
+
+/* ------------------------------------------------------------------- */
+
+void	CRegisteringInfoCache::SetUseCache(bool bUseCache)
+{
+	QSettings			settings;
+
+	settings.setValue("Register/UseInfoCache", bUseCache);
+	CCacheImpl::GetInstance().SetUseCache(bUseCache);
+};
+
+/* ------------------------------------------------------------------- */
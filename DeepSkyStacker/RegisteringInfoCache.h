@@ -0,0 +1,27 @@
+#ifndef __REGISTERINGINFOCACHE_H__
+#define __REGISTERINGINFOCACHE_H__
+
+class CRegisteredFrame;
+
+/* ------------------------------------------------------------------- */
+
+// Binary cache of the registering info (.Info.txt) files.
+// The records of all the frames of a folder are appended to a single index file
+// (DSSRegisteringInfo.bin) which is read at once the first time a frame of the
+// folder is looked up. A record is only used as long as the .Info.txt file it was
+// built from has not been modified (same size and last write time), so the text
+// files remain the reference. The index file may be shared by several processes:
+// the records are appended with the file opened for exclusive access.
+class CRegisteringInfoCache
+{
+public :
+	static bool	Load(LPCTSTR szInfoFileName, CRegisteredFrame & rf);
+	static void	Store(LPCTSTR szInfoFileName, const CRegisteredFrame & rf);
+
+	static bool	GetUseCache();
+	static void	SetUseCache(bool bUseCache);
+};
+
+/* ------------------------------------------------------------------- */
+
+#endif // __REGISTERINGINFOCACHE_H__
@@ -3,7 +3,12 @@
 
 #include "MatchingStars.h"
 #include "PixelTransform.h"
+#include "Multitask.h"
+#include "avx.h"
 #include <math.h>
+#include <atomic>
+#include <thread>
+#include <limits>
 
 #define _USE_MATH_DEFINES
 #include <cmath>
@@ -14,6 +19,8 @@ CRunningStackingEngine::CRunningStackingEngine()
 {
 	m_lNrStacked = 0;
 	m_fTotalExposure = 0;
+	m_bRejectOutliers = false;
+	m_bRejectingOutliers = false;
 };
 
 /* ------------------------------------------------------------------- */
@@ -24,6 +31,280 @@ CRunningStackingEngine::~CRunningStackingEngine()
 
 /* ------------------------------------------------------------------- */
 
+// Number of values kept for each pixel and channel before they are used
+const BYTE					RPS_RESERVOIRSIZE = 3;
+// The values of the reservoir are stored on 16 bits
+const float					RPS_RESERVOIRSCALE = 256.0f;
+// Minimum standard deviation used to reject a value (in the 0-255 range) so that
+// a pixel with very few different values does not reject all the new ones
+const float					RPS_MINSIGMA = 0.25f;
+// Kappa used to reject the outliers in the live stack
+const float					RSE_KAPPA = 2.5f;
+
+/* ------------------------------------------------------------------- */
+
+void	CRunningPixelStatistics::Init(LONG lWidth, LONG lHeight, LONG lNrChannels, float fKappa)
+{
+	m_lWidth		= lWidth;
+	m_lHeight		= lHeight;
+	m_lNrChannels	= lNrChannels;
+	m_lNrValues		= (size_t)lWidth * lHeight * lNrChannels;
+	m_fKappa		= fKappa;
+
+	m_vMean.assign(m_lNrValues, 0.0f);
+	m_vM2.assign(m_lNrValues, 0.0f);
+	m_vCount.assign(m_lNrValues, 0);
+	m_vReservoir.assign(m_lNrValues * RPS_RESERVOIRSIZE, 0);
+	m_vNrReserved.assign(m_lNrValues, 0);
+};
+
+/* ------------------------------------------------------------------- */
+
+void	CRunningPixelStatistics::Clear()
+{
+	std::vector<float>().swap(m_vMean);
+	std::vector<float>().swap(m_vM2);
+	std::vector<WORD>().swap(m_vCount);
+	std::vector<WORD>().swap(m_vReservoir);
+	std::vector<BYTE>().swap(m_vNrReserved);
+	m_lWidth = m_lHeight = m_lNrChannels = 0;
+	m_lNrValues = 0;
+};
+
+/* ------------------------------------------------------------------- */
+
+// Maximum distance of an accepted value to the mean.
+// With few accepted values the standard deviation is underestimated, so kappa is
+// replaced by the matching Student's t quantile (Cornish-Fisher approximation).
+inline float	CRunningPixelStatistics::GetThreshold(size_t lIndex) const
+{
+	const float			fCount = m_vCount[lIndex];
+	float				fSigma = 0,
+						fKappa = m_fKappa;
+
+	if (fCount > 1.0f)
+	{
+		const float		fDf = fCount - 1.0f;
+		const float		fKappa2 = m_fKappa * m_fKappa;
+
+		fSigma = sqrt(m_vM2[lIndex] / fDf);
+		fKappa *= 1.0f + (fKappa2 + 1.0f) / (4.0f * fDf) + (5.0f * fKappa2 * fKappa2 + 16.0f * fKappa2 + 3.0f) / (96.0f * fDf * fDf);
+	};
+
+	return fKappa * std::max(fSigma, RPS_MINSIGMA);
+};
+
+/* ------------------------------------------------------------------- */
+
+// Called when the reservoir is full.
+// The values of the reservoir which are not outliers (compared to their median)
+// seed the statistics if there are none yet, or replace them if they all moved
+// away from the current mean (the sky background changed...). Otherwise the
+// rejected values were only noise and are dropped.
+void	CRunningPixelStatistics::SeedFromReservoir(size_t lIndex)
+{
+	float				fValues[RPS_RESERVOIRSIZE];
+	float				fDeviations[RPS_RESERVOIRSIZE];
+	const BYTE			nNrValues = m_vNrReserved[lIndex];
+
+	for (BYTE k = 0;k<nNrValues;k++)
+		fValues[k] = m_vReservoir[k * m_lNrValues + lIndex] / RPS_RESERVOIRSCALE;
+
+	std::sort(fValues, fValues + nNrValues);
+	const float			fMedian = fValues[nNrValues / 2];
+
+	for (BYTE k = 0;k<nNrValues;k++)
+		fDeviations[k] = fabs(fValues[k] - fMedian);
+	std::sort(fDeviations, fDeviations + nNrValues);
+
+	// Median absolute deviation scaled to a standard deviation
+	const float			fThreshold = m_fKappa * std::max(1.4826f * fDeviations[nNrValues / 2], RPS_MINSIGMA);
+	float				fCount = 0,
+						fMean = 0,
+						fM2 = 0;
+
+	for (BYTE k = 0;k<nNrValues;k++)
+	{
+		if (fabs(fValues[k] - fMedian) <= fThreshold)
+		{
+			const float		fDelta = fValues[k] - fMean;
+
+			fCount += 1.0f;
+			fMean  += fDelta / fCount;
+			fM2	   += fDelta * (fValues[k] - fMean);
+		};
+	};
+
+	bool				bReplace = true;
+
+	if (m_vCount[lIndex])
+	{
+		// Replaced only if all the rejected values are on the same side of the mean
+		const float		fLimit = GetThreshold(lIndex);
+
+		bReplace = (fValues[0] > m_vMean[lIndex] + fLimit) || (fValues[nNrValues-1] < m_vMean[lIndex] - fLimit);
+	};
+
+	if (bReplace)
+	{
+		m_vCount[lIndex] = static_cast<WORD>(fCount);
+		m_vMean[lIndex]	 = fMean;
+		m_vM2[lIndex]	 = fM2;
+	};
+	m_vNrReserved[lIndex] = 0;
+};
+
+/* ------------------------------------------------------------------- */
+
+void	CRunningPixelStatistics::AddValue(size_t lIndex, float fValue)
+{
+	// Nothing if the pixel is not covered by the frame
+	if (fValue <= 0)
+		return;
+
+	const float			fCount = m_vCount[lIndex];
+	BYTE &				nNrReserved = m_vNrReserved[lIndex];
+	bool				bAccepted = false;
+
+	if (fCount)
+	{
+		const float		fMean = m_vMean[lIndex];
+
+		bAccepted = fabs(fValue - fMean) <= GetThreshold(lIndex);
+		if (bAccepted)
+		{
+			// Welford update
+			const float		fDelta = fValue - fMean;
+			const float		fNewMean = fMean + fDelta / (fCount + 1.0f);
+
+			if (m_vCount[lIndex] < std::numeric_limits<WORD>::max())
+				m_vCount[lIndex]++;
+			m_vMean[lIndex]	 = fNewMean;
+			m_vM2[lIndex]	+= fDelta * (fValue - fNewMean);
+
+			// Only consecutive rejected values are kept
+			nNrReserved = 0;
+		};
+	};
+
+	if (!bAccepted)
+	{
+		m_vReservoir[nNrReserved * m_lNrValues + lIndex] = static_cast<WORD>(std::min(fValue * RPS_RESERVOIRSCALE + 0.5f, 65535.0f));
+		nNrReserved++;
+		if (nNrReserved == RPS_RESERVOIRSIZE)
+			SeedFromReservoir(lIndex);
+	};
+};
+
+/* ------------------------------------------------------------------- */
+
+float	CRunningPixelStatistics::GetValue(size_t lIndex) const
+{
+	float				fResult = 0;
+
+	if (m_vCount[lIndex])
+		fResult = m_vMean[lIndex];
+	else if (m_vNrReserved[lIndex])
+	{
+		// Not seeded yet - average of the first values
+		const BYTE		nNrValues = m_vNrReserved[lIndex];
+
+		for (BYTE k = 0;k<nNrValues;k++)
+			fResult += m_vReservoir[k * m_lNrValues + lIndex];
+		fResult /= nNrValues * RPS_RESERVOIRSCALE;
+	};
+
+	return fResult;
+};
+
+/* ------------------------------------------------------------------- */
+
+// Planes of a gray or color bitmap of type TType (nothing if the bitmap has another type)
+template <typename TType>
+static std::vector<TType *>	GetBitmapPlanes(CMemoryBitmap * pBitmap, double & fMultiplier)
+{
+	std::vector<TType *>		vPlanes;
+
+	if (auto * pGrayBitmap = dynamic_cast<CGrayBitmapT<TType> *>(pBitmap))
+	{
+		vPlanes.push_back(pGrayBitmap->m_vPixels.data());
+		fMultiplier = pGrayBitmap->GetMultiplier();
+	}
+	else if (auto * pColorBitmap = dynamic_cast<CColorBitmapT<TType> *>(pBitmap))
+	{
+		vPlanes.push_back(pColorBitmap->m_Red.m_vPixels.data());
+		vPlanes.push_back(pColorBitmap->m_Green.m_vPixels.data());
+		vPlanes.push_back(pColorBitmap->m_Blue.m_vPixels.data());
+		fMultiplier = pColorBitmap->GetMultiplier();
+	};
+
+	return vPlanes;
+};
+
+/* ------------------------------------------------------------------- */
+
+// Add the temporary bitmap of a frame to the float accumulator (one task per group of rows)
+template <typename TType>
+static bool	AccumulateBitmap(CMemoryBitmap * pTempBitmap, CMemoryBitmap * pStackedBitmap)
+{
+	double					fTempMultiplier = 1.0,
+							fStackedMultiplier = 1.0;
+	std::vector<TType *>	vInPlanes = GetBitmapPlanes<TType>(pTempBitmap, fTempMultiplier);
+	std::vector<float *>	vOutPlanes = GetBitmapPlanes<float>(pStackedBitmap, fStackedMultiplier);
+
+	if (vInPlanes.empty() || vInPlanes.size() != vOutPlanes.size())
+		return false;
+
+	const size_t			lWidth = pStackedBitmap->Width();
+	const float				fScale = static_cast<float>(fStackedMultiplier / fTempMultiplier);
+
+	ParallelFor(0, pStackedBitmap->Height(), 16, [&](const LONG lStartRow, const LONG lEndRow)
+	{
+		for (size_t k = 0;k<vInPlanes.size();k++)
+		{
+			const TType *	pIn = vInPlanes[k] + lWidth * lStartRow;
+			float *			pOut = vOutPlanes[k] + lWidth * lStartRow;
+
+			for (size_t i = 0;i<lWidth * (lEndRow - lStartRow);i++)
+				pOut[i] += static_cast<float>(pIn[i]) * fScale;
+		};
+	});
+
+	return true;
+};
+
+/* ------------------------------------------------------------------- */
+
+// Add the temporary bitmap of a frame to the running statistics (one task per group of rows)
+template <typename TType>
+static bool	AddToStatistics(CMemoryBitmap * pTempBitmap, CRunningPixelStatistics & Statistics)
+{
+	double					fTempMultiplier = 1.0;
+	std::vector<TType *>	vInPlanes = GetBitmapPlanes<TType>(pTempBitmap, fTempMultiplier);
+
+	if (vInPlanes.empty() || vInPlanes.size() != static_cast<size_t>(Statistics.NrChannels()))
+		return false;
+
+	const size_t			lWidth = Statistics.Width();
+	const size_t			lPlaneSize = lWidth * Statistics.Height();
+	const float				fScale = static_cast<float>(1.0 / fTempMultiplier);
+
+	ParallelFor(0, Statistics.Height(), 16, [&](const LONG lStartRow, const LONG lEndRow)
+	{
+		for (size_t k = 0;k<vInPlanes.size();k++)
+		{
+			const TType *	pIn = vInPlanes[k];
+
+			for (size_t i = lWidth * lStartRow;i<lWidth * lEndRow;i++)
+				Statistics.AddValue(k * lPlaneSize + i, static_cast<float>(pIn[i]) * fScale);
+		};
+	});
+
+	return true;
+};
+
+/* ------------------------------------------------------------------- */
+
 void	CRunningStackingEngine::CreatePublicBitmap()
 {
 	ZFUNCTRACE_RUNTIME();
@@ -31,11 +312,20 @@ void	CRunningStackingEngine::CreatePublicBitmap()
 	LONG					lWidth,
 							lHeight;
 
-	if (m_pStackedBitmap && m_lNrStacked)
+	if (m_lNrStacked && (m_bRejectingOutliers || m_pStackedBitmap))
 	{
-		bMonochrome = m_pStackedBitmap->IsMonochrome();
-		lWidth		= m_pStackedBitmap->Width();
-		lHeight		= m_pStackedBitmap->Height();
+		if (m_bRejectingOutliers)
+		{
+			bMonochrome = (m_PixelStatistics.NrChannels() == 1);
+			lWidth		= m_PixelStatistics.Width();
+			lHeight		= m_PixelStatistics.Height();
+		}
+		else
+		{
+			bMonochrome = m_pStackedBitmap->IsMonochrome();
+			lWidth		= m_pStackedBitmap->Width();
+			lHeight		= m_pStackedBitmap->Height();
+		};
 
 		if (!m_pPublicBitmap)
 		{
@@ -47,42 +337,89 @@ void	CRunningStackingEngine::CreatePublicBitmap()
 			m_pPublicBitmap->Init(lWidth, lHeight);
 		};
 
-		PixelIterator			itIn;
-		PixelIterator			itOut;
+		// The public bitmap is the average of the accumulator (or the mean of the
+		// accepted values), clipped to 255
+		// (computed directly from the planes, one task per group of rows)
+		double					fOutMultiplier = 1.0;
+		std::vector<WORD *>		vOutPlanes = GetBitmapPlanes<WORD>(m_pPublicBitmap, fOutMultiplier);
+		const size_t			lNrPixels = (size_t)lWidth;
+		const float				fMaximum = static_cast<float>(255.0 * fOutMultiplier);
 
-		m_pPublicBitmap->GetIterator(&itOut);
-		m_pStackedBitmap->GetIterator(&itIn);
+		if (m_bRejectingOutliers)
+		{
+			const size_t			lPlaneSize = lNrPixels * lHeight;
+			const float				fScale = static_cast<float>(fOutMultiplier);
 
-		for (LONG j = 0;j<lHeight;j++)
-			for (LONG i = 0;i<lWidth;i++)
+			if (vOutPlanes.size() == static_cast<size_t>(m_PixelStatistics.NrChannels()))
 			{
-				if (bMonochrome)
+				ParallelFor(0, lHeight, 16, [&](const LONG lStartRow, const LONG lEndRow)
 				{
-					double			fGray;
+					for (size_t k = 0;k<vOutPlanes.size();k++)
+					{
+						WORD *			pOut = vOutPlanes[k];
 
-					itIn->GetPixel(fGray);
-					fGray /= m_lNrStacked;
-					itOut->SetPixel(min(fGray, 255.0));
-				}
-				else
+						for (size_t i = lNrPixels * lStartRow;i<lNrPixels * lEndRow;i++)
+							pOut[i] = static_cast<WORD>(std::max(0.0f, std::min(m_PixelStatistics.GetValue(k * lPlaneSize + i) * fScale, fMaximum)));
+					};
+				});
+			};
+		}
+		else
+		{
+			double					fInMultiplier = 1.0;
+			std::vector<float *>	vInPlanes = GetBitmapPlanes<float>(m_pStackedBitmap, fInMultiplier);
+			const float				fScale = static_cast<float>(fOutMultiplier / (fInMultiplier * m_lNrStacked));
+
+			if (vInPlanes.size() == vOutPlanes.size())
+			{
+				ParallelFor(0, lHeight, 16, [&](const LONG lStartRow, const LONG lEndRow)
 				{
-					double			fRed, fGreen, fBlue;
+					for (size_t k = 0;k<vInPlanes.size();k++)
+					{
+						const float *	pIn = vInPlanes[k] + lNrPixels * lStartRow;
+						WORD *			pOut = vOutPlanes[k] + lNrPixels * lStartRow;
 
-					itIn->GetPixel(fRed, fGreen, fBlue);
-					fRed	/= m_lNrStacked;
-					fGreen	/= m_lNrStacked;
-					fBlue	/= m_lNrStacked;
-					itOut->SetPixel(min(fRed, 255.0), min(fGreen, 255.0), min(fBlue, 255.0));
-				};
-				(*itIn)++;
-				(*itOut)++;
+						for (size_t i = 0;i<lNrPixels * (lEndRow - lStartRow);i++)
+							pOut[i] = static_cast<WORD>(std::max(0.0f, std::min(pIn[i] * fScale, fMaximum)));
+					};
+				});
 			};
+		};
 	};
 };
 
 /* ------------------------------------------------------------------- */
 
-bool	CRunningStackingEngine::AddImage(CLightFrameInfo & lfi, CDSSProgress * pProgress)
+// Height of the bands of rows stacked in parallel.
+// The bands are stacked in two passes (even bands, then odd bands), so two bands
+// stacked at the same time are separated by a whole band. They cannot write to
+// the same output rows as long as a band is higher than the vertical spread of
+// the transformation (estimated on a grid of points).
+static LONG	GetStackingBandHeight(const CPixelTransform & PixTransform, LONG lWidth, LONG lHeight)
+{
+	const LONG			lNrSteps = 16;
+	double				fMinShift = 0,
+						fMaxShift = 0;
+
+	for (LONG j = 0;j<=lNrSteps;j++)
+		for (LONG i = 0;i<=lNrSteps;i++)
+		{
+			CPointExt		pt((double)i * (lWidth - 1) / lNrSteps, (double)j * (lHeight - 1) / lNrSteps);
+			CPointExt		ptOut = PixTransform.Transform(pt);
+			const double	fShift = ptOut.Y - pt.Y;
+
+			if (!i && !j)
+				fMinShift = fMaxShift = fShift;
+			fMinShift = min(fMinShift, fShift);
+			fMaxShift = max(fMaxShift, fShift);
+		};
+
+	return max(64L, static_cast<LONG>(ceil(fMaxShift - fMinShift)) + 4);
+};
+
+/* ------------------------------------------------------------------- */
+
+bool	CRunningStackingEngine::AddImage(CLightFrameInfo & lfi, CMemoryBitmap * pBitmap, CDSSProgress * pProgress)
 {
 	ZFUNCTRACE_RUNTIME();
 	bool				bResult = false;
@@ -90,9 +427,8 @@ bool	CRunningStackingEngine::AddImage(CLightFrameInfo & lfi, CDSSProgress * pPro
 						lHeight;
 	bool				bColor;
 
-	// First load the input bitmap
-	CSmartPtr<CMemoryBitmap>		pBitmap;
-	if (::LoadFrame(lfi.m_strFileName,PICTURETYPE_LIGHTFRAME, pProgress, &pBitmap))
+	// The input bitmap is loaded by the caller (LoadFrame), its hot pixels are removed
+	if (pBitmap)
 	{
 		CString			strText;
 
@@ -101,14 +437,25 @@ bool	CRunningStackingEngine::AddImage(CLightFrameInfo & lfi, CDSSProgress * pPro
 		lHeight = pBitmap->Height();
 		bColor = !pBitmap->IsMonochrome() || pBitmap->IsCFA();
 
-		// Create the output bitmap
+		// Create the output bitmap (or the running statistics when the
+		// outliers are rejected)
 		if (!m_lNrStacked)
 		{
-			if (bColor)
-				m_pStackedBitmap.Attach(new C96BitFloatColorBitmap);
+			m_bRejectingOutliers = m_bRejectOutliers;
+			if (m_bRejectingOutliers)
+			{
+				m_pStackedBitmap.Release();
+				m_PixelStatistics.Init(lWidth, lHeight, bColor ? 3 : 1, RSE_KAPPA);
+			}
 			else
-				m_pStackedBitmap.Attach(new C32BitFloatGrayBitmap);
-			m_pStackedBitmap->Init(lWidth, lHeight);
+			{
+				m_PixelStatistics.Clear();
+				if (bColor)
+					m_pStackedBitmap.Attach(new C96BitFloatColorBitmap);
+				else
+					m_pStackedBitmap.Attach(new C32BitFloatGrayBitmap);
+				m_pStackedBitmap->Init(lWidth, lHeight);
+			};
 		};
 
 		if (m_BackgroundCalibration.m_BackgroundCalibrationMode != BCM_NONE)
@@ -121,70 +468,142 @@ bool	CRunningStackingEngine::AddImage(CLightFrameInfo & lfi, CDSSProgress * pPro
 			m_BackgroundCalibration.ComputeBackgroundCalibration(pBitmap, !m_lNrStacked, pProgress);
 		};
 
-		// Stack it (average)
-		CPixelTransform		PixTransform(lfi.m_BilinearParameters);
-		CString				strDescription;
-		PIXELDISPATCHVECTOR	vPixels;
-
-		vPixels.reserve(16);
+		// The frame is stacked in a temporary bitmap of the same type as the input
+		// bitmap (as the stacking engine does), which is then added to the accumulator
+		CSmartPtr<CMemoryBitmap>	pTempBitmap;
+		CBitmapCharacteristics		bc;
 
-		strDescription = lfi.m_strInfos;
-		if (lfi.m_lNrChannels==3)
-			strText.Format(IDS_STACKRGBLIGHT, lfi.m_lBitPerChannels, (LPCTSTR)strDescription, (LPCTSTR)lfi.m_strFileName);
-		else
-			strText.Format(IDS_STACKGRAYLIGHT, lfi.m_lBitPerChannels, (LPCTSTR)strDescription, (LPCTSTR)lfi.m_strFileName);
+		pBitmap->GetCharacteristics(bc);
+		bc.m_lNrChannels = bColor ? 3 : 1;
+		CreateBitmap(bc, &pTempBitmap);
 
-		if (pProgress)
-			pProgress->Start2(strText, lHeight);
-		for (LONG j = 0;j<lHeight;j++)
+		if (pTempBitmap && pTempBitmap->Init(lWidth, lHeight))
 		{
-			for (LONG i = 0;i<lWidth;i++)
-			{
-				double		fRed, fGreen, fBlue;
-				CPointExt	pt(i, j);
-				CPointExt	ptOut;
+			// Stack it (average)
+			CPixelTransform		PixTransform(lfi.m_BilinearParameters);
+			CString				strDescription;
+			CTaskInfo			TaskInfo;
+			CEntropyInfo		EntropyInfo;
+			AvxEntropy			avxEntropy(*pBitmap, EntropyInfo, nullptr);
+			const CRect			rcResult(0, 0, lWidth, lHeight);
+
+			TaskInfo.m_Method = MBP_AVERAGE;
+
+			strDescription = lfi.m_strInfos;
+			if (lfi.m_lNrChannels==3)
+				strText.Format(IDS_STACKRGBLIGHT, lfi.m_lBitPerChannels, (LPCTSTR)strDescription, (LPCTSTR)lfi.m_strFileName);
+			else
+				strText.Format(IDS_STACKGRAYLIGHT, lfi.m_lBitPerChannels, (LPCTSTR)strDescription, (LPCTSTR)lfi.m_strFileName);
 
-				ptOut = PixTransform.Transform(pt);
-				pBitmap->GetPixel(i, j, fRed, fGreen, fBlue);
+			if (pProgress)
+				pProgress->Start2(strText, lHeight);
+
+			LONG						lBandHeight = GetStackingBandHeight(PixTransform, lWidth, lHeight);
+			if (lBandHeight * 2 > lHeight)
+				lBandHeight = lHeight;
+
+			const LONG					lNrBands = (lHeight + lBandHeight - 1) / lBandHeight;
+			const std::thread::id		MainThreadId = std::this_thread::get_id();
+			std::atomic<LONG>			lNrRowsDone(0);
+
+			auto						StackBand = [&](const LONG lBand)
+			{
+				const LONG			lStart = lBand * lBandHeight;
+				const LONG			lEnd = min(lStart + lBandHeight, lHeight);
 
-				if (m_BackgroundCalibration.m_BackgroundCalibrationMode != BCM_NONE)
-					m_BackgroundCalibration.ApplyCalibration(fRed, fGreen, fBlue);
+				// First try AVX accelerated code, if not supported -> run conventional code.
+				AvxStacking			avxStacking(lStart, lEnd, *pBitmap, *pTempBitmap, rcResult, avxEntropy);
 
-				if ((fRed || fGreen || fBlue) && ptOut.IsInRect(0, 0, lWidth-1, lHeight-1))
+				if (avxStacking.stack(PixTransform, TaskInfo, m_BackgroundCalibration, 1) != 0)
 				{
-					vPixels.resize(0);
-					ComputePixelDispatch(ptOut, 1.0, vPixels);
+					PIXELDISPATCHVECTOR		vPixels;
 
-					for (LONG k = 0;k<vPixels.size();k++)
+					vPixels.reserve(16);
+					for (LONG j = lStart;j<lEnd;j++)
 					{
-						CPixelDispatch &		Pixel = vPixels[k];
-
-						// For each plane adjust the values
-						if (Pixel.m_lX >= 0 && Pixel.m_lX < lWidth &&
-							Pixel.m_lY >= 0 && Pixel.m_lY < lHeight)
+						for (LONG i = 0;i<lWidth;i++)
 						{
-							double		fPreviousRed,
-										fPreviousGreen,
-										fPreviousBlue;
-
-							m_pStackedBitmap->GetPixel(Pixel.m_lX, Pixel.m_lY, fPreviousRed, fPreviousGreen, fPreviousBlue);
-							fPreviousRed   += (double)fRed * Pixel.m_fPercentage;
-							fPreviousGreen += (double)fGreen * Pixel.m_fPercentage;
-							fPreviousBlue  += (double)fBlue * Pixel.m_fPercentage;
-							m_pStackedBitmap->SetPixel(Pixel.m_lX, Pixel.m_lY, fPreviousRed, fPreviousGreen, fPreviousBlue);
+							CPointExt		pt(i, j);
+							CPointExt		ptOut;
+							COLORREF16		crColor;
+							float			Red,
+											Green,
+											Blue;
+
+							ptOut = PixTransform.Transform(pt);
+							pBitmap->GetPixel16(i, j, crColor);
+
+							Red		= crColor.red;
+							Green	= crColor.green;
+							Blue	= crColor.blue;
+
+							if (m_BackgroundCalibration.m_BackgroundCalibrationMode != BCM_NONE)
+								m_BackgroundCalibration.ApplyCalibration(Red, Green, Blue);
+
+							if ((Red || Green || Blue) && ptOut.IsInRect(0, 0, lWidth-1, lHeight-1))
+							{
+								vPixels.resize(0);
+								ComputePixelDispatch(ptOut, 1.0, vPixels);
+
+								for (LONG k = 0;k<vPixels.size();k++)
+								{
+									CPixelDispatch &		Pixel = vPixels[k];
+
+									// For each plane adjust the values
+									if (Pixel.m_lX >= 0 && Pixel.m_lX < lWidth &&
+										Pixel.m_lY >= 0 && Pixel.m_lY < lHeight)
+									{
+										double		fPreviousRed,
+													fPreviousGreen,
+													fPreviousBlue;
+
+										pTempBitmap->GetPixel(Pixel.m_lX, Pixel.m_lY, fPreviousRed, fPreviousGreen, fPreviousBlue);
+										fPreviousRed   += (double)Red / 256.0 * Pixel.m_fPercentage;
+										fPreviousGreen += (double)Green / 256.0 * Pixel.m_fPercentage;
+										fPreviousBlue  += (double)Blue / 256.0 * Pixel.m_fPercentage;
+										fPreviousRed   = min(fPreviousRed, 255.0);
+										fPreviousGreen = min(fPreviousGreen, 255.0);
+										fPreviousBlue  = min(fPreviousBlue, 255.0);
+										pTempBitmap->SetPixel(Pixel.m_lX, Pixel.m_lY, fPreviousRed, fPreviousGreen, fPreviousBlue);
+									};
+								};
+							};
 						};
 					};
 				};
+
+				lNrRowsDone += lEnd - lStart;
+				if (pProgress && std::this_thread::get_id() == MainThreadId)
+					pProgress->Progress2(nullptr, lNrRowsDone);
 			};
+
+			// Even bands, then odd bands
+			for (LONG lParity = 0;lParity<2;lParity++)
+				ParallelFor(0, (lNrBands + 1 - lParity) / 2, 1, [&](const LONG lStartBand, const LONG lEndBand)
+				{
+					for (LONG lBand = lStartBand;lBand<lEndBand;lBand++)
+						StackBand(lBand * 2 + lParity);
+				});
+
+			// Add the frame to the accumulator
+			if (m_bRejectingOutliers)
+			{
+				if (!AddToStatistics<WORD>(pTempBitmap, m_PixelStatistics) &&
+					!AddToStatistics<DWORD>(pTempBitmap, m_PixelStatistics) &&
+					!AddToStatistics<float>(pTempBitmap, m_PixelStatistics))
+					AddToStatistics<BYTE>(pTempBitmap, m_PixelStatistics);
+			}
+			else if (!AccumulateBitmap<WORD>(pTempBitmap, m_pStackedBitmap) &&
+					 !AccumulateBitmap<DWORD>(pTempBitmap, m_pStackedBitmap) &&
+					 !AccumulateBitmap<float>(pTempBitmap, m_pStackedBitmap))
+				AccumulateBitmap<BYTE>(pTempBitmap, m_pStackedBitmap);
+
 			if (pProgress)
-				pProgress->Progress2(nullptr, j+1);
+				pProgress->End2();
+			m_lNrStacked++;
+			m_fTotalExposure += lfi.m_fExposure;
+			bResult = true;
 		};
-
-		if (pProgress)
-			pProgress->End2();
-		m_lNrStacked++;
-		m_fTotalExposure += lfi.m_fExposure;
-		bResult = true;
 	};
 
 	if (bResult && !m_MatchingStars.IsReferenceSet())
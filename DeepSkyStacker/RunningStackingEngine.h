@@ -7,6 +7,68 @@
 
 /* ------------------------------------------------------------------- */
 
+// Running statistics of each value (pixel and channel) of the live stack, used
+// to reject the outliers (satellite and plane trails...) as the frames arrive.
+// For each value the mean and variance of the accepted values are updated
+// incrementally (Welford) and a small reservoir keeps the values waiting to be
+// used: the first values, which are used to seed the statistics once their
+// outliers are removed, and then the consecutive rejected values, which
+// replace the statistics when they are all on the same side (the sky changed).
+// The memory used does not depend on the number of stacked frames (about four
+// float planes per channel).
+class CRunningPixelStatistics
+{
+private :
+	std::vector<float>				m_vMean;
+	std::vector<float>				m_vM2;
+	std::vector<WORD>				m_vCount;
+	std::vector<WORD>				m_vReservoir;		// RPS_RESERVOIRSIZE planes
+	std::vector<BYTE>				m_vNrReserved;
+	LONG							m_lWidth,
+									m_lHeight,
+									m_lNrChannels;
+	size_t							m_lNrValues;
+	float							m_fKappa;
+
+private :
+	float	GetThreshold(size_t lIndex) const;
+	void	SeedFromReservoir(size_t lIndex);
+
+public :
+	CRunningPixelStatistics() :
+		m_lWidth(0),
+		m_lHeight(0),
+		m_lNrChannels(0),
+		m_lNrValues(0),
+		m_fKappa(2.5f)
+	{
+	};
+
+	// The values are stored plane by plane (lWidth * lHeight values per channel)
+	// in the 0-255 range
+	void	Init(LONG lWidth, LONG lHeight, LONG lNrChannels, float fKappa);
+	void	Clear();
+	void	AddValue(size_t lIndex, float fValue);
+	float	GetValue(size_t lIndex) const;
+
+	LONG	Width() const
+	{
+		return m_lWidth;
+	};
+
+	LONG	Height() const
+	{
+		return m_lHeight;
+	};
+
+	LONG	NrChannels() const
+	{
+		return m_lNrChannels;
+	};
+};
+
+/* ------------------------------------------------------------------- */
+
 class CRunningStackingEngine
 {
 private :
@@ -16,6 +78,9 @@ private :
 	LONG							m_lNrStacked;
 	double							m_fTotalExposure;
 	CMatchingStars					m_MatchingStars;
+	bool							m_bRejectOutliers;
+	bool							m_bRejectingOutliers;	// Mode of the current stack
+	CRunningPixelStatistics			m_PixelStatistics;
 
 private:
 	void	CreatePublicBitmap();
@@ -25,7 +90,7 @@ public :
 	~CRunningStackingEngine();
 
 	bool	ComputeOffset(CLightFrameInfo & lfi);
-	bool	AddImage(CLightFrameInfo & lfi, CDSSProgress * pProgress);
+	bool	AddImage(CLightFrameInfo & lfi, CMemoryBitmap * pBitmap, CDSSProgress * pProgress);
 	bool	GetStackedImage(CMemoryBitmap ** ppBitmap)
 	{
 		bool			bResult = false;
@@ -49,10 +114,17 @@ public :
 		return m_fTotalExposure;
 	};
 
+	// Used from the next first stacked frame
+	void	SetRejectOutliers(bool bRejectOutliers)
+	{
+		m_bRejectOutliers = bRejectOutliers;
+	};
+
 	void	Clear()
 	{
 		m_pStackedBitmap.Release();
 		m_pPublicBitmap.Release();
+		m_PixelStatistics.Clear();
 		m_lNrStacked = 0;
 		m_fTotalExposure = 0;
 	};
@@ -3,9 +3,9 @@
 #include <math.h>
 #include <tiffio.h>
 #include <algorithm>
-#include <set>
 #include "TIFFUtil.h"
 #include "FITSUtil.h"
+#include "BitmapPyramid.h"
 
 #define _USE_MATH_DEFINES
 #include <cmath>
@@ -143,6 +143,168 @@ COLORREF CStackedBitmap::GetPixel(LONG X, LONG Y, bool bApplySettings)
 
 /* ------------------------------------------------------------------- */
 
+inline BYTE	ToByte(double fValue)
+{
+	if (fValue > 0)
+		return (fValue < 255.0) ? static_cast<BYTE>(fValue) : 255;
+	else
+		return 0;
+};
+
+/* ------------------------------------------------------------------- */
+
+void CStackedBitmapLUT::CAdjustTable::Init(const CHistogramAdjust & Adjust)
+{
+	m_Adjust = Adjust;
+	m_vValues.resize(HISTOSIZE);
+	m_vExact.resize(HISTOSIZE - 1);
+
+	ParallelFor(0, HISTOSIZE, 4096, [&](LONG lStart, LONG lEnd)
+	{
+		for (LONG i = lStart;i<lEnd;i++)
+			m_vValues[i] = AdjustValue(static_cast<double>(i) / HISTOSTEPS);
+	});
+
+	// The intervals that are not close to a line (discontinuity or sharp curvature)
+	// are not interpolated.
+	ParallelFor(0, HISTOSIZE - 1, 4096, [&](LONG lStart, LONG lEnd)
+	{
+		for (LONG i = lStart;i<lEnd;i++)
+		{
+			const double	fMiddle = AdjustValue((i + 0.5) / HISTOSTEPS);
+
+			m_vExact[i] = (fabs(fMiddle - (m_vValues[i] + m_vValues[i + 1]) / 2.0) > 1e-4) ? 1 : 0;
+		};
+	});
+};
+
+/* ------------------------------------------------------------------- */
+
+void CStackedBitmapLUT::Init(const CRGBHistogramAdjust & HistoAdjust, const CBezierAdjust & BezierAdjust, LONG lNrBitmaps, bool bMonochrome)
+{
+	CRGBHistogramAdjust		Histo = HistoAdjust;
+	CBezierAdjust			Bezier = BezierAdjust;
+
+	m_fNrBitmaps	= lNrBitmaps;
+	m_bMonochrome	= bMonochrome;
+
+	m_RedAdjust.Init(Histo.GetRedAdjust());
+	if (m_bMonochrome)
+	{
+		m_GreenAdjust.Clear();
+		m_BlueAdjust.Clear();
+	}
+	else
+	{
+		m_GreenAdjust.Init(Histo.GetGreenAdjust());
+		m_BlueAdjust.Init(Histo.GetBlueAdjust());
+	};
+
+	// Same curve as CBezierAdjust::GetValue
+	if (!Bezier.m_vPoints.size())
+		Bezier.Clear();
+	m_vCurve = Bezier.m_vPoints;
+
+	// The bins are powers of 2 fractions: L * CURVEBINS is exact
+	m_vCurveStart.resize(CURVEBINS + 1);
+	for (LONG i = 0;i<=CURVEBINS;i++)
+	{
+		const CBezierCurvePoint	pt(static_cast<double>(i) / CURVEBINS, 0);
+
+		m_vCurveStart[i] = static_cast<LONG>(std::lower_bound(m_vCurve.begin(), m_vCurve.end(), pt) - m_vCurve.begin());
+	};
+
+	// Same exponent as CBezierAdjust::AdjustSaturation
+	m_fSaturationExponent = 1;
+	if (Bezier.m_fSaturationShift > 0)
+		m_fSaturationExponent = 1.0/(Bezier.m_fSaturationShift/10.0);
+	else if (Bezier.m_fSaturationShift < 0)
+		m_fSaturationExponent = -Bezier.m_fSaturationShift/10.0;
+
+	m_vSaturation.clear();
+	if (Bezier.m_fSaturationShift != 0)
+	{
+		m_vSaturation.resize(SATURATIONSIZE);
+		for (LONG i = 0;i<SATURATIONSIZE;i++)
+			m_vSaturation[i] = pow(static_cast<double>(i) / (SATURATIONSIZE - 1), m_fSaturationExponent);
+	};
+};
+
+/* ------------------------------------------------------------------- */
+
+double CStackedBitmapLUT::GetLuminance(double L) const
+{
+	const LONG		lNrPoints = static_cast<LONG>(m_vCurve.size());
+	LONG			lIndex = 0;
+
+	if (L >= 1.0)
+		lIndex = m_vCurveStart[CURVEBINS];
+	else if (L > 0)
+		lIndex = m_vCurveStart[static_cast<LONG>(L * CURVEBINS)];
+
+	while (lIndex < lNrPoints && m_vCurve[lIndex].x < L)
+		lIndex++;
+
+	return (lIndex < lNrPoints) ? m_vCurve[lIndex].y : L;
+};
+
+/* ------------------------------------------------------------------- */
+
+double CStackedBitmapLUT::GetSaturation(double S) const
+{
+	if (m_vSaturation.empty())
+		return S;
+	else if (S >= 1.0/256.0 && S < 1.0)
+	{
+		const double	fIndex = S * (SATURATIONSIZE - 1);
+		const LONG		lIndex = static_cast<LONG>(fIndex);
+
+		return m_vSaturation[lIndex] + (m_vSaturation[lIndex + 1] - m_vSaturation[lIndex]) * (fIndex - lIndex);
+	}
+	else
+		return pow(S, m_fSaturationExponent);
+};
+
+/* ------------------------------------------------------------------- */
+
+void CStackedBitmapLUT::Convert(const float * pRed, const float * pGreen, const float * pBlue, LONG lNrPixels, RGBQUAD * pOut) const
+{
+	for (LONG i = 0;i<lNrPixels;i++, pOut++)
+	{
+		double			Red, Green, Blue;
+		double			H, S, L;
+
+		Red = m_RedAdjust.GetValue(pRed[i] / m_fNrBitmaps * 255.0);
+		if (m_bMonochrome)
+		{
+			// Gray pixel: no hue and no saturation (see ToHSL and ToRGB)
+			Red = Green = Blue = GetLuminance(Red / 255.0) * 255.0;
+		}
+		else
+		{
+			Green	= m_GreenAdjust.GetValue(pGreen[i] / m_fNrBitmaps * 255.0);
+			Blue	= m_BlueAdjust.GetValue(pBlue[i] / m_fNrBitmaps * 255.0);
+
+			ToHSL(Red, Green, Blue, H, S, L);
+
+			// adjust luminance
+			L = GetLuminance(L);
+
+			// adjust saturation
+			S = GetSaturation(S);
+
+			ToRGB(H, S, L, Red, Green, Blue);
+		};
+
+		pOut->rgbRed		= ToByte(Red);
+		pOut->rgbGreen		= ToByte(Green);
+		pOut->rgbBlue		= ToByte(Blue);
+		pOut->rgbReserved	= 0;
+	};
+};
+
+/* ------------------------------------------------------------------- */
+
 COLORREF16	CStackedBitmap::GetPixel16(LONG X, LONG Y, bool bApplySettings)
 {
 	COLORREF16			crResult;
@@ -464,53 +626,80 @@ void CStackedBitmap::SaveDSImage(LPCTSTR szStackedFile, LPRECT pRect, CDSSProgre
 
 /* ------------------------------------------------------------------- */
 
-#if !defined(PCL_PROJECT) && !defined(_CONSOLE)
-class CPixel
+void CStackedBitmap::BuildLevels()
 {
-public :
-	double			m_fRed,
-					m_fGreen,
-					m_fBlue;
-private :
-	void	CopyFrom(const CPixel & px)
-	{
-		m_fRed		= px.m_fRed;
-		m_fGreen	= px.m_fGreen;
-		m_fBlue		= px.m_fBlue;
-	};
-public :
-	CPixel(double fRed = 0, double fGreen = 0, double fBlue = 0)
-	{
-		m_fRed		= fRed;
-		m_fGreen	= fGreen;
-		m_fBlue		= fBlue;
-	};
-	CPixel(const CPixel & px)
+	ZFUNCTRACE_RUNTIME();
+	const LONG		lNrLevels = GetNrPyramidLevels(m_lWidth, m_lHeight);
+
+	m_vLevels.clear();
+	m_vLevels.resize(lNrLevels - 1);
+
+	for (LONG k = 1;k<lNrLevels;k++)
 	{
-		CopyFrom(px);
+		CLevel &		Level = m_vLevels[k - 1];
+		const LONG		lInWidth = k > 1 ? m_vLevels[k - 2].m_lWidth : m_lWidth,
+						lInHeight = k > 1 ? m_vLevels[k - 2].m_lHeight : m_lHeight;
+
+		Level.m_lWidth	= GetPyramidLevelSize(m_lWidth, k);
+		Level.m_lHeight	= GetPyramidLevelSize(m_lHeight, k);
+
+		const size_t	lSize = static_cast<size_t>(Level.m_lWidth) * Level.m_lHeight;
+
+		Level.m_vRedPlane.resize(lSize);
+		if (!m_bMonochrome)
+		{
+			Level.m_vGreenPlane.resize(lSize);
+			Level.m_vBluePlane.resize(lSize);
+		};
+
+		const CLevel *	pPrevious = k > 1 ? &m_vLevels[k - 2] : nullptr;
+		const float *	pInRed = pPrevious ? pPrevious->m_vRedPlane.data() : m_vRedPlane.data();
+		const float *	pInGreen = pPrevious ? pPrevious->m_vGreenPlane.data() : m_vGreenPlane.data();
+		const float *	pInBlue = pPrevious ? pPrevious->m_vBluePlane.data() : m_vBluePlane.data();
+
+		ParallelFor(0, Level.m_lHeight, 16, [&](LONG lStart, LONG lEnd)
+		{
+			ReducePyramidRows(pInRed, lInWidth, lInHeight, Level.m_vRedPlane.data(), lStart, lEnd);
+			if (!m_bMonochrome)
+			{
+				ReducePyramidRows(pInGreen, lInWidth, lInHeight, Level.m_vGreenPlane.data(), lStart, lEnd);
+				ReducePyramidRows(pInBlue, lInWidth, lInHeight, Level.m_vBluePlane.data(), lStart, lEnd);
+			};
+		});
 	};
+};
 
-    CPixel& operator=(CPixel const& other) = delete;
+/* ------------------------------------------------------------------- */
 
-	~CPixel() {};
+#if !defined(PCL_PROJECT) && !defined(_CONSOLE)
 
-	bool operator < (const CPixel & px) const
+void CStackedBitmap::RenderBitmap(C32BitsBitmap & Bitmap, const CStackedBitmapLUT & LUT, const RECT & rcRender, LONG lLevel)
+{
+	const LONG		lWidth = lLevel ? m_vLevels[lLevel - 1].m_lWidth : m_lWidth,
+					lHeight = lLevel ? m_vLevels[lLevel - 1].m_lHeight : m_lHeight;
+	const CPixelVector &	vRedPlane = lLevel ? m_vLevels[lLevel - 1].m_vRedPlane : m_vRedPlane;
+	const CPixelVector &	vGreenPlane = lLevel ? m_vLevels[lLevel - 1].m_vGreenPlane : m_vGreenPlane;
+	const CPixelVector &	vBluePlane = lLevel ? m_vLevels[lLevel - 1].m_vBluePlane : m_vBluePlane;
+	const LONG		lXMin = max(0L, rcRender.left),
+					lYMin = max(0L, rcRender.top),
+					lXMax = min(lWidth, rcRender.right),
+					lYMax = min(lHeight, rcRender.bottom);
+
+	if (lXMin >= lXMax)
+		return;
+
+	for (LONG j = lYMin;j<lYMax;j++)
 	{
-		if (m_fRed<px.m_fRed)
-			return true;
-		else if (m_fRed>px.m_fRed)
-			return false;
-		else if (m_fGreen<px.m_fGreen)
-			return true;
-		else if (m_fGreen>px.m_fGreen)
-			return false;
-		else
-			return m_fBlue<px.m_fBlue;
+		const size_t	lOffset = static_cast<size_t>(lWidth) * j + lXMin;
+		const float *	pRedPixel = vRedPlane.data() + lOffset;
+		const float *	pGreenPixel = m_bMonochrome ? pRedPixel : vGreenPlane.data() + lOffset;
+		const float *	pBluePixel = m_bMonochrome ? pRedPixel : vBluePlane.data() + lOffset;
+
+		LUT.Convert(pRedPixel, pGreenPixel, pBluePixel, lXMax - lXMin, reinterpret_cast<RGBQUAD *>(Bitmap.GetPixelBase(lXMin, j)));
 	};
 };
 
-typedef std::set<CPixel>			PIXELSET;
-typedef PIXELSET::iterator			PIXELITERATOR;
+/* ------------------------------------------------------------------- */
 
 HBITMAP CStackedBitmap::GetBitmap(C32BitsBitmap & Bitmap, RECT * pRect)
 {
@@ -519,86 +708,18 @@ HBITMAP CStackedBitmap::GetBitmap(C32BitsBitmap & Bitmap, RECT * pRect)
 
 	if (!Bitmap.IsEmpty())
 	{
-		LONG		lXMin = 0,
-					lYMin = 0,
-					lXMax = m_lWidth,
-					lYMax = m_lHeight;
+		CRect				rcRender(0, 0, m_lWidth, m_lHeight);
+		CStackedBitmapLUT	LUT;
 
 		if (pRect)
-		{
-			lXMin	= max(0L, pRect->left);
-			lYMin	= max(0L, pRect->top);
-			lXMax	= min(m_lWidth, pRect->right);
-			lYMax	= min(m_lHeight, pRect->bottom);
-		};
-
-		/*PIXELSET		sPixels;
-		PIXELITERATOR	it;*/
-
-		float *				pBaseRedPixel;
-		float *				pBaseGreenPixel = nullptr;
-		float *				pBaseBluePixel  = nullptr;
+			rcRender = *pRect;
 
-		pBaseRedPixel	= &(m_vRedPlane[m_lWidth * lYMin + lXMin]);
-		if (!m_bMonochrome)
-		{
-			pBaseGreenPixel = &(m_vGreenPlane[m_lWidth * lYMin + lXMin]);
-			pBaseBluePixel	= &(m_vBluePlane[m_lWidth * lYMin + lXMin]);
-		};
+		LUT.Init(m_HistoAdjust, m_BezierAdjust, m_lNrBitmaps, m_bMonochrome);
 
-#if defined (_OPENMP)
-#pragma omp parallel for default(none)
-#endif
-		for (LONG j = lYMin;j<lYMax;j++)
+		ParallelFor(max(0L, rcRender.top), min(m_lHeight, rcRender.bottom), 16, [&](LONG lStart, LONG lEnd)
 		{
-			LPBYTE			lpOut = Bitmap.GetPixelBase(lXMin, j);
-			LPRGBQUAD &		lpOutPixel = (LPRGBQUAD &)lpOut;
-			float *			pRedPixel = nullptr;;
-			float *			pGreenPixel = nullptr;
-			float *			pBluePixel = nullptr;
-
-			//
-			// pxxxPixel = pBasexxxPixel + 0, + m_lWidth, +m_lWidth * 2, etc..
-			//
-			pRedPixel	= pBaseRedPixel + (m_lWidth * (j - lYMin));
-			if (!m_bMonochrome)
-			{
-				pGreenPixel = pBaseGreenPixel + (m_lWidth * (j - lYMin));
-				pBluePixel  = pBaseBluePixel + (m_lWidth * (j - lYMin));
-			};
-			for (LONG i = lXMin;i<lXMax;i++)
-			{
-				COLORREF		crColor;
-
-				if (!m_bMonochrome)
-					crColor = GetPixel(*pRedPixel, *pGreenPixel, *pBluePixel, true);
-				else
-					crColor = GetPixel(*pRedPixel, *pRedPixel, *pRedPixel, true);
-
-				/*CPixel			px(*pRedPixel, *pGreenPixel, *pBluePixel);
-
-				it = sPixels.find(px);
-				if (it == sPixels.end())
-					sPixels.insert(px);*/
-
-				lpOutPixel->rgbRed		= GetRValue(crColor);
-				lpOutPixel->rgbGreen	= GetGValue(crColor);
-				lpOutPixel->rgbBlue		= GetBValue(crColor);
-				lpOutPixel->rgbReserved	= 0;
-				// Bitmap.SetPixel(i, j, crColor);
-
-				pRedPixel++;
-				if (!m_bMonochrome)
-				{
-					pGreenPixel++;
-					pBluePixel++;
-				};
-				lpOut += 4;
-			};
-		};
-
-		/*LONG				lNrPixels = sPixels.size();
-		printf("%ld", lNrPixels);*/
+			RenderBitmap(Bitmap, LUT, CRect(rcRender.left, lStart, rcRender.right, lEnd));
+		});
 	};
 
 	return Bitmap.GetHBITMAP();
@@ -142,9 +142,117 @@ class CFITSWriter;
 
 /* ------------------------------------------------------------------- */
 
+// Tone pipeline of the stacked bitmap (histogram adjust, luminance curve and
+// saturation) compiled into tables for the rendering of the 8 bits preview.
+//  - the histogram adjust of each channel is tabulated every 1/4 of unit on the
+//    0-65535 scale and interpolated. The values out of this range and the ones
+//    in the intervals where the interpolation is off (black and white points,
+//    clipping of the shift) are adjusted directly
+//  - the luminance curve gives the same result as CBezierAdjust::GetValue: the
+//    index of the first curve point of each of the CURVEBINS luminance bins is
+//    tabulated so only a few points are compared
+//  - the saturation is tabulated every 1/65536 and interpolated above 1/256
+//    (below it the power curve is too steep and is computed directly)
+// The interpolation is not exact: a value close to a rounding boundary of the
+// 8 bits conversion can be off by one level from the per-pixel pipeline.
+class CStackedBitmapLUT
+{
+private :
+	static constexpr LONG	HISTOSTEPS		= 4;
+	static constexpr LONG	HISTOSIZE		= 65535 * HISTOSTEPS + 1;
+	static constexpr LONG	CURVEBINS		= 4096;
+	static constexpr LONG	SATURATIONSIZE	= 65536 + 1;
+
+	class CAdjustTable
+	{
+	private :
+		CHistogramAdjust		m_Adjust;
+		std::vector<double>		m_vValues;
+		std::vector<BYTE>		m_vExact;	// Not interpolated: one byte per interval, written in parallel
+
+		double	AdjustValue(double fValue) const
+		{
+			fValue = m_Adjust.Adjust(fValue) / 255.0;
+
+			return (fValue > 255) ? 255 : fValue;
+		};
+
+	public :
+		void	Init(const CHistogramAdjust & Adjust);
+
+		void	Clear()
+		{
+			m_vValues.clear();
+			m_vExact.clear();
+		};
+
+		// fValue on the 0-65535 scale
+		double	GetValue(double fValue) const
+		{
+			if (fValue >= 0 && fValue < 65535.0)
+			{
+				const double	fIndex = fValue * HISTOSTEPS;
+				const LONG		lIndex = static_cast<LONG>(fIndex);
+
+				if (!m_vExact[lIndex])
+					return m_vValues[lIndex] + (m_vValues[lIndex + 1] - m_vValues[lIndex]) * (fIndex - lIndex);
+			};
+
+			return AdjustValue(fValue);
+		};
+	};
+
+	double					m_fNrBitmaps;
+	bool					m_bMonochrome;
+	CAdjustTable			m_RedAdjust;
+	CAdjustTable			m_GreenAdjust;
+	CAdjustTable			m_BlueAdjust;
+	BEZIERCURVEPOINTVECTOR	m_vCurve;
+	std::vector<LONG>		m_vCurveStart;
+	double					m_fSaturationExponent;
+	std::vector<double>		m_vSaturation;
+
+private :
+	double	GetLuminance(double L) const;
+	double	GetSaturation(double S) const;
+
+public :
+	CStackedBitmapLUT()
+	{
+		m_fNrBitmaps			= 1;
+		m_bMonochrome			= false;
+		m_fSaturationExponent	= 1;
+	};
+
+	virtual ~CStackedBitmapLUT() {};
+
+	void	Init(const CRGBHistogramAdjust & HistoAdjust, const CBezierAdjust & BezierAdjust, LONG lNrBitmaps, bool bMonochrome);
+	void	Convert(const float * pRed, const float * pGreen, const float * pBlue, LONG lNrPixels, RGBQUAD * pOut) const;
+};
+
+/* ------------------------------------------------------------------- */
+
 class CStackedBitmap
 {
 private :
+	// Reduced level of the planes (see BitmapPyramid.h)
+	class CLevel
+	{
+	public :
+		LONG					m_lWidth;
+		LONG					m_lHeight;
+		CPixelVector			m_vRedPlane;
+		CPixelVector			m_vGreenPlane;
+		CPixelVector			m_vBluePlane;
+
+	public :
+		CLevel() :
+			m_lWidth(0),
+			m_lHeight(0)
+		{
+		};
+	};
+
 	LONG						m_lWidth;
 	LONG						m_lHeight;
 	LONG						m_lOutputWidth,
@@ -160,6 +268,7 @@ private :
 
 	CBezierAdjust				m_BezierAdjust;
 	CRGBHistogramAdjust 		m_HistoAdjust;
+	std::vector<CLevel>			m_vLevels;
 
 private :
 	bool	LoadDSImage(LPCTSTR szStackedFile, CDSSProgress * pProgress = nullptr);
@@ -196,6 +305,7 @@ public :
 		m_vRedPlane.clear();
 		m_vGreenPlane.clear();
 		m_vBluePlane.clear();
+		m_vLevels.clear();
 
 		m_vRedPlane.resize(lSize);
 		if (!m_bMonochrome)
@@ -311,10 +421,23 @@ public :
 	void	SaveFITS16Bitmap(LPCTSTR szBitmapFile, LPRECT pRect = nullptr, CDSSProgress * pProgress = nullptr, bool bApplySettings = true);
 	void	SaveFITS32Bitmap(LPCTSTR szBitmapFile, LPRECT pRect = nullptr, CDSSProgress * pProgress = nullptr, bool bApplySettings = true, bool bFloat = false);
 #if !defined(PCL_PROJECT) && !defined(_CONSOLE)
+	// Render the part of the level lLevel in rcRender (level coordinates) into
+	// the bitmap of the same size with the compiled tone pipeline
+	// (called concurrently for distinct rectangles by the background rendering)
+	void	RenderBitmap(C32BitsBitmap & Bitmap, const CStackedBitmapLUT & LUT, const RECT & rcRender, LONG lLevel = 0);
 	HBITMAP	GetBitmap(C32BitsBitmap & Bitmap, RECT * pRect = nullptr);
 #endif
 	bool	GetBitmap(CMemoryBitmap ** ppBitmap, CDSSProgress * pProgress = nullptr);
 
+	// Compute the reduced levels of the planes used to render the zoomed out
+	// previews. Must be called again when the planes are modified.
+	void	BuildLevels();
+
+	LONG	GetNrLevels()
+	{
+		return static_cast<LONG>(m_vLevels.size()) + 1;
+	};
+
 	void	Clear()
 	{
 		m_lNrBitmaps = 0;
@@ -325,6 +448,7 @@ public :
 		m_vRedPlane.clear();
 		m_vGreenPlane.clear();
 		m_vBluePlane.clear();
+		m_vLevels.clear();
 		m_lTotalTime = 0;
 		m_lISOSpeed  = 0;
 		m_lGain  = -1;
@@ -1321,6 +1321,11 @@ LRESULT CStackingDlg::OnBackgroundImageLoaded(WPARAM wParam, LPARAM lParam)
 			ApplyGammaTransformation(m_LoadedImage.m_hBitmap, m_LoadedImage.m_pBitmap, m_GammaTransformation);
 		m_Picture.SetImg(phBitmap->GetHBITMAP(), true);
 
+		std::vector<HBITMAP>		vLevels;
+
+		phBitmap->GetLevels(vLevels);
+		m_Picture.SetImgLevels(vLevels);
+
 		if (m_Pictures.IsLightFrame(m_strShowFile))
 		{
 			m_Picture.SetButtonToolbar(&m_ButtonToolbar);
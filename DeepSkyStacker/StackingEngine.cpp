@@ -532,36 +532,40 @@ bool CStackingEngine::ComputeLightFrameOffset(LONG lBitmapIndice, CMatchingStars
 		STARVECTOR &		vStarsOrg = m_vBitmaps[0].m_vStars;
 		STARVECTOR &		vStarsDst = m_vBitmaps[lBitmapIndice].m_vStars;
 		LONG				i;
-		CMatchingStars		MatchingStars;
+		double				fXRatio,
+							fYRatio;
+		CMatchingStars		ScaledMatchingStars;
+
+		fXRatio = (double)m_vBitmaps[lBitmapIndice].RenderedWidth()/(double)m_vBitmaps[0].RenderedWidth();
+		fYRatio = (double)m_vBitmaps[lBitmapIndice].RenderedHeight()/(double)m_vBitmaps[0].RenderedHeight();
+
+		// The matching stars of the thread keep the reference patterns from one frame
+		// to the next - only a frame with another size needs its own scaled reference
+		CMatchingStars &	Matching = (fXRatio == 1.0 && fYRatio == 1.0) ? MatchingStars : ScaledMatchingStars;
 
 		m_CriticalSection.Lock();
 		std::sort(vStarsOrg.begin(), vStarsOrg.end(), CompareStarLuminancy);
 		std::sort(vStarsDst.begin(), vStarsDst.end(), CompareStarLuminancy);
 		m_CriticalSection.Unlock();
 
-		if (!MatchingStars.IsReferenceSet())
+		if (!Matching.IsReferenceSet())
 		{
-			double			fXRatio,
-							fYRatio;
-
-			fXRatio = (double)m_vBitmaps[lBitmapIndice].RenderedWidth()/(double)m_vBitmaps[0].RenderedWidth();
-			fYRatio = (double)m_vBitmaps[lBitmapIndice].RenderedHeight()/(double)m_vBitmaps[0].RenderedHeight();
 			for (i = 0; i<min(vStarsOrg.size(), static_cast<STARVECTOR::size_type>(100)); i++)
-				MatchingStars.AddReferenceStar(vStarsOrg[i].m_fX*fXRatio, vStarsOrg[i].m_fY*fYRatio);
+				Matching.AddReferenceStar(vStarsOrg[i].m_fX*fXRatio, vStarsOrg[i].m_fY*fYRatio);
 		};
-		MatchingStars.ClearTarget();
+		Matching.ClearTarget();
 		for (i = 0; i<min(vStarsDst.size(), static_cast<STARVECTOR::size_type>(100)); i++)
-			MatchingStars.AddTargetedStar(vStarsDst[i].m_fX, vStarsDst[i].m_fY);
+			Matching.AddTargetedStar(vStarsDst[i].m_fX, vStarsDst[i].m_fY);
 
-		MatchingStars.SetSizes(m_vBitmaps[lBitmapIndice].RenderedWidth(), m_vBitmaps[lBitmapIndice].RenderedHeight());
-		bResult = MatchingStars.ComputeCoordinateTransformation(BilinearParameters);
+		Matching.SetSizes(m_vBitmaps[lBitmapIndice].RenderedWidth(), m_vBitmaps[lBitmapIndice].RenderedHeight());
+		bResult = Matching.ComputeCoordinateTransformation(BilinearParameters);
 
 		if (bResult)
 		{
 			BilinearParameters.Offsets(m_vBitmaps[lBitmapIndice].m_fXOffset, m_vBitmaps[lBitmapIndice].m_fYOffset);
 			m_vBitmaps[lBitmapIndice].m_fAngle   = BilinearParameters.Angle(m_vBitmaps[lBitmapIndice].RenderedWidth());
 			m_vBitmaps[lBitmapIndice].m_BilinearParameters = BilinearParameters;
-			MatchingStars.GetVotedPairs(m_vBitmaps[lBitmapIndice].m_vVotedPairs);
+			Matching.GetVotedPairs(m_vBitmaps[lBitmapIndice].m_vVotedPairs);
 			m_CriticalSection.Lock();
 			m_StackingInfo.AddLightFrame(m_vBitmaps[lBitmapIndice].m_strFileName, BilinearParameters);
 			m_CriticalSection.Unlock();
@@ -598,7 +602,7 @@ public :
 	};
 
 	virtual bool	Process();
-	virtual bool	DoTask(HANDLE hEvent);
+	virtual bool	DoTask();
 };
 
 /* ------------------------------------------------------------------- */
@@ -607,28 +611,10 @@ bool	CComputeOffsetTask::Process()
 {
 	ZFUNCTRACE_RUNTIME();
 
-	bool			bStop = false;
-	CString			strText;
-
 	if (m_pStackingEngine->m_pProgress)
 		m_pStackingEngine->m_pProgress->SetNrUsedProcessors(GetNrThreads());
 
-	for (LONG i = 1;i<m_lLast && !bStop;i++)
-	{
-		if (m_pStackingEngine->m_pProgress)
-		{
-			strText.Format(IDS_COMPUTINGSTACKINGINFO, (LPCTSTR)m_pStackingEngine->m_vBitmaps[i].m_strFileName);
-			m_pStackingEngine->m_pProgress->Progress1(strText, i+1);
-			bStop = m_pStackingEngine->m_pProgress->IsCanceled();
-		};
-
-		DWORD			dwThreadId;
-
-		dwThreadId = GetAvailableThreadId();
-		PostThreadMessage(dwThreadId, WM_MT_PROCESS, 0, i);
-	};
-
-	CloseAllThreads();
+	ProcessChunks(1, m_lLast, 1);
 
 	if (m_pStackingEngine->m_pProgress)
 		m_pStackingEngine->m_pProgress->SetNrUsedProcessors();
@@ -638,40 +624,40 @@ bool	CComputeOffsetTask::Process()
 
 /* ------------------------------------------------------------------- */
 
-bool	CComputeOffsetTask::DoTask(HANDLE hEvent)
+bool	CComputeOffsetTask::DoTask()
 {
 	ZFUNCTRACE_RUNTIME();
 
 	bool			bResult = true;
-	bool			bEnd = false;
-	MSG				msg;
+	LONG			lStart, lCount;
 
 	{
 		CMatchingStars  MatchingStars;
 
-		// Create a message queue and signal the event
-		PeekMessage(&msg, nullptr, 0, 0, PM_NOREMOVE);
-		SetEvent(hEvent);
-		while (!bEnd && GetMessage(&msg, nullptr, 0, 0))
+		while (GetNextChunk(lStart, lCount))
 		{
-			if (msg.message == WM_MT_PROCESS)
+			// Only the thread which started the processing reports the progress
+			if (IsMainThread() && m_pStackingEngine->m_pProgress)
 			{
-				if (m_pStackingEngine->ComputeLightFrameOffset(msg.lParam, MatchingStars))
-				{
-					m_pStackingEngine->m_vBitmaps[msg.lParam].m_bDisabled = false;
-					m_CriticalSection.Lock();
-					m_pStackingEngine->m_lNrStackable++;
-					if (m_pStackingEngine->m_vBitmaps[msg.lParam].m_bComet)
-						m_pStackingEngine->m_lNrCometStackable++;
-					m_CriticalSection.Unlock();
-				}
-				else
-					m_pStackingEngine->m_vBitmaps[msg.lParam].m_bDisabled = true;
+				CString			strText;
 
-				SetEvent(hEvent);
+				strText.Format(IDS_COMPUTINGSTACKINGINFO, (LPCTSTR)m_pStackingEngine->m_vBitmaps[lStart].m_strFileName);
+				m_pStackingEngine->m_pProgress->Progress1(strText, lStart+1);
+				if (m_pStackingEngine->m_pProgress->IsCanceled())
+					CancelRemainingChunks();
+			};
+
+			if (m_pStackingEngine->ComputeLightFrameOffset(lStart, MatchingStars))
+			{
+				m_pStackingEngine->m_vBitmaps[lStart].m_bDisabled = false;
+				m_CriticalSection.Lock();
+				m_pStackingEngine->m_lNrStackable++;
+				if (m_pStackingEngine->m_vBitmaps[lStart].m_bComet)
+					m_pStackingEngine->m_lNrCometStackable++;
+				m_CriticalSection.Unlock();
 			}
-			else if (msg.message == WM_MT_STOP)
-				bEnd = true;
+			else
+				m_pStackingEngine->m_vBitmaps[lStart].m_bDisabled = true;
 		};
 	};
 
@@ -1782,138 +1768,127 @@ public :
 		m_pProgress = pProgress;
 	};
 
-	virtual bool	DoTask(HANDLE hEvent);
+	virtual bool	DoTask();
 	virtual bool	Process();
 };
 
 /* ------------------------------------------------------------------- */
 
-bool	CStackTask::DoTask(HANDLE hEvent)
+bool	CStackTask::DoTask()
 {
 	ZFUNCTRACE_RUNTIME();
 
 	bool					bResult = true;
 
 	LONG					i, j;
-	bool					bEnd = false;
-	MSG						msg;
+	LONG					lStart, lCount;
 	LONG					lWidth = m_pBitmap->Width();
 	PIXELDISPATCHVECTOR		vPixels;
 
 	vPixels.reserve(16);
 	AvxStacking avxStacking(0, 0, *m_pBitmap, *m_pTempBitmap, m_rcResult, *m_pAvxEntropy);
 
-	// Create a message queue and signal the event
-	PeekMessage(&msg, nullptr, 0, 0, PM_NOREMOVE);
-	SetEvent(hEvent);
-	while (!bEnd && GetMessage(&msg, nullptr, 0, 0))
+	while (GetNextChunk(lStart, lCount))
 	{
-		if (msg.message == WM_MT_PROCESS)
+		// First try AVX accelerated code, if not supported -> run conventional code.
+		avxStacking.init(lStart, lStart + lCount);
+		if (avxStacking.stack(m_PixTransform, *m_pLightTask, m_BackgroundCalibration, m_lPixelSizeMultiplier) != 0)
 		{
-			// First try AVX accelerated code, if not supported -> run conventional code.
-			avxStacking.init(msg.wParam, msg.wParam + msg.lParam);
-			if (avxStacking.stack(m_PixTransform, *m_pLightTask, m_BackgroundCalibration, m_lPixelSizeMultiplier) != 0)
+			for (j = lStart; j < lStart + lCount; j++)
 			{
-				for (j = msg.wParam; j < msg.wParam + msg.lParam; j++)
+				for (i = 0; i < lWidth; i++)
 				{
-					for (i = 0; i < lWidth; i++)
-					{
-						CPointExt	pt(i, j);
-						CPointExt	ptOut;
+					CPointExt	pt(i, j);
+					CPointExt	ptOut;
 
-						ptOut = m_PixTransform.Transform(pt);
+					ptOut = m_PixTransform.Transform(pt);
 
-						COLORREF16		crColor;
-						float			Red,
-							Green,
-							Blue;
-						double			fRedEntropy = 1.0,
-							fGreenEntropy = 1.0,
-							fBlueEntropy = 1.0;
+					COLORREF16		crColor;
+					float			Red,
+						Green,
+						Blue;
+					double			fRedEntropy = 1.0,
+						fGreenEntropy = 1.0,
+						fBlueEntropy = 1.0;
 
-						if (m_pLightTask->m_Method == MBP_ENTROPYAVERAGE)
-							m_EntropyWindow.GetPixel(i, j, fRedEntropy, fGreenEntropy, fBlueEntropy, crColor);
-						else
-							m_pBitmap->GetPixel16(i, j, crColor);
+					if (m_pLightTask->m_Method == MBP_ENTROPYAVERAGE)
+						m_EntropyWindow.GetPixel(i, j, fRedEntropy, fGreenEntropy, fBlueEntropy, crColor);
+					else
+						m_pBitmap->GetPixel16(i, j, crColor);
 
-						Red = crColor.red;
-						Green = crColor.green;
-						Blue = crColor.blue;
+					Red = crColor.red;
+					Green = crColor.green;
+					Blue = crColor.blue;
 
-						if (m_BackgroundCalibration.m_BackgroundCalibrationMode != BCM_NONE)
-							m_BackgroundCalibration.ApplyCalibration(Red, Green, Blue);
+					if (m_BackgroundCalibration.m_BackgroundCalibrationMode != BCM_NONE)
+						m_BackgroundCalibration.ApplyCalibration(Red, Green, Blue);
 
-						if ((Red || Green || Blue) && ptOut.IsInRect(0, 0, m_rcResult.Width() - 1, m_rcResult.Height() - 1))
+					if ((Red || Green || Blue) && ptOut.IsInRect(0, 0, m_rcResult.Width() - 1, m_rcResult.Height() - 1))
+					{
+						vPixels.resize(0);
+						ComputePixelDispatch(ptOut, m_lPixelSizeMultiplier, vPixels);
+
+						for (LONG k = 0; k < vPixels.size(); k++)
 						{
-							vPixels.resize(0);
-							ComputePixelDispatch(ptOut, m_lPixelSizeMultiplier, vPixels);
+							CPixelDispatch& Pixel = vPixels[k];
 
-							for (LONG k = 0; k < vPixels.size(); k++)
+							// For each plane adjust the values
+							if (Pixel.m_lX >= 0 && Pixel.m_lX < m_rcResult.Width() &&
+								Pixel.m_lY >= 0 && Pixel.m_lY < m_rcResult.Height())
 							{
-								CPixelDispatch& Pixel = vPixels[k];
-
-								// For each plane adjust the values
-								if (Pixel.m_lX >= 0 && Pixel.m_lX < m_rcResult.Width() &&
-									Pixel.m_lY >= 0 && Pixel.m_lY < m_rcResult.Height())
+								// Special case for entropy average
+								if (m_pLightTask->m_Method == MBP_ENTROPYAVERAGE)
 								{
-									// Special case for entropy average
-									if (m_pLightTask->m_Method == MBP_ENTROPYAVERAGE)
+									if (m_bColor)
 									{
-										if (m_bColor)
-										{
-											double				fOldRed,
-												fOldGreen,
-												fOldBlue;
-
-											m_pEntropyCoverage->GetValue(Pixel.m_lX, Pixel.m_lY, fOldRed, fOldGreen, fOldBlue);
-											fOldRed += Pixel.m_fPercentage * fRedEntropy;
-											fOldGreen += Pixel.m_fPercentage * fGreenEntropy;
-											fOldBlue += Pixel.m_fPercentage * fBlueEntropy;
-											m_pEntropyCoverage->SetValue(Pixel.m_lX, Pixel.m_lY, fOldRed, fOldGreen, fOldBlue);
-
-											m_pOutput->GetValue(Pixel.m_lX, Pixel.m_lY, fOldRed, fOldGreen, fOldBlue);
-											fOldRed += Red * Pixel.m_fPercentage * fRedEntropy;
-											fOldGreen += Green * Pixel.m_fPercentage * fGreenEntropy;
-											fOldBlue += Blue * Pixel.m_fPercentage * fBlueEntropy;
-											m_pOutput->SetValue(Pixel.m_lX, Pixel.m_lY, fOldRed, fOldGreen, fOldBlue);
-										}
-										else
-										{
-											double				fOldGray;
-
-											m_pEntropyCoverage->GetValue(Pixel.m_lX, Pixel.m_lY, fOldGray);
-											fOldGray += Pixel.m_fPercentage * fRedEntropy;
-											m_pEntropyCoverage->SetValue(Pixel.m_lX, Pixel.m_lY, fOldGray);
-
-											m_pOutput->GetValue(Pixel.m_lX, Pixel.m_lY, fOldGray);
-											fOldGray += Red * Pixel.m_fPercentage * fRedEntropy;
-											m_pOutput->SetValue(Pixel.m_lX, Pixel.m_lY, fOldGray);
-										};
+										double				fOldRed,
+											fOldGreen,
+											fOldBlue;
+
+										m_pEntropyCoverage->GetValue(Pixel.m_lX, Pixel.m_lY, fOldRed, fOldGreen, fOldBlue);
+										fOldRed += Pixel.m_fPercentage * fRedEntropy;
+										fOldGreen += Pixel.m_fPercentage * fGreenEntropy;
+										fOldBlue += Pixel.m_fPercentage * fBlueEntropy;
+										m_pEntropyCoverage->SetValue(Pixel.m_lX, Pixel.m_lY, fOldRed, fOldGreen, fOldBlue);
+
+										m_pOutput->GetValue(Pixel.m_lX, Pixel.m_lY, fOldRed, fOldGreen, fOldBlue);
+										fOldRed += Red * Pixel.m_fPercentage * fRedEntropy;
+										fOldGreen += Green * Pixel.m_fPercentage * fGreenEntropy;
+										fOldBlue += Blue * Pixel.m_fPercentage * fBlueEntropy;
+										m_pOutput->SetValue(Pixel.m_lX, Pixel.m_lY, fOldRed, fOldGreen, fOldBlue);
 									}
+									else
+									{
+										double				fOldGray;
 
-									double		fPreviousRed,
-										fPreviousGreen,
-										fPreviousBlue;
-
-									m_pTempBitmap->GetPixel(Pixel.m_lX, Pixel.m_lY, fPreviousRed, fPreviousGreen, fPreviousBlue);
-									fPreviousRed += (double)Red / 256.0 * Pixel.m_fPercentage;
-									fPreviousGreen += (double)Green / 256.0 * Pixel.m_fPercentage;
-									fPreviousBlue += (double)Blue / 256.0 * Pixel.m_fPercentage;
-									fPreviousRed = min(fPreviousRed, 255.0);
-									fPreviousGreen = min(fPreviousGreen, 255.0);
-									fPreviousBlue = min(fPreviousBlue, 255.0);
-									m_pTempBitmap->SetPixel(Pixel.m_lX, Pixel.m_lY, fPreviousRed, fPreviousGreen, fPreviousBlue);
-								};
+										m_pEntropyCoverage->GetValue(Pixel.m_lX, Pixel.m_lY, fOldGray);
+										fOldGray += Pixel.m_fPercentage * fRedEntropy;
+										m_pEntropyCoverage->SetValue(Pixel.m_lX, Pixel.m_lY, fOldGray);
+
+										m_pOutput->GetValue(Pixel.m_lX, Pixel.m_lY, fOldGray);
+										fOldGray += Red * Pixel.m_fPercentage * fRedEntropy;
+										m_pOutput->SetValue(Pixel.m_lX, Pixel.m_lY, fOldGray);
+									};
+								}
+
+								double		fPreviousRed,
+									fPreviousGreen,
+									fPreviousBlue;
+
+								m_pTempBitmap->GetPixel(Pixel.m_lX, Pixel.m_lY, fPreviousRed, fPreviousGreen, fPreviousBlue);
+								fPreviousRed += (double)Red / 256.0 * Pixel.m_fPercentage;
+								fPreviousGreen += (double)Green / 256.0 * Pixel.m_fPercentage;
+								fPreviousBlue += (double)Blue / 256.0 * Pixel.m_fPercentage;
+								fPreviousRed = min(fPreviousRed, 255.0);
+								fPreviousGreen = min(fPreviousGreen, 255.0);
+								fPreviousBlue = min(fPreviousBlue, 255.0);
+								m_pTempBitmap->SetPixel(Pixel.m_lX, Pixel.m_lY, fPreviousRed, fPreviousGreen, fPreviousBlue);
 							};
 						};
 					};
 				};
 			};
-
-			SetEvent(hEvent);
-		}
-		else if (msg.message == WM_MT_STOP)
-			bEnd = true;
+		};
 	};
 
 	return true;
@@ -1927,34 +1902,11 @@ bool	CStackTask::Process()
 
 	bool				bResult = true;
 	LONG				lHeight = m_pBitmap->Height();
-	LONG				i = 0;
 	LONG				lStep;
-	LONG				lRemaining;
-
-	if (m_pProgress)
-		m_pProgress->SetNrUsedProcessors(GetNrThreads());
 
 	lStep		= max(1L, lHeight/50);
-	lRemaining	= lHeight;
-
-	while (i<lHeight)
-	{
-		LONG			lAdd = min(lStep, lRemaining);
-		DWORD			dwThreadId;
 
-		dwThreadId = GetAvailableThreadId();
-		PostThreadMessage(dwThreadId, WM_MT_PROCESS, i, lAdd);
-
-		i			+=lAdd;
-		lRemaining	-= lAdd;
-		if (m_pProgress)
-			m_pProgress->Progress2(nullptr, i);
-	};
-
-	CloseAllThreads();
-
-	if (m_pProgress)
-		m_pProgress->SetNrUsedProcessors();
+	bResult = ProcessChunks(0, lHeight, lStep, m_pProgress);
 
 	return bResult;
 };
@@ -2045,6 +1997,14 @@ bool	CStackingEngine::StackLightFrame(CMemoryBitmap * pInBitmap, CPixelTransform
 		else
 			pBitmap = pInBitmap;
 
+		// The entropy, the background calibration and the non vectorised stacking read
+		// the CFA bitmaps with GetPixel: interpolate the missing colours only once
+		bool			bDemosaicCache = false;
+
+		if (!AvxSupport::checkSimdAvailability() || !AvxSupport{ *pBitmap }.isMonochromeCfaBitmapOfType<WORD>() ||
+			(m_pLightTask->m_Method == MBP_ENTROPYAVERAGE) || (m_BackgroundCalibration.m_BackgroundCalibrationMode != BCM_NONE))
+			bDemosaicCache = pBitmap->BuildDemosaicCache();
+
 		CStackTask		StackTask;
 
 		StackTask.Init(pBitmap, m_pProgress);
@@ -2280,6 +2240,9 @@ bool	CStackingEngine::StackLightFrame(CMemoryBitmap * pInBitmap, CPixelTransform
 			bResult = false;
 		};
 
+		if (bDemosaicCache)
+			pBitmap->ReleaseDemosaicCache();
+
 		if (m_pProgress)
 			m_pProgress->End2();
 	};
@@ -2289,6 +2252,213 @@ bool	CStackingEngine::StackLightFrame(CMemoryBitmap * pInBitmap, CPixelTransform
 
 /* ------------------------------------------------------------------- */
 
+class CPipelineFrame
+{
+public :
+	CString						m_strFileName;
+	STARVECTOR *				m_pStars;
+	__int64						m_lSize;
+	bool						m_bLoaded;
+	CSmartPtr<CMemoryBitmap>	m_pBitmap;
+	CSmartPtr<CMemoryBitmap>	m_pDelta;
+	std::exception_ptr			m_pException;
+
+public :
+	CPipelineFrame(LPCTSTR szFileName, STARVECTOR * pStars, __int64 lSize) :
+		m_strFileName(szFileName),
+		m_pStars(pStars),
+		m_lSize(lSize),
+		m_bLoaded(false)
+	{
+	};
+};
+
+/* ------------------------------------------------------------------- */
+
+// Loads and calibrates the next light frames on background threads while
+// the current one is stacked.
+// Loading is done by one thread because the RAW decoder is not reentrant, and
+// calibration by another one because the master dark detects the hot pixels
+// the first time it is used. Both still use the shared pool for their inner loops.
+class CLightFramePipeline
+{
+private :
+	CMasterFrames &					m_MasterFrames;
+	CPostCalibrationSettings		m_pcs;
+	std::vector<CPipelineFrame>		m_vFrames;
+	LONG							m_lDepth;
+	__int64							m_lMemoryLimit;
+	__int64							m_lMemoryInUse;
+	LONG							m_lNextToLoad;
+	LONG							m_lNextToCalibrate;
+	LONG							m_lNextToStack;
+	bool							m_bStop;
+	std::mutex						m_Mutex;
+	std::condition_variable			m_Condition;
+	std::thread						m_LoadThread;
+	std::thread						m_CalibrateThread;
+
+private :
+	void	LoadFrames()
+	{
+		ZFUNCTRACE_RUNTIME();
+
+		for (LONG i = 0;i<(LONG)m_vFrames.size();i++)
+		{
+			CPipelineFrame &		Frame = m_vFrames[i];
+
+			{
+				std::unique_lock<std::mutex>	Lock(m_Mutex);
+
+				// Always allow one frame in flight even if it is bigger than the limit
+				m_Condition.wait(Lock, [&]()
+				{
+					return m_bStop ||
+						   (i == m_lNextToStack) ||
+						   ((i - m_lNextToStack < m_lDepth) && (m_lMemoryInUse + Frame.m_lSize <= m_lMemoryLimit));
+				});
+				if (m_bStop)
+					return;
+				m_lMemoryInUse += Frame.m_lSize;
+			};
+
+			try
+			{
+				Frame.m_bLoaded = ::LoadFrame(Frame.m_strFileName, PICTURETYPE_LIGHTFRAME, nullptr, &Frame.m_pBitmap);
+			}
+			catch (...)
+			{
+				Frame.m_pException = std::current_exception();
+			};
+
+			{
+				std::lock_guard<std::mutex>		Lock(m_Mutex);
+				m_lNextToLoad = i+1;
+			};
+			m_Condition.notify_all();
+		};
+	};
+
+	void	CalibrateFrames()
+	{
+		ZFUNCTRACE_RUNTIME();
+
+		for (LONG i = 0;i<(LONG)m_vFrames.size();i++)
+		{
+			CPipelineFrame &		Frame = m_vFrames[i];
+
+			{
+				std::unique_lock<std::mutex>	Lock(m_Mutex);
+
+				m_Condition.wait(Lock, [&]() { return m_bStop || (i < m_lNextToLoad); });
+				if (m_bStop)
+					return;
+			};
+
+			if (Frame.m_bLoaded && !Frame.m_pException)
+			{
+				try
+				{
+					m_MasterFrames.ApplyAllMasters(Frame.m_pBitmap, Frame.m_pStars, nullptr);
+					ApplyCosmetic(Frame.m_pBitmap, &Frame.m_pDelta, m_pcs, nullptr);
+				}
+				catch (...)
+				{
+					Frame.m_pException = std::current_exception();
+				};
+			};
+
+			{
+				std::lock_guard<std::mutex>		Lock(m_Mutex);
+				m_lNextToCalibrate = i+1;
+			};
+			m_Condition.notify_all();
+		};
+	};
+
+public :
+	CLightFramePipeline(CMasterFrames & MasterFrames, const CPostCalibrationSettings & pcs) :
+		m_MasterFrames(MasterFrames),
+		m_pcs(pcs),
+		m_lDepth(max(1L, CAllStackingTasks::GetPrefetchDepth())),
+		m_lMemoryLimit(CAllStackingTasks::GetPrefetchMemoryLimit()),
+		m_lMemoryInUse(0),
+		m_lNextToLoad(0),
+		m_lNextToCalibrate(0),
+		m_lNextToStack(0),
+		m_bStop(false)
+	{
+	};
+
+	~CLightFramePipeline()
+	{
+		Stop();
+	};
+
+	void	AddFrame(LPCTSTR szFileName, STARVECTOR * pStars, const CFrameInfo & fi, bool bEntropy)
+	{
+		__int64				lSize = (__int64)fi.m_lWidth * fi.m_lHeight * max(1L, fi.m_lNrChannels) * max(8L, fi.m_lBitPerChannels) / 8;
+
+		// The entropy weighting adds up to three float planes with padded rows
+		// (see CEntropyInfo::InitPixelEntropies) while the frame is stacked
+		if (bEntropy)
+			lSize += (__int64)((fi.m_lWidth + 15) & ~15L) * fi.m_lHeight * 3 * sizeof(float);
+
+		m_vFrames.emplace_back(szFileName, pStars, lSize);
+	};
+
+	void	Start()
+	{
+		m_LoadThread		= std::thread(&CLightFramePipeline::LoadFrames, this);
+		m_CalibrateThread	= std::thread(&CLightFramePipeline::CalibrateFrames, this);
+	};
+
+	void	Stop()
+	{
+		{
+			std::lock_guard<std::mutex>		Lock(m_Mutex);
+			m_bStop = true;
+		};
+		m_Condition.notify_all();
+
+		if (m_LoadThread.joinable())
+			m_LoadThread.join();
+		if (m_CalibrateThread.joinable())
+			m_CalibrateThread.join();
+	};
+
+	// Waits until the frame lFrame is loaded and calibrated and hands it over.
+	// Frames must be requested in order.
+	bool	GetFrame(LONG lFrame, CMemoryBitmap ** ppBitmap, CMemoryBitmap ** ppDelta)
+	{
+		ZFUNCTRACE_RUNTIME();
+		CPipelineFrame &		Frame = m_vFrames[lFrame];
+		std::exception_ptr		pException;
+
+		{
+			std::unique_lock<std::mutex>	Lock(m_Mutex);
+
+			m_Condition.wait(Lock, [&]() { return lFrame < m_lNextToCalibrate; });
+			m_lMemoryInUse -= Frame.m_lSize;
+			m_lNextToStack = lFrame+1;
+		};
+		m_Condition.notify_all();
+
+		std::swap(pException, Frame.m_pException);
+		if (pException)
+			std::rethrow_exception(pException);
+
+		Frame.m_pBitmap.CopyTo(ppBitmap);
+		Frame.m_pDelta.CopyTo(ppDelta);
+		Frame.m_pBitmap.Release();
+		Frame.m_pDelta.Release();
+
+		return Frame.m_bLoaded;
+	};
+};
+
+/* ------------------------------------------------------------------- */
+
 bool	CStackingEngine::StackAll(CAllStackingTasks & tasks, CMemoryBitmap ** ppBitmap)
 {
 	ZFUNCTRACE_RUNTIME();
@@ -2433,9 +2603,12 @@ bool	CStackingEngine::StackAll(CAllStackingTasks & tasks, CMemoryBitmap ** ppBit
 					if ((m_pLightTask->m_Method == MBP_AVERAGE) && !m_bCreateCometImage && !m_pComet)
 						m_pLightTask->m_Method = MBP_FASTAVERAGE;
 
-					for (i = 0; i < pStackingInfo->m_pLightTask->m_vBitmaps.size() && !bStop; i++)
+					// First select the frames to stack and compute their transformations
+					std::vector<LONG>				vIndices;
+					std::vector<CPixelTransform>	vPixTransforms;
+
+					for (i = 0; i < pStackingInfo->m_pLightTask->m_vBitmaps.size(); i++)
 					{
-						// Stack this bitmap
 						LONG			lIndice;
 
 						lIndice = FindBitmapIndice(pStackingInfo->m_pLightTask->m_vBitmaps[i].m_strFileName);
@@ -2443,7 +2616,6 @@ bool	CStackingEngine::StackAll(CAllStackingTasks & tasks, CMemoryBitmap ** ppBit
 						{
 							if (!m_vBitmaps[lIndice].m_bDisabled)
 							{
-								bool			bComet = m_vBitmaps[lIndice].m_bComet;
 								bool			bStack = true;
 
 
@@ -2471,61 +2643,96 @@ bool	CStackingEngine::StackAll(CAllStackingTasks & tasks, CMemoryBitmap ** ppBit
 
 								if (bStack)
 								{
-									ZTRACE_RUNTIME("Stack %s", (LPCTSTR)m_vBitmaps[lIndice].m_strFileName);
+									vIndices.push_back(lIndice);
+									vPixTransforms.push_back(PixTransform);
+								};
+							};
+						};
+					};
 
-									if (m_pProgress)
-									{
-										strText.Format(IDS_STACKING_PICTURE, (m_lNrStacked + 1), m_lNrCurrentStackable, m_vBitmaps[lIndice].m_fXOffset, m_vBitmaps[lIndice].m_fYOffset, m_vBitmaps[lIndice].m_fAngle * 180 / M_PI);
-										m_pProgress->Progress1(strText, m_lNrStacked + 1);
-									};
+					// Load and calibrate the next frames in the background while the current one is stacked
+					std::unique_ptr<CLightFramePipeline>	pPipeline;
 
-									CSmartPtr<CMemoryBitmap>		pBitmap;
+					if (CAllStackingTasks::GetPrefetchDepth() > 0 && vIndices.size() > 1)
+					{
+						const bool		bEntropy = (m_pLightTask->m_Method == MBP_ENTROPYAVERAGE);
 
-									if (::LoadFrame(m_vBitmaps[lIndice].m_strFileName, PICTURETYPE_LIGHTFRAME, m_pProgress, &pBitmap))
-									{
-										CString				strDescription;
-
-										strDescription = m_vBitmaps[lIndice].m_strInfos;
-										if (m_vBitmaps[lIndice].m_lNrChannels == 3)
-											strText.Format(IDS_STACKRGBLIGHT, m_vBitmaps[lIndice].m_lBitPerChannels, (LPCTSTR)strDescription, (LPCTSTR)m_vBitmaps[lIndice].m_strFileName);
-										else
-											strText.Format(IDS_STACKGRAYLIGHT, m_vBitmaps[lIndice].m_lBitPerChannels, (LPCTSTR)strDescription, (LPCTSTR)m_vBitmaps[lIndice].m_strFileName);
-
-										ZTRACE_RUNTIME(CT2CA(strText, CP_UTF8));
-										// First apply transformations
-										MasterFrames.ApplyAllMasters(pBitmap, &(m_vBitmaps[lIndice].m_vStars), m_pProgress);
-
-										// Here save the calibrated light frame if needed
-										m_strCurrentLightFrame = m_vBitmaps[lIndice].m_strFileName;
-										CSmartPtr<CMemoryBitmap>		pDelta;
-
-										ApplyCosmetic(pBitmap, &pDelta, m_PostCalibrationSettings, m_pProgress);
-										if (m_bSaveCalibrated)
-											SaveCalibratedLightFrame(pBitmap);
-										if (pDelta)
-											SaveDeltaImage(pDelta);
-
-										if (m_pProgress)
-											m_pProgress->Start2(strText, 0);
-
-										// Stack
-										bStop = !StackLightFrame(pBitmap, PixTransform, m_vBitmaps[lIndice].m_fExposure, bComet);
-										m_lNrStacked++;
-
-										if (m_bCreateCometImage)
-											m_vCometShifts.emplace_back((LONG)m_vCometShifts.size(), PixTransform.m_fXCometShift, PixTransform.m_fYCometShift);
-
-										if (m_pProgress)
-										{
-											m_pProgress->End2();
-											bStop = bStop || m_pProgress->IsCanceled();
-										};
-									};
-								};
+						pPipeline = std::make_unique<CLightFramePipeline>(MasterFrames, m_PostCalibrationSettings);
+						for (LONG lIndice : vIndices)
+							pPipeline->AddFrame(m_vBitmaps[lIndice].m_strFileName, &(m_vBitmaps[lIndice].m_vStars), m_vBitmaps[lIndice], bEntropy);
+						pPipeline->Start();
+					};
+
+					for (i = 0; i < vIndices.size() && !bStop; i++)
+					{
+						// Stack this bitmap
+						LONG				lIndice = vIndices[i];
+						bool				bComet = m_vBitmaps[lIndice].m_bComet;
+						CPixelTransform &	PixTransform = vPixTransforms[i];
+						bool				bLoaded;
+
+						ZTRACE_RUNTIME("Stack %s", (LPCTSTR)m_vBitmaps[lIndice].m_strFileName);
+
+						if (m_pProgress)
+						{
+							strText.Format(IDS_STACKING_PICTURE, (m_lNrStacked + 1), m_lNrCurrentStackable, m_vBitmaps[lIndice].m_fXOffset, m_vBitmaps[lIndice].m_fYOffset, m_vBitmaps[lIndice].m_fAngle * 180 / M_PI);
+							m_pProgress->Progress1(strText, m_lNrStacked + 1);
+						};
+
+						CSmartPtr<CMemoryBitmap>		pBitmap;
+						CSmartPtr<CMemoryBitmap>		pDelta;
+
+						if (pPipeline)
+							bLoaded = pPipeline->GetFrame(i, &pBitmap, &pDelta);
+						else
+							bLoaded = ::LoadFrame(m_vBitmaps[lIndice].m_strFileName, PICTURETYPE_LIGHTFRAME, m_pProgress, &pBitmap);
+
+						if (bLoaded)
+						{
+							CString				strDescription;
+
+							strDescription = m_vBitmaps[lIndice].m_strInfos;
+							if (m_vBitmaps[lIndice].m_lNrChannels == 3)
+								strText.Format(IDS_STACKRGBLIGHT, m_vBitmaps[lIndice].m_lBitPerChannels, (LPCTSTR)strDescription, (LPCTSTR)m_vBitmaps[lIndice].m_strFileName);
+							else
+								strText.Format(IDS_STACKGRAYLIGHT, m_vBitmaps[lIndice].m_lBitPerChannels, (LPCTSTR)strDescription, (LPCTSTR)m_vBitmaps[lIndice].m_strFileName);
+
+							ZTRACE_RUNTIME(CT2CA(strText, CP_UTF8));
+							// First apply transformations (already done by the pipeline)
+							if (!pPipeline)
+								MasterFrames.ApplyAllMasters(pBitmap, &(m_vBitmaps[lIndice].m_vStars), m_pProgress);
+
+							// Here save the calibrated light frame if needed
+							m_strCurrentLightFrame = m_vBitmaps[lIndice].m_strFileName;
+
+							if (!pPipeline)
+								ApplyCosmetic(pBitmap, &pDelta, m_PostCalibrationSettings, m_pProgress);
+							if (m_bSaveCalibrated)
+								SaveCalibratedLightFrame(pBitmap);
+							if (pDelta)
+								SaveDeltaImage(pDelta);
+
+							if (m_pProgress)
+								m_pProgress->Start2(strText, 0);
+
+							// Stack
+							bStop = !StackLightFrame(pBitmap, PixTransform, m_vBitmaps[lIndice].m_fExposure, bComet);
+							m_lNrStacked++;
+
+							if (m_bCreateCometImage)
+								m_vCometShifts.emplace_back((LONG)m_vCometShifts.size(), PixTransform.m_fXCometShift, PixTransform.m_fYCometShift);
+
+							if (m_pProgress)
+							{
+								m_pProgress->End2();
+								bStop = bStop || m_pProgress->IsCanceled();
 							};
 						};
 					};
 
+					if (pPipeline)
+						pPipeline->Stop();
+
 					pStackingInfo->m_pLightTask->m_bDone = true;
 
 					bEnd = bStop;
@@ -87,7 +87,7 @@ bool	LoadFrame(LPCTSTR szFile, PICTURETYPE PictureType, CDSSProgress * pProgress
 
 		if (bOverrideRAW)
 			PushRAWSettings(false, true); // Allways use Raw Bayer for dark, offset, and flat frames
-		if (::LoadPicture(szFile, &pBitmap, pProgress))
+		if (::LoadPicture(szFile, &pBitmap, pProgress, bmpInfo.m_Format))
 			bResult = pBitmap.CopyTo(ppBitmap);
 		if (bOverrideRAW)
 			PopRAWSettings();
@@ -2038,6 +2038,149 @@ void CAllStackingTasks::SetTemporaryFilesFolder(QString strFolder)
 
 /* ------------------------------------------------------------------- */
 
+LONG CAllStackingTasks::GetPrefetchDepth()
+{
+	QSettings	settings;
+
+	// Number of light frames loaded and calibrated ahead of the one being stacked (0 = no prefetch)
+	return settings.value("Stacking/PrefetchDepth", (uint)2).toUInt();
+};
+
+/* ------------------------------------------------------------------- */
+
+void CAllStackingTasks::SetPrefetchDepth(LONG lDepth)
+{
+	QSettings	settings;
+
+	settings.setValue("Stacking/PrefetchDepth", (uint)max(0L, lDepth));
+};
+
+/* ------------------------------------------------------------------- */
+
+__int64 CAllStackingTasks::GetPrefetchMemoryLimit()
+{
+	QSettings		settings;
+	__int64			lResult;
+
+	// In MB - 0 means a quarter of the available physical memory
+	lResult = settings.value("Stacking/PrefetchMemoryLimit", (uint)0).toUInt();
+	if (lResult)
+		lResult *= 1024 * 1024;
+	else
+	{
+		MEMORYSTATUSEX		MemoryStatus;
+
+		MemoryStatus.dwLength = sizeof(MemoryStatus);
+		if (GlobalMemoryStatusEx(&MemoryStatus))
+			lResult = MemoryStatus.ullAvailPhys / 4;
+		else
+			lResult = (__int64)512 * 1024 * 1024;
+	};
+
+	return lResult;
+};
+
+/* ------------------------------------------------------------------- */
+
+void CAllStackingTasks::SetPrefetchMemoryLimit(LONG lLimitMB)
+{
+	QSettings	settings;
+
+	settings.setValue("Stacking/PrefetchMemoryLimit", (uint)max(0L, lLimitMB));
+};
+
+/* ------------------------------------------------------------------- */
+
+__int64 CAllStackingTasks::GetRegisterMemoryLimit()
+{
+	QSettings		settings;
+	__int64			lResult;
+
+	// Memory used by the light frames registered at once
+	// In MB - 0 means a quarter of the available physical memory
+	lResult = settings.value("Register/MemoryLimit", (uint)0).toUInt();
+	if (lResult)
+		lResult *= 1024 * 1024;
+	else
+	{
+		MEMORYSTATUSEX		MemoryStatus;
+
+		MemoryStatus.dwLength = sizeof(MemoryStatus);
+		if (GlobalMemoryStatusEx(&MemoryStatus))
+			lResult = MemoryStatus.ullAvailPhys / 4;
+		else
+			lResult = (__int64)512 * 1024 * 1024;
+	};
+
+	return lResult;
+};
+
+/* ------------------------------------------------------------------- */
+
+void CAllStackingTasks::SetRegisterMemoryLimit(LONG lLimitMB)
+{
+	QSettings	settings;
+
+	settings.setValue("Register/MemoryLimit", (uint)max(0L, lLimitMB));
+};
+
+/* ------------------------------------------------------------------- */
+
+__int64 CAllStackingTasks::GetInMemoryStackingLimit()
+{
+	QSettings			settings;
+	__int64				lResult;
+	MEMORYSTATUSEX		MemoryStatus;
+	__int64				lAvailable = 0;
+
+	MemoryStatus.dwLength = sizeof(MemoryStatus);
+	if (GlobalMemoryStatusEx(&MemoryStatus))
+		lAvailable = MemoryStatus.ullAvailPhys;
+
+	// Memory used by the median/kappa-sigma... stacking methods before spilling
+	// to the temporary files folder.
+	// In MB - 0 means half the available physical memory, never more than
+	// the available physical memory anyway
+	lResult = settings.value("Stacking/InMemoryStackingLimit", (uint)0).toUInt();
+	if (lResult)
+		lResult = min(lResult * 1024 * 1024, lAvailable);
+	else
+		lResult = lAvailable / 2;
+
+	return lResult;
+};
+
+/* ------------------------------------------------------------------- */
+
+void CAllStackingTasks::SetInMemoryStackingLimit(LONG lLimitMB)
+{
+	QSettings	settings;
+
+	settings.setValue("Stacking/InMemoryStackingLimit", (uint)max(0L, lLimitMB));
+};
+
+/* ------------------------------------------------------------------- */
+
+LONG CAllStackingTasks::GetCombineBuffers()
+{
+	QSettings	settings;
+
+	// Number of bands of the scratch file in flight while the median/kappa-sigma...
+	// result is computed: the one being combined and the ones read ahead (1 = no read ahead)
+	return max(1U, settings.value("Stacking/CombineBuffers", (uint)2).toUInt());
+};
+
+/* ------------------------------------------------------------------- */
+
+void CAllStackingTasks::SetCombineBuffers(LONG lNrBuffers)
+{
+	QSettings	settings;
+
+	settings.setValue("Stacking/CombineBuffers", (uint)max(1L, lNrBuffers));
+};
+
+/* ------------------------------------------------------------------- */
+
 BACKGROUNDCALIBRATIONMODE	CAllStackingTasks::GetBackgroundCalibrationMode()
 {
 	CWorkspace			workspace;
@@ -569,6 +569,17 @@ public :
 	static	QString GetTemporaryFilesFolder();
 	static	void SetTemporaryFilesFolder(QString strFolder);
 
+	static	LONG	GetPrefetchDepth();
+	static	void	SetPrefetchDepth(LONG lDepth);
+	static	__int64	GetPrefetchMemoryLimit();
+	static	void	SetPrefetchMemoryLimit(LONG lLimitMB);
+	static	__int64	GetRegisterMemoryLimit();
+	static	void	SetRegisterMemoryLimit(LONG lLimitMB);
+	static	__int64	GetInMemoryStackingLimit();
+	static	void	SetInMemoryStackingLimit(LONG lLimitMB);
+	static	LONG	GetCombineBuffers();
+	static	void	SetCombineBuffers(LONG lNrBuffers);
+
 	static	void GetPostCalibrationSettings(CPostCalibrationSettings & pcs);
 	static	void SetPostCalibrationSettings(const CPostCalibrationSettings & pcs);
 
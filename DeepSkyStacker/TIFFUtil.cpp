@@ -1,8 +1,14 @@
 #include <stdafx.h>
 #include "TIFFUtil.h"
+#include "Multitask.h"
 
 #include "zlib.h"
 #include <iostream>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
 #include <QSettings>
 
 #include <omp.h>
@@ -300,25 +306,136 @@ bool CTIFFReader::Read()
 		auto buffer = std::make_unique<unsigned char[]>(buffSize);
 		//
 		// The code used to read scan line by scan line and decode each individually
-		// Now try to inhale the whole image in as few calls as possible using
-		// TIFFReadEncodedStrip
+		// Now the strips (or tiles) are decoded concurrently, each thread using its
+		// own handle on the file since a TIFF handle can't be shared between threads.
 		//
-		auto stripCount = TIFFNumberOfStrips(m_tiff);
-		ZTRACE_RUNTIME("Number of strips is %u", stripCount);
+		const bool bTiled = TIFFIsTiled(m_tiff) != 0;
+		const LONG blockCount = bTiled ? TIFFNumberOfTiles(m_tiff) : TIFFNumberOfStrips(m_tiff);
+		ZTRACE_RUNTIME("Number of %s is %d", bTiled ? "tiles" : "strips", blockCount);
 
-		unsigned char* curr = buffer.get();
-		for (unsigned int i = 0; i < stripCount; i++)
+		uint32 rowsPerStrip = h;
+		uint32 tileWidth = 0, tileLength = 0;
+		if (bTiled)
 		{
-			const auto count = TIFFReadEncodedStrip(m_tiff, i, curr, -1);
-			if (-1 == count)
-			{
-				ZTRACE_RUNTIME("TIFFReadEncodedStrip returned an error");
+			TIFFGetField(m_tiff, TIFFTAG_TILEWIDTH, &tileWidth);
+			TIFFGetField(m_tiff, TIFFTAG_TILELENGTH, &tileLength);
+			if (!tileWidth || !tileLength)
 				return false;
-			}
-			curr += count; // Increment current buffer pointer
-			if (m_pProgress != nullptr)
-				m_pProgress->Progress2(nullptr, (this->h / 2 * i) / stripCount);
 		}
+		else
+		{
+			TIFFGetFieldDefaulted(m_tiff, TIFFTAG_ROWSPERSTRIP, &rowsPerStrip);
+			rowsPerStrip = std::min(rowsPerStrip, static_cast<uint32>(h));
+		}
+
+		const tdir_t directory = TIFFCurrentDirectory(m_tiff);
+		std::mutex handlesMutex;
+		std::condition_variable handleReleased;
+		bool canOpenHandles = true;
+		std::vector<TIFF*> freeHandles{ m_tiff };
+		std::vector<TIFF*> openedHandles;
+		std::atomic<bool> readError{ false };
+		std::atomic<LONG> blocksDone{ 0 };
+		const std::thread::id mainThreadId = std::this_thread::get_id();
+
+		//
+		// If another handle cannot be opened, wait for one of the handles already
+		// opened (at least m_tiff) to be released instead of failing.
+		//
+		const auto acquireHandle = [&]() -> TIFF*
+		{
+			{
+				std::unique_lock<std::mutex> lock(handlesMutex);
+				if (!canOpenHandles)
+					handleReleased.wait(lock, [&]() { return !freeHandles.empty(); });
+				if (!freeHandles.empty())
+				{
+					TIFF* handle = freeHandles.back();
+					freeHandles.pop_back();
+					return handle;
+				}
+			}
+			TIFF* handle = TIFFOpen(CT2CA(m_strFileName, CP_ACP), "r");
+			if (handle != nullptr && !TIFFSetDirectory(handle, directory))
+			{
+				TIFFClose(handle);
+				handle = nullptr;
+			}
+
+			std::unique_lock<std::mutex> lock(handlesMutex);
+			if (handle != nullptr)
+			{
+				openedHandles.push_back(handle);
+				return handle;
+			}
+			ZTRACE_RUNTIME("Cannot open another handle on the TIFF file, sharing the opened ones");
+			canOpenHandles = false;
+			handleReleased.wait(lock, [&]() { return !freeHandles.empty(); });
+			handle = freeHandles.back();
+			freeHandles.pop_back();
+			return handle;
+		};
+		const auto releaseHandle = [&](TIFF* handle) -> void
+		{
+			{
+				std::lock_guard<std::mutex> lock(handlesMutex);
+				freeHandles.push_back(handle);
+			}
+			handleReleased.notify_one();
+		};
+
+		ParallelFor(0, blockCount, 1, [&](const LONG startBlock, const LONG endBlock)
+		{
+			TIFF* handle = readError ? nullptr : acquireHandle();
+			if (handle == nullptr)
+			{
+				readError = true;
+				return;
+			}
+
+			std::vector<unsigned char> tileBuffer(bTiled ? TIFFTileSize(handle) : 0);
+			for (LONG block = startBlock; block < endBlock && !readError; ++block)
+			{
+				if (bTiled)
+				{
+					if (-1 == TIFFReadEncodedTile(handle, block, tileBuffer.data(), -1))
+					{
+						ZTRACE_RUNTIME("TIFFReadEncodedTile returned an error");
+						readError = true;
+						break;
+					}
+					//
+					// Copy the part of the tile which is inside the image
+					//
+					const uint32 tilesAcross = (w + tileWidth - 1) / tileWidth;
+					const uint32 x0 = (block % tilesAcross) * tileWidth;
+					const uint32 y0 = (block / tilesAcross) * tileLength;
+					const tmsize_t tileRowSize = TIFFTileRowSize(handle);
+					const tmsize_t copySize = (tileRowSize / tileWidth) * std::min(tileWidth, static_cast<uint32>(w) - x0);
+					const uint32 rows = std::min(tileLength, static_cast<uint32>(h) - y0);
+
+					for (uint32 row = 0; row < rows; ++row)
+						memcpy(buffer.get() + (y0 + row) * scanLineSize + (tileRowSize / tileWidth) * x0,
+							tileBuffer.data() + row * tileRowSize, copySize);
+				}
+				else if (-1 == TIFFReadEncodedStrip(handle, block, buffer.get() + block * rowsPerStrip * scanLineSize, -1))
+				{
+					ZTRACE_RUNTIME("TIFFReadEncodedStrip returned an error");
+					readError = true;
+					break;
+				}
+
+				++blocksDone;
+				if (m_pProgress != nullptr && std::this_thread::get_id() == mainThreadId)
+					m_pProgress->Progress2(nullptr, (this->h / 2 * blocksDone) / blockCount);
+			}
+			releaseHandle(handle);
+		});
+
+		for (TIFF* handle : openedHandles)
+			TIFFClose(handle);
+		if (readError)
+			return false;
 
 		BYTE* byteBuff = buffer.get();
 		WORD* shortBuff = reinterpret_cast<WORD*>(byteBuff);
@@ -614,6 +731,167 @@ bool CTIFFWriter::Open()
 
 /* ------------------------------------------------------------------- */
 
+//
+// In memory TIFF file used to encode strips with the libtiff codecs
+// on several threads at once (a TIFF handle can't be shared between threads).
+//
+class CTIFFMemoryFile
+{
+private :
+	std::vector<BYTE>		m_vData;
+	toff_t					m_Offset;
+
+	static CTIFFMemoryFile * FromHandle(thandle_t hFile)
+	{
+		return reinterpret_cast<CTIFFMemoryFile *>(hFile);
+	};
+
+	static tmsize_t	ReadProc(thandle_t hFile, void * pBuffer, tmsize_t lSize)
+	{
+		CTIFFMemoryFile *	pFile = FromHandle(hFile);
+		const tmsize_t		lAvailable = pFile->m_Offset < pFile->m_vData.size() ? static_cast<tmsize_t>(pFile->m_vData.size() - pFile->m_Offset) : 0;
+
+		lSize = std::min(lSize, lAvailable);
+		if (lSize > 0)
+			memcpy(pBuffer, pFile->m_vData.data() + pFile->m_Offset, lSize);
+		pFile->m_Offset += lSize;
+		return lSize;
+	};
+
+	static tmsize_t	WriteProc(thandle_t hFile, void * pBuffer, tmsize_t lSize)
+	{
+		CTIFFMemoryFile *	pFile = FromHandle(hFile);
+
+		if (pFile->m_Offset + lSize > pFile->m_vData.size())
+			pFile->m_vData.resize(pFile->m_Offset + lSize);
+		memcpy(pFile->m_vData.data() + pFile->m_Offset, pBuffer, lSize);
+		pFile->m_Offset += lSize;
+		return lSize;
+	};
+
+	static toff_t	SeekProc(thandle_t hFile, toff_t Offset, int nWhence)
+	{
+		CTIFFMemoryFile *	pFile = FromHandle(hFile);
+
+		switch (nWhence)
+		{
+		case SEEK_SET :
+			pFile->m_Offset = Offset;
+			break;
+		case SEEK_CUR :
+			pFile->m_Offset += Offset;
+			break;
+		case SEEK_END :
+			pFile->m_Offset = pFile->m_vData.size() + Offset;
+			break;
+		};
+		return pFile->m_Offset;
+	};
+
+	static int		CloseProc(thandle_t)
+	{
+		return 0;
+	};
+
+	static toff_t	SizeProc(thandle_t hFile)
+	{
+		return FromHandle(hFile)->m_vData.size();
+	};
+
+	static int		MapProc(thandle_t, void **, toff_t *)
+	{
+		return 0;
+	};
+
+	static void		UnmapProc(thandle_t, void *, toff_t)
+	{
+	};
+
+public :
+	//
+	// Layout and compression tags of an image, read once from its TIFF handle
+	// so that the strips can be encoded while the handle is used to write
+	//
+	class CStripFormat
+	{
+	public :
+		std::vector<std::pair<ttag_t, uint32>>	m_vLongTags;
+		std::vector<std::pair<ttag_t, uint16>>	m_vShortTags;
+		bool									m_bZipQuality;
+		int										m_nZipQuality;
+
+	public :
+		explicit CStripFormat(TIFF * pModel) :
+			m_bZipQuality(false),
+			m_nZipQuality(0)
+		{
+			uint32			lValue = 0;
+			uint16			wValue = 0;
+
+			for (const ttag_t Tag : { TIFFTAG_IMAGEWIDTH, TIFFTAG_IMAGELENGTH, TIFFTAG_ROWSPERSTRIP })
+			{
+				if (TIFFGetField(pModel, Tag, &lValue))
+					m_vLongTags.emplace_back(Tag, lValue);
+			};
+			for (const ttag_t Tag : { TIFFTAG_BITSPERSAMPLE, TIFFTAG_SAMPLESPERPIXEL, TIFFTAG_PLANARCONFIG,
+									  TIFFTAG_PHOTOMETRIC, TIFFTAG_SAMPLEFORMAT, TIFFTAG_COMPRESSION, TIFFTAG_PREDICTOR })
+			{
+				if (TIFFGetField(pModel, Tag, &wValue))
+					m_vShortTags.emplace_back(Tag, wValue);
+			};
+			wValue = COMPRESSION_NONE;
+			TIFFGetField(pModel, TIFFTAG_COMPRESSION, &wValue);
+			if (wValue == COMPRESSION_DEFLATE || wValue == COMPRESSION_ADOBE_DEFLATE)
+				m_bZipQuality = TIFFGetField(pModel, TIFFTAG_ZIPQUALITY, &m_nZipQuality) != 0;
+		};
+	};
+
+public :
+	CTIFFMemoryFile() :
+		m_Offset(0)
+	{
+	};
+
+	//
+	// Encode the strip lStrip of an image with the given layout and compression
+	// and return the encoded bytes in vEncoded
+	//
+	static bool	EncodeStrip(const CStripFormat & Format, uint32 lStrip, void * pData, tmsize_t lSize, std::vector<BYTE> & vEncoded)
+	{
+		bool				bResult = false;
+		CTIFFMemoryFile		File;
+		TIFF *				pTIFF = TIFFClientOpen("DSSStrip", "w", reinterpret_cast<thandle_t>(&File),
+												   ReadProc, WriteProc, SeekProc, CloseProc, SizeProc, MapProc, UnmapProc);
+
+		if (pTIFF)
+		{
+			for (const auto & Tag : Format.m_vLongTags)
+				TIFFSetField(pTIFF, Tag.first, Tag.second);
+			for (const auto & Tag : Format.m_vShortTags)
+				TIFFSetField(pTIFF, Tag.first, Tag.second);
+			if (Format.m_bZipQuality)
+				TIFFSetField(pTIFF, TIFFTAG_ZIPQUALITY, Format.m_nZipQuality);
+
+			if (-1 != TIFFWriteEncodedStrip(pTIFF, lStrip, pData, lSize))
+			{
+				const uint64	Offset = TIFFGetStrileOffset(pTIFF, lStrip);
+				const uint64	Count = TIFFGetStrileByteCount(pTIFF, lStrip);
+
+				if (Offset + Count <= File.m_vData.size())
+				{
+					vEncoded.assign(File.m_vData.begin() + Offset, File.m_vData.begin() + Offset + Count);
+					bResult = true;
+				};
+			};
+			TIFFCleanup(pTIFF);		// No need to write the directory of the in memory file
+		};
+
+		return bResult;
+	};
+};
+
+/* ------------------------------------------------------------------- */
+
 bool CTIFFWriter::Write()
 {
 	ZFUNCTRACE_RUNTIME();
@@ -784,23 +1062,75 @@ bool CTIFFWriter::Write()
 			tsize_t stripSize = rowsPerStrip * scanLineSize;
 			tsize_t bytesRemaining = h * scanLineSize;
 			tsize_t size = stripSize;
-			for (long strip = 0; strip < numStrips; strip++)
+			if (compression == COMPRESSION_NONE || numStrips < 2)
 			{
-				if (bytesRemaining < stripSize)
-					size = bytesRemaining;
-
-				tsize_t result = TIFFWriteEncodedStrip(m_tiff, strip, curr, size);
-				if (-1 == result)
+				for (long strip = 0; strip < numStrips; strip++)
 				{
-					ZTRACE_RUNTIME("TIFFWriteEncodedStrip() failed");
-					bError = true;
-					break;
+					if (bytesRemaining < stripSize)
+						size = bytesRemaining;
+
+					tsize_t result = TIFFWriteEncodedStrip(m_tiff, strip, curr, size);
+					if (-1 == result)
+					{
+						ZTRACE_RUNTIME("TIFFWriteEncodedStrip() failed");
+						bError = true;
+						break;
+					}
+					curr += result;
+					bytesRemaining -= result;
+
+					if (m_pProgress != nullptr)
+						m_pProgress->Progress2(nullptr, h / 2 + (h * strip) / (2 * numStrips));
 				}
-				curr += result;
-				bytesRemaining -= result;
+			}
+			else
+			{
+				//
+				// The strips are compressed concurrently and written out in strip
+				// order by whichever thread completes the next strip to write.
+				// m_tiff is only used under writeMutex: the tags needed to encode
+				// the strips are read before.
+				//
+				const CTIFFMemoryFile::CStripFormat stripFormat(m_tiff);
+				std::vector<std::vector<BYTE>> encodedStrips(numStrips);
+				std::vector<bool> encodedDone(numStrips, false);
+				std::mutex writeMutex;
+				long nextStrip = 0;
+				std::atomic<bool> writeError{ false };
+				const std::thread::id mainThreadId = std::this_thread::get_id();
+
+				ParallelFor(0, numStrips, 1, [&](const LONG startStrip, const LONG endStrip)
+				{
+					for (LONG strip = startStrip; strip < endStrip; ++strip)
+					{
+						const tsize_t stripStart = strip * stripSize;
+						const tsize_t stripBytes = std::min(stripSize, h * scanLineSize - stripStart);
+
+						if (!writeError && !CTIFFMemoryFile::EncodeStrip(stripFormat, strip, curr + stripStart, stripBytes, encodedStrips[strip]))
+						{
+							ZTRACE_RUNTIME("Encoding of strip %d failed", strip);
+							writeError = true;
+						}
+
+						std::lock_guard<std::mutex> lock(writeMutex);
+						encodedDone[strip] = true;
+						while (nextStrip < numStrips && encodedDone[nextStrip])
+						{
+							std::vector<BYTE>& encoded = encodedStrips[nextStrip];
+							if (!writeError && -1 == TIFFWriteRawStrip(m_tiff, nextStrip, encoded.data(), encoded.size()))
+							{
+								ZTRACE_RUNTIME("TIFFWriteRawStrip() failed");
+								writeError = true;
+							}
+							std::vector<BYTE>().swap(encoded);
+							++nextStrip;
+						}
 
-				if (m_pProgress != nullptr)
-					m_pProgress->Progress2(nullptr, h / 2 + (h * strip) / (2 * numStrips));
+						if (m_pProgress != nullptr && std::this_thread::get_id() == mainThreadId)
+							m_pProgress->Progress2(nullptr, h / 2 + (h * nextStrip) / (2 * numStrips));
+					}
+				});
+				bError = writeError;
 			}
 
 			free(buff);
@@ -1,6 +1,7 @@
 #include "StdAfx.h"
 #include "avx_avg.h"
 #include "avx.h"
+#include "avx_simd.h"
 #include <immintrin.h>
 
 AvxAccumulation::AvxAccumulation(const CRect& resultRect, const CTaskInfo& tInfo, CMemoryBitmap& tempbm, CMemoryBitmap& outbm, AvxEntropy& entroinfo) noexcept :
@@ -18,6 +19,10 @@ AvxAccumulation::AvxAccumulation(const CRect& resultRect, const CTaskInfo& tInfo
 
 int AvxAccumulation::accumulate(const int nrStackedBitmaps)
 {
+	// Fast average and maximum of 16 bit and float bitmaps are handled by the runtime dispatched kernels, on every CPU.
+	if (accumulateWithKernels<WORD>(nrStackedBitmaps) == 0 || accumulateWithKernels<float>(nrStackedBitmaps) == 0)
+		return 0;
+
 	if (!AvxSupport::checkSimdAvailability())
 		return 1;
 
@@ -31,6 +36,60 @@ int AvxAccumulation::accumulate(const int nrStackedBitmaps)
 	return AvxSupport::zeroUpper(rval);
 }
 
+template <class T_IN>
+int AvxAccumulation::accumulateWithKernels(const int nrStackedBitmaps)
+{
+	if (taskInfo.m_Method != MBP_FASTAVERAGE && taskInfo.m_Method != MBP_MAXIMUM)
+		return 1;
+
+	const AvxSupport avxTempBitmap{ tempBitmap };
+	if (!avxTempBitmap.bitmapHasCorrectType<T_IN>())
+		return 1;
+
+	const SimdKernels& kernels = SimdKernels::get();
+	const float nrStacked = static_cast<float>(nrStackedBitmaps);
+	const size_t nrPixels = static_cast<size_t>(resultWidth) * static_cast<size_t>(resultHeight);
+
+	// The rows are contiguous, so each channel is processed in one go.
+	const auto accumulateChannel = [&](const T_IN* const pIn, float* const pOut) -> void
+	{
+		if (taskInfo.m_Method == MBP_MAXIMUM)
+		{
+			if constexpr (std::is_same<T_IN, float>::value)
+				kernels.maximumFloat(pIn, pOut, nrPixels);
+			else
+				kernels.maximumWord(pIn, pOut, nrPixels);
+		}
+		else
+		{
+			if constexpr (std::is_same<T_IN, float>::value)
+				kernels.averageFloat(pIn, pOut, nrPixels, nrStacked);
+			else
+				kernels.averageWord(pIn, pOut, nrPixels, nrStacked);
+		}
+	};
+
+	if (avxTempBitmap.isColorBitmap())
+	{
+		auto* const pOutput = dynamic_cast<CColorBitmapT<float>*>(&outputBitmap);
+		if (pOutput == nullptr)
+			return 1;
+		accumulateChannel(avxTempBitmap.redPixels<T_IN>().data(), pOutput->m_Red.m_vPixels.data());
+		accumulateChannel(avxTempBitmap.greenPixels<T_IN>().data(), pOutput->m_Green.m_vPixels.data());
+		accumulateChannel(avxTempBitmap.bluePixels<T_IN>().data(), pOutput->m_Blue.m_vPixels.data());
+		return 0;
+	}
+	if (avxTempBitmap.isMonochromeBitmap())
+	{
+		auto* const pOutput = dynamic_cast<CGrayBitmapT<float>*>(&outputBitmap);
+		if (pOutput == nullptr)
+			return 1;
+		accumulateChannel(avxTempBitmap.grayPixels<T_IN>().data(), pOutput->m_vPixels.data());
+		return 0;
+	}
+	return 1;
+}
+
 template <class T_IN, class T_OUT>
 int AvxAccumulation::doAccumulate(const int nrStackedBitmaps)
 {
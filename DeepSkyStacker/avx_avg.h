@@ -23,6 +23,9 @@ public:
 
 	int accumulate(const int nrStackedBitmaps);
 private:
+	template <class T_IN>
+	int accumulateWithKernels(const int nrStackedBitmaps);
+
 	template <class T_IN, class T_OUT>
 	int doAccumulate(const int nrStackedBitmaps);
 };
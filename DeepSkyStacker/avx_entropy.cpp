@@ -53,14 +53,19 @@ int AvxEntropy::doCalcEntropies(const int squareSize, const int nSquaresX, const
 	const int width = inputBitmap.Width();
 	const int height = inputBitmap.Height();
 
-	const auto getDistribution = [](const auto& histogram, T value) -> float
+	const auto getHistoIndex = [](T value) -> size_t
 	{
 		if constexpr (std::is_integral<T>::value && sizeof(T) == 4) // 32 bit integral type 
 			value >>= 16;
-		return static_cast<float>(histogram[std::min(static_cast<size_t>(value), size_t{ USHORT_MAX })]);
+		return std::min(static_cast<size_t>(value), size_t{ USHORT_MAX });
+	};
+	const auto getDistribution = [&getHistoIndex](const auto& histogram, T value) -> float
+	{
+		return static_cast<float>(histogram[getHistoIndex(value)]);
 	};
 
-	const auto calcEntropyOfSquare = [squareSize, width, height, vectorLen, &getDistribution](const int col, const int row, const T* const pColor, auto& histogram) -> EntropyVectorType::value_type
+	// The histogram must be empty on entry, it is left empty (only the used entries are cleared, not the 65536).
+	const auto calcEntropyOfSquare = [squareSize, width, height, vectorLen, &getHistoIndex, &getDistribution](const int col, const int row, const T* const pColor, auto& histogram) -> EntropyVectorType::value_type
 	{
 		const int xmin = col * squareSize;
 		const int xmax = std::min(xmin + squareSize, width);
@@ -68,7 +73,6 @@ int AvxEntropy::doCalcEntropies(const int squareSize, const int nSquaresX, const
 		const int ymin = row * squareSize;
 		const int ymax = std::min(ymin + squareSize, height);
 		const int nrVectors = nx / vectorLen;
-		memset(histogram.data(), 0, histogram.size() * sizeof(histogram[0]));
 
 		for (int y = ymin; y < ymax; ++y)
 		{
@@ -111,7 +115,23 @@ int AvxEntropy::doCalcEntropies(const int squareSize, const int nSquaresX, const
 		// Accumulate float entropy and horizontal sum of avxEntropy.
 		const __m256 r0 = _mm256_hadd_ps(_mm256_hadd_ps(avxEntropy, _mm256_setzero_ps()), _mm256_setzero_ps()); // ., ., ., e4+e5+e6+e7, ., ., ., e0+e1+e2+e3
 		entropy += _mm_cvtss_f32(_mm_add_ps(_mm256_castps256_ps128(r0), _mm256_extractf128_ps(r0, 1)));
-		
+
+		for (int y = ymin; y < ymax; ++y)
+		{
+			const T* p = pColor + y * width + xmin;
+			for (int n = 0; n < nrVectors; ++n, p += vectorLen)
+			{
+				const auto [lo, hi] = AvxSupport::read16PackedInt(p);
+				alignas(32) int indices[16];
+				_mm256_store_si256(reinterpret_cast<__m256i*>(indices), lo);
+				_mm256_store_si256(reinterpret_cast<__m256i*>(indices + 8), hi);
+				for (const int index : indices)
+					histogram[index] = 0;
+			}
+			for (int x = xmin + nrVectors * vectorLen; x < xmax; ++x, ++p)
+				histogram[getHistoIndex(*p)] = 0;
+		}
+
 		return entropy / (N * std::log(2.0f));
 	};
 
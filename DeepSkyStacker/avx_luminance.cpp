@@ -2,6 +2,7 @@
 #include "avx_luminance.h"
 #include "avx_cfa.h"
 #include "avx.h"
+#include "avx_simd.h"
 
 AvxLuminance::AvxLuminance(CMemoryBitmap& inputbm, CMemoryBitmap& outbm) noexcept :
 	inputBitmap{ inputbm },
@@ -18,6 +19,10 @@ AvxLuminance::AvxLuminance(CMemoryBitmap& inputbm, CMemoryBitmap& outbm) noexcep
 
 int AvxLuminance::computeLuminanceBitmap(const size_t lineStart, const size_t lineEnd)
 {
+	// 16 bit bitmaps (except CFA) are handled by the runtime dispatched kernels, on every CPU.
+	if (computeLuminanceWithKernels(lineStart, lineEnd) == 0)
+		return 0;
+
 	if (!avxReady)
 		return 1;
 
@@ -31,6 +36,38 @@ int AvxLuminance::computeLuminanceBitmap(const size_t lineStart, const size_t li
 	return AvxSupport::zeroUpper(rval);
 }
 
+int AvxLuminance::computeLuminanceWithKernels(const size_t lineStart, const size_t lineEnd)
+{
+	constexpr double scalingFactor = 1.0 / 256.0;
+
+	const AvxSupport avxInputSupport{ inputBitmap };
+	AvxSupport avxOutputSupport{ outputBitmap };
+	if (!avxOutputSupport.isMonochromeBitmapOfType<double>())
+		return 1;
+
+	const SimdKernels& kernels = SimdKernels::get();
+	const size_t width = inputBitmap.Width();
+
+	if (avxInputSupport.isColorBitmapOfType<WORD>())
+	{
+		for (size_t row = lineStart; row < lineEnd; ++row)
+		{
+			kernels.luminanceRgb(&avxInputSupport.redPixels<WORD>().at(row * width), &avxInputSupport.greenPixels<WORD>().at(row * width), &avxInputSupport.bluePixels<WORD>().at(row * width),
+				&avxOutputSupport.grayPixels<double>().at(row * width), width, scalingFactor);
+		}
+		return 0;
+	}
+
+	if (avxInputSupport.isMonochromeBitmapOfType<WORD>() && !avxInputSupport.isMonochromeCfaBitmapOfType<WORD>())
+	{
+		for (size_t row = lineStart; row < lineEnd; ++row)
+			kernels.luminanceGray(&avxInputSupport.grayPixels<WORD>().at(row * width), &avxOutputSupport.grayPixels<double>().at(row * width), width, scalingFactor);
+		return 0;
+	}
+
+	return 1;
+}
+
 template <class T>
 int AvxLuminance::doComputeLuminance(const size_t lineStart, const size_t lineEnd)
 {
@@ -18,6 +18,8 @@ public:
 
 	int computeLuminanceBitmap(const size_t lineStart, const size_t lineEnd);
 private:
+	int computeLuminanceWithKernels(const size_t lineStart, const size_t lineEnd);
+
 	template <class T>
 	int doComputeLuminance(const size_t lineStart, const size_t lineEnd);
 
@@ -1,5 +1,12 @@
 #pragma once
 
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <limits>
+#include <cstdint>
+#include <type_traits>
+
 namespace Medianhelper
 {
 
@@ -70,6 +77,180 @@ namespace Medianhelper
 		}
 	}
 
+
+	// ************* Sorting networks *************
+
+	// Up to this number of values the median of a single set is computed with a selection network
+	// (fixed sequence of branchless compare-exchanges), above it quickselect is faster.
+	constexpr int MaxNetworkSize = 32;
+	// Networks are built up to this size. The batched medians process BatchSize sets at once, so the
+	// cost of a comparator is shared and the networks stay faster than quickselect up to this size.
+	constexpr int MaxBatchNetworkSize = 64;
+	constexpr int BatchSize = 16;
+	// From this number of 16 bit values on, the median is selected with two 256 bins histograms.
+	constexpr int RadixSelectMinSize = 40;
+
+	typedef std::vector<std::pair<std::uint8_t, std::uint8_t>> Comparators;
+
+	// Batcher's odd-even merge sort for 1 to MaxBatchNetworkSize values, and the same networks pruned
+	// to the comparators the median depends on.
+	// The networks are built for the next power of two. The comparators using an index >= n are dropped:
+	// the missing values behave like +infinity which would never be moved.
+	class SortingNetworks
+	{
+	private:
+		std::vector<Comparators> sortNetworks;
+		std::vector<Comparators> medianNetworks;
+
+		static Comparators buildSortNetwork(const int n)
+		{
+			Comparators comparators;
+			int size = 1;
+			while (size < n)
+				size <<= 1;
+
+			for (int p = 1; p < size; p <<= 1)
+				for (int k = p; k >= 1; k >>= 1)
+					for (int j = k % p; j + k < size; j += 2 * k)
+						for (int i = 0; i < k && i + j + k < size; ++i)
+							if ((i + j) / (2 * p) == (i + j + k) / (2 * p) && i + j + k < n)
+								comparators.emplace_back(static_cast<std::uint8_t>(i + j), static_cast<std::uint8_t>(i + j + k));
+			return comparators;
+		}
+
+		// Walk the network backwards and only keep the comparators writing to a wire the middle
+		// elements (n/2 and n/2-1) depend on.
+		static Comparators buildMedianNetwork(const Comparators& sortNetwork, const int n)
+		{
+			std::uint64_t needed = std::uint64_t{ 1 } << (n / 2);
+			if ((n & 1) == 0)
+				needed |= std::uint64_t{ 1 } << (n / 2 - 1);
+
+			Comparators comparators;
+			for (auto it = sortNetwork.crbegin(); it != sortNetwork.crend(); ++it)
+			{
+				const std::uint64_t wires = (std::uint64_t{ 1 } << it->first) | (std::uint64_t{ 1 } << it->second);
+				if ((needed & wires) != 0)
+				{
+					needed |= wires;
+					comparators.push_back(*it);
+				}
+			}
+			return Comparators(comparators.crbegin(), comparators.crend());
+		}
+
+		SortingNetworks() :
+			sortNetworks(MaxBatchNetworkSize + 1),
+			medianNetworks(MaxBatchNetworkSize + 1)
+		{
+			for (int n = 2; n <= MaxBatchNetworkSize; ++n)
+			{
+				sortNetworks[n] = buildSortNetwork(n);
+				medianNetworks[n] = buildMedianNetwork(sortNetworks[n], n);
+			}
+		}
+
+	public:
+		static const SortingNetworks& get()
+		{
+			static const SortingNetworks networks;
+			return networks;
+		}
+
+		const Comparators& sort(const int n) const
+		{
+			return sortNetworks[n];
+		}
+		const Comparators& median(const int n) const
+		{
+			return medianNetworks[n];
+		}
+	};
+
+	// Written so that it compiles to min/max instructions (no branch), also when vectorized.
+	template <class T>
+	inline void compareExchange(T& a, T& b)
+	{
+		const T lo = b < a ? b : a;
+		const T hi = b < a ? a : b;
+		a = lo;
+		b = hi;
+	}
+
+	template <class T>
+	inline void applyNetwork(T arr[], const Comparators& comparators)
+	{
+		for (const auto& comparator : comparators)
+			compareExchange(arr[comparator.first], arr[comparator.second]);
+	}
+
+	// Same result as qMedian, including the integer truncation of (a+b)/2.
+	template <class T>
+	inline T middleValue(const T a, const T b, const int n)
+	{
+		return ((n & 1) == 0) ? static_cast<T>((a + b) / 2) : b;
+	}
+
+	template <class T>
+	inline T networkMedian(T arr[], const int n)
+	{
+		if (n == 1)
+			return arr[0];
+		applyNetwork(arr, SortingNetworks::get().median(n));
+		return middleValue(arr[(n / 2) - ((n & 1) == 0 ? 1 : 0)], arr[n / 2], n);
+	}
+
+	// ************* Radix selection *************
+
+	// Median of 16 bit values with two counting passes (high byte, then low byte of the values in
+	// the selected high byte bucket). The order of the values is not modified.
+	inline std::uint16_t radixMedian(const std::uint16_t arr[], const int n)
+	{
+		int histogram[256] = {};
+		int rankB = n / 2;
+		int rankA = ((n & 1) == 0) ? rankB - 1 : rankB;
+
+		for (int i = 0; i < n; ++i)
+			++histogram[arr[i] >> 8];
+
+		const auto findBucket = [&histogram](int& rank) -> int
+		{
+			int bucket = 0;
+			while (rank >= histogram[bucket])
+				rank -= histogram[bucket++];
+			return bucket;
+		};
+		const int highA = findBucket(rankA);
+		const int highB = findBucket(rankB);
+
+		std::uint16_t a, b;
+		if (highA == highB)
+		{
+			std::fill(std::begin(histogram), std::end(histogram), 0);
+			for (int i = 0; i < n; ++i)
+				if ((arr[i] >> 8) == highB)
+					++histogram[arr[i] & 0xff];
+			a = static_cast<std::uint16_t>((highA << 8) | findBucket(rankA));
+			b = static_cast<std::uint16_t>((highB << 8) | findBucket(rankB));
+		}
+		else
+		{
+			// a is the largest value of its bucket and b the smallest of the next non empty one.
+			a = static_cast<std::uint16_t>(highA << 8);
+			b = static_cast<std::uint16_t>((highB << 8) | 0xff);
+			for (int i = 0; i < n; ++i)
+			{
+				const int high = arr[i] >> 8;
+				if (high == highA && arr[i] > a)
+					a = arr[i];
+				else if (high == highB && arr[i] < b)
+					b = arr[i];
+			}
+		}
+
+		return middleValue(a, b, n);
+	}
+
 };
 
 template <class T>
@@ -82,3 +263,134 @@ inline T qMedian(T arr[], const int n, const int quantile)
 	// If n is even -> (a+b)/2 ELSE b
 	return ((n & 1) == 0) ? ((a + b) / 2) : b;
 }
+
+
+// Median of n > 0 values, same result as qMedian(arr, n, n / 2). The values are reordered.
+template <class T>
+inline T FastMedian(T arr[], const int n)
+{
+	if (n <= Medianhelper::MaxNetworkSize)
+		return Medianhelper::networkMedian(arr, n);
+	if constexpr (std::is_same<T, std::uint16_t>::value)
+	{
+		if (n >= Medianhelper::RadixSelectMinSize)
+			return Medianhelper::radixMedian(arr, n);
+	}
+	return qMedian(arr, n, n / 2);
+}
+
+// Sorts n values in increasing order.
+template <class T>
+inline void FastSort(T arr[], const int n)
+{
+	if (n > 1 && n <= Medianhelper::MaxNetworkSize)
+		Medianhelper::applyNetwork(arr, Medianhelper::SortingNetworks::get().sort(n));
+	else
+		std::sort(arr, arr + n);
+}
+
+// Medians of nrColumns (1..BatchSize) adjacent pixels of a set of scan lines: the values of the
+// column c are pLines[f][offset + c] for all the lines f.
+// Like the per pixel path the zero values are ignored (the median of a column without any value
+// is 0), and 32 bit integers are shifted by valueShift after the zero test.
+// Up to MaxBatchNetworkSize lines the values are stored line by line and the same network is applied
+// to all the columns at once, the ignored values being replaced by the largest value of T so that
+// they are sorted last.
+template <class T>
+inline void BatchMedian(const T* const pLines[], const int nrLines, const size_t offset, const int nrColumns, const int valueShift, T pMedians[], std::vector<T>& vWork)
+{
+	using namespace Medianhelper;
+	constexpr T ignored = std::numeric_limits<T>::has_infinity ? std::numeric_limits<T>::infinity() : std::numeric_limits<T>::max();
+	const auto shifted = [valueShift](const T value) -> T
+	{
+		if constexpr (std::is_integral<T>::value && sizeof(T) == 4)
+			return value >> valueShift;
+		else
+			return value;
+	};
+
+	if (nrLines > MaxBatchNetworkSize)
+	{
+		vWork.resize(nrLines);
+		for (int c = 0; c < nrColumns; ++c)
+		{
+			int N = 0;
+			for (int f = 0; f < nrLines; ++f)
+			{
+				const T value = pLines[f][offset + c];
+				if (value != T{ 0 })
+					vWork[N++] = shifted(value);
+			}
+			pMedians[c] = (N == 0) ? T{ 0 } : FastMedian(vWork.data(), N);
+		}
+		return;
+	}
+
+	int sizes[BatchSize] = {};
+	vWork.resize(nrLines * size_t{ BatchSize });
+	T* const pWork = vWork.data();
+
+	for (int f = 0; f < nrLines; ++f)
+	{
+		T* const pRow = pWork + f * size_t{ BatchSize };
+		for (int c = 0; c < BatchSize; ++c)
+		{
+			const T value = (c < nrColumns) ? pLines[f][offset + c] : T{ 0 };
+			if (value != T{ 0 })
+			{
+				pRow[c] = shifted(value);
+				++sizes[c];
+			}
+			else
+				pRow[c] = ignored;
+		}
+	}
+
+	// When no value is ignored the middle elements are enough, otherwise they depend on the column.
+	bool allValues = true;
+	for (int c = 0; c < nrColumns; ++c)
+		allValues = allValues && (sizes[c] == nrLines);
+
+	if (nrLines > 1)
+	{
+		const auto& networks = SortingNetworks::get();
+		for (const auto& comparator : allValues ? networks.median(nrLines) : networks.sort(nrLines))
+		{
+			T* const pA = pWork + comparator.first * size_t{ BatchSize };
+			T* const pB = pWork + comparator.second * size_t{ BatchSize };
+			for (int c = 0; c < BatchSize; ++c)
+				compareExchange(pA[c], pB[c]);
+		}
+	}
+
+	for (int c = 0; c < nrColumns; ++c)
+	{
+		const int N = sizes[c];
+		if (N == 0)
+			pMedians[c] = T{ 0 };
+		else
+			pMedians[c] = middleValue(pWork[(N / 2 - ((N & 1) == 0 ? 1 : 0)) * size_t{ BatchSize } + c], pWork[(N / 2) * size_t{ BatchSize } + c], N);
+	}
+}
+
+// Median of each of the lWidth pixels of a plane of the scan lines (starting at planeOffset),
+// converted to the output type the same way as Median() does.
+template <class T, class TOut>
+inline void LineMedian(const std::vector<void*>& vScanLines, const size_t planeOffset, const int lWidth, const int valueShift, TOut pOut[])
+{
+	std::vector<const T*> vLines;
+	std::vector<T> vWork;
+	T medians[Medianhelper::BatchSize];
+
+	vLines.reserve(vScanLines.size());
+	for (const void* const p : vScanLines)
+		vLines.push_back(static_cast<const T*>(p) + planeOffset);
+
+	for (int i = 0; i < lWidth; i += Medianhelper::BatchSize)
+	{
+		const int nrColumns = std::min(Medianhelper::BatchSize, lWidth - i);
+		BatchMedian(vLines.data(), static_cast<int>(vLines.size()), i, nrColumns, valueShift, medians, vWork);
+		for (int c = 0; c < nrColumns; ++c)
+			pOut[i + c] = static_cast<TOut>(static_cast<double>(medians[c]));
+	}
+}
@@ -167,7 +167,7 @@ int AvxOutputComposition::doProcessMedianKappaSigma(const int line, std::vector<
 					pData[n] = currentMedian;
 		}
 
-		return static_cast<float>(qMedian(pData, N, N / 2));
+		return static_cast<float>(FastMedian(pData, N));
 	};
 
 	const auto vectorMedian = [&quickMedian](__m256& loMedian, __m256& hiMedian, const __m256 loLoBound, const __m256 hiLoBound, const __m256 loHiBound, const __m256 hiHiBound) -> void
@@ -365,26 +365,9 @@ int AvxOutputComposition::doProcessMedianKappaSigma(const int line, std::vector<
 
 	const auto medianLoop = [&](float* pOut, const int colorOffset) -> void
 	{
-		const size_t outputWidth = outputBitmap.Width();
-		const float uBound = initialUpperBound();
-
-		for (int counter = 0; counter < nrVectors; ++counter, pOut += 16)
-		{
-			__m256 loMedian = _mm256_setzero_ps();
-			__m256 hiMedian = _mm256_setzero_ps();
-
-			initMedianData(counter * size_t{ 16 } + colorOffset, 16);
-			vectorMedian(loMedian, hiMedian, _mm256_set1_ps(0.0f), _mm256_set1_ps(0.0f), _mm256_set1_ps(uBound), _mm256_set1_ps(uBound));
-			_mm256_storeu_ps(pOut + static_cast<size_t>(line) * outputWidth, loMedian);
-			_mm256_storeu_ps(pOut + 8 + static_cast<size_t>(line) * outputWidth, hiMedian);
-		}
-		// Rest of line
-		for (int n = nrVectors * 16; n < width; ++n, ++pOut)
-		{
-			initMedianData(n + colorOffset, 1);
-			const float median = quickMedian(0, 0.0f, uBound, 0.0f);
-			*(pOut + static_cast<size_t>(line) * outputWidth) = median;
-		}
+		// Same kernels as the scalar path: 16 columns at once with the sorting networks (zero values ignored).
+		constexpr int valueShift = (std::is_integral<T>::value && sizeof(T) == 4) ? 16 : 0;
+		LineMedian<T>(lineAddresses, colorOffset, width, valueShift, pOut + static_cast<size_t>(line) * outputBitmap.Width());
 	};
 
 	const auto methodSelectorLoop = [&](float* pOut, const int colorOffset) -> void
@@ -0,0 +1,232 @@
+#include "StdAfx.h"
+#include "avx_simd.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <vector>
+#include <intrin.h>
+
+namespace
+{
+	void luminanceRgbScalar(const std::uint16_t* pRed, const std::uint16_t* pGreen, const std::uint16_t* pBlue, double* pOut, const size_t count, const double scalingFactor) noexcept
+	{
+		for (size_t n = 0; n < count; ++n)
+		{
+			const unsigned minColor = std::min(std::min(pRed[n], pGreen[n]), pBlue[n]);
+			const unsigned maxColor = std::max(std::max(pRed[n], pGreen[n]), pBlue[n]);
+			pOut[n] = (static_cast<double>(minColor) + static_cast<double>(maxColor)) * (0.5 * scalingFactor);
+		}
+	}
+
+	void luminanceGrayScalar(const std::uint16_t* pGray, double* pOut, const size_t count, const double scalingFactor) noexcept
+	{
+		for (size_t n = 0; n < count; ++n)
+			pOut[n] = static_cast<double>(pGray[n]) * scalingFactor;
+	}
+
+	template <class T>
+	void averageScalar(const T* pIn, float* pOut, const size_t count, const float nrStacked) noexcept
+	{
+		const float nrStacked1 = nrStacked + 1.0f;
+		for (size_t n = 0; n < count; ++n)
+			pOut[n] = std::fma(pOut[n], nrStacked, static_cast<float>(pIn[n])) / nrStacked1;
+	}
+
+	template <class T>
+	void maximumScalar(const T* pIn, float* pOut, const size_t count) noexcept
+	{
+		for (size_t n = 0; n < count; ++n)
+			pOut[n] = std::max(pOut[n], static_cast<float>(pIn[n]));
+	}
+
+	void rgbToLabScalar(const float* pRed, const float* pGreen, const float* pBlue, float* pL, float* pA, float* pB, const size_t count) noexcept
+	{
+		const float* const pCubeRoot = SimdKernels::labCubeRootTable();
+		const auto cubeRoot = [pCubeRoot](const float value) -> float
+		{
+			return pCubeRoot[std::clamp(static_cast<int>(value * 65535.0f), 0, 65535)];
+		};
+
+		for (size_t n = 0; n < count; ++n)
+		{
+			const float X = cubeRoot(0.433953f * pRed[n] + 0.376219f * pGreen[n] + 0.189828f * pBlue[n]);
+			const float Y = cubeRoot(0.212671f * pRed[n] + 0.715160f * pGreen[n] + 0.072169f * pBlue[n]);
+			const float Z = cubeRoot(0.017758f * pRed[n] + 0.109477f * pGreen[n] + 0.872766f * pBlue[n]);
+			pL[n] = 116.0f * Y - 16.0f;
+			pA[n] = 500.0f * (X - Y);
+			pB[n] = 200.0f * (Y - Z);
+		}
+	}
+
+	void ahdHomogeneityScalar(const float* const pLabH[3], const float* const pLabV[3], const ptrdiff_t stride, std::uint8_t* pHomoH, std::uint8_t* pHomoV, const size_t count) noexcept
+	{
+		const ptrdiff_t dir[4] = { -1, 1, -stride, stride };
+
+		for (size_t n = 0; n < count; ++n)
+		{
+			float lDiffH[4], lDiffV[4], abDiffH[4], abDiffV[4];
+
+			for (int i = 0; i < 4; ++i)
+			{
+				const ptrdiff_t k = static_cast<ptrdiff_t>(n) + dir[i];
+				lDiffH[i] = std::fabs(pLabH[0][n] - pLabH[0][k]);
+				lDiffV[i] = std::fabs(pLabV[0][n] - pLabV[0][k]);
+				const float aDiffH = pLabH[1][n] - pLabH[1][k];
+				const float bDiffH = pLabH[2][n] - pLabH[2][k];
+				const float aDiffV = pLabV[1][n] - pLabV[1][k];
+				const float bDiffV = pLabV[2][n] - pLabV[2][k];
+				abDiffH[i] = aDiffH * aDiffH + bDiffH * bDiffH;
+				abDiffV[i] = aDiffV * aDiffV + bDiffV * bDiffV;
+			}
+
+			// Horizontal neighbours for H, vertical ones for V.
+			const float lEpsilon = std::min(std::max(lDiffH[0], lDiffH[1]), std::max(lDiffV[2], lDiffV[3]));
+			const float abEpsilon = std::min(std::max(abDiffH[0], abDiffH[1]), std::max(abDiffV[2], abDiffV[3]));
+
+			std::uint8_t homoH = 0, homoV = 0;
+			for (int i = 0; i < 4; ++i)
+			{
+				homoH += (lDiffH[i] <= lEpsilon && abDiffH[i] <= abEpsilon) ? 1 : 0;
+				homoV += (lDiffV[i] <= lEpsilon && abDiffV[i] <= abEpsilon) ? 1 : 0;
+			}
+			pHomoH[n] = homoH;
+			pHomoV[n] = homoV;
+		}
+	}
+
+	void cfaBilinearScalar(const std::uint16_t* pPrevious, const std::uint16_t* pCurrent, const std::uint16_t* pNext, float* pFirst, float* pSecond, const size_t count, const bool greenFirst, const bool blueLine) noexcept
+	{
+		// The sums of WORDs are exact in float, so are the averages.
+		for (size_t n = 0; n < count; ++n, ++pPrevious, ++pCurrent, ++pNext)
+		{
+			const int horizontal = pCurrent[-1] + pCurrent[1];
+			const int vertical = pPrevious[0] + pNext[0];
+
+			if (((n & 1) == 0) == greenFirst)
+			{
+				// Green pixel: the line colour is on the left and right, the other one above and below
+				pFirst[n] = static_cast<float>(blueLine ? vertical : horizontal) * 0.5f;
+				pSecond[n] = static_cast<float>(blueLine ? horizontal : vertical) * 0.5f;
+			}
+			else
+			{
+				// Red or blue pixel: the green is around, the other colour on the diagonals
+				const float cross = static_cast<float>(horizontal + vertical) * 0.25f;
+				const float diagonal = static_cast<float>(pPrevious[-1] + pPrevious[1] + pNext[-1] + pNext[1]) * 0.25f;
+				pFirst[n] = blueLine ? diagonal : cross;
+				pSecond[n] = blueLine ? cross : diagonal;
+			}
+		}
+	}
+
+	SimdKernels::Isa detectIsa() noexcept
+	{
+		int cpuid[4] = { -1 };
+
+		__cpuidex(cpuid, 0, 0);
+		const int maxLeaf = cpuid[0];
+
+		__cpuidex(cpuid, 1, 0);
+		const bool SSE41supported = (cpuid[2] & (1 << 19)) != 0;
+		const bool FMAsupported = (cpuid[2] & (1 << 12)) != 0;
+		const bool OSXSAVEsupported = (cpuid[2] & (1 << 27)) != 0;
+		const unsigned long long xcr0 = OSXSAVEsupported ? _xgetbv(0) : 0;
+		const bool AVXenabledInOS = (xcr0 & 0x06) == 0x06; // SSE + YMM
+		const bool AVX512enabledInOS = (xcr0 & 0xe6) == 0xe6; // SSE + YMM + opmask + ZMM
+
+		bool AVX2supported = false;
+		bool AVX512supported = false;
+		if (maxLeaf >= 7)
+		{
+			__cpuidex(cpuid, 7, 0);
+			AVX2supported = (cpuid[1] & (1 << 5)) != 0;
+			// AVX512 F + BW
+			AVX512supported = (cpuid[1] & (1 << 16)) != 0 && (cpuid[1] & (1 << 30)) != 0;
+		}
+
+		if (AVX512supported && AVX2supported && FMAsupported && AVX512enabledInOS)
+			return SimdKernels::Isa::AVX512;
+		if (AVX2supported && FMAsupported && AVXenabledInOS)
+			return SimdKernels::Isa::AVX2;
+		if (SSE41supported)
+			return SimdKernels::Isa::SSE41;
+		return SimdKernels::Isa::Scalar;
+	}
+}
+
+const SimdKernels SimdKernels::scalarKernels{
+	SimdKernels::Isa::Scalar,
+	&luminanceRgbScalar,
+	&luminanceGrayScalar,
+	&averageScalar<std::uint16_t>,
+	&averageScalar<float>,
+	&maximumScalar<std::uint16_t>,
+	&maximumScalar<float>,
+	&rgbToLabScalar,
+	&ahdHomogeneityScalar,
+	&cfaBilinearScalar
+};
+
+SimdKernels::Isa SimdKernels::cpuIsa() noexcept
+{
+	static const Isa isa = detectIsa();
+	return isa;
+}
+
+const SimdKernels* SimdKernels::forIsa(const Isa isa) noexcept
+{
+	if (isa > cpuIsa())
+		return nullptr;
+
+	switch (isa)
+	{
+	case Isa::AVX512: return &avx512Kernels;
+	case Isa::AVX2: return &avx2Kernels;
+	case Isa::SSE41: return &sse41Kernels;
+	default: return &scalarKernels;
+	}
+}
+
+namespace
+{
+	std::atomic<bool> useSimdSetting{ true };
+}
+
+void SimdKernels::setUseSimd(const bool useSimd) noexcept
+{
+	useSimdSetting.store(useSimd, std::memory_order_relaxed);
+}
+
+const SimdKernels& SimdKernels::get()
+{
+	// If user has disabled SIMD vectorisation (settings dialog) -> scalar kernels.
+	if (!useSimdSetting.load(std::memory_order_relaxed))
+		return scalarKernels;
+	return *forIsa(cpuIsa());
+}
+
+const float* SimdKernels::labCubeRootTable()
+{
+	static const std::vector<float> table = []() -> std::vector<float>
+	{
+		std::vector<float> values(0x10000);
+		for (size_t i = 0; i < values.size(); ++i)
+		{
+			const float r = static_cast<float>(i) / 65535.0f;
+			values[i] = r > 0.008856f ? std::pow(r, 1.0f / 3.0f) : static_cast<float>(7.787f * r + 16.0 / 116.0);
+		}
+		return values;
+	}();
+	return table.data();
+}
+
+const char* SimdKernels::isaName(const Isa isa) noexcept
+{
+	switch (isa)
+	{
+	case Isa::AVX512: return "AVX-512";
+	case Isa::AVX2: return "AVX2";
+	case Isa::SSE41: return "SSE4.1";
+	default: return "Scalar";
+	}
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+* Runtime dispatched SIMD kernels.
+*
+* Each kernel has a scalar reference implementation and SSE4.1, AVX2 and AVX-512 variants (one translation unit per
+* instruction set, each compiled with its own code generation flags). The variant is chosen once, from the CPU features
+* detected at the first call. The scalar variant is used when the user has disabled SIMD vectorisation.
+*
+* All variants give bit-identical results to the scalar reference, except the running averages of the SSE4.1 variant
+* (no FMA: one more rounding, so at most 2 ulp off).
+*/
+
+class SimdKernels
+{
+public:
+	enum class Isa { Scalar, SSE41, AVX2, AVX512 };
+
+	// out[n] = (min(r, g, b) + max(r, g, b)) * 0.5 * scalingFactor
+	typedef void (*LuminanceRgbFunction)(const std::uint16_t* pRed, const std::uint16_t* pGreen, const std::uint16_t* pBlue, double* pOut, const size_t count, const double scalingFactor) noexcept;
+	// out[n] = gray * scalingFactor
+	typedef void (*LuminanceGrayFunction)(const std::uint16_t* pGray, double* pOut, const size_t count, const double scalingFactor) noexcept;
+	// out[n] = (out[n] * nrStacked + in[n]) / (nrStacked + 1)
+	typedef void (*AverageWordFunction)(const std::uint16_t* pIn, float* pOut, const size_t count, const float nrStacked) noexcept;
+	typedef void (*AverageFloatFunction)(const float* pIn, float* pOut, const size_t count, const float nrStacked) noexcept;
+	// out[n] = max(out[n], in[n])
+	typedef void (*MaximumWordFunction)(const std::uint16_t* pIn, float* pOut, const size_t count) noexcept;
+	typedef void (*MaximumFloatFunction)(const float* pIn, float* pOut, const size_t count) noexcept;
+	// CIELab of RGB values in [0, 1], the cube root being read in labCubeRootTable()
+	typedef void (*RgbToLabFunction)(const float* pRed, const float* pGreen, const float* pBlue, float* pL, float* pA, float* pB, const size_t count) noexcept;
+	// AHD homogeneity (0..4) of count pixels of the horizontally (H) and vertically (V) interpolated images.
+	// pLabH/pLabV are the L, a and b planes of the first pixel, the neighbours being at +-1 and +-stride.
+	typedef void (*AhdHomogeneityFunction)(const float* const pLabH[3], const float* const pLabV[3], const ptrdiff_t stride, std::uint8_t* pHomoH, std::uint8_t* pHomoV, const size_t count) noexcept;
+	// Bilinear interpolation of the 2 missing colours (in RGB order) of count pixels of a Bayer line, not normalised.
+	// The pixels at -1 and count must exist. greenFirst: the first pixel is green, blueLine: the line has blue pixels (else red).
+	typedef void (*CfaBilinearFunction)(const std::uint16_t* pPrevious, const std::uint16_t* pCurrent, const std::uint16_t* pNext, float* pFirst, float* pSecond, const size_t count, const bool greenFirst, const bool blueLine) noexcept;
+
+	Isa isa;
+	LuminanceRgbFunction luminanceRgb;
+	LuminanceGrayFunction luminanceGray;
+	AverageWordFunction averageWord;
+	AverageFloatFunction averageFloat;
+	MaximumWordFunction maximumWord;
+	MaximumFloatFunction maximumFloat;
+	RgbToLabFunction rgbToLab;
+	AhdHomogeneityFunction ahdHomogeneity;
+	CfaBilinearFunction cfaBilinear;
+
+	// Kernels for this CPU (scalar if SIMD is disabled in the settings).
+	static const SimdKernels& get();
+	// Cached UseSimd setting, kept up to date by CMultitask (read at startup and by SetUseSimd).
+	static void setUseSimd(const bool useSimd) noexcept;
+	// Kernels of a given instruction set, nullptr if this CPU cannot run them.
+	static const SimdKernels* forIsa(const Isa isa) noexcept;
+	// Best instruction set supported by this CPU and OS (detected once).
+	static Isa cpuIsa() noexcept;
+	static const char* isaName(const Isa isa) noexcept;
+	// f(t) of the CIELab conversion (cube root above 0.008856) for t = i / 65535, i = 0..65535.
+	static const float* labCubeRootTable();
+
+	// Defined in avx_simd.cpp, avx_simd_sse41.cpp, avx_simd_avx2.cpp and avx_simd_avx512.cpp.
+	static const SimdKernels scalarKernels;
+	static const SimdKernels sse41Kernels;
+	static const SimdKernels avx2Kernels;
+	static const SimdKernels avx512Kernels;
+};
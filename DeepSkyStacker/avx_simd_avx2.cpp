@@ -0,0 +1,231 @@
+#include "StdAfx.h"
+#include "avx_simd.h"
+#include <type_traits>
+#include <immintrin.h>
+
+// AVX2 + FMA kernels. This file must be compiled with /arch:AVX2.
+
+namespace
+{
+	inline void storeWordsAsDouble(const __m256i words, const double scalingFactor, double* const pOut) noexcept
+	{
+		const __m256d vScalingFactor = _mm256_set1_pd(scalingFactor);
+		const __m256i lo = _mm256_cvtepu16_epi32(_mm256_castsi256_si128(words));
+		const __m256i hi = _mm256_cvtepu16_epi32(_mm256_extracti128_si256(words, 1));
+		_mm256_storeu_pd(pOut, _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(lo)), vScalingFactor));
+		_mm256_storeu_pd(pOut + 4, _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(lo, 1)), vScalingFactor));
+		_mm256_storeu_pd(pOut + 8, _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(hi)), vScalingFactor));
+		_mm256_storeu_pd(pOut + 12, _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(hi, 1)), vScalingFactor));
+	}
+
+	// Same for the sums of 2 vectors of words (exact in 32 bits)
+	inline void storeWordSumsAsDouble(const __m256i words1, const __m256i words2, const double scalingFactor, double* const pOut) noexcept
+	{
+		const __m256d vScalingFactor = _mm256_set1_pd(scalingFactor);
+		const __m256i lo = _mm256_add_epi32(_mm256_cvtepu16_epi32(_mm256_castsi256_si128(words1)), _mm256_cvtepu16_epi32(_mm256_castsi256_si128(words2)));
+		const __m256i hi = _mm256_add_epi32(_mm256_cvtepu16_epi32(_mm256_extracti128_si256(words1, 1)), _mm256_cvtepu16_epi32(_mm256_extracti128_si256(words2, 1)));
+		_mm256_storeu_pd(pOut, _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(lo)), vScalingFactor));
+		_mm256_storeu_pd(pOut + 4, _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(lo, 1)), vScalingFactor));
+		_mm256_storeu_pd(pOut + 8, _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(hi)), vScalingFactor));
+		_mm256_storeu_pd(pOut + 12, _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(hi, 1)), vScalingFactor));
+	}
+
+	void luminanceRgbAvx2(const std::uint16_t* pRed, const std::uint16_t* pGreen, const std::uint16_t* pBlue, double* pOut, const size_t count, const double scalingFactor) noexcept
+	{
+		constexpr size_t vectorLen = 16;
+		const size_t nrVectors = count / vectorLen;
+
+		for (size_t counter = 0; counter < nrVectors; ++counter, pRed += vectorLen, pGreen += vectorLen, pBlue += vectorLen, pOut += vectorLen)
+		{
+			const __m256i red = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pRed));
+			const __m256i green = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pGreen));
+			const __m256i blue = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pBlue));
+			const __m256i minColor = _mm256_min_epu16(_mm256_min_epu16(red, green), blue);
+			const __m256i maxColor = _mm256_max_epu16(_mm256_max_epu16(red, green), blue);
+			storeWordSumsAsDouble(minColor, maxColor, 0.5 * scalingFactor, pOut);
+		}
+		_mm256_zeroupper();
+		SimdKernels::scalarKernels.luminanceRgb(pRed, pGreen, pBlue, pOut, count - nrVectors * vectorLen, scalingFactor);
+	}
+
+	void luminanceGrayAvx2(const std::uint16_t* pGray, double* pOut, const size_t count, const double scalingFactor) noexcept
+	{
+		constexpr size_t vectorLen = 16;
+		const size_t nrVectors = count / vectorLen;
+
+		for (size_t counter = 0; counter < nrVectors; ++counter, pGray += vectorLen, pOut += vectorLen)
+			storeWordsAsDouble(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(pGray)), scalingFactor, pOut);
+		_mm256_zeroupper();
+		SimdKernels::scalarKernels.luminanceGray(pGray, pOut, count - nrVectors * vectorLen, scalingFactor);
+	}
+
+	inline __m256 read8Single(const std::uint16_t* const pIn) noexcept
+	{
+		return _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pIn))));
+	}
+	inline __m256 read8Single(const float* const pIn) noexcept
+	{
+		return _mm256_loadu_ps(pIn);
+	}
+
+	template <class T>
+	void averageAvx2(const T* pIn, float* pOut, const size_t count, const float nrStacked) noexcept
+	{
+		constexpr size_t vectorLen = 8;
+		const size_t nrVectors = count / vectorLen;
+		const __m256 vNrStacked = _mm256_set1_ps(nrStacked);
+		const __m256 vNrStacked1 = _mm256_set1_ps(nrStacked + 1.0f);
+
+		for (size_t counter = 0; counter < nrVectors; ++counter, pIn += vectorLen, pOut += vectorLen)
+			_mm256_storeu_ps(pOut, _mm256_div_ps(_mm256_fmadd_ps(_mm256_loadu_ps(pOut), vNrStacked, read8Single(pIn)), vNrStacked1));
+		_mm256_zeroupper();
+
+		if constexpr (std::is_same<T, float>::value)
+			SimdKernels::scalarKernels.averageFloat(pIn, pOut, count - nrVectors * vectorLen, nrStacked);
+		else
+			SimdKernels::scalarKernels.averageWord(pIn, pOut, count - nrVectors * vectorLen, nrStacked);
+	}
+
+	template <class T>
+	void maximumAvx2(const T* pIn, float* pOut, const size_t count) noexcept
+	{
+		constexpr size_t vectorLen = 8;
+		const size_t nrVectors = count / vectorLen;
+
+		for (size_t counter = 0; counter < nrVectors; ++counter, pIn += vectorLen, pOut += vectorLen)
+			_mm256_storeu_ps(pOut, _mm256_max_ps(_mm256_loadu_ps(pOut), read8Single(pIn)));
+		_mm256_zeroupper();
+
+		if constexpr (std::is_same<T, float>::value)
+			SimdKernels::scalarKernels.maximumFloat(pIn, pOut, count - nrVectors * vectorLen);
+		else
+			SimdKernels::scalarKernels.maximumWord(pIn, pOut, count - nrVectors * vectorLen);
+	}
+
+	// No FMA here: the products are summed in the order of the scalar kernel to get the same table index.
+	inline __m256 cubeRoot8(const float* const pCubeRoot, const __m256 r, const __m256 g, const __m256 b, const float cr, const float cg, const float cb) noexcept
+	{
+		const __m256 value = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(cr), r), _mm256_mul_ps(_mm256_set1_ps(cg), g)), _mm256_mul_ps(_mm256_set1_ps(cb), b));
+		const __m256i index = _mm256_min_epi32(_mm256_max_epi32(_mm256_cvttps_epi32(_mm256_mul_ps(value, _mm256_set1_ps(65535.0f))), _mm256_setzero_si256()), _mm256_set1_epi32(65535));
+		return _mm256_i32gather_ps(pCubeRoot, index, 4);
+	}
+
+	void rgbToLabAvx2(const float* pRed, const float* pGreen, const float* pBlue, float* pL, float* pA, float* pB, const size_t count) noexcept
+	{
+		constexpr size_t vectorLen = 8;
+		const size_t nrVectors = count / vectorLen;
+		const float* const pCubeRoot = SimdKernels::labCubeRootTable();
+
+		for (size_t counter = 0; counter < nrVectors; ++counter, pRed += vectorLen, pGreen += vectorLen, pBlue += vectorLen, pL += vectorLen, pA += vectorLen, pB += vectorLen)
+		{
+			const __m256 r = _mm256_loadu_ps(pRed);
+			const __m256 g = _mm256_loadu_ps(pGreen);
+			const __m256 b = _mm256_loadu_ps(pBlue);
+			const __m256 X = cubeRoot8(pCubeRoot, r, g, b, 0.433953f, 0.376219f, 0.189828f);
+			const __m256 Y = cubeRoot8(pCubeRoot, r, g, b, 0.212671f, 0.715160f, 0.072169f);
+			const __m256 Z = cubeRoot8(pCubeRoot, r, g, b, 0.017758f, 0.109477f, 0.872766f);
+			_mm256_storeu_ps(pL, _mm256_sub_ps(_mm256_mul_ps(_mm256_set1_ps(116.0f), Y), _mm256_set1_ps(16.0f)));
+			_mm256_storeu_ps(pA, _mm256_mul_ps(_mm256_set1_ps(500.0f), _mm256_sub_ps(X, Y)));
+			_mm256_storeu_ps(pB, _mm256_mul_ps(_mm256_set1_ps(200.0f), _mm256_sub_ps(Y, Z)));
+		}
+		_mm256_zeroupper();
+		SimdKernels::scalarKernels.rgbToLab(pRed, pGreen, pBlue, pL, pA, pB, count - nrVectors * vectorLen);
+	}
+
+	void ahdHomogeneityAvx2(const float* const pLabH[3], const float* const pLabV[3], const ptrdiff_t stride, std::uint8_t* pHomoH, std::uint8_t* pHomoV, const size_t count) noexcept
+	{
+		constexpr size_t vectorLen = 8;
+		const size_t nrVectors = count / vectorLen;
+		const ptrdiff_t dir[4] = { -1, 1, -stride, stride };
+		const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+
+		const auto store8 = [](std::uint8_t* const pOut, const __m256i homo) -> void
+		{
+			const __m128i words = _mm_packs_epi32(_mm256_castsi256_si128(homo), _mm256_extracti128_si256(homo, 1));
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(pOut), _mm_packus_epi16(words, words));
+		};
+
+		size_t n = 0;
+		for (size_t counter = 0; counter < nrVectors; ++counter, n += vectorLen)
+		{
+			__m256 lDiffH[4], lDiffV[4], abDiffH[4], abDiffV[4];
+			const __m256 lH = _mm256_loadu_ps(pLabH[0] + n), aH = _mm256_loadu_ps(pLabH[1] + n), bH = _mm256_loadu_ps(pLabH[2] + n);
+			const __m256 lV = _mm256_loadu_ps(pLabV[0] + n), aV = _mm256_loadu_ps(pLabV[1] + n), bV = _mm256_loadu_ps(pLabV[2] + n);
+
+			for (int i = 0; i < 4; ++i)
+			{
+				const ptrdiff_t k = static_cast<ptrdiff_t>(n) + dir[i];
+				lDiffH[i] = _mm256_and_ps(_mm256_sub_ps(lH, _mm256_loadu_ps(pLabH[0] + k)), absMask);
+				lDiffV[i] = _mm256_and_ps(_mm256_sub_ps(lV, _mm256_loadu_ps(pLabV[0] + k)), absMask);
+				const __m256 aDiffH = _mm256_sub_ps(aH, _mm256_loadu_ps(pLabH[1] + k));
+				const __m256 bDiffH = _mm256_sub_ps(bH, _mm256_loadu_ps(pLabH[2] + k));
+				const __m256 aDiffV = _mm256_sub_ps(aV, _mm256_loadu_ps(pLabV[1] + k));
+				const __m256 bDiffV = _mm256_sub_ps(bV, _mm256_loadu_ps(pLabV[2] + k));
+				abDiffH[i] = _mm256_add_ps(_mm256_mul_ps(aDiffH, aDiffH), _mm256_mul_ps(bDiffH, bDiffH));
+				abDiffV[i] = _mm256_add_ps(_mm256_mul_ps(aDiffV, aDiffV), _mm256_mul_ps(bDiffV, bDiffV));
+			}
+
+			const __m256 lEpsilon = _mm256_min_ps(_mm256_max_ps(lDiffH[0], lDiffH[1]), _mm256_max_ps(lDiffV[2], lDiffV[3]));
+			const __m256 abEpsilon = _mm256_min_ps(_mm256_max_ps(abDiffH[0], abDiffH[1]), _mm256_max_ps(abDiffV[2], abDiffV[3]));
+
+			// The masks are -1 where the neighbour is homogeneous: subtracting them counts the neighbours.
+			__m256i homoH = _mm256_setzero_si256(), homoV = _mm256_setzero_si256();
+			for (int i = 0; i < 4; ++i)
+			{
+				homoH = _mm256_sub_epi32(homoH, _mm256_castps_si256(_mm256_and_ps(_mm256_cmp_ps(lDiffH[i], lEpsilon, _CMP_LE_OQ), _mm256_cmp_ps(abDiffH[i], abEpsilon, _CMP_LE_OQ))));
+				homoV = _mm256_sub_epi32(homoV, _mm256_castps_si256(_mm256_and_ps(_mm256_cmp_ps(lDiffV[i], lEpsilon, _CMP_LE_OQ), _mm256_cmp_ps(abDiffV[i], abEpsilon, _CMP_LE_OQ))));
+			}
+			store8(pHomoH + n, homoH);
+			store8(pHomoV + n, homoV);
+		}
+		_mm256_zeroupper();
+
+		const float* const pTailH[3] = { pLabH[0] + n, pLabH[1] + n, pLabH[2] + n };
+		const float* const pTailV[3] = { pLabV[0] + n, pLabV[1] + n, pLabV[2] + n };
+		SimdKernels::scalarKernels.ahdHomogeneity(pTailH, pTailV, stride, pHomoH + n, pHomoV + n, count - n);
+	}
+
+	inline __m256i read8Int(const std::uint16_t* const pIn) noexcept
+	{
+		return _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pIn)));
+	}
+
+	void cfaBilinearAvx2(const std::uint16_t* pPrevious, const std::uint16_t* pCurrent, const std::uint16_t* pNext, float* pFirst, float* pSecond, const size_t count, const bool greenFirst, const bool blueLine) noexcept
+	{
+		constexpr size_t vectorLen = 8;
+		const size_t nrVectors = count / vectorLen;
+		// The vectors start on even pixels, so the green pixels are always in the same lanes.
+		const __m256 greenMask = greenFirst ? _mm256_castsi256_ps(_mm256_setr_epi32(-1, 0, -1, 0, -1, 0, -1, 0)) : _mm256_castsi256_ps(_mm256_setr_epi32(0, -1, 0, -1, 0, -1, 0, -1));
+		const __m256 half = _mm256_set1_ps(0.5f);
+		const __m256 quarter = _mm256_set1_ps(0.25f);
+
+		for (size_t counter = 0; counter < nrVectors; ++counter, pPrevious += vectorLen, pCurrent += vectorLen, pNext += vectorLen, pFirst += vectorLen, pSecond += vectorLen)
+		{
+			const __m256i horizontal = _mm256_add_epi32(read8Int(pCurrent - 1), read8Int(pCurrent + 1));
+			const __m256i vertical = _mm256_add_epi32(read8Int(pPrevious), read8Int(pNext));
+			const __m256i diagonal = _mm256_add_epi32(_mm256_add_epi32(read8Int(pPrevious - 1), read8Int(pPrevious + 1)), _mm256_add_epi32(read8Int(pNext - 1), read8Int(pNext + 1)));
+			const __m256 horizontalAvg = _mm256_mul_ps(_mm256_cvtepi32_ps(horizontal), half);
+			const __m256 verticalAvg = _mm256_mul_ps(_mm256_cvtepi32_ps(vertical), half);
+			const __m256 crossAvg = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_add_epi32(horizontal, vertical)), quarter);
+			const __m256 diagonalAvg = _mm256_mul_ps(_mm256_cvtepi32_ps(diagonal), quarter);
+
+			_mm256_storeu_ps(pFirst, _mm256_blendv_ps(blueLine ? diagonalAvg : crossAvg, blueLine ? verticalAvg : horizontalAvg, greenMask));
+			_mm256_storeu_ps(pSecond, _mm256_blendv_ps(blueLine ? crossAvg : diagonalAvg, blueLine ? horizontalAvg : verticalAvg, greenMask));
+		}
+		_mm256_zeroupper();
+		SimdKernels::scalarKernels.cfaBilinear(pPrevious, pCurrent, pNext, pFirst, pSecond, count - nrVectors * vectorLen, greenFirst, blueLine);
+	}
+}
+
+const SimdKernels SimdKernels::avx2Kernels{
+	SimdKernels::Isa::AVX2,
+	&luminanceRgbAvx2,
+	&luminanceGrayAvx2,
+	&averageAvx2<std::uint16_t>,
+	&averageAvx2<float>,
+	&maximumAvx2<std::uint16_t>,
+	&maximumAvx2<float>,
+	&rgbToLabAvx2,
+	&ahdHomogeneityAvx2,
+	&cfaBilinearAvx2
+};
@@ -0,0 +1,224 @@
+#include "StdAfx.h"
+#include "avx_simd.h"
+#include <type_traits>
+#include <immintrin.h>
+
+// AVX-512 (F + BW) kernels. This file must be compiled with /arch:AVX512.
+
+namespace
+{
+	inline void storeWordsAsDouble(const __m512i words, const double scalingFactor, double* const pOut) noexcept
+	{
+		const __m512d vScalingFactor = _mm512_set1_pd(scalingFactor);
+		const __m512i lo = _mm512_cvtepu16_epi32(_mm512_castsi512_si256(words));
+		const __m512i hi = _mm512_cvtepu16_epi32(_mm512_extracti64x4_epi64(words, 1));
+		_mm512_storeu_pd(pOut, _mm512_mul_pd(_mm512_cvtepi32_pd(_mm512_castsi512_si256(lo)), vScalingFactor));
+		_mm512_storeu_pd(pOut + 8, _mm512_mul_pd(_mm512_cvtepi32_pd(_mm512_extracti64x4_epi64(lo, 1)), vScalingFactor));
+		_mm512_storeu_pd(pOut + 16, _mm512_mul_pd(_mm512_cvtepi32_pd(_mm512_castsi512_si256(hi)), vScalingFactor));
+		_mm512_storeu_pd(pOut + 24, _mm512_mul_pd(_mm512_cvtepi32_pd(_mm512_extracti64x4_epi64(hi, 1)), vScalingFactor));
+	}
+
+	// Same for the sums of 2 vectors of words (exact in 32 bits)
+	inline void storeWordSumsAsDouble(const __m512i words1, const __m512i words2, const double scalingFactor, double* const pOut) noexcept
+	{
+		const __m512d vScalingFactor = _mm512_set1_pd(scalingFactor);
+		const __m512i lo = _mm512_add_epi32(_mm512_cvtepu16_epi32(_mm512_castsi512_si256(words1)), _mm512_cvtepu16_epi32(_mm512_castsi512_si256(words2)));
+		const __m512i hi = _mm512_add_epi32(_mm512_cvtepu16_epi32(_mm512_extracti64x4_epi64(words1, 1)), _mm512_cvtepu16_epi32(_mm512_extracti64x4_epi64(words2, 1)));
+		_mm512_storeu_pd(pOut, _mm512_mul_pd(_mm512_cvtepi32_pd(_mm512_castsi512_si256(lo)), vScalingFactor));
+		_mm512_storeu_pd(pOut + 8, _mm512_mul_pd(_mm512_cvtepi32_pd(_mm512_extracti64x4_epi64(lo, 1)), vScalingFactor));
+		_mm512_storeu_pd(pOut + 16, _mm512_mul_pd(_mm512_cvtepi32_pd(_mm512_castsi512_si256(hi)), vScalingFactor));
+		_mm512_storeu_pd(pOut + 24, _mm512_mul_pd(_mm512_cvtepi32_pd(_mm512_extracti64x4_epi64(hi, 1)), vScalingFactor));
+	}
+
+	void luminanceRgbAvx512(const std::uint16_t* pRed, const std::uint16_t* pGreen, const std::uint16_t* pBlue, double* pOut, const size_t count, const double scalingFactor) noexcept
+	{
+		constexpr size_t vectorLen = 32;
+		const size_t nrVectors = count / vectorLen;
+
+		for (size_t counter = 0; counter < nrVectors; ++counter, pRed += vectorLen, pGreen += vectorLen, pBlue += vectorLen, pOut += vectorLen)
+		{
+			const __m512i red = _mm512_loadu_si512(pRed);
+			const __m512i green = _mm512_loadu_si512(pGreen);
+			const __m512i blue = _mm512_loadu_si512(pBlue);
+			const __m512i minColor = _mm512_min_epu16(_mm512_min_epu16(red, green), blue);
+			const __m512i maxColor = _mm512_max_epu16(_mm512_max_epu16(red, green), blue);
+			storeWordSumsAsDouble(minColor, maxColor, 0.5 * scalingFactor, pOut);
+		}
+		_mm256_zeroupper();
+		SimdKernels::scalarKernels.luminanceRgb(pRed, pGreen, pBlue, pOut, count - nrVectors * vectorLen, scalingFactor);
+	}
+
+	void luminanceGrayAvx512(const std::uint16_t* pGray, double* pOut, const size_t count, const double scalingFactor) noexcept
+	{
+		constexpr size_t vectorLen = 32;
+		const size_t nrVectors = count / vectorLen;
+
+		for (size_t counter = 0; counter < nrVectors; ++counter, pGray += vectorLen, pOut += vectorLen)
+			storeWordsAsDouble(_mm512_loadu_si512(pGray), scalingFactor, pOut);
+		_mm256_zeroupper();
+		SimdKernels::scalarKernels.luminanceGray(pGray, pOut, count - nrVectors * vectorLen, scalingFactor);
+	}
+
+	inline __m512 read16Single(const std::uint16_t* const pIn) noexcept
+	{
+		return _mm512_cvtepi32_ps(_mm512_cvtepu16_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(pIn))));
+	}
+	inline __m512 read16Single(const float* const pIn) noexcept
+	{
+		return _mm512_loadu_ps(pIn);
+	}
+
+	template <class T>
+	void averageAvx512(const T* pIn, float* pOut, const size_t count, const float nrStacked) noexcept
+	{
+		constexpr size_t vectorLen = 16;
+		const size_t nrVectors = count / vectorLen;
+		const __m512 vNrStacked = _mm512_set1_ps(nrStacked);
+		const __m512 vNrStacked1 = _mm512_set1_ps(nrStacked + 1.0f);
+
+		for (size_t counter = 0; counter < nrVectors; ++counter, pIn += vectorLen, pOut += vectorLen)
+			_mm512_storeu_ps(pOut, _mm512_div_ps(_mm512_fmadd_ps(_mm512_loadu_ps(pOut), vNrStacked, read16Single(pIn)), vNrStacked1));
+		_mm256_zeroupper();
+
+		if constexpr (std::is_same<T, float>::value)
+			SimdKernels::scalarKernels.averageFloat(pIn, pOut, count - nrVectors * vectorLen, nrStacked);
+		else
+			SimdKernels::scalarKernels.averageWord(pIn, pOut, count - nrVectors * vectorLen, nrStacked);
+	}
+
+	template <class T>
+	void maximumAvx512(const T* pIn, float* pOut, const size_t count) noexcept
+	{
+		constexpr size_t vectorLen = 16;
+		const size_t nrVectors = count / vectorLen;
+
+		for (size_t counter = 0; counter < nrVectors; ++counter, pIn += vectorLen, pOut += vectorLen)
+			_mm512_storeu_ps(pOut, _mm512_max_ps(_mm512_loadu_ps(pOut), read16Single(pIn)));
+		_mm256_zeroupper();
+
+		if constexpr (std::is_same<T, float>::value)
+			SimdKernels::scalarKernels.maximumFloat(pIn, pOut, count - nrVectors * vectorLen);
+		else
+			SimdKernels::scalarKernels.maximumWord(pIn, pOut, count - nrVectors * vectorLen);
+	}
+
+	// No FMA here: the products are summed in the order of the scalar kernel to get the same table index.
+	inline __m512 cubeRoot16(const float* const pCubeRoot, const __m512 r, const __m512 g, const __m512 b, const float cr, const float cg, const float cb) noexcept
+	{
+		const __m512 value = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(_mm512_set1_ps(cr), r), _mm512_mul_ps(_mm512_set1_ps(cg), g)), _mm512_mul_ps(_mm512_set1_ps(cb), b));
+		const __m512i index = _mm512_min_epi32(_mm512_max_epi32(_mm512_cvttps_epi32(_mm512_mul_ps(value, _mm512_set1_ps(65535.0f))), _mm512_setzero_si512()), _mm512_set1_epi32(65535));
+		return _mm512_i32gather_ps(index, pCubeRoot, 4);
+	}
+
+	void rgbToLabAvx512(const float* pRed, const float* pGreen, const float* pBlue, float* pL, float* pA, float* pB, const size_t count) noexcept
+	{
+		constexpr size_t vectorLen = 16;
+		const size_t nrVectors = count / vectorLen;
+		const float* const pCubeRoot = SimdKernels::labCubeRootTable();
+
+		for (size_t counter = 0; counter < nrVectors; ++counter, pRed += vectorLen, pGreen += vectorLen, pBlue += vectorLen, pL += vectorLen, pA += vectorLen, pB += vectorLen)
+		{
+			const __m512 r = _mm512_loadu_ps(pRed);
+			const __m512 g = _mm512_loadu_ps(pGreen);
+			const __m512 b = _mm512_loadu_ps(pBlue);
+			const __m512 X = cubeRoot16(pCubeRoot, r, g, b, 0.433953f, 0.376219f, 0.189828f);
+			const __m512 Y = cubeRoot16(pCubeRoot, r, g, b, 0.212671f, 0.715160f, 0.072169f);
+			const __m512 Z = cubeRoot16(pCubeRoot, r, g, b, 0.017758f, 0.109477f, 0.872766f);
+			_mm512_storeu_ps(pL, _mm512_sub_ps(_mm512_mul_ps(_mm512_set1_ps(116.0f), Y), _mm512_set1_ps(16.0f)));
+			_mm512_storeu_ps(pA, _mm512_mul_ps(_mm512_set1_ps(500.0f), _mm512_sub_ps(X, Y)));
+			_mm512_storeu_ps(pB, _mm512_mul_ps(_mm512_set1_ps(200.0f), _mm512_sub_ps(Y, Z)));
+		}
+		_mm256_zeroupper();
+		SimdKernels::scalarKernels.rgbToLab(pRed, pGreen, pBlue, pL, pA, pB, count - nrVectors * vectorLen);
+	}
+
+	void ahdHomogeneityAvx512(const float* const pLabH[3], const float* const pLabV[3], const ptrdiff_t stride, std::uint8_t* pHomoH, std::uint8_t* pHomoV, const size_t count) noexcept
+	{
+		constexpr size_t vectorLen = 16;
+		const size_t nrVectors = count / vectorLen;
+		const ptrdiff_t dir[4] = { -1, 1, -stride, stride };
+		const __m512i one = _mm512_set1_epi32(1);
+
+		size_t n = 0;
+		for (size_t counter = 0; counter < nrVectors; ++counter, n += vectorLen)
+		{
+			__m512 lDiffH[4], lDiffV[4], abDiffH[4], abDiffV[4];
+			const __m512 lH = _mm512_loadu_ps(pLabH[0] + n), aH = _mm512_loadu_ps(pLabH[1] + n), bH = _mm512_loadu_ps(pLabH[2] + n);
+			const __m512 lV = _mm512_loadu_ps(pLabV[0] + n), aV = _mm512_loadu_ps(pLabV[1] + n), bV = _mm512_loadu_ps(pLabV[2] + n);
+
+			for (int i = 0; i < 4; ++i)
+			{
+				const ptrdiff_t k = static_cast<ptrdiff_t>(n) + dir[i];
+				lDiffH[i] = _mm512_abs_ps(_mm512_sub_ps(lH, _mm512_loadu_ps(pLabH[0] + k)));
+				lDiffV[i] = _mm512_abs_ps(_mm512_sub_ps(lV, _mm512_loadu_ps(pLabV[0] + k)));
+				const __m512 aDiffH = _mm512_sub_ps(aH, _mm512_loadu_ps(pLabH[1] + k));
+				const __m512 bDiffH = _mm512_sub_ps(bH, _mm512_loadu_ps(pLabH[2] + k));
+				const __m512 aDiffV = _mm512_sub_ps(aV, _mm512_loadu_ps(pLabV[1] + k));
+				const __m512 bDiffV = _mm512_sub_ps(bV, _mm512_loadu_ps(pLabV[2] + k));
+				abDiffH[i] = _mm512_add_ps(_mm512_mul_ps(aDiffH, aDiffH), _mm512_mul_ps(bDiffH, bDiffH));
+				abDiffV[i] = _mm512_add_ps(_mm512_mul_ps(aDiffV, aDiffV), _mm512_mul_ps(bDiffV, bDiffV));
+			}
+
+			const __m512 lEpsilon = _mm512_min_ps(_mm512_max_ps(lDiffH[0], lDiffH[1]), _mm512_max_ps(lDiffV[2], lDiffV[3]));
+			const __m512 abEpsilon = _mm512_min_ps(_mm512_max_ps(abDiffH[0], abDiffH[1]), _mm512_max_ps(abDiffV[2], abDiffV[3]));
+
+			__m512i homoH = _mm512_setzero_si512(), homoV = _mm512_setzero_si512();
+			for (int i = 0; i < 4; ++i)
+			{
+				homoH = _mm512_mask_add_epi32(homoH, _mm512_cmp_ps_mask(lDiffH[i], lEpsilon, _CMP_LE_OQ) & _mm512_cmp_ps_mask(abDiffH[i], abEpsilon, _CMP_LE_OQ), homoH, one);
+				homoV = _mm512_mask_add_epi32(homoV, _mm512_cmp_ps_mask(lDiffV[i], lEpsilon, _CMP_LE_OQ) & _mm512_cmp_ps_mask(abDiffV[i], abEpsilon, _CMP_LE_OQ), homoV, one);
+			}
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(pHomoH + n), _mm512_cvtepi32_epi8(homoH));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(pHomoV + n), _mm512_cvtepi32_epi8(homoV));
+		}
+		_mm256_zeroupper();
+
+		const float* const pTailH[3] = { pLabH[0] + n, pLabH[1] + n, pLabH[2] + n };
+		const float* const pTailV[3] = { pLabV[0] + n, pLabV[1] + n, pLabV[2] + n };
+		SimdKernels::scalarKernels.ahdHomogeneity(pTailH, pTailV, stride, pHomoH + n, pHomoV + n, count - n);
+	}
+
+	inline __m512i read16Int(const std::uint16_t* const pIn) noexcept
+	{
+		return _mm512_cvtepu16_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(pIn)));
+	}
+
+	void cfaBilinearAvx512(const std::uint16_t* pPrevious, const std::uint16_t* pCurrent, const std::uint16_t* pNext, float* pFirst, float* pSecond, const size_t count, const bool greenFirst, const bool blueLine) noexcept
+	{
+		constexpr size_t vectorLen = 16;
+		const size_t nrVectors = count / vectorLen;
+		// The vectors start on even pixels, so the green pixels are always in the same lanes.
+		const __mmask16 greenMask = greenFirst ? 0x5555 : 0xaaaa;
+		const __m512 half = _mm512_set1_ps(0.5f);
+		const __m512 quarter = _mm512_set1_ps(0.25f);
+
+		for (size_t counter = 0; counter < nrVectors; ++counter, pPrevious += vectorLen, pCurrent += vectorLen, pNext += vectorLen, pFirst += vectorLen, pSecond += vectorLen)
+		{
+			const __m512i horizontal = _mm512_add_epi32(read16Int(pCurrent - 1), read16Int(pCurrent + 1));
+			const __m512i vertical = _mm512_add_epi32(read16Int(pPrevious), read16Int(pNext));
+			const __m512i diagonal = _mm512_add_epi32(_mm512_add_epi32(read16Int(pPrevious - 1), read16Int(pPrevious + 1)), _mm512_add_epi32(read16Int(pNext - 1), read16Int(pNext + 1)));
+			const __m512 horizontalAvg = _mm512_mul_ps(_mm512_cvtepi32_ps(horizontal), half);
+			const __m512 verticalAvg = _mm512_mul_ps(_mm512_cvtepi32_ps(vertical), half);
+			const __m512 crossAvg = _mm512_mul_ps(_mm512_cvtepi32_ps(_mm512_add_epi32(horizontal, vertical)), quarter);
+			const __m512 diagonalAvg = _mm512_mul_ps(_mm512_cvtepi32_ps(diagonal), quarter);
+
+			_mm512_storeu_ps(pFirst, _mm512_mask_blend_ps(greenMask, blueLine ? diagonalAvg : crossAvg, blueLine ? verticalAvg : horizontalAvg));
+			_mm512_storeu_ps(pSecond, _mm512_mask_blend_ps(greenMask, blueLine ? crossAvg : diagonalAvg, blueLine ? horizontalAvg : verticalAvg));
+		}
+		_mm256_zeroupper();
+		SimdKernels::scalarKernels.cfaBilinear(pPrevious, pCurrent, pNext, pFirst, pSecond, count - nrVectors * vectorLen, greenFirst, blueLine);
+	}
+}
+
+const SimdKernels SimdKernels::avx512Kernels{
+	SimdKernels::Isa::AVX512,
+	&luminanceRgbAvx512,
+	&luminanceGrayAvx512,
+	&averageAvx512<std::uint16_t>,
+	&averageAvx512<float>,
+	&maximumAvx512<std::uint16_t>,
+	&maximumAvx512<float>,
+	&rgbToLabAvx512,
+	&ahdHomogeneityAvx512,
+	&cfaBilinearAvx512
+};
@@ -0,0 +1,226 @@
+#include "StdAfx.h"
+#include "avx_simd.h"
+#include <type_traits>
+#include <cstring>
+#include <smmintrin.h>
+
+// SSE4.1 kernels. SSE4.1 has no FMA, so the running averages are rounded once more (at most 2 ulp off the scalar reference).
+
+namespace
+{
+	inline void storeWordsAsDouble(const __m128i words, const double scalingFactor, double* const pOut) noexcept
+	{
+		const __m128d vScalingFactor = _mm_set1_pd(scalingFactor);
+		const __m128i lo = _mm_cvtepu16_epi32(words);
+		const __m128i hi = _mm_cvtepu16_epi32(_mm_srli_si128(words, 8));
+		_mm_storeu_pd(pOut, _mm_mul_pd(_mm_cvtepi32_pd(lo), vScalingFactor));
+		_mm_storeu_pd(pOut + 2, _mm_mul_pd(_mm_cvtepi32_pd(_mm_srli_si128(lo, 8)), vScalingFactor));
+		_mm_storeu_pd(pOut + 4, _mm_mul_pd(_mm_cvtepi32_pd(hi), vScalingFactor));
+		_mm_storeu_pd(pOut + 6, _mm_mul_pd(_mm_cvtepi32_pd(_mm_srli_si128(hi, 8)), vScalingFactor));
+	}
+
+	// Same for the sums of 2 vectors of words (exact in 32 bits)
+	inline void storeWordSumsAsDouble(const __m128i words1, const __m128i words2, const double scalingFactor, double* const pOut) noexcept
+	{
+		const __m128d vScalingFactor = _mm_set1_pd(scalingFactor);
+		const __m128i lo = _mm_add_epi32(_mm_cvtepu16_epi32(words1), _mm_cvtepu16_epi32(words2));
+		const __m128i hi = _mm_add_epi32(_mm_cvtepu16_epi32(_mm_srli_si128(words1, 8)), _mm_cvtepu16_epi32(_mm_srli_si128(words2, 8)));
+		_mm_storeu_pd(pOut, _mm_mul_pd(_mm_cvtepi32_pd(lo), vScalingFactor));
+		_mm_storeu_pd(pOut + 2, _mm_mul_pd(_mm_cvtepi32_pd(_mm_srli_si128(lo, 8)), vScalingFactor));
+		_mm_storeu_pd(pOut + 4, _mm_mul_pd(_mm_cvtepi32_pd(hi), vScalingFactor));
+		_mm_storeu_pd(pOut + 6, _mm_mul_pd(_mm_cvtepi32_pd(_mm_srli_si128(hi, 8)), vScalingFactor));
+	}
+
+	void luminanceRgbSse41(const std::uint16_t* pRed, const std::uint16_t* pGreen, const std::uint16_t* pBlue, double* pOut, const size_t count, const double scalingFactor) noexcept
+	{
+		constexpr size_t vectorLen = 8;
+		const size_t nrVectors = count / vectorLen;
+
+		for (size_t counter = 0; counter < nrVectors; ++counter, pRed += vectorLen, pGreen += vectorLen, pBlue += vectorLen, pOut += vectorLen)
+		{
+			const __m128i red = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pRed));
+			const __m128i green = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pGreen));
+			const __m128i blue = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pBlue));
+			const __m128i minColor = _mm_min_epu16(_mm_min_epu16(red, green), blue);
+			const __m128i maxColor = _mm_max_epu16(_mm_max_epu16(red, green), blue);
+			storeWordSumsAsDouble(minColor, maxColor, 0.5 * scalingFactor, pOut);
+		}
+		SimdKernels::scalarKernels.luminanceRgb(pRed, pGreen, pBlue, pOut, count - nrVectors * vectorLen, scalingFactor);
+	}
+
+	void luminanceGraySse41(const std::uint16_t* pGray, double* pOut, const size_t count, const double scalingFactor) noexcept
+	{
+		constexpr size_t vectorLen = 8;
+		const size_t nrVectors = count / vectorLen;
+
+		for (size_t counter = 0; counter < nrVectors; ++counter, pGray += vectorLen, pOut += vectorLen)
+			storeWordsAsDouble(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pGray)), scalingFactor, pOut);
+		SimdKernels::scalarKernels.luminanceGray(pGray, pOut, count - nrVectors * vectorLen, scalingFactor);
+	}
+
+	inline __m128 read4Single(const std::uint16_t* const pIn) noexcept
+	{
+		return _mm_cvtepi32_ps(_mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(pIn))));
+	}
+	inline __m128 read4Single(const float* const pIn) noexcept
+	{
+		return _mm_loadu_ps(pIn);
+	}
+
+	template <class T>
+	void averageSse41(const T* pIn, float* pOut, const size_t count, const float nrStacked) noexcept
+	{
+		constexpr size_t vectorLen = 4;
+		const size_t nrVectors = count / vectorLen;
+		const __m128 vNrStacked = _mm_set1_ps(nrStacked);
+		const __m128 vNrStacked1 = _mm_set1_ps(nrStacked + 1.0f);
+
+		for (size_t counter = 0; counter < nrVectors; ++counter, pIn += vectorLen, pOut += vectorLen)
+			_mm_storeu_ps(pOut, _mm_div_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(pOut), vNrStacked), read4Single(pIn)), vNrStacked1));
+
+		if constexpr (std::is_same<T, float>::value)
+			SimdKernels::scalarKernels.averageFloat(pIn, pOut, count - nrVectors * vectorLen, nrStacked);
+		else
+			SimdKernels::scalarKernels.averageWord(pIn, pOut, count - nrVectors * vectorLen, nrStacked);
+	}
+
+	template <class T>
+	void maximumSse41(const T* pIn, float* pOut, const size_t count) noexcept
+	{
+		constexpr size_t vectorLen = 4;
+		const size_t nrVectors = count / vectorLen;
+
+		for (size_t counter = 0; counter < nrVectors; ++counter, pIn += vectorLen, pOut += vectorLen)
+			_mm_storeu_ps(pOut, _mm_max_ps(_mm_loadu_ps(pOut), read4Single(pIn)));
+
+		if constexpr (std::is_same<T, float>::value)
+			SimdKernels::scalarKernels.maximumFloat(pIn, pOut, count - nrVectors * vectorLen);
+		else
+			SimdKernels::scalarKernels.maximumWord(pIn, pOut, count - nrVectors * vectorLen);
+	}
+
+	// SSE4.1 has no gather: the 4 table entries are read one by one.
+	inline __m128 cubeRoot4(const float* const pCubeRoot, const __m128 r, const __m128 g, const __m128 b, const float cr, const float cg, const float cb) noexcept
+	{
+		const __m128 value = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(cr), r), _mm_mul_ps(_mm_set1_ps(cg), g)), _mm_mul_ps(_mm_set1_ps(cb), b));
+		const __m128i index = _mm_min_epi32(_mm_max_epi32(_mm_cvttps_epi32(_mm_mul_ps(value, _mm_set1_ps(65535.0f))), _mm_setzero_si128()), _mm_set1_epi32(65535));
+		return _mm_setr_ps(pCubeRoot[_mm_cvtsi128_si32(index)], pCubeRoot[_mm_extract_epi32(index, 1)], pCubeRoot[_mm_extract_epi32(index, 2)], pCubeRoot[_mm_extract_epi32(index, 3)]);
+	}
+
+	void rgbToLabSse41(const float* pRed, const float* pGreen, const float* pBlue, float* pL, float* pA, float* pB, const size_t count) noexcept
+	{
+		constexpr size_t vectorLen = 4;
+		const size_t nrVectors = count / vectorLen;
+		const float* const pCubeRoot = SimdKernels::labCubeRootTable();
+
+		for (size_t counter = 0; counter < nrVectors; ++counter, pRed += vectorLen, pGreen += vectorLen, pBlue += vectorLen, pL += vectorLen, pA += vectorLen, pB += vectorLen)
+		{
+			const __m128 r = _mm_loadu_ps(pRed);
+			const __m128 g = _mm_loadu_ps(pGreen);
+			const __m128 b = _mm_loadu_ps(pBlue);
+			const __m128 X = cubeRoot4(pCubeRoot, r, g, b, 0.433953f, 0.376219f, 0.189828f);
+			const __m128 Y = cubeRoot4(pCubeRoot, r, g, b, 0.212671f, 0.715160f, 0.072169f);
+			const __m128 Z = cubeRoot4(pCubeRoot, r, g, b, 0.017758f, 0.109477f, 0.872766f);
+			_mm_storeu_ps(pL, _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(116.0f), Y), _mm_set1_ps(16.0f)));
+			_mm_storeu_ps(pA, _mm_mul_ps(_mm_set1_ps(500.0f), _mm_sub_ps(X, Y)));
+			_mm_storeu_ps(pB, _mm_mul_ps(_mm_set1_ps(200.0f), _mm_sub_ps(Y, Z)));
+		}
+		SimdKernels::scalarKernels.rgbToLab(pRed, pGreen, pBlue, pL, pA, pB, count - nrVectors * vectorLen);
+	}
+
+	void ahdHomogeneitySse41(const float* const pLabH[3], const float* const pLabV[3], const ptrdiff_t stride, std::uint8_t* pHomoH, std::uint8_t* pHomoV, const size_t count) noexcept
+	{
+		constexpr size_t vectorLen = 4;
+		const size_t nrVectors = count / vectorLen;
+		const ptrdiff_t dir[4] = { -1, 1, -stride, stride };
+		const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+
+		const auto store4 = [](std::uint8_t* const pOut, const __m128i homo) -> void
+		{
+			const __m128i words = _mm_packs_epi32(homo, homo);
+			const int bytes = _mm_cvtsi128_si32(_mm_packus_epi16(words, words));
+			memcpy(pOut, &bytes, vectorLen);
+		};
+
+		size_t n = 0;
+		for (size_t counter = 0; counter < nrVectors; ++counter, n += vectorLen)
+		{
+			__m128 lDiffH[4], lDiffV[4], abDiffH[4], abDiffV[4];
+			const __m128 lH = _mm_loadu_ps(pLabH[0] + n), aH = _mm_loadu_ps(pLabH[1] + n), bH = _mm_loadu_ps(pLabH[2] + n);
+			const __m128 lV = _mm_loadu_ps(pLabV[0] + n), aV = _mm_loadu_ps(pLabV[1] + n), bV = _mm_loadu_ps(pLabV[2] + n);
+
+			for (int i = 0; i < 4; ++i)
+			{
+				const ptrdiff_t k = static_cast<ptrdiff_t>(n) + dir[i];
+				lDiffH[i] = _mm_and_ps(_mm_sub_ps(lH, _mm_loadu_ps(pLabH[0] + k)), absMask);
+				lDiffV[i] = _mm_and_ps(_mm_sub_ps(lV, _mm_loadu_ps(pLabV[0] + k)), absMask);
+				const __m128 aDiffH = _mm_sub_ps(aH, _mm_loadu_ps(pLabH[1] + k));
+				const __m128 bDiffH = _mm_sub_ps(bH, _mm_loadu_ps(pLabH[2] + k));
+				const __m128 aDiffV = _mm_sub_ps(aV, _mm_loadu_ps(pLabV[1] + k));
+				const __m128 bDiffV = _mm_sub_ps(bV, _mm_loadu_ps(pLabV[2] + k));
+				abDiffH[i] = _mm_add_ps(_mm_mul_ps(aDiffH, aDiffH), _mm_mul_ps(bDiffH, bDiffH));
+				abDiffV[i] = _mm_add_ps(_mm_mul_ps(aDiffV, aDiffV), _mm_mul_ps(bDiffV, bDiffV));
+			}
+
+			const __m128 lEpsilon = _mm_min_ps(_mm_max_ps(lDiffH[0], lDiffH[1]), _mm_max_ps(lDiffV[2], lDiffV[3]));
+			const __m128 abEpsilon = _mm_min_ps(_mm_max_ps(abDiffH[0], abDiffH[1]), _mm_max_ps(abDiffV[2], abDiffV[3]));
+
+			// The masks are -1 where the neighbour is homogeneous: subtracting them counts the neighbours.
+			__m128i homoH = _mm_setzero_si128(), homoV = _mm_setzero_si128();
+			for (int i = 0; i < 4; ++i)
+			{
+				homoH = _mm_sub_epi32(homoH, _mm_castps_si128(_mm_and_ps(_mm_cmple_ps(lDiffH[i], lEpsilon), _mm_cmple_ps(abDiffH[i], abEpsilon))));
+				homoV = _mm_sub_epi32(homoV, _mm_castps_si128(_mm_and_ps(_mm_cmple_ps(lDiffV[i], lEpsilon), _mm_cmple_ps(abDiffV[i], abEpsilon))));
+			}
+			store4(pHomoH + n, homoH);
+			store4(pHomoV + n, homoV);
+		}
+
+		const float* const pTailH[3] = { pLabH[0] + n, pLabH[1] + n, pLabH[2] + n };
+		const float* const pTailV[3] = { pLabV[0] + n, pLabV[1] + n, pLabV[2] + n };
+		SimdKernels::scalarKernels.ahdHomogeneity(pTailH, pTailV, stride, pHomoH + n, pHomoV + n, count - n);
+	}
+
+	inline __m128i read4Int(const std::uint16_t* const pIn) noexcept
+	{
+		return _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(pIn)));
+	}
+
+	void cfaBilinearSse41(const std::uint16_t* pPrevious, const std::uint16_t* pCurrent, const std::uint16_t* pNext, float* pFirst, float* pSecond, const size_t count, const bool greenFirst, const bool blueLine) noexcept
+	{
+		constexpr size_t vectorLen = 4;
+		const size_t nrVectors = count / vectorLen;
+		// The vectors start on even pixels, so the green pixels are always in the same lanes.
+		const __m128 greenMask = greenFirst ? _mm_castsi128_ps(_mm_setr_epi32(-1, 0, -1, 0)) : _mm_castsi128_ps(_mm_setr_epi32(0, -1, 0, -1));
+		const __m128 half = _mm_set1_ps(0.5f);
+		const __m128 quarter = _mm_set1_ps(0.25f);
+
+		for (size_t counter = 0; counter < nrVectors; ++counter, pPrevious += vectorLen, pCurrent += vectorLen, pNext += vectorLen, pFirst += vectorLen, pSecond += vectorLen)
+		{
+			const __m128i horizontal = _mm_add_epi32(read4Int(pCurrent - 1), read4Int(pCurrent + 1));
+			const __m128i vertical = _mm_add_epi32(read4Int(pPrevious), read4Int(pNext));
+			const __m128i diagonal = _mm_add_epi32(_mm_add_epi32(read4Int(pPrevious - 1), read4Int(pPrevious + 1)), _mm_add_epi32(read4Int(pNext - 1), read4Int(pNext + 1)));
+			const __m128 horizontalAvg = _mm_mul_ps(_mm_cvtepi32_ps(horizontal), half);
+			const __m128 verticalAvg = _mm_mul_ps(_mm_cvtepi32_ps(vertical), half);
+			const __m128 crossAvg = _mm_mul_ps(_mm_cvtepi32_ps(_mm_add_epi32(horizontal, vertical)), quarter);
+			const __m128 diagonalAvg = _mm_mul_ps(_mm_cvtepi32_ps(diagonal), quarter);
+
+			_mm_storeu_ps(pFirst, _mm_blendv_ps(blueLine ? diagonalAvg : crossAvg, blueLine ? verticalAvg : horizontalAvg, greenMask));
+			_mm_storeu_ps(pSecond, _mm_blendv_ps(blueLine ? crossAvg : diagonalAvg, blueLine ? horizontalAvg : verticalAvg, greenMask));
+		}
+		SimdKernels::scalarKernels.cfaBilinear(pPrevious, pCurrent, pNext, pFirst, pSecond, count - nrVectors * vectorLen, greenFirst, blueLine);
+	}
+}
+
+const SimdKernels SimdKernels::sse41Kernels{
+	SimdKernels::Isa::SSE41,
+	&luminanceRgbSse41,
+	&luminanceGraySse41,
+	&averageSse41<std::uint16_t>,
+	&averageSse41<float>,
+	&maximumSse41<std::uint16_t>,
+	&maximumSse41<float>,
+	&rgbToLabSse41,
+	&ahdHomogeneitySse41,
+	&cfaBilinearSse41
+};
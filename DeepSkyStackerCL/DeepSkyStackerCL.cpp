@@ -262,6 +262,7 @@ int _tmain(int argc, _TCHAR* argv[])
 	OleInitialize(nullptr);
 
 	SetUILanguage();
+	CMultitask::LoadSettings();
 
 	#ifndef NOGDIPLUS
 	GdiplusStartupInput		gdiplusStartupInput;
@@ -61,6 +61,7 @@ BOOL CDeepSkyStackerLiveApp::InitInstance()
 
 	// Standard initialization
 	SetRegistryKey(_T("DeepSkyStacker"));
+	CMultitask::LoadSettings();
 
 	return FALSE;
 }
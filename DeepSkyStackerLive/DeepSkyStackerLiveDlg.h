@@ -288,6 +288,20 @@ inline void		AddOffsetsAngleToGraph(LPCTSTR szFileName, double fdX, double fdY,
 
 /* ------------------------------------------------------------------- */
 
+inline void		AddPipelineStatsToGraph(const CLivePipelineStats & stats)
+{
+	CWnd *			pWnd = AfxGetApp()->GetMainWnd();
+
+	if (pWnd)
+	{
+		CDeepSkyStackerLiveDlg *	pDlg = dynamic_cast<CDeepSkyStackerLiveDlg *>(pWnd);
+		if (pDlg)
+			pDlg->GetGraphsTab().AddPipelineStats(stats);
+	};
+};
+
+/* ------------------------------------------------------------------- */
+
 inline void		UpdateLiveSettings()
 {
 	CWnd *			pWnd = AfxGetApp()->GetMainWnd();
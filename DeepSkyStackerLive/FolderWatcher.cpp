@@ -0,0 +1,434 @@
+#include "stdafx.h"
+#include "FolderWatcher.h"
+
+#if defined(__linux__)
+#include <sys/inotify.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+/* ------------------------------------------------------------------- */
+
+// Interval at which the files waiting to be complete are checked again
+// when the folder is watched using the system notifications
+const int					FW_PENDINGCHECKINTERVAL = 1000;	// ms
+
+/* ------------------------------------------------------------------- */
+
+CFolderWatcher::CFolderWatcher() :
+	m_nPollingTime(10),
+	m_bStop(false),
+	m_bEventDriven(false)
+{
+#if defined(_WIN32)
+	m_hDirectory = INVALID_HANDLE_VALUE;
+	m_hStopEvent = nullptr;
+#elif defined(__linux__)
+	m_nNotifyFd	 = -1;
+	m_nStopFd	 = -1;
+#endif
+};
+
+/* ------------------------------------------------------------------- */
+
+CFolderWatcher::~CFolderWatcher()
+{
+	Stop();
+};
+
+/* ------------------------------------------------------------------- */
+
+bool CFolderWatcher::Start(const std::filesystem::path & Folder, unsigned int nPollingTime, const std::vector<std::filesystem::path> & vKnownFiles, NEWFILECALLBACK Callback)
+{
+	std::error_code			ec;
+
+	Stop();
+
+	if (!std::filesystem::is_directory(Folder, ec))
+		return false;
+
+	m_Folder		= Folder;
+	m_nPollingTime	= std::max(1U, nPollingTime);
+	m_Callback		= std::move(Callback);
+	m_sReported.clear();
+	m_sReported.insert(vKnownFiles.begin(), vKnownFiles.end());
+	m_mPending.clear();
+	m_bStop			= false;
+
+	// The files which are not known yet may still be written: they are
+	// reported as soon as they are complete
+	ScanFolder();
+
+	m_bEventDriven = OpenNotifications();
+	if (m_bEventDriven)
+		m_Thread = std::thread(&CFolderWatcher::WatchEvents, this);
+	else
+		m_Thread = std::thread(&CFolderWatcher::WatchPolling, this);
+
+	return true;
+};
+
+/* ------------------------------------------------------------------- */
+
+void CFolderWatcher::Stop()
+{
+	if (m_Thread.joinable())
+	{
+		{
+			std::lock_guard<std::mutex>		Lock(m_StopMutex);
+
+			m_bStop = true;
+		}
+		m_StopCondition.notify_all();
+#if defined(_WIN32)
+		if (m_hStopEvent)
+			SetEvent(m_hStopEvent);
+#elif defined(__linux__)
+		if (m_nStopFd >= 0)
+		{
+			uint64_t		ulValue = 1;
+			ssize_t			lWritten;
+
+			lWritten = write(m_nStopFd, &ulValue, sizeof(ulValue));
+			(void)lWritten;
+		};
+#endif
+		m_Thread.join();
+	};
+	CloseNotifications();
+	m_bEventDriven = false;
+};
+
+/* ------------------------------------------------------------------- */
+
+void CFolderWatcher::ScanFolder()
+{
+	std::error_code			ec;
+
+	for (std::filesystem::directory_iterator it(m_Folder, ec), end; !ec && it != end; it.increment(ec))
+	{
+		if (it->is_regular_file(ec))
+			AddPendingFile(it->path());
+	};
+};
+
+/* ------------------------------------------------------------------- */
+
+void CFolderWatcher::AddPendingFile(const std::filesystem::path & File)
+{
+	if (m_sReported.find(File) == m_sReported.end())
+		m_mPending.emplace(File, CPendingFile());
+};
+
+/* ------------------------------------------------------------------- */
+
+bool CFolderWatcher::IsFileComplete(const std::filesystem::path & File, CPendingFile & pf)
+{
+	bool					bResult = false;
+	std::error_code			ec;
+	std::uintmax_t			ulSize = std::filesystem::file_size(File, ec);
+
+	if (!ec)
+	{
+		std::filesystem::file_time_type		LastWriteTime = std::filesystem::last_write_time(File, ec);
+
+		if (!ec)
+		{
+#if defined(_WIN32)
+			if (m_bEventDriven)
+			{
+				// The file can be opened without sharing only when the
+				// writer has closed it
+				HANDLE			hFile;
+
+				hFile = CreateFileW(File.c_str(), GENERIC_READ, 0, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+				if (hFile != INVALID_HANDLE_VALUE)
+				{
+					CloseHandle(hFile);
+					bResult = (ulSize > 0);
+				};
+			}
+			else
+#endif
+			// The file did not change since the last check
+			bResult = pf.m_bChecked && (ulSize > 0) && (ulSize == pf.m_ulSize) && (LastWriteTime == pf.m_LastWriteTime);
+
+			pf.m_ulSize			= ulSize;
+			pf.m_LastWriteTime	= LastWriteTime;
+			pf.m_bChecked		= true;
+		};
+	};
+
+	return bResult;
+};
+
+/* ------------------------------------------------------------------- */
+
+void CFolderWatcher::CheckPendingFiles()
+{
+	std::vector<std::filesystem::path>	vCompleted;
+
+	for (auto it = m_mPending.begin(); it != m_mPending.end() && !m_bStop;)
+	{
+		std::error_code			ec;
+
+		if (!std::filesystem::is_regular_file(it->first, ec))
+			it = m_mPending.erase(it);	// Deleted or moved away
+		else
+		{
+			if (IsFileComplete(it->first, it->second))
+				vCompleted.push_back(it->first);
+			++it;
+		};
+	};
+
+	for (const auto & File : vCompleted)
+		ReportFile(File);
+};
+
+/* ------------------------------------------------------------------- */
+
+void CFolderWatcher::ReportFile(const std::filesystem::path & File)
+{
+	m_mPending.erase(File);
+	if (!m_bStop && m_sReported.insert(File).second && m_Callback)
+		m_Callback(File);
+};
+
+/* ------------------------------------------------------------------- */
+
+void CFolderWatcher::WatchPolling()
+{
+	std::unique_lock<std::mutex>	Lock(m_StopMutex);
+
+	while (!m_bStop)
+	{
+		Lock.unlock();
+		ScanFolder();
+		CheckPendingFiles();
+		Lock.lock();
+		m_StopCondition.wait_for(Lock, std::chrono::seconds(m_nPollingTime), [this]() { return m_bStop.load(); });
+	};
+};
+
+/* ------------------------------------------------------------------- */
+
+#if defined(_WIN32)
+
+const DWORD					FW_NOTIFYBUFFERSIZE = 64 * 1024;
+
+bool CFolderWatcher::OpenNotifications()
+{
+	m_hDirectory = CreateFileW(m_Folder.c_str(), FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+							   nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+	if (m_hDirectory != INVALID_HANDLE_VALUE)
+		m_hStopEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+
+	if (m_hDirectory == INVALID_HANDLE_VALUE || !m_hStopEvent)
+	{
+		CloseNotifications();
+		return false;
+	};
+
+	return true;
+};
+
+/* ------------------------------------------------------------------- */
+
+void CFolderWatcher::CloseNotifications()
+{
+	if (m_hDirectory != INVALID_HANDLE_VALUE)
+		CloseHandle(m_hDirectory);
+	m_hDirectory = INVALID_HANDLE_VALUE;
+	if (m_hStopEvent)
+		CloseHandle(m_hStopEvent);
+	m_hStopEvent = nullptr;
+};
+
+/* ------------------------------------------------------------------- */
+
+void CFolderWatcher::WatchEvents()
+{
+	const DWORD					dwFilter = FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE;
+	std::vector<DWORD>			vBuffer(FW_NOTIFYBUFFERSIZE / sizeof(DWORD));
+	OVERLAPPED					ov = {};
+	bool						bPending;
+
+	ov.hEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+	bPending = ov.hEvent && ReadDirectoryChangesW(m_hDirectory, vBuffer.data(), FW_NOTIFYBUFFERSIZE, FALSE, dwFilter, nullptr, &ov, nullptr);
+	if (!bPending)
+	{
+		// The notifications are not available for this folder (network share...)
+		if (ov.hEvent)
+			CloseHandle(ov.hEvent);
+		m_bEventDriven = false;
+		WatchPolling();
+		return;
+	};
+
+	CheckPendingFiles();
+	while (!m_bStop)
+	{
+		HANDLE			hEvents[2] = { m_hStopEvent, ov.hEvent };
+		DWORD			dwWait;
+
+		dwWait = WaitForMultipleObjects(2, hEvents, FALSE, m_mPending.empty() ? INFINITE : FW_PENDINGCHECKINTERVAL);
+		if (dwWait == WAIT_OBJECT_0 || dwWait == WAIT_FAILED)
+			break;
+		if (dwWait == WAIT_OBJECT_0 + 1)
+		{
+			DWORD			dwBytes = 0;
+
+			bPending = false;
+			if (GetOverlappedResult(m_hDirectory, &ov, &dwBytes, FALSE) && dwBytes)
+			{
+				const BYTE *	pData = reinterpret_cast<const BYTE *>(vBuffer.data());
+
+				for (;;)
+				{
+					const FILE_NOTIFY_INFORMATION *	pInfo = reinterpret_cast<const FILE_NOTIFY_INFORMATION *>(pData);
+
+					if (pInfo->Action == FILE_ACTION_ADDED ||
+						pInfo->Action == FILE_ACTION_MODIFIED ||
+						pInfo->Action == FILE_ACTION_RENAMED_NEW_NAME)
+						AddPendingFile(m_Folder / std::wstring(pInfo->FileName, pInfo->FileNameLength / sizeof(WCHAR)));
+
+					if (!pInfo->NextEntryOffset)
+						break;
+					pData += pInfo->NextEntryOffset;
+				};
+			}
+			else
+				ScanFolder();	// The buffer overflowed - some changes were lost
+
+			ResetEvent(ov.hEvent);
+			bPending = ReadDirectoryChangesW(m_hDirectory, vBuffer.data(), FW_NOTIFYBUFFERSIZE, FALSE, dwFilter, nullptr, &ov, nullptr);
+			if (!bPending)
+				break;
+		};
+		CheckPendingFiles();
+	};
+
+	if (bPending)
+	{
+		DWORD			dwBytes;
+
+		CancelIo(m_hDirectory);
+		GetOverlappedResult(m_hDirectory, &ov, &dwBytes, TRUE);
+	};
+	CloseHandle(ov.hEvent);
+
+	// The folder is still watched by polling if the notifications failed
+	if (!m_bStop)
+	{
+		m_bEventDriven = false;
+		WatchPolling();
+	};
+};
+
+/* ------------------------------------------------------------------- */
+
+#elif defined(__linux__)
+
+bool CFolderWatcher::OpenNotifications()
+{
+	m_nNotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (m_nNotifyFd >= 0 &&
+		inotify_add_watch(m_nNotifyFd, m_Folder.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_ONLYDIR) >= 0)
+		m_nStopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+	if (m_nNotifyFd < 0 || m_nStopFd < 0)
+	{
+		CloseNotifications();
+		return false;
+	};
+
+	return true;
+};
+
+/* ------------------------------------------------------------------- */
+
+void CFolderWatcher::CloseNotifications()
+{
+	if (m_nNotifyFd >= 0)
+		close(m_nNotifyFd);	// Also removes the watch
+	m_nNotifyFd = -1;
+	if (m_nStopFd >= 0)
+		close(m_nStopFd);
+	m_nStopFd = -1;
+};
+
+/* ------------------------------------------------------------------- */
+
+void CFolderWatcher::WatchEvents()
+{
+	alignas(struct inotify_event) char	szBuffer[16 * 1024];
+
+	CheckPendingFiles();
+	while (!m_bStop)
+	{
+		struct pollfd		fds[2] = { { m_nStopFd, POLLIN, 0 }, { m_nNotifyFd, POLLIN, 0 } };
+		int					nResult;
+
+		nResult = poll(fds, 2, m_mPending.empty() ? -1 : FW_PENDINGCHECKINTERVAL);
+		if (nResult < 0 && errno != EINTR)
+			break;
+		if (fds[0].revents)
+			break;
+		if (fds[1].revents & POLLIN)
+		{
+			ssize_t				lLength;
+
+			while ((lLength = read(m_nNotifyFd, szBuffer, sizeof(szBuffer))) > 0)
+			{
+				for (const char * pData = szBuffer; pData < szBuffer + lLength;)
+				{
+					const struct inotify_event *	pEvent = reinterpret_cast<const struct inotify_event *>(pData);
+
+					if (pEvent->mask & IN_Q_OVERFLOW)
+						ScanFolder();	// Some events were lost
+					else if (pEvent->len && !(pEvent->mask & IN_ISDIR))
+						ReportFile(m_Folder / pEvent->name);	// Written and closed, or moved in
+
+					pData += sizeof(struct inotify_event) + pEvent->len;
+				};
+			};
+		};
+		CheckPendingFiles();
+	};
+
+	// The folder is still watched by polling if the notifications failed
+	if (!m_bStop)
+	{
+		m_bEventDriven = false;
+		WatchPolling();
+	};
+};
+
+/* ------------------------------------------------------------------- */
+
+#else
+
+bool CFolderWatcher::OpenNotifications()
+{
+	return false;
+};
+
+/* ------------------------------------------------------------------- */
+
+void CFolderWatcher::CloseNotifications()
+{
+};
+
+/* ------------------------------------------------------------------- */
+
+void CFolderWatcher::WatchEvents()
+{
+	WatchPolling();
+};
+
+#endif
+
+/* ------------------------------------------------------------------- */
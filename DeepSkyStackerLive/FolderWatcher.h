@@ -0,0 +1,106 @@
+#ifndef __FOLDERWATCHER_H__
+#define __FOLDERWATCHER_H__
+
+#pragma once
+
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <set>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <thread>
+
+/* ------------------------------------------------------------------- */
+
+// Watch a folder and report each new file once it is fully written.
+//
+// The folder is never rescanned for each change: the notifications of the
+// system are used whenever possible
+//  - Linux : inotify, a file is complete on IN_CLOSE_WRITE or IN_MOVED_TO
+//  - Windows : ReadDirectoryChangesW, a created or modified file is
+//    complete when it can be opened without sharing (the writer closed it)
+// When none is available the folder is listed every nPollingTime seconds
+// and a new file is complete when its size and last write time did not
+// change between two listings.
+//
+// The callback is called from the watcher thread, and only once per file.
+class CFolderWatcher
+{
+public :
+	typedef std::function<void(const std::filesystem::path &)>	NEWFILECALLBACK;
+
+private :
+	class CPendingFile
+	{
+	public :
+		std::uintmax_t					m_ulSize;
+		std::filesystem::file_time_type	m_LastWriteTime;
+		bool							m_bChecked;
+
+	public :
+		CPendingFile() :
+			m_ulSize(0),
+			m_bChecked(false)
+		{
+		};
+	};
+
+	typedef std::map<std::filesystem::path, CPendingFile>	PENDINGFILEMAP;
+
+	std::filesystem::path			m_Folder;
+	NEWFILECALLBACK					m_Callback;
+	unsigned int					m_nPollingTime;
+	std::set<std::filesystem::path>	m_sReported;
+	PENDINGFILEMAP					m_mPending;
+	std::thread						m_Thread;
+	std::atomic<bool>				m_bStop;
+	std::mutex						m_StopMutex;
+	std::condition_variable			m_StopCondition;
+	std::atomic<bool>				m_bEventDriven;
+
+#if defined(_WIN32)
+	void *							m_hDirectory;
+	void *							m_hStopEvent;
+#elif defined(__linux__)
+	int								m_nNotifyFd;
+	int								m_nStopFd;
+#endif
+
+private :
+	bool	OpenNotifications();
+	void	CloseNotifications();
+	void	WatchEvents();
+	void	WatchPolling();
+
+	void	ScanFolder();
+	void	AddPendingFile(const std::filesystem::path & File);
+	void	CheckPendingFiles();
+	bool	IsFileComplete(const std::filesystem::path & File, CPendingFile & pf);
+	void	ReportFile(const std::filesystem::path & File);
+
+public :
+	CFolderWatcher();
+	virtual ~CFolderWatcher();
+
+	// The vKnownFiles are never reported (already processed or ignored).
+	// Returns false if the folder cannot be watched at all.
+	bool	Start(const std::filesystem::path & Folder, unsigned int nPollingTime, const std::vector<std::filesystem::path> & vKnownFiles, NEWFILECALLBACK Callback);
+	void	Stop();
+
+	bool	IsRunning() const
+	{
+		return m_Thread.joinable();
+	};
+
+	bool	IsEventDriven() const
+	{
+		return m_bEventDriven;
+	};
+};
+
+/* ------------------------------------------------------------------- */
+
+#endif // __FOLDERWATCHER_H__
@@ -35,6 +35,7 @@ void CGraphViewTab::DoDataExchange(CDataExchange* pDX)
 	DDX_Control(pDX, IDC_OFFSET, m_Offset);
 	DDX_Control(pDX, IDC_ANGLE, m_Angle);
 	DDX_Control(pDX, IDC_SKYBACKGROUND, m_SkyBackground);
+	DDX_Control(pDX, IDC_PIPELINE, m_Pipeline);
 	DDX_Control(pDX, IDC_GRAPH, m_Graph);
 }
 
@@ -48,6 +49,7 @@ BEGIN_MESSAGE_MAP(CGraphViewTab, CDialog)
 	ON_BN_CLICKED(IDC_OFFSET, OnOffset)
 	ON_BN_CLICKED(IDC_ANGLE, OnAngle)
 	ON_BN_CLICKED(IDC_SKYBACKGROUND, OnSkyBackground)
+	ON_BN_CLICKED(IDC_PIPELINE, OnPipeline)
 	ON_WM_ERASEBKGND()
 	ON_WM_CTLCOLOR()
 END_MESSAGE_MAP()
@@ -56,72 +58,25 @@ END_MESSAGE_MAP()
 
 void CGraphViewTab::ChangeVisibleGraph()
 {
-	if (m_Score.GetCheck())
-	{
-		m_csAngle.SetVisible(false);
-		m_csScores.SetVisible(true);
-		m_csStars.SetVisible(false);
-		m_csdX.SetVisible(false);
-		m_csdY.SetVisible(false);
-		m_csFWHM.SetVisible(false);
-		m_csSkyBackground.SetVisible(false);
-		m_Graph.GetLegend()->SetVisible(FALSE);
-	}
-	else if (m_FWHM.GetCheck())
-	{
-		m_csAngle.SetVisible(false);
-		m_csScores.SetVisible(false);
-		m_csStars.SetVisible(false);
-		m_csdX.SetVisible(false);
-		m_csdY.SetVisible(false);
-		m_csFWHM.SetVisible(true);
-		m_csSkyBackground.SetVisible(false);
-		m_Graph.GetLegend()->SetVisible(FALSE);
-	}
-	else if (m_Stars.GetCheck())
-	{
-		m_csAngle.SetVisible(false);
-		m_csScores.SetVisible(false);
-		m_csStars.SetVisible(true);
-		m_csdX.SetVisible(false);
-		m_csdY.SetVisible(false);
-		m_csFWHM.SetVisible(false);
-		m_csSkyBackground.SetVisible(false);
-		m_Graph.GetLegend()->SetVisible(FALSE);
-	}
-	else if (m_Offset.GetCheck())
-	{
-		m_csAngle.SetVisible(false);
-		m_csScores.SetVisible(false);
-		m_csStars.SetVisible(false);
-		m_csdX.SetVisible(true);
-		m_csdY.SetVisible(true);
-		m_csFWHM.SetVisible(false);
-		m_csSkyBackground.SetVisible(false);
-		m_Graph.GetLegend()->SetVisible(FALSE);
-	}
-	else if (m_Angle.GetCheck())
-	{
-		m_csAngle.SetVisible(true);
-		m_csScores.SetVisible(false);
-		m_csStars.SetVisible(false);
-		m_csdX.SetVisible(false);
-		m_csdY.SetVisible(false);
-		m_csFWHM.SetVisible(false);
-		m_csSkyBackground.SetVisible(false);
-		m_Graph.GetLegend()->SetVisible(FALSE);
-	}
-	else if (m_SkyBackground.GetCheck())
-	{
-		m_csAngle.SetVisible(false);
-		m_csScores.SetVisible(false);
-		m_csStars.SetVisible(false);
-		m_csdX.SetVisible(false);
-		m_csdY.SetVisible(false);
-		m_csFWHM.SetVisible(false);
-		m_csSkyBackground.SetVisible(true);
-		m_Graph.GetLegend()->SetVisible(FALSE);
-	};
+	const bool			bPipeline = (m_Pipeline.GetCheck() != 0);
+
+	m_csScores.SetVisible(m_Score.GetCheck() != 0);
+	m_csFWHM.SetVisible(m_FWHM.GetCheck() != 0);
+	m_csStars.SetVisible(m_Stars.GetCheck() != 0);
+	m_csdX.SetVisible(m_Offset.GetCheck() != 0);
+	m_csdY.SetVisible(m_Offset.GetCheck() != 0);
+	m_csAngle.SetVisible(m_Angle.GetCheck() != 0);
+	m_csSkyBackground.SetVisible(m_SkyBackground.GetCheck() != 0);
+
+	m_csToLoad.SetVisible(bPipeline);
+	m_csToRegister.SetVisible(bPipeline);
+	m_csToStack.SetVisible(bPipeline);
+	m_csLoadTime.SetVisible(bPipeline);
+	m_csRegisterTime.SetVisible(bPipeline);
+	m_csStackTime.SetVisible(bPipeline);
+
+	// Only the pipeline graph has several named curves
+	m_Graph.GetLegend()->SetVisible(bPipeline);
 
 	m_Graph.GetLeftAxis()->SetAutomatic(true);
 	m_Graph.GetLeftAxis()->SetAutoMargin(true, 5);
@@ -158,6 +113,12 @@ BOOL CGraphViewTab::OnInitDialog()
 		m_csdY.Init(m_Graph, RGB(0, 100, 200));
 		m_csAngle.Init(m_Graph, RGB(0, 200, 0));
 		m_csSkyBackground.Init(m_Graph, RGB(0, 100, 200));
+		m_csToLoad.Init(m_Graph, RGB(200, 0, 0));
+		m_csToRegister.Init(m_Graph, RGB(0, 100, 200));
+		m_csToStack.Init(m_Graph, RGB(0, 200, 0));
+		m_csLoadTime.Init(m_Graph, RGB(200, 120, 120));
+		m_csRegisterTime.Init(m_Graph, RGB(120, 170, 220));
+		m_csStackTime.Init(m_Graph, RGB(120, 220, 120));
 	}
 	else
 	{
@@ -169,10 +130,22 @@ BOOL CGraphViewTab::OnInitDialog()
 		m_csdY.Init(m_Graph, RGB(0, 0, 255));
 		m_csAngle.Init(m_Graph, RGB(0, 255, 0));
 		m_csSkyBackground.Init(m_Graph, RGB(0, 0, 128));
+		m_csToLoad.Init(m_Graph, RGB(255, 0, 0));
+		m_csToRegister.Init(m_Graph, RGB(0, 0, 255));
+		m_csToStack.Init(m_Graph, RGB(0, 160, 0));
+		m_csLoadTime.Init(m_Graph, RGB(128, 0, 0));
+		m_csRegisterTime.Init(m_Graph, RGB(0, 0, 128));
+		m_csStackTime.Init(m_Graph, RGB(0, 96, 0));
 	}
 
 	m_csdX.SetName(_T("dX"));
 	m_csdY.SetName(_T("dY"));
+	m_csToLoad.SetName(_T("To load"));
+	m_csToRegister.SetName(_T("To register"));
+	m_csToStack.SetName(_T("To stack"));
+	m_csLoadTime.SetName(_T("Load (s)"));
+	m_csRegisterTime.SetName(_T("Register (s)"));
+	m_csStackTime.SetName(_T("Stack (s)"));
 
 	m_Graph.GetBottomAxis()->SetAutomatic(true);
 	m_Graph.GetLeftAxis()->SetAutomatic(true);
@@ -195,6 +168,7 @@ void CGraphViewTab::OnScore()
 		m_Offset.SetCheck(FALSE);
 		m_Angle.SetCheck(FALSE);
 		m_SkyBackground.SetCheck(FALSE);
+		m_Pipeline.SetCheck(FALSE);
 		ChangeVisibleGraph();
 	};
 };
@@ -210,6 +184,7 @@ void CGraphViewTab::OnFWHM()
 		m_Offset.SetCheck(FALSE);
 		m_Angle.SetCheck(FALSE);
 		m_SkyBackground.SetCheck(FALSE);
+		m_Pipeline.SetCheck(FALSE);
 		ChangeVisibleGraph();
 	};
 };
@@ -225,6 +200,7 @@ void CGraphViewTab::OnStars()
 		m_Offset.SetCheck(FALSE);
 		m_Angle.SetCheck(FALSE);
 		m_SkyBackground.SetCheck(FALSE);
+		m_Pipeline.SetCheck(FALSE);
 		ChangeVisibleGraph();
 	};
 };
@@ -240,6 +216,7 @@ void CGraphViewTab::OnOffset()
 		m_Stars.SetCheck(FALSE);
 		m_Angle.SetCheck(FALSE);
 		m_SkyBackground.SetCheck(FALSE);
+		m_Pipeline.SetCheck(FALSE);
 		ChangeVisibleGraph();
 	};
 };
@@ -255,6 +232,7 @@ void CGraphViewTab::OnAngle()
 		m_Stars.SetCheck(FALSE);
 		m_Offset.SetCheck(FALSE);
 		m_SkyBackground.SetCheck(FALSE);
+		m_Pipeline.SetCheck(FALSE);
 		ChangeVisibleGraph();
 	};
 };
@@ -300,6 +278,7 @@ void CGraphViewTab::OnSkyBackground()
 		m_Stars.SetCheck(FALSE);
 		m_Offset.SetCheck(FALSE);
 		m_Angle.SetCheck(FALSE);
+		m_Pipeline.SetCheck(FALSE);
 		ChangeVisibleGraph();
 	};
 };
@@ -445,3 +424,35 @@ void CGraphViewTab::ChangeImageInfo(LPCTSTR szFileName, STACKIMAGEINFO info)
 };
 
 /* ------------------------------------------------------------------- */
+
+void CGraphViewTab::OnPipeline()
+{
+	if (m_Pipeline.GetCheck())
+	{
+		m_Score.SetCheck(FALSE);
+		m_FWHM.SetCheck(FALSE);
+		m_Stars.SetCheck(FALSE);
+		m_Offset.SetCheck(FALSE);
+		m_Angle.SetCheck(FALSE);
+		m_SkyBackground.SetCheck(FALSE);
+		ChangeVisibleGraph();
+	};
+};
+
+/* ------------------------------------------------------------------- */
+
+void CGraphViewTab::AddPipelineStats(const CLivePipelineStats & stats)
+{
+	double				fX = m_csToLoad.m_pMain->GetPointsCount()+1;
+
+	m_csToLoad.AddPoint(fX, stats.m_lNrToLoad);
+	m_csToRegister.AddPoint(fX, stats.m_lNrToRegister);
+	m_csToStack.AddPoint(fX, stats.m_lNrToStack);
+	m_csLoadTime.AddPoint(fX, stats.m_fLoadTime);
+	m_csRegisterTime.AddPoint(fX, stats.m_fRegisterTime);
+	m_csStackTime.AddPoint(fX, stats.m_fStackTime);
+
+	m_Graph.RefreshCtrl();
+};
+
+/* ------------------------------------------------------------------- */
@@ -12,6 +12,8 @@
 #include "ChartCtrl.h"
 #include "ChartPointsSerie.h"
 
+class CLivePipelineStats;
+
 // CGraphViewTab dialog
 
 typedef enum tagPOINTTYPE
@@ -182,6 +184,7 @@ private :
 	CButton				m_Offset;
 	CButton				m_Angle;
 	CButton				m_SkyBackground;
+	CButton				m_Pipeline;
 	CChartCtrl			m_Graph;
 
 	CChartSeries		m_csScores;
@@ -192,6 +195,14 @@ private :
 	CChartSeries		m_csAngle;
 	CChartSeries		m_csSkyBackground;
 
+	// Queue depths and stage durations of the live engine pipeline
+	CChartSeries		m_csToLoad;
+	CChartSeries		m_csToRegister;
+	CChartSeries		m_csToStack;
+	CChartSeries		m_csLoadTime;
+	CChartSeries		m_csRegisterTime;
+	CChartSeries		m_csStackTime;
+
 	std::vector<CString>	m_vFiles;
 
 	bool m_bDarkMode;
@@ -218,6 +229,7 @@ protected :
 	afx_msg void OnOffset();
 	afx_msg void OnAngle();
 	afx_msg void OnSkyBackground();
+	afx_msg void OnPipeline();
 	afx_msg HBRUSH OnCtlColor(CDC* pDC, CWnd* pWnd, UINT nCtlColor);
 	afx_msg BOOL OnEraseBkgnd(CDC* pDC);
 
@@ -229,6 +241,7 @@ public :
 	void	AddOffsetAngle(LPCTSTR szFileName, double fdX, double fdY, double fAngle);
 	void	SetPoint(LPCTSTR szFileName, POINTTYPE ptType, CHARTTYPE ctType);
 	void	ChangeImageInfo(LPCTSTR szFileName, STACKIMAGEINFO info);
+	void	AddPipelineStats(const CLivePipelineStats & stats);
 };
 
 
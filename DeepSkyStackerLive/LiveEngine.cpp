@@ -16,6 +16,13 @@ extern void	SetUILanguage();
 
 /* ------------------------------------------------------------------- */
 
+static double	SecondsSince(const std::chrono::steady_clock::time_point & tStart)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - tStart).count();
+};
+
+/* ------------------------------------------------------------------- */
+
 DWORD	WINAPI	LiveEngineThreadProc(LPVOID lpParameter)
 {
 	DWORD						dwResult = 0;
@@ -32,7 +39,15 @@ DWORD	WINAPI	LiveEngineThreadProc(LPVOID lpParameter)
 
 void	CLiveEngine::MoveImage(LPCTSTR szFileName)
 {
-	if (m_LiveSettings.IsStack_Move())
+	bool					bMove;
+
+	{
+		std::lock_guard<std::mutex>		Lock(m_SettingsMutex);
+
+		bMove = m_LiveSettings.IsStack_Move();
+	};
+
+	if (bMove)
 	{
 		// Move szFileName to the NonStackable subfolder
 		// (create it if necessary)
@@ -256,7 +271,7 @@ BOOL CLiveEngine::IsFileAvailable(LPCTSTR szFileName)
 	HANDLE						hFile;
 
 	hFile = CreateFile(szFileName, GENERIC_READ, 0, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
-	if (hFile)
+	if (hFile != INVALID_HANDLE_VALUE)
 	{
 		bResult = TRUE;
 		CloseHandle(hFile);
@@ -267,17 +282,26 @@ BOOL CLiveEngine::IsFileAvailable(LPCTSTR szFileName)
 
 /* ------------------------------------------------------------------- */
 
-BOOL CLiveEngine::LoadFile(LPCTSTR szFileName)
+BOOL CLiveEngine::GetFileInfo(LPCTSTR szFileName, CBitmapInfo & BitmapInfo)
 {
-	BOOL						bResult = FALSE;
+	// Only the headers are read: the GUI thread never waits for a decoding
+	std::lock_guard<std::mutex>		Lock(m_InfoMutex);
 
-	CBitmapInfo			bmpInfo;
+	return GetPictureInfo(szFileName, BitmapInfo);
+};
+
+/* ------------------------------------------------------------------- */
 
-	if (GetPictureInfo(szFileName, bmpInfo) && bmpInfo.CanLoad())
+BOOL CLiveEngine::LoadFile(CLiveFrame & frame)
+{
+	BOOL						bResult = FALSE;
+	LPCTSTR						szFileName = frame.m_strFileName;
+	CBitmapInfo &				bmpInfo = frame.m_BitmapInfo;
+
+	if (GetFileInfo(szFileName, bmpInfo) && bmpInfo.CanLoad())
 	{
 		CString						strText;
 		CString						strDescription;
-		BOOL						bOverrideRAW = TRUE;
 
 		bmpInfo.GetDescription(strDescription);
 		if (bmpInfo.m_lNrChannels==3)
@@ -285,67 +309,20 @@ BOOL CLiveEngine::LoadFile(LPCTSTR szFileName)
 		else
 			strText.Format(IDS_LOADGRAYLIGHT, bmpInfo.m_lBitPerChannel, (LPCTSTR)strDescription, szFileName);
 
-		Start2(strText, 0);
+		m_LoadProgress.Start2(strText, 0);
 		CAllDepthBitmap				adb;
 		adb.SetDontUseAHD(TRUE);
 
-		bResult = LoadPicture(szFileName, adb, this);
-		End2();
+		std::unique_lock<std::mutex>	DecodeLock(m_DecodeMutex);
+
+		bResult = LoadPicture(szFileName, adb, &m_LoadProgress, bmpInfo.m_Format);
+		m_LoadProgress.End2();
+		DecodeLock.unlock();
 		if (bResult)
 		{
+			frame.m_pBitmap = adb.m_pBitmap;
 			PostFileLoaded(adb.m_pBitmap, adb.m_pWndBitmap, szFileName);
 			PostChangeImageStatus(szFileName, IS_LOADED);
-
-			// Now register the image
-			CLightFrameInfo			lfi;
-
-			strText.Format(IDS_REGISTERINGNAME, (LPCTSTR)szFileName);
-			Start2(strText, 0);
-			lfi.SetBitmap(szFileName, FALSE, FALSE);
-			lfi.SetProgress(this);
-			lfi.RegisterPicture(adb.m_pBitmap);
-			lfi.SaveRegisteringInfo();
-			lfi.m_lISOSpeed = bmpInfo.m_lISOSpeed;
-			lfi.m_lGain = bmpInfo.m_lGain;
-			lfi.m_fExposure = bmpInfo.m_fExposure;
-			End2();
-			PostFileRegistered(szFileName);
-			PostChangeImageStatus(szFileName, IS_REGISTERED);
-
-			TCHAR					szName[_MAX_FNAME];
-			TCHAR					szExt[_MAX_EXT];
-			CString					strName;
-
-			_tsplitpath(szFileName, nullptr, nullptr, szName, szExt);
-			strName.Format(_T("%s%s"), szName, szExt);
-			strText.Format(IDS_LOG_REGISTERRESULTS, (LPCTSTR)strName, lfi.m_vStars.size(), lfi.m_fFWHM, lfi.m_fOverallQuality);
-			PostToLog(strText, TRUE);
-
-			CString					strError;
-			BOOL					bWarning;
-			CString					strWarning;
-
-			bWarning = IsImageWarning1(szFileName, lfi.m_vStars.size(), lfi.m_fFWHM, lfi.m_fOverallQuality, lfi.m_SkyBackground.m_fLight*100.0, strWarning);
-			PostChangeImageInfo(szFileName, II_DONTSTACK_NONE);
-			if (bWarning)
-			{
-				strText.Format(IDS_LOG_WARNING, (LPCTSTR)szFileName, (LPCTSTR) strWarning);
-				PostToLog(strText, TRUE, FALSE, TRUE, RGB(208, 127, 0));
-				PostWarning(strWarning);
-			};
-			if (IsImageStackable1(szFileName, lfi.m_vStars.size(), lfi.m_fFWHM, lfi.m_fOverallQuality, lfi.m_SkyBackground.m_fLight*100.0, strError))
-			{
-				// Check against stacking conditions before adding it to
-				// the stack list
-				m_qToStack.push_back(lfi);
-			}
-			else
-			{
-				strText.Format(IDS_LOG_IMAGENOTSTACKABLE1, (LPCTSTR)szFileName, (LPCTSTR) strError);
-				PostToLog(strText, TRUE, TRUE, FALSE, RGB(255, 0, 0));
-				PostChangeImageStatus(szFileName, IS_NOTSTACKABLE);
-				MoveImage(szFileName);
-			};
 		}
 		else
 		{
@@ -360,6 +337,86 @@ BOOL CLiveEngine::LoadFile(LPCTSTR szFileName)
 
 /* ------------------------------------------------------------------- */
 
+BOOL CLiveEngine::StackFrame(CLightFrameInfo & lfi)
+{
+	// The file is loaded again: the stacking needs the bitmap before it is
+	// demosaiced for the display and the registering.
+	// It is not decoded at the same time as the next file of the load stage.
+	CSmartPtr<CMemoryBitmap>	pBitmap;
+	bool						bLoaded;
+
+	{
+		std::lock_guard<std::mutex>		Lock(m_DecodeMutex);
+
+		bLoaded = ::LoadFrame(lfi.m_strFileName, PICTURETYPE_LIGHTFRAME, &m_StackProgress, &pBitmap);
+	};
+
+	return bLoaded && m_RunningStackingEngine.AddImage(lfi, pBitmap, &m_StackProgress);
+};
+
+/* ------------------------------------------------------------------- */
+
+BOOL CLiveEngine::RegisterFile(CLiveFrame & frame)
+{
+	// Returns TRUE if the image can be stacked
+	BOOL						bResult = FALSE;
+	LPCTSTR						szFileName = frame.m_strFileName;
+	CLightFrameInfo &			lfi = frame.m_lfi;
+	CString						strText;
+
+	strText.Format(IDS_REGISTERINGNAME, (LPCTSTR)szFileName);
+	m_RegisterProgress.Start2(strText, 0);
+	lfi.SetBitmap(szFileName, FALSE, FALSE);
+	lfi.SetProgress(&m_RegisterProgress);
+	lfi.RegisterPicture(frame.m_pBitmap);
+	lfi.SaveRegisteringInfo();
+	lfi.m_lISOSpeed = frame.m_BitmapInfo.m_lISOSpeed;
+	lfi.m_lGain = frame.m_BitmapInfo.m_lGain;
+	lfi.m_fExposure = frame.m_BitmapInfo.m_fExposure;
+	m_RegisterProgress.End2();
+	PostFileRegistered(szFileName);
+	PostChangeImageStatus(szFileName, IS_REGISTERED);
+
+	TCHAR					szName[_MAX_FNAME];
+	TCHAR					szExt[_MAX_EXT];
+	CString					strName;
+
+	_tsplitpath(szFileName, nullptr, nullptr, szName, szExt);
+	strName.Format(_T("%s%s"), szName, szExt);
+	strText.Format(IDS_LOG_REGISTERRESULTS, (LPCTSTR)strName, lfi.m_vStars.size(), lfi.m_fFWHM, lfi.m_fOverallQuality);
+	PostToLog(strText, TRUE);
+
+	CString					strError;
+	BOOL					bWarning;
+	CString					strWarning;
+
+	{
+		std::lock_guard<std::mutex>		Lock(m_SettingsMutex);
+
+		bWarning = IsImageWarning1(szFileName, lfi.m_vStars.size(), lfi.m_fFWHM, lfi.m_fOverallQuality, lfi.m_SkyBackground.m_fLight*100.0, strWarning);
+		PostChangeImageInfo(szFileName, II_DONTSTACK_NONE);
+		bResult = IsImageStackable1(szFileName, lfi.m_vStars.size(), lfi.m_fFWHM, lfi.m_fOverallQuality, lfi.m_SkyBackground.m_fLight*100.0, strError);
+	};
+
+	if (bWarning)
+	{
+		strText.Format(IDS_LOG_WARNING, (LPCTSTR)szFileName, (LPCTSTR) strWarning);
+		PostToLog(strText, TRUE, FALSE, TRUE, RGB(208, 127, 0));
+		PostWarning(strWarning);
+	};
+	if (!bResult)
+	{
+		strText.Format(IDS_LOG_IMAGENOTSTACKABLE1, (LPCTSTR)szFileName, (LPCTSTR) strError);
+		PostToLog(strText, TRUE, TRUE, FALSE, RGB(255, 0, 0));
+		PostChangeImageStatus(szFileName, IS_NOTSTACKABLE);
+		MoveImage(szFileName);
+	};
+
+	return bResult;
+};
+
+/* ------------------------------------------------------------------- */
+
 void CLiveEngine::SaveStackedImage(CMemoryBitmap * pBitmap)
 {
 	CSmartPtr<CMemoryBitmap>	pStackedImage;
@@ -380,10 +437,10 @@ void CLiveEngine::SaveStackedImage(CMemoryBitmap * pBitmap)
 		CString				strText;
 
 		strText.Format(IDS_SAVINGSTACKEDIMAGE, (LPCTSTR)strFolder);
-		this->Start2(strText, 0);
+		m_StackProgress.Start2(strText, 0);
 
-		WriteTIFF(strOutputFile, pStackedImage, this, _T("Autostacked Image"), 0, -1, m_RunningStackingEngine.GetTotalExposure(), 0.0);
-		this->End2();
+		WriteTIFF(strOutputFile, pStackedImage, &m_StackProgress, _T("Autostacked Image"), 0, -1, m_RunningStackingEngine.GetTotalExposure(), 0.0);
+		m_StackProgress.End2();
 
 		PostStackedImageSaved();
 	};
@@ -457,126 +514,310 @@ void CLiveEngine::PostStackedImageSaved()
 
 /* ------------------------------------------------------------------- */
 
-BOOL CLiveEngine::ProcessNext()
+bool CLiveEngine::IsStackQueueFull()
 {
-	// Returns FALSE is there is nothing to do
-	BOOL				bResult = FALSE;
+	// Called with m_PipelineMutex locked.
+	// Before the reference frame is set all the registered frames are kept
+	// (the best one becomes the reference), and when stacking is off they
+	// wait until it is switched on.
+	return m_bStackingOn && m_bReferenceFrameSet && (m_qToStack.size() >= LIVE_TOSTACKDEPTH);
+};
+
+/* ------------------------------------------------------------------- */
 
-	if (m_qToStack.size() && m_bStackingOn)
+void CLiveEngine::LoadStage()
+{
+	SetUILanguage();
+	SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
+
+	for (;;)
 	{
-		if (!m_bReferenceFrameSet)
+		CLiveFrame				frame;
+
 		{
-			if (m_LiveSettings.IsDontStack_Delayed() && m_qToStack.size() < m_LiveSettings.GetMinImages())
+			std::unique_lock<std::mutex>	Lock(m_PipelineMutex);
+
+			// Wait for a file to load and for room in the registering queue
+			m_LoadCondition.wait(Lock, [this]()
 			{
-				bResult = FALSE;
-			}
-			else
+				return m_bStopPipeline ||
+					   (m_bRegisteringOn && m_qToLoad.size() && m_qToRegister.size() < LIVE_TOREGISTERDEPTH);
+			});
+			if (m_bStopPipeline)
+				break;
+
+			frame = m_qToLoad.front();
+			m_qToLoad.pop_front();
+		};
+
+		if (!IsFileAvailable(frame.m_strFileName))
+		{
+			// The file is still being written - try again later
+			std::unique_lock<std::mutex>	Lock(m_PipelineMutex);
+
+			if (frame.m_dwGeneration == m_dwGeneration)
+				m_qToLoad.push_back(frame);
+			m_LoadCondition.wait_for(Lock, std::chrono::milliseconds(100));
+			continue;
+		};
+
+		const auto				tStart = std::chrono::steady_clock::now();
+		BOOL					bLoaded;
+
+		bLoaded = LoadFile(frame);
+		frame.m_fLoadTime = SecondsSince(tStart);
+
+		if (bLoaded)
+		{
 			{
-				// Select the best reference frame from all the available images
-				// (best score)
-				std::deque<CLightFrameInfo>::iterator	it,
-														bestit = m_qToStack.end();
-				double									fMaxScore = 0;
+				std::lock_guard<std::mutex>		Lock(m_PipelineMutex);
 
-				for (it = m_qToStack.begin();it != m_qToStack.end();it++)
-				{
-					if ((*it).m_fOverallQuality > fMaxScore)
-					{
-						bestit = it;
-						fMaxScore = (*it).m_fOverallQuality;
-					};
-				};
+				// Frames loaded before the pending images were cleared are dropped
+				if (frame.m_dwGeneration == m_dwGeneration)
+					m_qToRegister.push_back(frame);
+			};
+			m_RegisterCondition.notify_all();
+		}
+		else
+			PostPipelineStats(frame, 0);
+		PostUpdatePending();
+	};
+};
+
+/* ------------------------------------------------------------------- */
+
+void CLiveEngine::RegisterStage()
+{
+	SetUILanguage();
+	SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
 
-				if (bestit != m_qToStack.end())
+	for (;;)
+	{
+		CLiveFrame				frame;
+
+		{
+			std::unique_lock<std::mutex>	Lock(m_PipelineMutex);
+
+			m_RegisterCondition.wait(Lock, [this]()
+			{
+				return m_bStopPipeline || m_qToRegister.size();
+			});
+			if (m_bStopPipeline)
+				break;
+
+			frame = m_qToRegister.front();
+			m_qToRegister.pop_front();
+		};
+		m_LoadCondition.notify_all();
+		PostUpdatePending();
+
+		const auto				tStart = std::chrono::steady_clock::now();
+		BOOL					bStackable;
+
+		bStackable = RegisterFile(frame);
+		frame.m_fRegisterTime = SecondsSince(tStart);
+		// The stacking engine loads the file again
+		frame.m_pBitmap.Release();
+
+		if (bStackable)
+		{
+			bool				bQueued = false;
+
+			{
+				std::unique_lock<std::mutex>	Lock(m_PipelineMutex);
+
+				// Wait for room in the stacking queue
+				m_RegisterCondition.wait(Lock, [this]()
 				{
-					m_RunningStackingEngine.ComputeOffset((*bestit));
-					PostUpdateImageOffsets((*bestit).m_strFileName, 0, 0, 0);
-					m_RunningStackingEngine.AddImage((*bestit), this);
-					PostChangeImageStatus((*bestit).m_strFileName, IS_STACKED);
-					PostChangeImageInfo((*bestit).m_strFileName, II_SETREFERENCE);
-					m_qToStack.erase(bestit);
-					m_bReferenceFrameSet = TRUE;
-					PostStackedImage();
-				}
-				else
-					m_qToStack.clear();
-				bResult = TRUE;
+					return m_bStopPipeline || !IsStackQueueFull();
+				});
+				if (!m_bStopPipeline && frame.m_dwGeneration == m_dwGeneration)
+				{
+					m_qToStack.push_back(frame);
+					bQueued = true;
+				};
 			};
+
+			// Wake up the engine thread which stacks the frames
+			if (bQueued)
+				PostThreadMessage(m_dwThreadID, WM_LE_MESSAGE, 0, 0);
 		}
 		else
+			PostPipelineStats(frame, 0);
+	};
+};
+
+/* ------------------------------------------------------------------- */
+
+void CLiveEngine::StartPipeline()
+{
+	m_bStopPipeline = false;
+	m_LoadThread	 = std::thread([this]() { LoadStage(); });
+	m_RegisterThread = std::thread([this]() { RegisterStage(); });
+};
+
+/* ------------------------------------------------------------------- */
+
+void CLiveEngine::StopPipeline()
+{
+	{
+		std::lock_guard<std::mutex>		Lock(m_PipelineMutex);
+
+		m_bStopPipeline = true;
+	};
+	m_LoadCondition.notify_all();
+	m_RegisterCondition.notify_all();
+
+	if (m_LoadThread.joinable())
+		m_LoadThread.join();
+	if (m_RegisterThread.joinable())
+		m_RegisterThread.join();
+};
+
+/* ------------------------------------------------------------------- */
+
+BOOL CLiveEngine::ProcessNext()
+{
+	// Stacks the next registered frame (the loading and the registering
+	// are done by the pipeline threads)
+	// Returns FALSE is there is nothing to do
+	BOOL				bResult = FALSE;
+	BOOL				bReference = FALSE;
+	CLiveFrame			frame;
+
+	if (m_bStackingOn)
+	{
+		std::lock_guard<std::mutex>		Lock(m_PipelineMutex);
+
+		if (m_qToStack.size())
 		{
-			CLightFrameInfo			lfi;
-			double					fdX, fdY, fAngle;
-			CString					strError;
-			CString					strText;
-			BOOL					bError = FALSE;
-			BOOL					bWarning = FALSE;
-			CString					strWarning;
-
-			lfi = m_qToStack.front();
-			m_qToStack.pop_front();
-			if (m_RunningStackingEngine.ComputeOffset(lfi))
+			if (!m_bReferenceFrameSet)
 			{
-				lfi.m_BilinearParameters.Offsets(fdX, fdY);
-				fAngle = lfi.m_BilinearParameters.Angle(lfi.RenderedWidth()) * 180.0/M_PI;
-				PostUpdateImageOffsets(lfi.m_strFileName, fdX, fdY, fAngle);
-				PostChangeImageInfo(lfi.m_strFileName, II_DONTSTACK_NONE);
-				bWarning = IsImageWarning2(lfi.m_strFileName, fdX, fdY, fAngle, strWarning);
-				if (bWarning)
-					PostWarning(strWarning);
-				if (IsImageStackable2(lfi.m_strFileName, fdX, fdY, fAngle, strError))
+				if (!m_LiveSettings.IsDontStack_Delayed() || m_qToStack.size() >= m_LiveSettings.GetMinImages())
 				{
-					m_RunningStackingEngine.AddImage(lfi, this);
-					PostChangeImageStatus(lfi.m_strFileName, IS_STACKED);
+					// Select the best reference frame from all the available images
+					// (best score)
+					LIVEFRAMEQUEUE::iterator		it,
+													bestit = m_qToStack.end();
+					double							fMaxScore = 0;
 
-					CPointExt		pt1, pt2, pt3, pt4;
+					for (it = m_qToStack.begin();it != m_qToStack.end();it++)
+					{
+						if ((*it).m_lfi.m_fOverallQuality > fMaxScore)
+						{
+							bestit = it;
+							fMaxScore = (*it).m_lfi.m_fOverallQuality;
+						};
+					};
 
-					lfi.m_BilinearParameters.Footprint(pt1, pt2, pt3, pt4);
-					PostFootprint(pt1, pt2, pt3, pt4);
-					PostStackedImage();
-				}
-				else
-				{
-					bError = TRUE;
+					if (bestit != m_qToStack.end())
+					{
+						frame = (*bestit);
+						m_qToStack.erase(bestit);
+						bReference = TRUE;
+					}
+					else
+						m_qToStack.clear();
+					bResult = TRUE;
 				};
 			}
 			else
 			{
-				// Can't find transformation - impossible to stack the image
-				strError.LoadString(IDS_NOSTACK_NOTRANSFORMATION);
-				bError = TRUE;
+				frame = m_qToStack.front();
+				m_qToStack.pop_front();
+				bResult = TRUE;
 			};
+		};
+	};
 
-			if (bWarning)
-			{
-				strText.Format(IDS_LOG_WARNING, (LPCTSTR)lfi.m_strFileName, (LPCTSTR) strWarning);
-				PostToLog(strText, TRUE, FALSE, TRUE, RGB(208, 127, 0));
-			};
-			if (bError)
-			{
-				strText.Format(IDS_LOG_IMAGENOTSTACKABLE1, (LPCTSTR)lfi.m_strFileName, (LPCTSTR) strError);
-				PostToLog(strText, TRUE, TRUE, FALSE, RGB(255, 0, 0));
-				PostChangeImageStatus(lfi.m_strFileName, IS_NOTSTACKABLE);
-				MoveImage(lfi.m_strFileName);
-			};
+	if (!bResult || !frame.m_strFileName.GetLength())
+		return bResult;
 
-			bResult = TRUE;
+	// There is room in the stacking queue
+	m_RegisterCondition.notify_all();
+
+	CLightFrameInfo &		lfi = frame.m_lfi;
+	const auto				tStart = std::chrono::steady_clock::now();
+	BOOL					bStacked = FALSE;
+
+	{
+		// Only used when a new stack is started
+		std::lock_guard<std::mutex>		Lock(m_SettingsMutex);
+
+		m_RunningStackingEngine.SetRejectOutliers(m_LiveSettings.IsStack_RejectOutliers());
+	}
+
+	if (bReference)
+	{
+		m_RunningStackingEngine.ComputeOffset(lfi);
+		PostUpdateImageOffsets(lfi.m_strFileName, 0, 0, 0);
+		StackFrame(lfi);
+		PostChangeImageStatus(lfi.m_strFileName, IS_STACKED);
+		PostChangeImageInfo(lfi.m_strFileName, II_SETREFERENCE);
+		{
+			std::lock_guard<std::mutex>		Lock(m_PipelineMutex);
+
+			m_bReferenceFrameSet = TRUE;
 		};
+		PostStackedImage();
 	}
-	if (m_bRegisteringOn && !bResult && m_qToRegister.size())
+	else
 	{
-		CString			strFileName;
+		double					fdX, fdY, fAngle;
+		CString					strError;
+		CString					strText;
+		BOOL					bError = FALSE;
+		BOOL					bWarning = FALSE;
+		CString					strWarning;
+
+		if (m_RunningStackingEngine.ComputeOffset(lfi))
+		{
+			lfi.m_BilinearParameters.Offsets(fdX, fdY);
+			fAngle = lfi.m_BilinearParameters.Angle(lfi.RenderedWidth()) * 180.0/M_PI;
+			PostUpdateImageOffsets(lfi.m_strFileName, fdX, fdY, fAngle);
+			PostChangeImageInfo(lfi.m_strFileName, II_DONTSTACK_NONE);
+			bWarning = IsImageWarning2(lfi.m_strFileName, fdX, fdY, fAngle, strWarning);
+			if (bWarning)
+				PostWarning(strWarning);
+			if (IsImageStackable2(lfi.m_strFileName, fdX, fdY, fAngle, strError))
+			{
+				StackFrame(lfi);
+				PostChangeImageStatus(lfi.m_strFileName, IS_STACKED);
 
-		strFileName = m_qToRegister.front();
-		m_qToRegister.pop_front();
-		PostUpdatePending();
-		if (IsFileAvailable(strFileName))
-			LoadFile(strFileName);
+				CPointExt		pt1, pt2, pt3, pt4;
+
+				lfi.m_BilinearParameters.Footprint(pt1, pt2, pt3, pt4);
+				PostFootprint(pt1, pt2, pt3, pt4);
+				PostStackedImage();
+			}
+			else
+			{
+				bError = TRUE;
+			};
+		}
 		else
-			m_qToRegister.push_back(strFileName);
-		bResult = TRUE;
+		{
+			// Can't find transformation - impossible to stack the image
+			strError.LoadString(IDS_NOSTACK_NOTRANSFORMATION);
+			bError = TRUE;
+		};
+
+		if (bWarning)
+		{
+			strText.Format(IDS_LOG_WARNING, (LPCTSTR)lfi.m_strFileName, (LPCTSTR) strWarning);
+			PostToLog(strText, TRUE, FALSE, TRUE, RGB(208, 127, 0));
+		};
+		if (bError)
+		{
+			strText.Format(IDS_LOG_IMAGENOTSTACKABLE1, (LPCTSTR)lfi.m_strFileName, (LPCTSTR) strError);
+			PostToLog(strText, TRUE, TRUE, FALSE, RGB(255, 0, 0));
+			PostChangeImageStatus(lfi.m_strFileName, IS_NOTSTACKABLE);
+			MoveImage(lfi.m_strFileName);
+		};
 	};
 
+	PostPipelineStats(frame, SecondsSince(tStart));
+
 	return bResult;
 };
 
@@ -588,6 +829,7 @@ void CLiveEngine::LiveEngine()
 	MSG					msg;
 
 	PeekMessage(&msg, nullptr, 0, 0, PM_NOREMOVE);
+	StartPipeline();
 	SetEvent(m_hEvent);
 	while (!bEnd && ::GetMessage(&msg, nullptr, 0, 0))
 	{
@@ -597,25 +839,40 @@ void CLiveEngine::LiveEngine()
 			CSmartPtr<CLiveEngineMsg>	pMsg;
 			if (GetMessage(&pMsg, m_InMessages))
 			{
+				std::unique_lock<std::mutex>	Lock(m_PipelineMutex);
+
 				// Do the stuff
 				switch (pMsg->GetMessage())
 				{
 				case LEM_NEWFILE :
 					{
-						CString				strFileName;
+						CLiveFrame			frame;
 
-						if (pMsg->GetNewFile(strFileName))
+						if (pMsg->GetNewFile(frame.m_strFileName))
 						{
+							CString			strText;
+
+							strText.Format(IDS_LOG_NEWFILE, (LPCTSTR)frame.m_strFileName);
+							PostToLog(strText, FALSE, FALSE, FALSE, RGB(0, 128, 0));
+
 							// Add the file to the to do list
-							m_qToRegister.push_back(strFileName);
+							frame.m_dwGeneration = m_dwGeneration;
+							frame.m_tQueued		 = std::chrono::steady_clock::now();
+							m_qToLoad.push_back(frame);
+							Lock.unlock();
 							PostUpdatePending();
 						};
 					};
 					break;
 				case LEM_UPDATESETTINGS :
-					m_LiveSettings.LoadFromRegistry();
+					{
+						std::lock_guard<std::mutex>		SettingsLock(m_SettingsMutex);
+
+						m_LiveSettings.LoadFromRegistry();
+					};
 					break;
 				case LEM_SAVESTACKEDIMAGE :
+					Lock.unlock();
 					SaveStackedImage();
 					break;
 				case LEM_ENABLESTACKING :
@@ -633,13 +890,18 @@ void CLiveEngine::LiveEngine()
 					m_bStackingOn    = FALSE;
 					break;
 				case LEM_CLEARSTACKEDIMAGE :
-					m_RunningStackingEngine.Clear();
 					m_bReferenceFrameSet = FALSE;
+					Lock.unlock();
+					m_RunningStackingEngine.Clear();
 					PostStackedImage();
 					break;
 				case LEM_CLEARPENDINGIMAGES :
+					// Frames being loaded or registered are dropped too
+					m_dwGeneration++;
+					m_qToLoad.clear();
 					m_qToRegister.clear();
 					m_qToStack.clear();
+					Lock.unlock();
 					PostUpdatePending();
 					break;
 				case LEM_STOP :
@@ -650,10 +912,16 @@ void CLiveEngine::LiveEngine()
 				};
 			};
 
+			// The state of the pipeline may have changed
+			m_LoadCondition.notify_all();
+			m_RegisterCondition.notify_all();
+
 			while (!bEnd && !::PeekMessage(&msg, nullptr, 0, 0, PM_NOREMOVE) && ProcessNext());
 			SetEvent(m_hEvent);
 		};
 	};
+
+	StopPipeline();
 };
 
 /* ------------------------------------------------------------------- */
@@ -837,10 +1105,53 @@ void CLiveEngine::PostUpdateImageOffsets(LPCTSTR szFileName, double fdX, double
 
 void CLiveEngine::PostUpdatePending()
 {
+	CSmartPtr<CLiveEngineMsg>	pMsg;
+	LONG						lNrPending;
+
+	{
+		std::lock_guard<std::mutex>		Lock(m_PipelineMutex);
+
+		lNrPending = (LONG)(m_qToLoad.size() + m_qToRegister.size());
+	};
+
+	pMsg.Create();
+	pMsg->SetPending(lNrPending);
+	PostOutMessage(pMsg);
+};
+
+/* ------------------------------------------------------------------- */
+
+void CLiveEngine::PostPipelineStats(const CLiveFrame & frame, double fStackTime)
+{
+	CLivePipelineStats			stats;
+
+	{
+		std::lock_guard<std::mutex>		Lock(m_PipelineMutex);
+
+		stats.m_lNrToLoad		= (LONG)m_qToLoad.size();
+		stats.m_lNrToRegister	= (LONG)m_qToRegister.size();
+		stats.m_lNrToStack		= (LONG)m_qToStack.size();
+	};
+	stats.m_fLoadTime		= frame.m_fLoadTime;
+	stats.m_fRegisterTime	= frame.m_fRegisterTime;
+	stats.m_fStackTime		= fStackTime;
+	stats.m_fTotalTime		= SecondsSince(frame.m_tQueued);
+
+	TCHAR						szName[_MAX_FNAME];
+	TCHAR						szExt[_MAX_EXT];
+	CString						strName;
+	CString						strText;
+
+	_tsplitpath(frame.m_strFileName, nullptr, nullptr, szName, szExt);
+	strName.Format(_T("%s%s"), szName, szExt);
+	strText.Format(IDS_LOG_PIPELINE, (LPCTSTR)strName, stats.m_fTotalTime, stats.m_fLoadTime, stats.m_fRegisterTime, stats.m_fStackTime,
+				   stats.m_lNrToLoad, stats.m_lNrToRegister, stats.m_lNrToStack);
+	PostToLog(strText, TRUE, FALSE, FALSE, RGB(0, 0, 128));
+
 	CSmartPtr<CLiveEngineMsg>	pMsg;
 
 	pMsg.Create();
-	pMsg->SetPending((LONG)(m_qToRegister.size()));
+	pMsg->SetPipelineStats(frame.m_strFileName, stats);
 	PostOutMessage(pMsg);
 };
 
@@ -855,12 +1166,13 @@ CLiveEngine::CLiveEngine()
 	m_bStackingOn		= FALSE;
 	m_bRegisteringOn	= TRUE;
 	m_bReferenceFrameSet = FALSE;
+	m_bStopPipeline		= false;
+	m_dwGeneration		= 0;
 	m_lNrUnsavedImages   = 0;
 	m_LiveSettings.LoadFromRegistry();
-    m_lTotal1 = 0;
-    m_lTotal2 = 0;
-    m_lAchieved1 = 0;
-    m_lAchieved2 = 0;
+	m_LoadProgress.SetLiveEngine(this);
+	m_RegisterProgress.SetLiveEngine(this);
+	m_StackProgress.SetLiveEngine(this);
 };
 
 /* ------------------------------------------------------------------- */
@@ -1061,21 +1373,21 @@ void	CLiveEngine::ClearAll()
 /* ------------------------------------------------------------------- */
 // DSSProgress methods
 
-void	CLiveEngine::GetStartText(CString & strText)
+void	CLiveEngineProgress::GetStartText(CString & strText)
 {
 	strText = m_strProgress1;
 };
 
 /* ------------------------------------------------------------------- */
 
-void	CLiveEngine::GetStart2Text(CString & strText)
+void	CLiveEngineProgress::GetStart2Text(CString & strText)
 {
 	strText = m_strProgress2;
 };
 
 /* ------------------------------------------------------------------- */
 
-void	CLiveEngine::Start(LPCTSTR szTitle, LONG lTotal1, BOOL bEnableCancel)
+void	CLiveEngineProgress::Start(LPCTSTR szTitle, LONG lTotal1, bool bEnableCancel)
 {
 	CString			strText = szTitle;
 
@@ -1084,7 +1396,7 @@ void	CLiveEngine::Start(LPCTSTR szTitle, LONG lTotal1, BOOL bEnableCancel)
 		m_strProgress1 = szTitle;
 		strText.Replace(_T("\n"), _T(" "));
 		strText += "\n";
-		PostToLog(strText, TRUE);
+		m_pLiveEngine->PostToLog(strText, TRUE);
 	};
 	if (lTotal1)
 		m_lTotal1      = lTotal1;
@@ -1093,20 +1405,20 @@ void	CLiveEngine::Start(LPCTSTR szTitle, LONG lTotal1, BOOL bEnableCancel)
 
 /* ------------------------------------------------------------------- */
 
-void	CLiveEngine::Progress1(LPCTSTR szText, LONG lAchieved1)
+void	CLiveEngineProgress::Progress1(LPCTSTR szText, LONG lAchieved1)
 {
 	if (szText)
 		m_strProgress1 = szText;
 	if (((double)(lAchieved1-m_lAchieved1)/(double)m_lTotal1) > 0.10)
 	{
-		PostProgress(m_strProgress1, lAchieved1, m_lTotal1);
+		m_pLiveEngine->PostProgress(m_strProgress1, lAchieved1, m_lTotal1);
 		m_lAchieved1 = lAchieved1;
 	};
 };
 
 /* ------------------------------------------------------------------- */
 
-void	CLiveEngine::Start2(LPCTSTR szText, LONG lTotal2)
+void	CLiveEngineProgress::Start2(LPCTSTR szText, LONG lTotal2)
 {
 	CString			strText = szText;
 
@@ -1115,7 +1427,7 @@ void	CLiveEngine::Start2(LPCTSTR szText, LONG lTotal2)
 		m_strProgress2 = szText;
 		strText.Replace(_T("\n"), _T(" "));
 		strText += "\n";
-		PostToLog(strText, TRUE);
+		m_pLiveEngine->PostToLog(strText, TRUE);
 	};
 	if (lTotal2)
 		m_lTotal2      = lTotal2;
@@ -1124,45 +1436,45 @@ void	CLiveEngine::Start2(LPCTSTR szText, LONG lTotal2)
 
 /* ------------------------------------------------------------------- */
 
-void	CLiveEngine::Progress2(LPCTSTR szText, LONG lAchieved2)
+void	CLiveEngineProgress::Progress2(LPCTSTR szText, LONG lAchieved2)
 {
 	if (szText)
 		m_strProgress2 = szText;
 	if ((((double)(lAchieved2-m_lAchieved2)/(double)m_lTotal2) > 0.10) ||
 		 (lAchieved2 == m_lTotal2))
 	{
-		PostProgress(m_strProgress2, lAchieved2, m_lTotal2);
+		m_pLiveEngine->PostProgress(m_strProgress2, lAchieved2, m_lTotal2);
 		m_lAchieved2 = lAchieved2;
 	};
 };
 
 /* ------------------------------------------------------------------- */
 
-void	CLiveEngine::End2()
+void	CLiveEngineProgress::End2()
 {
-	PostEndProgress();
+	m_pLiveEngine->PostEndProgress();
 };
 
 /* ------------------------------------------------------------------- */
 
-BOOL	CLiveEngine::IsCanceled()
+bool	CLiveEngineProgress::IsCanceled()
 {
-	return FALSE;
+	return false;
 };
 
 /* ------------------------------------------------------------------- */
 
-BOOL	CLiveEngine::Close()
+bool	CLiveEngineProgress::Close()
 {
-	PostEndProgress();
-	return TRUE;
+	m_pLiveEngine->PostEndProgress();
+	return true;
 };
 
 /* ------------------------------------------------------------------- */
 
-BOOL	CLiveEngine::Warning(LPCTSTR szText)
+bool	CLiveEngineProgress::Warning(LPCTSTR szText)
 {
-	return TRUE;
+	return true;
 };
 
 /* ------------------------------------------------------------------- */
@@ -3,6 +3,11 @@
 
 #include <queue>
 #include <list>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
 #include "DSSProgress.h"
 #include "DSSTools.h"
 #include "BitmapExt.h"
@@ -40,7 +45,8 @@ typedef enum tagLIVEENGINEMSG
 	LEM_STACKEDIMAGESAVED		= 22,
 	LEM_CLEARSTACKEDIMAGE		= 23,
 	LEM_CLEARPENDINGIMAGES		= 24,
-	LEM_SETFOOTPRINT			= 25
+	LEM_SETFOOTPRINT			= 25,
+	LEM_UPDATEPIPELINE			= 26
 }LIVEENGINEMSG;
 
 typedef enum tagIMAGESTATUS
@@ -75,6 +81,34 @@ typedef enum tagSTACKIMAGEINFO
 
 /* ------------------------------------------------------------------- */
 
+// Depths of the queues of the pipeline and time spent by a frame in each stage
+// (in seconds) when the frame leaves the pipeline
+class CLivePipelineStats
+{
+public :
+	LONG						m_lNrToLoad;
+	LONG						m_lNrToRegister;
+	LONG						m_lNrToStack;
+	double						m_fLoadTime;
+	double						m_fRegisterTime;
+	double						m_fStackTime;
+	double						m_fTotalTime;
+
+public :
+	CLivePipelineStats()
+	{
+		m_lNrToLoad		= 0;
+		m_lNrToRegister	= 0;
+		m_lNrToStack	= 0;
+		m_fLoadTime		= 0;
+		m_fRegisterTime	= 0;
+		m_fStackTime	= 0;
+		m_fTotalTime	= 0;
+	};
+};
+
+/* ------------------------------------------------------------------- */
+
 class CLiveEngineMsg : public CRefCount
 {
 private :
@@ -105,6 +139,7 @@ private :
 
 	STACKIMAGEINFO				m_ImageInfo;
 	LONG						m_lNrPending;
+	CLivePipelineStats			m_PipelineStats;
 
 public :
     CLiveEngineMsg()
@@ -281,6 +316,13 @@ public :
 		m_strText		= szWarning;
 	};
 
+	void	SetPipelineStats(LPCTSTR szFile, const CLivePipelineStats & stats)
+	{
+		m_Msg			= LEM_UPDATEPIPELINE;
+		m_strFile		= szFile;
+		m_PipelineStats	= stats;
+	};
+
 	BOOL	GetNewFile(CString & strFileName)
 	{
 		BOOL			bResult = FALSE;
@@ -466,6 +508,20 @@ public :
 
 		return bResult;
 	};
+
+	BOOL	GetPipelineStats(CString & strFile, CLivePipelineStats & stats)
+	{
+		BOOL			bResult = FALSE;
+
+		if (m_Msg == LEM_UPDATEPIPELINE)
+		{
+			strFile	= m_strFile;
+			stats	= m_PipelineStats;
+			bResult = TRUE;
+		};
+
+		return bResult;
+	};
 };
 
 typedef CSmartPtr<CLiveEngineMsg>				LIVEENGINEMSGPTR;
@@ -474,8 +530,87 @@ typedef LIVEENGINEMSGLIST::iterator				LIVEENGINEMSGITERATOR;
 
 /* ------------------------------------------------------------------- */
 
-class CLiveEngine : public CDSSProgress
+// A frame going through the load, register and stack stages
+class CLiveFrame
+{
+public :
+	CString						m_strFileName;
+	CBitmapInfo					m_BitmapInfo;
+	CSmartPtr<CMemoryBitmap>	m_pBitmap;
+	CLightFrameInfo				m_lfi;
+	DWORD						m_dwGeneration;
+	std::chrono::steady_clock::time_point	m_tQueued;
+	double						m_fLoadTime;
+	double						m_fRegisterTime;
+
+public :
+	CLiveFrame()
+	{
+		m_dwGeneration	= 0;
+		m_fLoadTime		= 0;
+		m_fRegisterTime	= 0;
+	};
+};
+
+/* ------------------------------------------------------------------- */
+
+class CLiveEngine;
+
+// Progress of one stage of the pipeline (each stage runs in its own thread)
+class CLiveEngineProgress : public CDSSProgress
 {
+private :
+	CLiveEngine *				m_pLiveEngine;
+	CString						m_strProgress1;
+	CString						m_strProgress2;
+	LONG						m_lTotal1,
+								m_lTotal2;
+	LONG						m_lAchieved1,
+								m_lAchieved2;
+
+public :
+	CLiveEngineProgress()
+	{
+		m_pLiveEngine	= nullptr;
+		m_lTotal1		= 0;
+		m_lTotal2		= 0;
+		m_lAchieved1	= 0;
+		m_lAchieved2	= 0;
+	};
+
+	virtual ~CLiveEngineProgress() {};
+
+	void	SetLiveEngine(CLiveEngine * pLiveEngine)
+	{
+		m_pLiveEngine = pLiveEngine;
+	};
+
+	virtual void	GetStartText(CString & strText);
+	virtual void	GetStart2Text(CString & strText);
+	virtual	void	Start(LPCTSTR szTitle, LONG lTotal1, bool bEnableCancel = true);
+	virtual void	Progress1(LPCTSTR szText, LONG lAchieved1);
+	virtual void	Start2(LPCTSTR szText, LONG lTotal2);
+	virtual void	Progress2(LPCTSTR szText, LONG lAchieved2);
+	virtual void	End2();
+	virtual bool	IsCanceled();
+	virtual bool	Close();
+	virtual bool	Warning(LPCTSTR szText);
+};
+
+/* ------------------------------------------------------------------- */
+
+typedef std::deque<CLiveFrame>					LIVEFRAMEQUEUE;
+
+// Maximum number of loaded frames waiting to be registered
+const size_t					LIVE_TOREGISTERDEPTH	= 2;
+// Maximum number of registered frames waiting to be stacked (once the
+// reference frame is set and as long as stacking is on)
+const size_t					LIVE_TOSTACKDEPTH		= 4;
+
+class CLiveEngine
+{
+	friend class CLiveEngineProgress;
+
 private :
 	CComAutoCriticalSection		m_CriticalSection;
 	LIVEENGINEMSGLIST			m_InMessages;
@@ -485,23 +620,54 @@ private :
 	DWORD						m_dwThreadID;
 	HANDLE						m_hEvent;
 	CLiveSettings				m_LiveSettings;
-	std::deque<CString>			m_qToRegister;
-	std::deque<CLightFrameInfo>	m_qToStack;
+	std::mutex					m_SettingsMutex;
+	CRunningStackingEngine		m_RunningStackingEngine;
+	LONG						m_lNrUnsavedImages;
+
+	// LibRaw, the RAW settings and the decoders are not thread safe: the files
+	// are decoded one at a time by the load stage and the engine thread.
+	// The file headers (GetFileInfo, used by the GUI thread and the load stage)
+	// are read one at a time under their own lock, which is never held during
+	// a decoding.
+	std::mutex					m_DecodeMutex;
+	std::mutex					m_InfoMutex;
+
+	// Pipeline: the engine thread stacks the frames, the loading and the
+	// registering are done by two worker threads.
+	// The queues and the flags below are protected by m_PipelineMutex.
+	std::mutex					m_PipelineMutex;
+	std::condition_variable		m_LoadCondition;
+	std::condition_variable		m_RegisterCondition;
+	std::thread					m_LoadThread;
+	std::thread					m_RegisterThread;
+	LIVEFRAMEQUEUE				m_qToLoad;
+	LIVEFRAMEQUEUE				m_qToRegister;
+	LIVEFRAMEQUEUE				m_qToStack;
+	DWORD						m_dwGeneration;
+	bool						m_bStopPipeline;
 	BOOL						m_bStackingOn;
 	BOOL						m_bRegisteringOn;
 	BOOL						m_bReferenceFrameSet;
-	CRunningStackingEngine		m_RunningStackingEngine;
-	LONG						m_lNrUnsavedImages;
+
+	CLiveEngineProgress			m_LoadProgress;
+	CLiveEngineProgress			m_RegisterProgress;
+	CLiveEngineProgress			m_StackProgress;
 
 private :
 	void	StartEngine();
 	void	CloseEngine();
+	void	StartPipeline();
+	void	StopPipeline();
+	void	LoadStage();
+	void	RegisterStage();
+	bool	IsStackQueueFull();
 	BOOL	GetMessage(CLiveEngineMsg ** ppMsg, LIVEENGINEMSGLIST & msglist);
 	void	PostOutMessage(CLiveEngineMsg * pMsg);
 	void	PostToLog(LPCTSTR szText, BOOL bDateTime = FALSE, BOOL bBold = FALSE, BOOL bItalic = FALSE, COLORREF crColor = RGB(0, 0, 0));
 	void	PostProgress(LPCTSTR szText, LONG lAchieved, LONG lTotal);
 	void	PostEndProgress();
 	void	PostUpdatePending();
+	void	PostPipelineStats(const CLiveFrame & frame, double fStackTime);
 	void	PostFileLoaded(CMemoryBitmap * pBitmap, C32BitsBitmap * pWndBitmap, LPCTSTR szFileName);
 	void	PostFileRegistered(LPCTSTR szFileName);
 	void	PostChangeImageStatus(LPCTSTR szFileName, IMAGESTATUS status);
@@ -516,7 +682,9 @@ private :
 	BOOL	IsImageStackable2(LPCTSTR szFile, double fdX, double fdY, double fAngle, CString & strError);
 	BOOL	IsImageWarning1(LPCTSTR szFile, double fStarCount, double fFWHM, double fScore, double fSkyBackground, CString & strWarning);
 	BOOL	IsImageWarning2(LPCTSTR szFile, double fdX, double fdY, double fAngle, CString & strWarning);
-	BOOL	LoadFile(LPCTSTR szFileName);
+	BOOL	LoadFile(CLiveFrame & frame);
+	BOOL	RegisterFile(CLiveFrame & frame);
+	BOOL	StackFrame(CLightFrameInfo & lfi);
 	BOOL	ProcessNext();
 	void	MoveImage(LPCTSTR szFileName);
 
@@ -532,6 +700,7 @@ public :
 	};
 
 	BOOL	IsFileAvailable(LPCTSTR szFileName);
+	BOOL	GetFileInfo(LPCTSTR szFileName, CBitmapInfo & BitmapInfo);
 
 	BOOL	GetMessage(CLiveEngineMsg ** ppMsg);
 	void	AddFileToProcess(LPCTSTR szFile);
@@ -544,27 +713,6 @@ public :
 	void	ClearStackedImage();
 	void	ClearPendingImages();
 	void	ClearAll();
-
-// DSSProgress methods
-private :
-	CString						m_strProgress1;
-	CString						m_strProgress2;
-	LONG						m_lTotal1,
-								m_lTotal2;
-	LONG						m_lAchieved1,
-								m_lAchieved2;
-
-public :
-	virtual void	GetStartText(CString & strText);
-	virtual void	GetStart2Text(CString & strText);
-	virtual	void	Start(LPCTSTR szTitle, LONG lTotal1, BOOL bEnableCancel = TRUE);
-	virtual void	Progress1(LPCTSTR szText, LONG lAchieved1);
-	virtual void	Start2(LPCTSTR szText, LONG lTotal2);
-	virtual void	Progress2(LPCTSTR szText, LONG lAchieved2);
-	virtual void	End2();
-	virtual BOOL	IsCanceled();
-	virtual BOOL	Close();
-	virtual BOOL	Warning(LPCTSTR szText);
 };
 
 /* ------------------------------------------------------------------- */
@@ -17,6 +17,7 @@ const DWORD					LSSF_SKY	= 0x00000020L;
 const DWORD					LSSF_DELAYED= 0x00010000L;
 const DWORD					LSSF_SAVE	= 0x00020000L;
 const DWORD					LSSF_MOVE	= 0x00040000L;
+const DWORD					LSSF_REJECTOUTLIERS	= 0x00080000L;
 
 const DWORD					LSWA_SOUND	= 0x00000001L;	// Warning Actions
 const DWORD					LSWA_FLASH	= 0x00000002L;
@@ -90,6 +91,7 @@ public :
 	BOOL	IsDontStack_Delayed()	{	return (m_dwStackingFlags & LSSF_DELAYED) ? TRUE : FALSE; };
 	BOOL	IsStack_Save()	{	return (m_dwStackingFlags & LSSF_SAVE) ? TRUE : FALSE; };
 	BOOL	IsStack_Move()	{	return (m_dwStackingFlags & LSSF_MOVE) ? TRUE : FALSE; };
+	BOOL	IsStack_RejectOutliers()	{	return (m_dwStackingFlags & LSSF_REJECTOUTLIERS) ? TRUE : FALSE; };
 
 	BOOL	IsWarning_Score()	{	return (m_dwWarningFlags & LSWF_SCORE) ? TRUE : FALSE; };
 	BOOL	IsWarning_Stars()	{	return (m_dwWarningFlags & LSWF_STARS) ? TRUE : FALSE; };
@@ -121,6 +123,7 @@ public :
 	void	SetDontStack_Delayed(BOOL bSet)	{ bSet ? (m_dwStackingFlags |= LSSF_DELAYED) : (m_dwStackingFlags &=~LSSF_DELAYED);};
 	void	SetStack_Save(BOOL bSet)	{ bSet ? (m_dwStackingFlags |= LSSF_SAVE) : (m_dwStackingFlags &=~LSSF_SAVE);};
 	void	SetStack_Move(BOOL bSet)	{ bSet ? (m_dwStackingFlags |= LSSF_MOVE) : (m_dwStackingFlags &=~LSSF_MOVE);};
+	void	SetStack_RejectOutliers(BOOL bSet)	{ bSet ? (m_dwStackingFlags |= LSSF_REJECTOUTLIERS) : (m_dwStackingFlags &=~LSSF_REJECTOUTLIERS);};
 
 	void	SetWarning_Score(BOOL bSet)		{ bSet ? (m_dwWarningFlags |= LSWF_SCORE) : (m_dwWarningFlags &=~LSWF_SCORE);};
 	void	SetWarning_Stars(BOOL bSet)		{ bSet ? (m_dwWarningFlags |= LSWF_STARS) : (m_dwWarningFlags &=~LSWF_STARS);};
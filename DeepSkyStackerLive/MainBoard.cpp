@@ -14,8 +14,6 @@
 #include <FrameInfo.h>
 #include <..\SMTP\PJNSMTP.h>
 
-const	DWORD			WM_FOLDERCHANGE	= WM_USER+100;
-
 #define TEXT_DARK RGB(200, 200, 200)
 #define TEXT_NORMAL RGB(255, 255, 255)
 #define GDI_TEXT_COLOUR m_bDarkMode ? Color(0xff000000 | TEXT_DARK) : Color(0xff000000 | TEXT_NORMAL)
@@ -42,7 +40,6 @@ CMainBoard::CMainBoard(CWnd* pParent /*=nullptr*/, bool bDarkMode /*=false*/)
 	: CDialog(CMainBoard::IDD, pParent),
 	m_bDarkMode(bDarkMode)
 {
-	m_ulSHRegister = 0;
 	m_bProgressing = FALSE;
 	m_bMonitoring  = FALSE;
 	m_bStacking	   = FALSE;
@@ -63,6 +60,8 @@ CMainBoard::CMainBoard(CWnd* pParent /*=nullptr*/, bool bDarkMode /*=false*/)
 
 CMainBoard::~CMainBoard()
 {
+	// The watcher posts the new files to this window from its own thread
+	m_FolderWatcher.Stop();
 }
 
 /* ------------------------------------------------------------------- */
@@ -93,11 +92,10 @@ BEGIN_MESSAGE_MAP(CMainBoard, CDialog)
 	ON_WM_ERASEBKGND()
 	ON_WM_SIZE()
 	ON_WM_LBUTTONDOWN()
-	ON_WM_TIMER()
 
 	ON_NOTIFY(NM_LINKCLICK, IDC_MONITOREDFOLDER, OnMonitoredFolder)
-	ON_MESSAGE(WM_FOLDERCHANGE, OnFolderChange)
 	ON_MESSAGE(WM_LIVEENGINE, OnLiveEngine)
+	ON_MESSAGE(WM_NEWFILE, OnNewFile)
 END_MESSAGE_MAP()
 
 /* ------------------------------------------------------------------- */
@@ -1026,6 +1024,56 @@ void CMainBoard::OnSize(UINT nType, int cx, int cy)
 
 /* ------------------------------------------------------------------- */
 
+static bool IsExcludedFile(LPCTSTR szFile, const CString & strExcluded)
+{
+	TCHAR			szExt[_MAX_EXT];
+	CString			strExt;
+
+	_tsplitpath(szFile, nullptr, nullptr, nullptr, szExt);
+	strExt = szExt;
+	strExt.MakeUpper();
+
+	return !strExt.GetLength() || (strExcluded.Find(strExt, 0) != -1);
+};
+
+/* ------------------------------------------------------------------- */
+
+static bool IsFileToProcess(LPCTSTR szFile, CLiveSettings & LiveSettings, CLiveEngine & LiveEngine)
+{
+	bool				bResult = false;
+	CBitmapInfo			bmpInfo;
+
+	if (LiveEngine.GetFileInfo(szFile, bmpInfo))
+	{
+		if (bmpInfo.m_strFileType=="RAW")
+			bResult = LiveSettings.IsProcess_RAW();
+		else if (bmpInfo.m_strFileType.Left(4)=="FITS")
+			bResult = LiveSettings.IsProcess_FITS();
+		else if (bmpInfo.m_strFileType.Left(4)=="TIFF")
+			bResult = LiveSettings.IsProcess_TIFF();
+		else
+			bResult = LiveSettings.IsProcess_Others();
+	};
+
+	return bResult;
+};
+
+/* ------------------------------------------------------------------- */
+
+static CString GetExcludedExtensions()
+{
+	CRegistry				reg;
+	CString					strExcluded;
+
+	if (!reg.LoadKey(REGENTRY_BASEKEY_LIVE, _T("Excluded"), strExcluded))
+		strExcluded = _T(".TMP;.BAK;.TEMP;.TXT");
+	strExcluded.MakeUpper();
+
+	return strExcluded;
+};
+
+/* ------------------------------------------------------------------- */
+
 void	CMainBoard::GetNewFilesInMonitoredFolder(std::vector<CString> & vFiles)
 {
 	CString					strFolder;
@@ -1033,14 +1081,10 @@ void	CMainBoard::GetNewFilesInMonitoredFolder(std::vector<CString> & vFiles)
 	CString					strFileMask;
 	HANDLE					hFindFiles;
 	CRegistry				reg;
-	std::vector<CString>	vDelayedFiles;
-	CString					strExcluded;
+	CString					strExcluded = GetExcludedExtensions();
 
 	vFiles.clear();
 	reg.LoadKey(REGENTRY_BASEKEY_LIVE, _T("MonitoredFolder"), strFolder);
-	if (!reg.LoadKey(REGENTRY_BASEKEY_LIVE, _T("Excluded"), strExcluded))
-		strExcluded = _T(".TMP;.BAK;.TEMP;.TXT");
-	strExcluded.MakeUpper();
 
 	strFolder += _T("\\");
 	strFileMask = strFolder;
@@ -1057,46 +1101,18 @@ void	CMainBoard::GetNewFilesInMonitoredFolder(std::vector<CString> & vFiles)
 			strFile += FindData.cFileName;
 
 			// Check that it is not a txt file
-			TCHAR			szExt[_MAX_EXT];
-			CString			strExt;
-
-			_tsplitpath(strFile, nullptr, nullptr, nullptr, szExt);
-			strExt = szExt;
-			strExt.MakeUpper();
-			if (strExt.GetLength() && (strExcluded.Find(strExt, 0) == -1))
+			if (!IsExcludedFile(strFile, strExcluded))
 			{
 				// Check that the file is not already in the all list
 				if (!std::binary_search(m_vAllFiles.begin(), m_vAllFiles.end(), strFile))
 				{
 					// Check that it is an image file which is to
-					// be processed
-					if (m_LiveEngine.IsFileAvailable(strFile))
-					{
-						CBitmapInfo			bmpInfo;
-
-						if (GetPictureInfo(strFile, bmpInfo))
-						{
-							BOOL			bAdd = FALSE;
-
-							if (bmpInfo.m_strFileType=="RAW")
-								bAdd = m_LiveSettings.IsProcess_RAW();
-							else if (bmpInfo.m_strFileType.Left(4)=="FITS")
-								bAdd = m_LiveSettings.IsProcess_FITS();
-							else if (bmpInfo.m_strFileType.Left(4)=="TIFF")
-								bAdd = m_LiveSettings.IsProcess_TIFF();
-							else
-								bAdd = m_LiveSettings.IsProcess_Others();
-
-							if (bAdd)
-								vFiles.push_back(strFile);
-						};
-					}
-					else
-					{
-						// Remove the file from the all files list and
-						// put the timer to try again in 10 seconds
-						vDelayedFiles.push_back(strFile);
-					};
+					// be processed.
+					// The files which are still being written are
+					// reported later by the folder watcher.
+					if (m_LiveEngine.IsFileAvailable(strFile) &&
+						IsFileToProcess(strFile, m_LiveSettings, m_LiveEngine))
+						vFiles.push_back(strFile);
 				};
 			};
 		}
@@ -1105,30 +1121,12 @@ void	CMainBoard::GetNewFilesInMonitoredFolder(std::vector<CString> & vFiles)
 		FindClose(hFindFiles);
 
 		std::sort(vFiles.begin(), vFiles.end());
-
-		if (vDelayedFiles.size() && m_ulSHRegister)
-		{
-			// Use and alternate method
-			DWORD			dwPollingTime = 10;
-
-			reg.LoadKey(REGENTRY_BASEKEY_LIVE, _T("PollingTime"), dwPollingTime);
-
-			SetTimer(1, dwPollingTime*1000, nullptr);
-		};
 	};
 };
 
 /* ------------------------------------------------------------------- */
-// The lParam value contains the event SHCNE_xxxx
-// The wParam value supplies the SHNOTIFYSTRUCT
 
-typedef struct
-{
-    DWORD dwItem1;    // dwItem1 contains the previous PIDL or name of the folder.
-    DWORD dwItem2;    // dwItem2 contains the new PIDL or name of the folder.
-} SHNOTIFYSTRUCT;
-
-LRESULT CMainBoard::OnFolderChange(WPARAM wParam, LPARAM lParam)
+void CMainBoard::AddNewFilesToProcess()
 {
 	std::vector<CString>		vFiles;
 	std::vector<CString>		vNewFiles;
@@ -1152,7 +1150,7 @@ LRESULT CMainBoard::OnFolderChange(WPARAM wParam, LPARAM lParam)
 		{
 			CBitmapInfo				BitmapInfo;
 
-			if (GetPictureInfo(vNewFiles[i], BitmapInfo))
+			if (m_LiveEngine.GetFileInfo(vNewFiles[i], BitmapInfo))
 				vBitmapInfos.push_back(BitmapInfo);
 		};
 
@@ -1166,122 +1164,144 @@ LRESULT CMainBoard::OnFolderChange(WPARAM wParam, LPARAM lParam)
 			m_vAllFiles.push_back(vNewFiles[i]);
 		std::sort(m_vAllFiles.begin(), m_vAllFiles.end());
 
+		// Each file is logged by the live engine when it is queued
 		strNewFiles.Format(IDS_LOG_NEWFILESFOUND, vNewFiles.size());
 		AddToLog(strNewFiles, TRUE, FALSE, FALSE, LOG_GREEN_TEXT);
 		for (LONG i = 0;i<vNewFiles.size();i++)
-		{
-			strNewFiles.Format(IDS_LOG_NEWFILE, (LPCTSTR)vNewFiles[i]);
-			AddToLog(strNewFiles, FALSE, FALSE, FALSE, LOG_GREEN_TEXT);
 			m_LiveEngine.AddFileToProcess(vNewFiles[i]);
-		};
 	};
-
-	return 1;
 };
 
 /* ------------------------------------------------------------------- */
 
-void CMainBoard::OnTimer(UINT_PTR nIDEvent)
+bool CMainBoard::StartFolderWatcher(LPCTSTR szFolder)
 {
-	if (nIDEvent)
+	CRegistry							reg;
+	DWORD								dwPollingTime = 10;
+	std::vector<std::filesystem::path>	vKnownFiles;
+	const HWND							hWnd = GetSafeHwnd();
+
+	reg.LoadKey(REGENTRY_BASEKEY_LIVE, _T("PollingTime"), dwPollingTime);
+
+	// All the files already in the folder are known, except the ones that are
+	// still being written: the watcher reports them once they are complete
+	const CString						strExcluded = GetExcludedExtensions();
+	std::error_code						ec;
+
+	for (const auto & Entry : std::filesystem::directory_iterator(std::filesystem::path(szFolder), ec))
 	{
-		if (m_ulSHRegister)
-			KillTimer(nIDEvent);
-		OnFolderChange(0, 0);
+		const CString			strFile(Entry.path().c_str());
+
+		if (!Entry.is_regular_file(ec))
+			continue;
+
+		if (std::binary_search(m_vAllFiles.begin(), m_vAllFiles.end(), strFile) ||
+			IsExcludedFile(strFile, strExcluded) ||
+			m_LiveEngine.IsFileAvailable(strFile))
+			vKnownFiles.push_back(Entry.path());
 	};
+
+	// The new files are only queued by the watcher thread: they are checked
+	// and given to the live engine by OnNewFile, the monitored folder is never
+	// rescanned
+	return m_FolderWatcher.Start(std::filesystem::path(szFolder), dwPollingTime, vKnownFiles,
+		[this, hWnd](const std::filesystem::path & File)
+		{
+			{
+				std::lock_guard<std::mutex>		Lock(m_NewFilesMutex);
+
+				m_vNewFiles.emplace_back(File.c_str());
+			}
+			::PostMessage(hWnd, WM_NEWFILE, 0, 0);
+		});
 };
 
 /* ------------------------------------------------------------------- */
 
-void CMainBoard::OnMonitor()
+void CMainBoard::StopFolderWatcher()
 {
-	HRESULT					hResult;
-	CComPtr<IShellFolder>	pIShellFolder;
-	CComPtr<IBindCtx>		pIBindCtx;
-	SHChangeNotifyEntry		shCNE;
-	LPITEMIDLIST			ppidl;
-	BOOL					bUseExisting = FALSE;
+	m_FolderWatcher.Stop();
+
+	// Drop the files reported before the watcher was stopped
+	std::lock_guard<std::mutex>		Lock(m_NewFilesMutex);
+
+	m_vNewFiles.clear();
+};
+
+/* ------------------------------------------------------------------- */
+
+LRESULT CMainBoard::OnNewFile(WPARAM, LPARAM)
+{
+	std::vector<CString>		vNewFiles;
 
-	if (m_ulSHRegister)
-	{
-		SHChangeNotifyDeregister(m_ulSHRegister);
-		m_ulSHRegister = 0;
-	};
-	KillTimer(1);
-	try
 	{
-		CRegistry				reg;
-		CString					strFolder;
-		std::vector<CString>	vNewFiles;
+		std::lock_guard<std::mutex>		Lock(m_NewFilesMutex);
 
-		reg.LoadKey(REGENTRY_BASEKEY_LIVE, _T("MonitoredFolder"), strFolder);
+		vNewFiles.swap(m_vNewFiles);
+	}
 
-		m_vAllFiles.clear();
-		GetNewFilesInMonitoredFolder(vNewFiles);
+	if (vNewFiles.size())
+	{
+		CString						strExcluded = GetExcludedExtensions();
 
-		if (!m_lNrStacked && !m_lNrPending && vNewFiles.size())
+		for (const CString & strFile : vNewFiles)
 		{
-			// Ask if the user want to use existing images
-			CString			strText;
-			int				nResult;
+			if (!IsExcludedFile(strFile, strExcluded) &&
+				IsFileToProcess(strFile, m_LiveSettings, m_LiveEngine))
+				m_LiveEngine.AddFileToProcess(strFile);
+		};
+	};
 
-			strText.Format(IDS_USEEXISTINGIMAGES, vNewFiles.size());
+	return 0;
+};
 
-			nResult = AfxMessageBox(strText, MB_YESNO | MB_ICONQUESTION);
-			if (nResult == IDYES)
-			{
-				m_vAllFiles.clear();
-				bUseExisting = TRUE;
-			};
-		}
-		else
-			m_vAllFiles = std::move(vNewFiles);
+/* ------------------------------------------------------------------- */
 
-		hResult = SHGetDesktopFolder(&pIShellFolder);
-		if (hResult != S_OK)
-			throw(hResult);
-		hResult = CreateBindCtx(0, &pIBindCtx);
-		if (hResult != S_OK)
-			throw(hResult);
+void CMainBoard::OnMonitor()
+{
+	BOOL					bUseExisting = FALSE;
+	CRegistry				reg;
+	CString					strFolder;
+	std::vector<CString>	vNewFiles;
 
-		hResult = pIShellFolder->ParseDisplayName(nullptr, pIBindCtx, CComBSTR(strFolder), nullptr, &ppidl, nullptr);
-		if (hResult != S_OK)
-			throw(hResult);
+	StopFolderWatcher();
 
-		shCNE.fRecursive = FALSE;
-		shCNE.pidl		 = ppidl;
-		m_ulSHRegister = SHChangeNotifyRegister(m_hWnd, SHCNE_DISKEVENTS, SHCNE_ALLEVENTS, WM_FOLDERCHANGE, 1, &shCNE);
+	reg.LoadKey(REGENTRY_BASEKEY_LIVE, _T("MonitoredFolder"), strFolder);
 
-		if (!m_ulSHRegister)
-		{
-			// Use and alternate method
-			DWORD			dwPollingTime = 10;
+	m_vAllFiles.clear();
+	GetNewFilesInMonitoredFolder(vNewFiles);
 
-			reg.LoadKey(REGENTRY_BASEKEY_LIVE, _T("PollingTime"), dwPollingTime);
+	if (!m_lNrStacked && !m_lNrPending && vNewFiles.size())
+	{
+		// Ask if the user want to use existing images
+		CString			strText;
+		int				nResult;
 
-			SetTimer(1, dwPollingTime*1000, nullptr);
-		};
+		strText.Format(IDS_USEEXISTINGIMAGES, vNewFiles.size());
 
-		//if (m_ulSHRegister)
-		{
-			CString			strText;
+		nResult = AfxMessageBox(strText, MB_YESNO | MB_ICONQUESTION);
+		if (nResult == IDYES)
+			bUseExisting = TRUE;
+	};
 
-			strText.Format(IDS_LOG_STARTMONITORING, (LPCTSTR)strFolder);
-			AddToLog(strText, TRUE, TRUE, FALSE, LOG_GREEN_TEXT);
-		}
-		/*else
-		{
-			CString			strText;
+	// The existing images that are not used are never processed
+	if (!bUseExisting)
+		m_vAllFiles = std::move(vNewFiles);
 
-			strText.Format(IDS_LOG_ERRORSTARTMONITORING, (LPCTSTR)strFolder);
-			AddToLog(strText, TRUE, TRUE, FALSE, LOG_GREEN_TEXT);
-		};*/
+	if (bUseExisting)
+		AddNewFilesToProcess();
 
-		if (bUseExisting)
-			OnFolderChange(0, 0);
+	CString			strText;
+
+	if (StartFolderWatcher(strFolder))
+	{
+		strText.Format(IDS_LOG_STARTMONITORING, (LPCTSTR)strFolder);
+		AddToLog(strText, TRUE, TRUE, FALSE, LOG_GREEN_TEXT);
 	}
-	catch(HRESULT )
+	else
 	{
+		strText.Format(IDS_LOG_ERRORSTARTMONITORING, (LPCTSTR)strFolder);
+		AddToLog(strText, TRUE, TRUE, FALSE, LOG_RED_TEXT);
 	};
 };
 
@@ -1289,8 +1309,8 @@ void CMainBoard::OnMonitor()
 
 void CMainBoard::OnStop()
 {
-	KillTimer(1);
-	if (m_bMonitoring/*m_ulSHRegister*/)
+	StopFolderWatcher();
+	if (m_bMonitoring)
 	{
 		CRegistry			reg;
 		CString				strFolder;
@@ -1300,10 +1320,6 @@ void CMainBoard::OnStop()
 
 		strText.Format(IDS_LOG_STOPMONITORING, (LPCTSTR)strFolder);
 		AddToLog(strText, TRUE, TRUE, FALSE, LOG_RED_TEXT);
-
-		if (m_ulSHRegister)
-			SHChangeNotifyDeregister(m_ulSHRegister);
-		m_ulSHRegister = 0;
 	};
 };
 
@@ -1311,7 +1327,7 @@ void CMainBoard::OnStop()
 
 void CMainBoard::OnStack()
 {
-	if (m_bMonitoring/*m_ulSHRegister*/)
+	if (m_bMonitoring)
 	{
 		CRegistry			reg;
 		CString				strFolder;
@@ -1429,6 +1445,15 @@ LRESULT CMainBoard::OnLiveEngine(WPARAM, LPARAM)
 					InvalidateStats();
 			}
 			break;
+		case LEM_UPDATEPIPELINE :
+			{
+				CString						strFileName;
+				CLivePipelineStats			stats;
+
+				if (pMsg->GetPipelineStats(strFileName, stats))
+					AddPipelineStatsToGraph(stats);
+			};
+			break;
 		case LEM_FILELOADED :
 			{
 				CSmartPtr<CMemoryBitmap>	pBitmap;
@@ -7,8 +7,11 @@
 #include "label.h"
 #include "LiveEngine.h"
 #include "LiveSettings.h"
+#include "FolderWatcher.h"
 #include <ControlPos.h>
 
+const DWORD						WM_NEWFILE		= WM_USER + 201;
+
 
 // CMainBoard dialog
 
@@ -46,9 +49,8 @@ protected :
 	afx_msg void OnMonitor();
 	afx_msg void OnStack();
 	afx_msg void OnStop();
-	afx_msg LRESULT OnFolderChange(WPARAM, LPARAM);
 	afx_msg LRESULT OnLiveEngine(WPARAM, LPARAM);
-	afx_msg void OnTimer(UINT_PTR nIDEvent);
+	afx_msg LRESULT OnNewFile(WPARAM, LPARAM);
 
 	virtual BOOL OnInitDialog();
 
@@ -70,10 +72,12 @@ private :
 	CStatic					m_Warnings;
 	CStatic					m_Stats;
 
-	ULONG					m_ulSHRegister;
 	std::vector<CString>	m_vAllFiles;
 
 	CLiveEngine				m_LiveEngine;
+	CFolderWatcher			m_FolderWatcher;
+	std::mutex				m_NewFilesMutex;	// The new files are reported from the watcher thread
+	std::vector<CString>	m_vNewFiles;
 
 	BOOL					m_bProgressing;
 	CString					m_strProgress;
@@ -103,6 +107,9 @@ private :
 	BOOL	ChangeMonitoredFolder();
 	BOOL	CheckRestartMonitoring();
 	void	GetNewFilesInMonitoredFolder(std::vector<CString> & vFiles);
+	void	AddNewFilesToProcess();
+	bool	StartFolderWatcher(LPCTSTR szFolder);
+	void	StopFolderWatcher();
 	void	InvalidateProgress();
 	void	InvalidateButtons();
 	void	InvalidateStats();
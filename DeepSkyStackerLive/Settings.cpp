@@ -78,6 +78,7 @@ void CSettingsTab::DoDataExchange(CDataExchange* pDX)
 	DDX_Control(pDX, IDC_PROCESS_TIFF, m_Process_TIFF);
 	DDX_Control(pDX, IDC_PROCESS_OTHERS, m_Process_Others);
 	DDX_Control(pDX, IDC_DARKTHEME, m_DarkTheme);
+	DDX_Control(pDX, IDC_REJECTOUTLIERS, m_RejectOutliers);
 }
 
 /* ------------------------------------------------------------------- */
@@ -112,6 +113,7 @@ BEGIN_MESSAGE_MAP(CSettingsTab, CDialog)
 	ON_EN_CHANGE(IDC_ANGLE, OnChangeSetting)
 	ON_EN_CHANGE(IDC_MAX_SKYBACKGROUND, OnChangeSetting)
 	ON_BN_CLICKED(IDC_DARKTHEME, OnChangeSetting)
+	ON_BN_CLICKED(IDC_REJECTOUTLIERS, OnChangeSetting)
 
 	ON_BN_CLICKED(IDC_WARN_SOUND, OnChangeSetting)
 	ON_BN_CLICKED(IDC_WARN_FLASH, OnChangeSetting)
@@ -250,6 +252,7 @@ void CSettingsTab::UpdateFromRegistry()
 
 	m_SaveStackedImage.SetCheck(m_LiveSettings.IsStack_Save());
 	m_MoveNonStackable.SetCheck(m_LiveSettings.IsStack_Move());
+	m_RejectOutliers.SetCheck(m_LiveSettings.IsStack_RejectOutliers());
 
 	m_Warn_Flash.SetCheck(m_LiveSettings.IsWarning_Flash());
 	m_Warn_Sound.SetCheck(m_LiveSettings.IsWarning_Sound());
@@ -320,6 +323,7 @@ void CSettingsTab::SaveToRegistry()
 
 	m_LiveSettings.SetStack_Save(m_SaveStackedImage.GetCheck());
 	m_LiveSettings.SetStack_Move(m_MoveNonStackable.GetCheck());
+	m_LiveSettings.SetStack_RejectOutliers(m_RejectOutliers.GetCheck());
 
 	m_LiveSettings.SetWarning_Flash(m_Warn_Flash.GetCheck());
 	m_LiveSettings.SetWarning_Sound(m_Warn_Sound.GetCheck());
@@ -109,6 +109,7 @@ private :
 	CButton				m_Process_TIFF;
 	CButton				m_Process_Others;
 	CButton				m_DarkTheme;
+	CButton				m_RejectOutliers;
 
 	BOOL m_bDarkMode;
 
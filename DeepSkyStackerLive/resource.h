@@ -131,6 +131,8 @@
 #define IDC_MOVENONSTACKABLE            1064
 #define IDC_COPYTOCLIPBOARD             1065
 #define IDC_BACKGROUND                  1066
+#define IDC_PIPELINE                    1067
+#define IDC_REJECTOUTLIERS              1068
 #define IDS_CREATEMASTERDARK            1100
 #define IDS_CREATEMASTEROFFSET          1101
 #define IDS_ADDOFFSET                   1102
@@ -294,6 +296,7 @@
 #define IDS_ERRORMOVINGFILE             42043
 #define IDS_FILEMOVED                   42044
 #define IDS_NOSTACK_SKYBACKGROUND       42045
+#define IDS_LOG_PIPELINE                42046
 
 // Next default values for new objects
 // 
@@ -301,7 +304,7 @@
 #ifndef APSTUDIO_READONLY_SYMBOLS
 #define _APS_NEXT_RESOURCE_VALUE        140
 #define _APS_NEXT_COMMAND_VALUE         32771
-#define _APS_NEXT_CONTROL_VALUE         1067
+#define _APS_NEXT_CONTROL_VALUE         1069
 #define _APS_NEXT_SYMED_VALUE           101
 #endif
 #endif
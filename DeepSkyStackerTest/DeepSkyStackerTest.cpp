@@ -0,0 +1,59 @@
+// DeepSkyStackerTest.cpp : unit tests of the kernels shared by DeepSkyStacker,
+// DeepSkyStackerCL and DeepSkyStackerLive.
+// Returns 0 when all the tests pass (the project runs it after each build).
+// With /BENCH the kernels are also timed.
+//
+
+#include <stdafx.h>
+#include "DeepSkyStackerTest.h"
+#include "avx_simd.h"
+
+/* ------------------------------------------------------------------- */
+
+namespace
+{
+	typedef int (*TESTFUNCTION)(std::vector<std::string> & errors);
+
+	// Runs a test and prints its failures, returns false if it failed
+	bool	RunTest(LPCSTR szName, TESTFUNCTION pTest)
+	{
+		std::vector<std::string>	vErrors;
+		const int					lNrErrors = pTest(vErrors);
+
+		for (const std::string & strError : vErrors)
+			printf("  %s\n", strError.c_str());
+		printf("%s: %d error(s)\n", szName, lNrErrors);
+
+		return !lNrErrors;
+	};
+};
+
+/* ------------------------------------------------------------------- */
+
+int _tmain(int argc, _TCHAR* argv[])
+{
+	bool				bResult = true;
+
+	printf("SIMD instruction set of this CPU: %s\n\n", SimdKernels::isaName(SimdKernels::cpuIsa()));
+
+	bResult = RunTest("SIMD kernels", TestSimdKernels) && bResult;
+	bResult = RunTest("Median kernels", TestMedianKernels) && bResult;
+
+	if (argc == 2 && !_tcsicmp(argv[1], _T("/BENCH")))
+	{
+		std::vector<std::string>	vErrors;
+		std::vector<std::string>	vTimings;
+
+		printf("\n");
+		if (BenchMedianKernels(vErrors, vTimings))
+			bResult = false;
+		for (const std::string & strTiming : vTimings)
+			printf("%s\n", strTiming.c_str());
+		for (const std::string & strError : vErrors)
+			printf("  %s\n", strError.c_str());
+	};
+
+	printf(bResult ? "\nAll the tests passed\n" : "\nSome tests failed\n");
+
+	return bResult ? 0 : 1;
+}
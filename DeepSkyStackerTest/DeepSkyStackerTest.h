@@ -0,0 +1,12 @@
+#pragma once
+
+/* ------------------------------------------------------------------- */
+
+// Unit tests of the DeepSkyStacker kernels, run by DeepSkyStackerTest.cpp.
+// Each test returns the number of failures, which are described in errors.
+
+int	TestSimdKernels(std::vector<std::string> & errors);
+int	TestMedianKernels(std::vector<std::string> & errors);
+
+// Timings of the median kernels (/BENCH), the results of the kernels being compared
+int	BenchMedianKernels(std::vector<std::string> & errors, std::vector<std::string> & timings);
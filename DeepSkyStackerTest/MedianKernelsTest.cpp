@@ -0,0 +1,221 @@
+#include "stdafx.h"
+#include "DeepSkyStackerTest.h"
+#include "avx_median.h"
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Comparison of the median kernels with qMedian (TestMedianKernels) and timings of the three kernels
+// (BenchMedianKernels, DeepSkyStackerTest /BENCH).
+//
+// The sets of values are the ones of a per pixel combine: 1 to maxFrames frames of 16 bit, 32 bit (shifted by 16 bits
+// after the zero test) or float bitmaps, some of the values being 0 (ignored).
+// FastMedian and LineMedian must return exactly what qMedian returns. The timings are the average time of one median,
+// including the gathering of the values of the pixel for qMedian and FastMedian, as done by the per pixel path.
+
+namespace
+{
+	constexpr int maxFrames = 100;
+	constexpr int lineWidth = 3 * Medianhelper::BatchSize + 5;
+	constexpr int nrTimedColumns = 1 << 14;
+	constexpr int timedFrames[] = { 5, 10, 16, 24, 32, 40, 64, 100 };
+
+	template <class T>
+	constexpr int valueShift = (std::is_integral<T>::value && sizeof(T) == 4) ? 16 : 0;
+
+	template <class T>
+	class CMedianCheck
+	{
+	private:
+		const char* const typeName;
+		std::vector<std::string>& errors;
+		std::mt19937 generator;
+		std::vector<T> work;
+
+	public:
+		CMedianCheck(const char* const name, std::vector<std::string>& e) :
+			typeName{ name },
+			errors{ e },
+			generator{ 1234 }
+		{}
+
+	private:
+		static T shifted(const T value) noexcept
+		{
+			if constexpr (valueShift<T> != 0)
+				return value >> valueShift<T>;
+			else
+				return value;
+		}
+
+		void fail(const char* const kernelName, const int nrFrames, const char* const data)
+		{
+			errors.push_back(std::string{ typeName } + " " + kernelName + ": " + std::to_string(nrFrames) + " frame(s), " + data);
+		}
+
+		// One value out of zeroRatio is 0 (none if zeroRatio is 0). With narrow values there are many ties.
+		std::vector<T> randomValues(const size_t size, const int zeroRatio, const bool narrow)
+		{
+			std::uniform_int_distribution<int> zeroDistribution{ 0, zeroRatio > 0 ? zeroRatio - 1 : 0 };
+			std::uniform_int_distribution<unsigned> wordDistribution{ 1, narrow ? 16u : 65535u };
+			std::vector<T> values(size);
+
+			for (auto& value : values)
+			{
+				if (zeroRatio > 0 && zeroDistribution(generator) == 0)
+					value = T{ 0 };
+				else if constexpr (std::is_floating_point<T>::value)
+					value = narrow ? static_cast<T>(wordDistribution(generator)) : std::uniform_real_distribution<T>{ 1, 65535 }(generator);
+				else if constexpr (valueShift<T> != 0)
+					value = static_cast<T>((wordDistribution(generator) << 16) | (wordDistribution(generator) & 0xffff));
+				else
+					value = static_cast<T>(wordDistribution(generator));
+			}
+			return values;
+		}
+
+		// Lines of 2 * width values, the pixels are in the second half (like the green plane of a color bitmap).
+		std::vector<std::vector<T>> randomLines(const int nrFrames, const int width, const int zeroRatio, const bool narrow)
+		{
+			std::vector<std::vector<T>> lines;
+			for (int f = 0; f < nrFrames; ++f)
+				lines.push_back(randomValues(2 * static_cast<size_t>(width), zeroRatio, narrow));
+			return lines;
+		}
+
+		static std::vector<void*> scanLines(std::vector<std::vector<T>>& lines)
+		{
+			std::vector<void*> vScanLines;
+			for (auto& line : lines)
+				vScanLines.push_back(line.data());
+			return vScanLines;
+		}
+
+		// Median of the non zero values of the column c, with qMedian or FastMedian
+		template <bool Reference>
+		T columnMedian(const std::vector<std::vector<T>>& lines, const size_t c)
+		{
+			work.clear();
+			for (const auto& line : lines)
+				if (line[c] != T{ 0 })
+					work.push_back(shifted(line[c]));
+
+			const int N = static_cast<int>(work.size());
+			if (N == 0)
+				return T{ 0 };
+			if constexpr (Reference)
+				return qMedian(work.data(), N, N / 2);
+			else
+				return FastMedian(work.data(), N);
+		}
+
+		void checkFastMedian(const int nrFrames, const bool narrow)
+		{
+			const std::vector<T> values = randomValues(nrFrames, 0, narrow);
+			std::vector<T> reference = values;
+			std::vector<T> fast = values;
+
+			if (qMedian(reference.data(), nrFrames, nrFrames / 2) != FastMedian(fast.data(), nrFrames))
+				fail("FastMedian", nrFrames, narrow ? "narrow values" : "wide values");
+		}
+
+		void checkLineMedian(const int nrFrames, const int zeroRatio, const bool narrow)
+		{
+			std::vector<std::vector<T>> lines = randomLines(nrFrames, lineWidth, zeroRatio, narrow);
+			std::vector<T> medians(lineWidth);
+
+			LineMedian<T>(scanLines(lines), lineWidth, lineWidth, valueShift<T>, medians.data());
+			for (int c = 0; c < lineWidth; ++c)
+			{
+				if (medians[c] != columnMedian<true>(lines, lineWidth + static_cast<size_t>(c)))
+				{
+					fail("LineMedian", nrFrames, zeroRatio > 0 ? "with zero values" : "without zero value");
+					break;
+				}
+			}
+		}
+
+		void timeKernels(const int nrFrames, std::vector<std::string>& timings)
+		{
+			using Clock = std::chrono::steady_clock;
+			std::vector<std::vector<T>> lines = randomLines(nrFrames, nrTimedColumns, 0, false);
+			const std::vector<void*> vScanLines = scanLines(lines);
+			std::vector<T> medians(nrTimedColumns);
+			double qMedianSum = 0, fastMedianSum = 0, lineMedianSum = 0;
+
+			const auto nsPerMedian = [](const Clock::time_point start) -> double
+			{
+				return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / nrTimedColumns;
+			};
+
+			Clock::time_point start = Clock::now();
+			for (int c = 0; c < nrTimedColumns; ++c)
+				qMedianSum += static_cast<double>(columnMedian<true>(lines, nrTimedColumns + static_cast<size_t>(c)));
+			const double qMedianTime = nsPerMedian(start);
+
+			start = Clock::now();
+			for (int c = 0; c < nrTimedColumns; ++c)
+				fastMedianSum += static_cast<double>(columnMedian<false>(lines, nrTimedColumns + static_cast<size_t>(c)));
+			const double fastMedianTime = nsPerMedian(start);
+
+			start = Clock::now();
+			LineMedian<T>(vScanLines, nrTimedColumns, nrTimedColumns, valueShift<T>, medians.data());
+			const double lineMedianTime = nsPerMedian(start);
+
+			for (const T median : medians)
+				lineMedianSum += static_cast<double>(median);
+			if (fastMedianSum != qMedianSum || lineMedianSum != qMedianSum)
+				fail("timings", nrFrames, "different medians");
+
+			char szTiming[200];
+			snprintf(szTiming, sizeof(szTiming), "%-6s %3d frames: qMedian %7.1f ns, FastMedian %7.1f ns, LineMedian %7.1f ns",
+				typeName, nrFrames, qMedianTime, fastMedianTime, lineMedianTime);
+			timings.push_back(szTiming);
+		}
+
+	public:
+		void run()
+		{
+			for (const bool narrow : { false, true })
+			{
+				for (int nrFrames = 1; nrFrames <= maxFrames; ++nrFrames)
+				{
+					checkFastMedian(nrFrames, narrow);
+					checkLineMedian(nrFrames, 0, narrow);
+					checkLineMedian(nrFrames, 4, narrow);
+				}
+			}
+		}
+
+		void bench(std::vector<std::string>& timings)
+		{
+			for (const int nrFrames : timedFrames)
+				timeKernels(nrFrames, timings);
+		}
+	};
+}
+
+int TestMedianKernels(std::vector<std::string>& errors)
+{
+	const size_t nrErrors = errors.size();
+
+	CMedianCheck<WORD>{ "16 bit", errors }.run();
+	CMedianCheck<unsigned long>{ "32 bit", errors }.run();
+	CMedianCheck<float>{ "float", errors }.run();
+
+	return static_cast<int>(errors.size() - nrErrors);
+}
+
+int BenchMedianKernels(std::vector<std::string>& errors, std::vector<std::string>& timings)
+{
+	const size_t nrErrors = errors.size();
+
+	CMedianCheck<WORD>{ "16 bit", errors }.bench(timings);
+	CMedianCheck<unsigned long>{ "32 bit", errors }.bench(timings);
+	CMedianCheck<float>{ "float", errors }.bench(timings);
+
+	return static_cast<int>(errors.size() - nrErrors);
+}
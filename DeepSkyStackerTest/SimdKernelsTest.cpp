@@ -0,0 +1,215 @@
+#include "stdafx.h"
+#include "DeepSkyStackerTest.h"
+#include "avx_simd.h"
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Comparison of the SIMD variants this CPU can run with the scalar reference.
+//
+// Every kernel is run on random data for all the lengths up to a few AVX-512 vectors, so that the vector loops and
+// the scalar tails are both checked, and at several offsets to check the unaligned loads.
+
+namespace
+{
+	constexpr size_t maxCount = 4 * 32 + 3;
+	constexpr size_t maxOffset = 3;
+
+	template <class T>
+	bool sameValues(const std::vector<T>& reference, const std::vector<T>& values, const unsigned maxUlp) noexcept
+	{
+		if constexpr (std::is_same<T, float>::value)
+		{
+			for (size_t n = 0; n < reference.size(); ++n)
+			{
+				std::int32_t referenceBits, valueBits;
+				memcpy(&referenceBits, &reference[n], sizeof(float));
+				memcpy(&valueBits, &values[n], sizeof(float));
+				if (std::abs(static_cast<std::int64_t>(referenceBits) - valueBits) > maxUlp)
+					return false;
+			}
+			return true;
+		}
+		else
+			return memcmp(reference.data(), values.data(), reference.size() * sizeof(T)) == 0;
+	}
+
+	class CKernelCheck
+	{
+	private:
+		const SimdKernels& kernels;
+		std::vector<std::string>& errors;
+		std::mt19937 generator;
+
+	public:
+		CKernelCheck(const SimdKernels& k, std::vector<std::string>& e) :
+			kernels{ k },
+			errors{ e },
+			generator{ 1234 }
+		{}
+
+	private:
+		void fail(const char* const kernelName, const size_t count, const size_t offset)
+		{
+			errors.push_back(std::string{ SimdKernels::isaName(kernels.isa) } + " " + kernelName + ": count " + std::to_string(count) + ", offset " + std::to_string(offset));
+		}
+
+		std::vector<std::uint16_t> randomWords(const size_t size)
+		{
+			std::uniform_int_distribution<int> distribution{ 0, 65535 };
+			std::vector<std::uint16_t> values(size);
+			for (auto& value : values)
+				value = static_cast<std::uint16_t>(distribution(generator));
+			return values;
+		}
+
+		std::vector<float> randomFloats(const size_t size, const float minValue, const float maxValue)
+		{
+			std::uniform_real_distribution<float> distribution{ minValue, maxValue };
+			std::vector<float> values(size);
+			for (auto& value : values)
+				value = distribution(generator);
+			return values;
+		}
+
+		// Few distinct values, so that the comparisons of the homogeneity have ties.
+		std::vector<float> randomSteps(const size_t size)
+		{
+			std::uniform_int_distribution<int> distribution{ 0, 7 };
+			std::vector<float> values(size);
+			for (auto& value : values)
+				value = static_cast<float>(distribution(generator)) * 0.5f;
+			return values;
+		}
+
+	public:
+		void checkLuminance(const size_t count, const size_t offset)
+		{
+			const std::vector<std::uint16_t> red = randomWords(count + offset), green = randomWords(count + offset), blue = randomWords(count + offset);
+			std::vector<double> reference(count), values(count);
+
+			SimdKernels::scalarKernels.luminanceRgb(red.data() + offset, green.data() + offset, blue.data() + offset, reference.data(), count, 1.0 / 256.0);
+			kernels.luminanceRgb(red.data() + offset, green.data() + offset, blue.data() + offset, values.data(), count, 1.0 / 256.0);
+			if (!sameValues(reference, values, 0))
+				fail("luminanceRgb", count, offset);
+
+			SimdKernels::scalarKernels.luminanceGray(red.data() + offset, reference.data(), count, 1.0 / 256.0);
+			kernels.luminanceGray(red.data() + offset, values.data(), count, 1.0 / 256.0);
+			if (!sameValues(reference, values, 0))
+				fail("luminanceGray", count, offset);
+		}
+
+		void checkAccumulation(const size_t count, const size_t offset)
+		{
+			// No FMA in SSE4.1: the running averages may be 2 ulp off.
+			const unsigned maxUlp = kernels.isa == SimdKernels::Isa::SSE41 ? 2 : 0;
+			const std::vector<std::uint16_t> words = randomWords(count + offset);
+			const std::vector<float> floats = randomFloats(count + offset, 0.0f, 65535.0f);
+			const std::vector<float> output = randomFloats(count, 0.0f, 65535.0f);
+			const float nrStacked = static_cast<float>(std::uniform_int_distribution<int>{ 1, 100 }(generator));
+			std::vector<float> reference, values;
+
+			reference = values = output;
+			SimdKernels::scalarKernels.averageWord(words.data() + offset, reference.data(), count, nrStacked);
+			kernels.averageWord(words.data() + offset, values.data(), count, nrStacked);
+			if (!sameValues(reference, values, maxUlp))
+				fail("averageWord", count, offset);
+
+			reference = values = output;
+			SimdKernels::scalarKernels.averageFloat(floats.data() + offset, reference.data(), count, nrStacked);
+			kernels.averageFloat(floats.data() + offset, values.data(), count, nrStacked);
+			if (!sameValues(reference, values, maxUlp))
+				fail("averageFloat", count, offset);
+
+			reference = values = output;
+			SimdKernels::scalarKernels.maximumWord(words.data() + offset, reference.data(), count);
+			kernels.maximumWord(words.data() + offset, values.data(), count);
+			if (!sameValues(reference, values, 0))
+				fail("maximumWord", count, offset);
+
+			reference = values = output;
+			SimdKernels::scalarKernels.maximumFloat(floats.data() + offset, reference.data(), count);
+			kernels.maximumFloat(floats.data() + offset, values.data(), count);
+			if (!sameValues(reference, values, 0))
+				fail("maximumFloat", count, offset);
+		}
+
+		void checkLab(const size_t count, const size_t offset)
+		{
+			const std::vector<float> red = randomFloats(count + offset, 0.0f, 1.0f), green = randomFloats(count + offset, 0.0f, 1.0f), blue = randomFloats(count + offset, 0.0f, 1.0f);
+			std::vector<float> referenceL(count), referenceA(count), referenceB(count), valuesL(count), valuesA(count), valuesB(count);
+
+			SimdKernels::scalarKernels.rgbToLab(red.data() + offset, green.data() + offset, blue.data() + offset, referenceL.data(), referenceA.data(), referenceB.data(), count);
+			kernels.rgbToLab(red.data() + offset, green.data() + offset, blue.data() + offset, valuesL.data(), valuesA.data(), valuesB.data(), count);
+			if (!sameValues(referenceL, valuesL, 0) || !sameValues(referenceA, valuesA, 0) || !sameValues(referenceB, valuesB, 0))
+				fail("rgbToLab", count, offset);
+		}
+
+		void checkHomogeneity(const size_t count, const size_t offset)
+		{
+			// 3 lines with one more pixel on each side, the pixels to check are in the middle line.
+			const ptrdiff_t stride = static_cast<ptrdiff_t>(count + offset + 2);
+			std::vector<float> planes[6];
+			for (auto& plane : planes)
+				plane = randomSteps(3 * stride);
+
+			const size_t first = stride + 1 + offset;
+			const float* const pLabH[3] = { planes[0].data() + first, planes[1].data() + first, planes[2].data() + first };
+			const float* const pLabV[3] = { planes[3].data() + first, planes[4].data() + first, planes[5].data() + first };
+			std::vector<std::uint8_t> referenceH(count), referenceV(count), valuesH(count), valuesV(count);
+
+			SimdKernels::scalarKernels.ahdHomogeneity(pLabH, pLabV, stride, referenceH.data(), referenceV.data(), count);
+			kernels.ahdHomogeneity(pLabH, pLabV, stride, valuesH.data(), valuesV.data(), count);
+			if (!sameValues(referenceH, valuesH, 0) || !sameValues(referenceV, valuesV, 0))
+				fail("ahdHomogeneity", count, offset);
+		}
+
+		void checkCfa(const size_t count, const size_t offset)
+		{
+			// The pixels at -1 and count are read.
+			const std::vector<std::uint16_t> previous = randomWords(count + offset + 2), current = randomWords(count + offset + 2), next = randomWords(count + offset + 2);
+			std::vector<float> referenceFirst(count), referenceSecond(count), valuesFirst(count), valuesSecond(count);
+
+			for (int pattern = 0; pattern < 4; ++pattern)
+			{
+				const bool greenFirst = (pattern & 1) != 0;
+				const bool blueLine = (pattern & 2) != 0;
+
+				SimdKernels::scalarKernels.cfaBilinear(previous.data() + offset + 1, current.data() + offset + 1, next.data() + offset + 1, referenceFirst.data(), referenceSecond.data(), count, greenFirst, blueLine);
+				kernels.cfaBilinear(previous.data() + offset + 1, current.data() + offset + 1, next.data() + offset + 1, valuesFirst.data(), valuesSecond.data(), count, greenFirst, blueLine);
+				if (!sameValues(referenceFirst, valuesFirst, 0) || !sameValues(referenceSecond, valuesSecond, 0))
+					fail("cfaBilinear", count, offset);
+			}
+		}
+	};
+}
+
+int TestSimdKernels(std::vector<std::string>& errors)
+{
+	const size_t nrErrors = errors.size();
+
+	for (const SimdKernels::Isa isa : { SimdKernels::Isa::SSE41, SimdKernels::Isa::AVX2, SimdKernels::Isa::AVX512 })
+	{
+		const SimdKernels* const pKernels = SimdKernels::forIsa(isa);
+		if (pKernels == nullptr)
+			continue;
+
+		CKernelCheck check{ *pKernels, errors };
+		for (size_t offset = 0; offset <= maxOffset; ++offset)
+		{
+			for (size_t count = 0; count <= maxCount; ++count)
+			{
+				check.checkLuminance(count, offset);
+				check.checkAccumulation(count, offset);
+				check.checkLab(count, offset);
+				check.checkHomogeneity(count, offset);
+				check.checkCfa(count, offset);
+			}
+		}
+	}
+
+	return static_cast<int>(errors.size() - nrErrors);
+}
@@ -140,9 +140,37 @@ END_MESSAGE_MAP()
 #include <gdiplus.h>
 using namespace Gdiplus;
 
-static Bitmap * GetBitmap(CRect & rcOut, HBITMAP hBitmap, CRect & rcSrc, CRect & rcDst, BOOL bInterpolate, Bitmap * pInBitmap = nullptr, bool bDarkMode=false)
+// Bitmap(HBITMAP) copies all the pixels each time it is called: the 32 bits
+// DIB sections (the images of DeepSkyStacker) are used in place instead.
+static Bitmap * WrapBitmap(HBITMAP hBitmap)
 {
-	Bitmap *		pBitmap = new Bitmap(hBitmap, nullptr);
+	DIBSECTION		ds;
+
+	if (GetObject(hBitmap, sizeof(ds), &ds) == sizeof(ds) && ds.dsBm.bmBits && ds.dsBm.bmBitsPixel == 32)
+	{
+		const INT		lStride = ds.dsBm.bmWidthBytes;
+		BYTE *			pBits = (BYTE *)ds.dsBm.bmBits;
+
+		GdiFlush();
+		if (ds.dsBmih.biHeight > 0)
+		{
+			// Bottom-up DIB: start from the last scan line in memory
+			return new Bitmap(ds.dsBm.bmWidth, ds.dsBm.bmHeight, -lStride, PixelFormat32bppRGB, pBits + (ds.dsBm.bmHeight - 1) * lStride);
+		}
+		else
+			return new Bitmap(ds.dsBm.bmWidth, ds.dsBm.bmHeight, lStride, PixelFormat32bppRGB, pBits);
+	};
+
+	return new Bitmap(hBitmap, nullptr);
+};
+
+/* ------------------------------------------------------------------- */
+
+// fSrcScale is the size of hBitmap relative to the image the source rectangle
+// is expressed in (a reduced level of the image)
+static Bitmap * GetBitmap(CRect & rcOut, HBITMAP hBitmap, CRect & rcSrc, CRect & rcDst, BOOL bInterpolate, Bitmap * pInBitmap = nullptr, bool bDarkMode=false, double fSrcScale = 1.0)
+{
+	Bitmap *		pBitmap = WrapBitmap(hBitmap);
 	Bitmap *		pOutBitmap;
 
 	if (pInBitmap)
@@ -164,7 +192,7 @@ static Bitmap * GetBitmap(CRect & rcOut, HBITMAP hBitmap, CRect & rcSrc, CRect &
 
 	if (pBitmap && pGraphics && pOutBitmap)
 	{
-		RectF				rcfSrc(rcSrc.left, rcSrc.top, rcSrc.Width(), rcSrc.Height());
+		RectF				rcfSrc(rcSrc.left * fSrcScale, rcSrc.top * fSrcScale, rcSrc.Width() * fSrcScale, rcSrc.Height() * fSrcScale);
 		RectF				rcfDst(rcDst.left, rcDst.top, rcDst.Width(), rcDst.Height());
 		ImageAttributes *	pAttr = nullptr;
 
@@ -212,7 +240,16 @@ BOOL CWndImage::CreateInternalBitmap()
 		CRect & src = m_srcRect;
 		CRect & dst = m_dstRect;
 
-		m_pBaseImage  = ::GetBitmap(r, (HBITMAP)m_bmp.GetSafeHandle(), src, dst, (m_zoomX < 1), m_pBaseImage, m_bDarkMode);
+		// Zoomed out: draw the smallest reduced level that is still larger
+		// than the destination
+		HBITMAP		hBitmap = (HBITMAP)m_bmp.GetSafeHandle();
+		const int	lLevel = GetImgLevel();
+		const int	lScale = 1 << lLevel;
+
+		if (lLevel)
+			hBitmap = m_vLevels[lLevel - 1];
+
+		m_pBaseImage  = ::GetBitmap(r, hBitmap, src, dst, (m_zoomX * lScale < 1), m_pBaseImage, m_bDarkMode, 1.0 / lScale);
 		bResult = TRUE;
 	};
 	m_bInvalidateInternalBitmap = FALSE;
@@ -677,6 +714,7 @@ void CWndImage::SetImg(HBITMAP bmp, bool shared)
 
 		m_bmp.Attach(bmp);
 		m_shared = shared;
+		m_vLevels.clear();
 
 		if (bmp != 0)
 		{
@@ -698,6 +736,23 @@ void CWndImage::SetImg(HBITMAP bmp, bool shared)
 //  SetImage Clones
 // ------------------------------------------------------------------
 
+void CWndImage::SetImgLevels(const std::vector<HBITMAP> & vLevels)
+{
+	m_vLevels = vLevels;
+	m_bInvalidateInternalBitmap = TRUE;
+	CWnd::Invalidate(FALSE);
+}
+
+int CWndImage::GetImgLevel() const
+{
+	int			lLevel = 0;
+
+	while (lLevel < (int)m_vLevels.size() && m_zoomX * (2 << lLevel) <= 1.0)
+		lLevel++;
+
+	return lLevel;
+}
+
 void CWndImage::SetImg(CBitmap * bmp)
 {
 	SetImg(bmp ? (HBITMAP) (bmp->m_hObject) : 0);
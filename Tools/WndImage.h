@@ -25,6 +25,7 @@
 #pragma once
 #endif // _MSC_VER > 1000
 
+#include <vector>
 #include "ButtonToolbar.h"
 
 // ==================================================================
@@ -92,6 +93,11 @@ class CWndImage : public CWnd
     bool        SetImg(UINT resID, HINSTANCE instance = 0);
     bool        SetImgFile(LPCTSTR fileName);
 
+    // Reduced copies of the image drawn when zoomed out, each half the size
+    // of the previous one (not owned, reset by SetImg)
+    void        SetImgLevels(const std::vector<HBITMAP> & vLevels);
+    int         GetImgLevel() const;                    // 0: the image itself
+
     int         GetImgSizeX() const      { return m_bmpSize.cx;  }
     int         GetImgSizeY() const      { return m_bmpSize.cy;  }
     int         GetBltMode()  const      { return m_bltMode;     }
@@ -153,6 +159,7 @@ class CWndImage : public CWnd
 
 
     CBitmap     m_bmp;              // the bitmap we wanna blit
+    std::vector<HBITMAP> m_vLevels; // reduced copies of m_bmp
 
 	BOOL		m_bEnableZoom;		// Zoom is enabled?
 	CRect		m_rcZoom;			// Rectangle where the zoom is drawn